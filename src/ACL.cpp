@@ -11,7 +11,12 @@
 #ifdef MURMUR
 #	include "ServerUser.h"
 
+#	include <QtCore/QPair>
 #	include <QtCore/QStack>
+#	include <QtCore/QVarLengthArray>
+
+#	include <algorithm>
+#	include <atomic>
 #endif
 
 ChanACL::ChanACL(Channel *chan) : QObject(chan) {
@@ -93,95 +98,206 @@ ChanACL::operator QString() const {
 
 #ifdef MURMUR
 
-bool ChanACL::hasPermission(ServerUser *p, Channel *chan, QFlags< Perm > perm, ACLCache *cache) {
-	Permissions granted = effectivePermissions(p, chan, cache);
+namespace {
+// Default permissions
+const ChanACL::Permissions defaultPermissions = ChanACL::Traverse | ChanACL::Enter | ChanACL::Speak | ChanACL::Whisper
+												| ChanACL::TextMessage | ChanACL::Listen;
+const ChanACL::Permissions rootOnlyPermissions =
+	ChanACL::Kick | ChanACL::Ban | ChanACL::ResetUserContent | ChanACL::Register | ChanACL::SelfRegister;
+} // namespace
+
+ChanACL::Permissions ChanACL::Program::evaluate(const ServerUser &user) const {
+	Permissions granted = this->granted;
+	Permissions current = flags;
+
+	// -1 means that the group has not been evaluated yet
+	QVarLengthArray< signed char, 32 > groupMatches(static_cast< int >(groups.size()));
+	std::fill(groupMatches.begin(), groupMatches.end(), static_cast< signed char >(-1));
+
+	std::size_t i = 0;
+	for (const Level &level : levels) {
+		if (level.reset)
+			granted = defaultPermissions;
+
+		for (; i < level.end; ++i) {
+			const Rule &rule = rules[i];
+
+			bool matches = (rule.userId != -1) && (rule.userId == user.iId);
+			if (!matches && rule.group != -1) {
+				signed char &groupMatch = groupMatches[rule.group];
+				if (groupMatch == -1) {
+					const GroupReference &group = groups[static_cast< std::size_t >(rule.group)];
+					const Channel &aclChannel   = group.aclChannel ? *group.aclChannel : *channel;
+
+					groupMatch = Group::appliesToUser(*channel, aclChannel, group.specification, user) ? 1 : 0;
+				}
+				matches = groupMatch == 1;
+			}
 
-	return ((granted & perm) != None);
-}
+			if (matches) {
+				current = (current | rule.allowFlags) & ~rule.denyFlags;
+				granted = (granted | rule.allow) & ~rule.deny;
+			}
+		}
 
-// Return effective permissions.
-QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *chan, ACLCache *cache) {
-	// Superuser
-	if (p->iId == 0) {
-		return static_cast< Permissions >(All & ~(Speak | Whisper));
+		if (!current)
+			return None;
 	}
 
-#	if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
-	// Qt 5.15 introduced a default constructor that initializes the flags to be set to no flags
-	Permissions granted;
-#	else
-	// Before Qt 5.15 we have emulate the default constructor by assigning a literal zero
-	Permissions granted = 0;
-#	endif
+	return granted;
+}
 
-	if (cache) {
-		QHash< Channel *, Permissions > *h = cache->value(p);
-		if (h)
-			granted = h->value(chan);
-	}
+std::shared_ptr< const ChanACL::Program > ChanACL::compile(const Channel *chan) {
+	using Type = Group::Specification::Type;
 
-	if (granted & Cached) {
-		return granted;
-	}
+	std::shared_ptr< Program > program = std::make_shared< Program >();
 
-	QStack< Channel * > chanstack;
-	Channel *ch = chan;
+	program->channel = chan;
+	program->granted = defaultPermissions;
+	program->flags   = Traverse;
+
+	QStack< const Channel * > chanstack;
+	const Channel *ch = chan;
 
 	while (ch) {
 		chanstack.push(ch);
 		ch = ch->cParent;
 	}
 
-	// Default permissions
-	Permissions def = Traverse | Enter | Speak | Whisper | TextMessage | Listen;
-
-	granted = def;
-
-	bool traverse = true;
-	bool write    = false;
-	ChanACL *acl;
+	// As long as every rule seen so far applies to every user, rules can be applied to the initial state directly
+	bool folding = true;
+	QHash< QPair< const Channel *, QString >, int > groupIndices;
 
 	while (!chanstack.isEmpty()) {
 		ch = chanstack.pop();
-		if (!ch->bInheritACL)
-			granted = def;
-
-		foreach (acl, ch->qlACL) {
-			bool matchUser  = (acl->iUserId != -1) && (acl->iUserId == p->iId);
-			bool matchGroup = Group::appliesToUser(*chan, *ch, acl->qsGroup, *p);
-			if (matchUser || matchGroup) {
-				if (acl->pAllow & Traverse)
-					traverse = true;
-				if (acl->pDeny & Traverse)
-					traverse = false;
-				if (acl->pAllow & Write)
-					write = true;
-				if (acl->pDeny & Write)
-					write = false;
-				if (ch->iId == 0 && chan == ch && acl->bApplyHere) {
-					if (acl->pAllow & Kick)
-						granted |= Kick;
-					if (acl->pAllow & Ban)
-						granted |= Ban;
-					if (acl->pAllow & ResetUserContent)
-						granted |= ResetUserContent;
-					if (acl->pAllow & Register)
-						granted |= Register;
-					if (acl->pAllow & SelfRegister)
-						granted |= SelfRegister;
-				}
-				if ((ch == chan && acl->bApplyHere) || (ch != chan && acl->bApplySubs)) {
-					granted |= (acl->pAllow & ~(Kick | Ban | ResetUserContent | Register | SelfRegister | Cached));
-					granted &= ~acl->pDeny;
+
+		const bool reset = !ch->bInheritACL;
+		if (folding && reset)
+			program->granted = defaultPermissions;
+
+		const bool resetInProgram    = reset && !folding;
+		const std::size_t levelBegin = program->rules.size();
+
+		foreach (const ChanACL *acl, ch->qlACL) {
+			Program::Rule rule;
+			rule.userId     = acl->iUserId;
+			rule.group      = -1;
+			rule.allow      = None;
+			rule.deny       = None;
+			rule.allowFlags = acl->pAllow & (Traverse | Write);
+			rule.denyFlags  = acl->pDeny & (Traverse | Write);
+
+			if (ch->iId == 0 && chan == ch && acl->bApplyHere)
+				rule.allow |= acl->pAllow & rootOnlyPermissions;
+			if ((ch == chan && acl->bApplyHere) || (ch != chan && acl->bApplySubs)) {
+				rule.allow |= acl->pAllow & ~(rootOnlyPermissions | Cached);
+				rule.deny = acl->pDeny;
+			}
+
+			if (!rule.allow && !rule.deny && !rule.allowFlags && !rule.denyFlags)
+				continue;
+
+			const Group::Specification specification = Group::Specification::parse(acl->qsGroup);
+
+			const bool matchesEveryone = specification.type == Type::All && !specification.invert;
+			const bool matchesNobody   =
+				specification.type == Type::Invalid || (specification.type == Type::None && !specification.invert);
+
+			if (folding && matchesEveryone) {
+				program->flags   = (program->flags | rule.allowFlags) & ~rule.denyFlags;
+				program->granted = (program->granted | rule.allow) & ~rule.deny;
+				continue;
+			}
+
+			if (!matchesNobody) {
+				const QPair< const Channel *, QString > key(specification.useACLChannel ? ch : nullptr, acl->qsGroup);
+
+				auto it = groupIndices.find(key);
+				if (it == groupIndices.end()) {
+					it = groupIndices.insert(key, static_cast< int >(program->groups.size()));
+					program->groups.push_back({ key.first, specification });
 				}
+
+				rule.group = it.value();
+			} else if (rule.userId == -1) {
+				// Can't ever match
+				continue;
 			}
+
+			folding = false;
+			program->rules.push_back(rule);
 		}
-		if (!traverse && !write) {
-			granted = None;
-			break;
+
+		if (folding) {
+			if (!program->flags) {
+				program->granted = None;
+				break;
+			}
+		} else if (program->rules.size() != levelBegin || resetInProgram) {
+			program->levels.push_back({ program->rules.size(), resetInProgram });
+		}
+	}
+
+	return program;
+}
+
+void ChanACL::invalidatePrograms(Channel *chan) {
+	const unsigned int generation = nextGeneration();
+
+	QStack< Channel * > channels;
+	channels.push(chan);
+
+	while (!channels.isEmpty()) {
+		Channel *current = channels.pop();
+
+		std::atomic_store(&current->m_aclProgram, std::shared_ptr< const Program >());
+		// The generation is only published after the program has been discarded (and loaded before the program by
+		// effectivePermissions), so that permissions cached for it can't stem from the outdated program
+		current->m_aclGeneration.store(generation);
+
+		foreach (Channel *child, current->qlChannels)
+			channels.push(child);
+	}
+}
+
+unsigned int ChanACL::nextGeneration() {
+	static std::atomic< unsigned int > generation(0);
+
+	return ++generation;
+}
+
+bool ChanACL::hasPermission(ServerUser *p, Channel *chan, QFlags< Perm > perm, ACLCache *cache) {
+	Permissions granted = effectivePermissions(p, chan, cache);
+
+	return ((granted & perm) != None);
+}
+
+// Return effective permissions.
+QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *chan, ACLCache *cache) {
+	// Superuser
+	if (p->iId == 0) {
+		return static_cast< Permissions >(All & ~(Speak | Whisper));
+	}
+
+	const unsigned int generation = chan->m_aclGeneration.load();
+
+	if (cache) {
+		const ChanCache *h = cache->value(p);
+		if (h) {
+			ChanCache::const_iterator it = h->constFind(chan);
+			if (it != h->constEnd() && it->generation == generation)
+				return it->permissions;
 		}
 	}
 
+	std::shared_ptr< const Program > program = std::atomic_load(&chan->m_aclProgram);
+	if (!program) {
+		program = compile(chan);
+		std::atomic_store(&chan->m_aclProgram, program);
+	}
+
+	Permissions granted = program->evaluate(*p);
+
 	if (granted & Write) {
 		granted |=
 			Traverse | Enter | MuteDeafen | Move | MakeChannel | LinkChannel | TextMessage | MakeTempChannel | Listen;
@@ -191,9 +307,9 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 
 	if (cache) {
 		if (!cache->contains(p))
-			cache->insert(p, new QHash< Channel *, Permissions >);
+			cache->insert(p, new ChanCache);
 
-		cache->value(p)->insert(chan, granted | Cached);
+		cache->value(p)->insert(chan, { granted | Cached, generation });
 	}
 
 	return granted;
@@ -9,6 +9,13 @@
 #include <QtCore/QHash>
 #include <QtCore/QObject>
 
+#ifdef MURMUR
+#	include "Group.h"
+
+#	include <memory>
+#	include <vector>
+#endif
+
 class Channel;
 class User;
 class ServerUser;
@@ -47,7 +54,13 @@ public:
 
 	Q_DECLARE_FLAGS(Permissions, Perm)
 
-	typedef QHash< Channel *, Permissions > ChanCache;
+	/// Permissions cached for a channel along with the ACL generation of the channel they have been computed for
+	struct CachedPermissions {
+		Permissions permissions;
+		unsigned int generation;
+	};
+
+	typedef QHash< Channel *, CachedPermissions > ChanCache;
 	typedef QHash< User *, ChanCache * > ACLCache;
 
 	Channel *c;
@@ -71,6 +84,62 @@ public:
 	explicit operator QString() const;
 
 #ifdef MURMUR
+	/// The ACLs that are relevant for a single channel, flattened from the root channel downwards into a list of
+	/// rules with precomputed permission masks. Rules that apply to every user are folded into the initial state,
+	/// so that evaluating a program only has to look at the rules that actually depend on the user.
+	///
+	/// Programs are compiled lazily by effectivePermissions and have to be discarded via invalidatePrograms
+	/// whenever the ACLs or the inheritance flag of the channel or any of its parents change or the channel is
+	/// moved.
+	struct Program {
+		struct Rule {
+			/// The ID of the user this rule applies to or -1
+			int userId;
+			/// The index of the group (in groups) this rule applies to or -1
+			int group;
+			/// The permissions granted on the program's channel
+			Permissions allow;
+			/// The permissions denied on the program's channel (applied after allow)
+			Permissions deny;
+			/// Traverse and Write state granted by this rule
+			Permissions allowFlags;
+			/// Traverse and Write state denied by this rule (applied after allowFlags)
+			Permissions denyFlags;
+		};
+
+		struct GroupReference {
+			/// The channel defining the ACL or nullptr if the specification does not depend on it
+			const Channel *aclChannel;
+			Group::Specification specification;
+		};
+
+		struct Level {
+			/// The index into rules one past the last rule of this level
+			std::size_t end;
+			/// Whether the permissions granted so far are reset to the defaults before evaluating this level
+			bool reset;
+		};
+
+		const Channel *channel;
+		/// The permissions granted after folding all user-independent rules
+		Permissions granted;
+		/// The Traverse and Write state after folding all user-independent rules
+		Permissions flags;
+		std::vector< Level > levels;
+		std::vector< Rule > rules;
+		/// Group specifications interned per program, such that each of them is evaluated at most once
+		std::vector< GroupReference > groups;
+
+		Permissions evaluate(const ServerUser &user) const;
+	};
+
+	static std::shared_ptr< const Program > compile(const Channel *c);
+	/// Discards the compiled programs of the given channel and all of its sub-channels and moves them to a new ACL
+	/// generation, which marks all permissions cached for them as outdated
+	static void invalidatePrograms(Channel *c);
+	/// @returns An ACL generation that has not been handed out before
+	static unsigned int nextGeneration();
+
 	static bool hasPermission(ServerUser *p, Channel *c, QFlags< Perm > perm, ACLCache *cache);
 	static QFlags< Perm > effectivePermissions(ServerUser *p, Channel *c, ACLCache *cache);
 #else
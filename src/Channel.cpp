@@ -31,6 +31,10 @@ Channel::Channel(unsigned int id, const QString &name, QObject *p) : QObject(p)
 	cParent     = qobject_cast< Channel * >(p);
 	if (cParent)
 		cParent->addChannel(this);
+#ifdef MURMUR
+	// A fresh generation ensures that permissions cached for a deleted channel at the same address are not reused
+	m_aclGeneration.store(ChanACL::nextGeneration());
+#endif
 #ifdef MUMBLE
 	uiPermissions = 0;
 	m_filterMode  = ChannelFilterMode::NORMAL;
@@ -245,12 +249,18 @@ void Channel::addChannel(Channel *c) {
 	c->cParent = this;
 	c->setParent(this);
 	qlChannels << c;
+#ifdef MURMUR
+	ChanACL::invalidatePrograms(c);
+#endif
 }
 
 void Channel::removeChannel(Channel *c) {
 	c->cParent = nullptr;
 	c->setParent(nullptr);
 	qlChannels.removeAll(c);
+#ifdef MURMUR
+	ChanACL::invalidatePrograms(c);
+#endif
 }
 
 void Channel::addUser(User *p) {
@@ -18,6 +18,13 @@
 #	include "ChannelFilterMode.h"
 #endif
 
+#ifdef MURMUR
+#	include "ACL.h"
+
+#	include <atomic>
+#	include <memory>
+#endif
+
 class User;
 class Group;
 class ChanACL;
@@ -56,6 +63,16 @@ public:
 	std::atomic< bool > localUserCanEnter;
 #endif
 
+#ifdef MURMUR
+	/// The compiled ACL program of this channel or nullptr if it has not been compiled yet. As it may be compiled
+	/// concurrently by multiple threads holding a read lock, it must only be accessed via std::atomic_load and
+	/// std::atomic_store.
+	std::shared_ptr< const ChanACL::Program > m_aclProgram;
+	/// The ACL generation of this channel. Cached permissions are only valid as long as it matches the generation
+	/// they have been computed for.
+	std::atomic< unsigned int > m_aclGeneration;
+#endif
+
 	QSet< Channel * > qsPermLinks;
 	QHash< Channel *, int > qhLinks;
 
@@ -26,7 +26,6 @@ HANDLE Connection::hQoS = nullptr;
 Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 	qtsSocket = qtsSock;
 	qtsSocket->setParent(this);
-	iPacketLength        = -1;
 	bDisconnectedEmitted = false;
 	csCrypt              = std::make_unique< CryptStateOCB2 >();
 
@@ -100,48 +99,53 @@ void Connection::resetActivityTime() {
 }
 
 /**
- * This function waits until a complete package is received and then emits it as a message.
- * It gets called everytime new data is available and interprets the message prefix header
- * to figure out the type and length. It then waits until the complete message is buffered
- * and emits it as a message so it can be handled by the corresponding message handler
- * routine.
+ * This function reads the available data into the read buffer and handles every message that has been received
+ * completely. It gets called everytime new data is available and interprets the message prefix header
+ * to figure out the type and length. Messages are passed to messageReceived in place, an incomplete message is
+ * kept in the buffer until the rest of it arrives.
  *
  * @see QSslSocket::readyRead()
  * @see void ServerHandler::message(unsigned int msgType, const QByteArray &qbaMsg)
- * @see void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *u)
+ * @see void ServerUser::messageReceived(Mumble::Protocol::TCPMessageType type, gsl::span< const byte > data)
  */
 void Connection::socketRead() {
-	while (true) {
-		qint64 iAvailable = qtsSocket->bytesAvailable();
-		if (iPacketLength == -1) {
-			if (iAvailable < 6)
-				return;
-
-			unsigned char a_ucBuffer[6];
-
-			qtsSocket->read(reinterpret_cast< char * >(a_ucBuffer), 6);
-			m_type        = static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(&a_ucBuffer[0]));
-			iPacketLength = qFromBigEndian< int >(&a_ucBuffer[2]);
-			iAvailable -= 6;
-		}
+	while (qtsSocket->bytesAvailable() > 0) {
+		gsl::span< Mumble::Protocol::byte > writable = m_readBuffer.writable();
 
-		if ((iPacketLength == -1) || (iAvailable < iPacketLength))
+		const qint64 read =
+			qtsSocket->read(reinterpret_cast< char * >(writable.data()), static_cast< qint64 >(writable.size()));
+		if (read <= 0)
 			return;
 
-		if (iPacketLength > 0x7fffff) {
+		m_readBuffer.commit(static_cast< std::size_t >(read));
+
+		bool aborted = false;
+		const bool valid = m_readBuffer.process(
+			[&](Mumble::Protocol::TCPMessageType type, gsl::span< const Mumble::Protocol::byte > data) {
+				messageReceived(type, data);
+
+				aborted = qtsSocket->state() == QAbstractSocket::UnconnectedState;
+				return !aborted;
+			});
+
+		if (!valid) {
 			qWarning() << "Host tried to send huge packet";
 			disconnectSocket(true);
 			return;
 		}
-
-		QByteArray qbaBuffer = qtsSocket->read(iPacketLength);
-		iPacketLength        = -1;
-		iAvailable -= iPacketLength;
-
-		emit message(m_type, qbaBuffer);
+		if (aborted) {
+			// The connection has been aborted while handling a message
+			m_readBuffer.clear();
+			return;
+		}
 	}
 }
 
+void Connection::messageReceived(Mumble::Protocol::TCPMessageType type,
+								 gsl::span< const Mumble::Protocol::byte > data) {
+	emit message(type, QByteArray(reinterpret_cast< const char * >(data.data()), static_cast< int >(data.size())));
+}
+
 void Connection::socketError(QAbstractSocket::SocketError err) {
 	emit connectionClosed(err, qtsSocket->errorString());
 }
@@ -7,6 +7,7 @@
 #define MUMBLE_CONNECTION_H_
 
 #include "MumbleProtocol.h"
+#include "TCPReadBuffer.h"
 
 #include <QtCore/QtGlobal>
 
@@ -41,8 +42,7 @@ private:
 protected:
 	QSslSocket *qtsSocket;
 	QElapsedTimer qtLastPacket;
-	Mumble::Protocol::TCPMessageType m_type;
-	int iPacketLength;
+	TCPReadBuffer m_readBuffer;
 #ifdef Q_OS_WIN
 	static HANDLE hQoS;
 	DWORD dwFlow;
@@ -60,6 +60,12 @@ signals:
 	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &);
 	void handleSslErrors(const QList< QSslError > &);
 
+protected:
+	/// Called for every message that has been received completely. The default implementation emits message.
+	///
+	/// @param data The message's payload, which is only valid until this function returns
+	virtual void messageReceived(Mumble::Protocol::TCPMessageType type, gsl::span< const Mumble::Protocol::byte > data);
+
 public:
 	Connection(QObject *parent, QSslSocket *qtsSocket);
 	~Connection();
@@ -11,6 +11,8 @@
 #	include "ServerUser.h"
 
 #	include <QtCore/QStack>
+
+#	include <utility>
 #endif
 
 const Qt::CaseSensitivity Group::accessTokenCaseSensitivity = Qt::CaseInsensitive;
@@ -98,37 +100,31 @@ QSet< QString > Group::groupNames(Channel *chan) {
 	return m;
 }
 
-#	define RET_FALSE (invert ? true : false)
-#	define RET_TRUE (invert ? false : true)
-
-bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChannel, QString groupSpecification,
-						  const ServerUser &user) {
-	bool matches                  = false;
-	bool invert                   = false;
-	bool isAccessToken            = false;
-	bool isCertHash               = false;
-	const Channel *contextChannel = &currentChannel;
+Group::Specification Group::Specification::parse(QString groupSpecification) {
+	Specification specification;
 
 	while (!groupSpecification.isEmpty()) {
 		if (groupSpecification.startsWith(QChar::fromLatin1('!'))) {
-			invert             = true;
-			groupSpecification = groupSpecification.remove(0, 1);
+			specification.invert = true;
+			groupSpecification   = groupSpecification.remove(0, 1);
 			continue;
 		}
 
 		if (groupSpecification.startsWith(QChar::fromLatin1('~'))) {
-			contextChannel     = &aclChannel;
-			groupSpecification = groupSpecification.remove(0, 1);
+			specification.useACLChannel = true;
+			groupSpecification          = groupSpecification.remove(0, 1);
 			continue;
 		}
 
 		if (groupSpecification.startsWith(QChar::fromLatin1('#'))) {
-			isAccessToken      = true;
+			specification.type = Type::AccessToken;
 			groupSpecification = groupSpecification.remove(0, 1);
 			continue;
 		}
 		if (groupSpecification.startsWith(QChar::fromLatin1('$'))) {
-			isCertHash         = true;
+			if (specification.type != Type::AccessToken) {
+				specification.type = Type::CertificateHash;
+			}
 			groupSpecification = groupSpecification.remove(0, 1);
 			continue;
 		}
@@ -137,116 +133,169 @@ bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChann
 	}
 
 	if (groupSpecification.isEmpty()) {
-		return false;
+		specification.type = Type::Invalid;
+		return specification;
 	}
 
-
 	// First, all special cases that aren't even groups and meta groups (groups that don't actually exist as groups but
 	// have a special meaning based on their name
-	if (isAccessToken)
-		matches = user.qslAccessTokens.contains(groupSpecification, Group::accessTokenCaseSensitivity);
-	else if (isCertHash)
-		matches = user.qsHash == groupSpecification;
-	else if (groupSpecification == QLatin1String("none"))
-		matches = false;
-	else if (groupSpecification == QLatin1String("all"))
-		matches = true;
-	else if (groupSpecification == QLatin1String("auth"))
-		matches = (user.iId >= 0);
-	else if (groupSpecification == QLatin1String("strong"))
-		matches = user.bVerified;
-	else if (groupSpecification == QLatin1String("in"))
-		matches = (user.cChannel == contextChannel);
-	else if (groupSpecification == QLatin1String("out"))
-		matches = !(user.cChannel == contextChannel);
-	else if (groupSpecification == QLatin1String("sub") || groupSpecification.startsWith(QLatin1String("sub,"))) {
+	if (specification.type == Type::AccessToken || specification.type == Type::CertificateHash) {
+		specification.name = groupSpecification;
+	} else if (groupSpecification == QLatin1String("none")) {
+		specification.type = Type::None;
+	} else if (groupSpecification == QLatin1String("all")) {
+		specification.type = Type::All;
+	} else if (groupSpecification == QLatin1String("auth")) {
+		specification.type = Type::Auth;
+	} else if (groupSpecification == QLatin1String("strong")) {
+		specification.type = Type::Strong;
+	} else if (groupSpecification == QLatin1String("in")) {
+		specification.type = Type::In;
+	} else if (groupSpecification == QLatin1String("out")) {
+		specification.type = Type::Out;
+	} else if (groupSpecification == QLatin1String("sub") || groupSpecification.startsWith(QLatin1String("sub,"))) {
+		specification.type = Type::Sub;
 		groupSpecification = groupSpecification.remove(0, 4);
 
-		int requiredChannelOffset = 0;
-		int minDescendantLevel    = 1;
-		int maxDescendantLevel    = 1000;
-
 		// Parse arguments, if any
 		QStringList args = groupSpecification.split(QLatin1String(","));
 		if (args.count() >= 1 && !args[0].isEmpty()) {
-			requiredChannelOffset = args[0].toInt();
+			specification.requiredChannelOffset = args[0].toInt();
 		}
 		if (args.count() >= 2 && !args[1].isEmpty()) {
-			minDescendantLevel = args[1].toInt();
+			specification.minDescendantLevel = args[1].toInt();
 		}
 		if (args.count() >= 3 && !args[2].isEmpty()) {
-			maxDescendantLevel = args[2].toInt();
+			specification.maxDescendantLevel = args[2].toInt();
 		}
+	} else {
+		// The group specification is an actual group name
+		specification.type = Type::Named;
+		specification.name = groupSpecification;
+	}
 
-		// Assemble channel hierarchy from root channel to the channel the player is currently in
-		QList< const Channel * > homeChannelHierarchy;
-		const Channel *channel = user.cChannel;
-		while (channel) {
-			homeChannelHierarchy.prepend(channel);
-			channel = channel->cParent;
-		}
-
-		// Assemble channel hierarchy from root channel to the channel the ACL containing this specification is
-		// evaluated for
-		QList< const Channel * > currentChannelHierarchy;
-		channel = &currentChannel;
-		while (channel) {
-			currentChannelHierarchy.prepend(channel);
-			channel = channel->cParent;
-		}
-
-		int requiredChannelIndex = currentChannelHierarchy.indexOf(contextChannel);
-		Q_ASSERT(requiredChannelIndex != -1);
-
-		requiredChannelIndex += requiredChannelOffset;
-
-		if (requiredChannelIndex >= currentChannelHierarchy.count()) {
-			return RET_FALSE;
-		} else if (requiredChannelIndex < 0) {
-			requiredChannelIndex = 0;
-		}
+	return specification;
+}
 
-		const Channel *requiredChannel = currentChannelHierarchy[requiredChannelIndex];
-		if (homeChannelHierarchy.indexOf(requiredChannel) == -1) {
-			return RET_FALSE;
-		}
+bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChannel, QString groupSpecification,
+						  const ServerUser &user) {
+	return appliesToUser(currentChannel, aclChannel, Specification::parse(std::move(groupSpecification)), user);
+}
 
-		const int minDepth = requiredChannelIndex + minDescendantLevel;
-		const int maxDepth = requiredChannelIndex + maxDescendantLevel;
+#	define RET_FALSE (specification.invert ? true : false)
 
-		const int totalDepth = homeChannelHierarchy.count() - 1;
+bool Group::appliesToUser(const Channel &currentChannel, const Channel &aclChannel,
+						  const Specification &specification, const ServerUser &user) {
+	bool matches                  = false;
+	const Channel *contextChannel = specification.useACLChannel ? &aclChannel : &currentChannel;
+
+	switch (specification.type) {
+		case Specification::Type::Invalid:
+			return false;
+		case Specification::Type::AccessToken:
+			matches = user.qslAccessTokens.contains(specification.name, Group::accessTokenCaseSensitivity);
+			break;
+		case Specification::Type::CertificateHash:
+			matches = user.qsHash == specification.name;
+			break;
+		case Specification::Type::None:
+			matches = false;
+			break;
+		case Specification::Type::All:
+			matches = true;
+			break;
+		case Specification::Type::Auth:
+			matches = (user.iId >= 0);
+			break;
+		case Specification::Type::Strong:
+			matches = user.bVerified;
+			break;
+		case Specification::Type::In:
+			matches = (user.cChannel == contextChannel);
+			break;
+		case Specification::Type::Out:
+			matches = !(user.cChannel == contextChannel);
+			break;
+		case Specification::Type::Sub: {
+			// The hierarchies from the root channel to the channel the user is in and to the channel the ACL
+			// containing this specification is evaluated for are only ever compared by depth, so instead of assembling
+			// them, the depth of each involved channel is determined by walking up its parent chain.
+			int currentDepth         = -1;
+			int requiredChannelIndex = -1;
+			for (const Channel *channel = &currentChannel; channel; channel = channel->cParent) {
+				if (channel == contextChannel) {
+					// Counted from the current channel for now and converted below
+					requiredChannelIndex = currentDepth + 1;
+				}
+				++currentDepth;
+			}
+			Q_ASSERT(requiredChannelIndex != -1);
 
-		matches = (totalDepth >= minDepth) && (totalDepth <= maxDepth);
-	} else {
-		// The group specification is an actual group name
-		QStack< const Group * > groupStack;
+			if (requiredChannelIndex != -1) {
+				requiredChannelIndex = currentDepth - requiredChannelIndex;
+			}
+			requiredChannelIndex += specification.requiredChannelOffset;
 
-		const Channel *channel = contextChannel;
+			if (requiredChannelIndex > currentDepth) {
+				return RET_FALSE;
+			} else if (requiredChannelIndex < 0) {
+				requiredChannelIndex = 0;
+			}
 
-		while (channel) {
-			const Group *group = channel->qhGroups.value(groupSpecification);
+			const Channel *requiredChannel = &currentChannel;
+			for (int i = currentDepth; i > requiredChannelIndex; --i) {
+				requiredChannel = requiredChannel->cParent;
+			}
 
-			if (group) {
-				if ((channel != contextChannel) && !group->bInheritable)
-					break;
-				groupStack.push(group);
-				if (!group->bInherit)
-					break;
+			bool isInRequiredChannel = false;
+			int totalDepth           = -1;
+			for (const Channel *channel = user.cChannel; channel; channel = channel->cParent) {
+				if (channel == requiredChannel) {
+					isInRequiredChannel = true;
+				}
+				++totalDepth;
+			}
+			if (!isInRequiredChannel) {
+				return RET_FALSE;
 			}
 
-			channel = channel->cParent;
-		}
+			const int minDepth = requiredChannelIndex + specification.minDescendantLevel;
+			const int maxDepth = requiredChannelIndex + specification.maxDescendantLevel;
 
-		while (!groupStack.isEmpty()) {
-			const Group *group = groupStack.pop();
-			if (group->qsAdd.contains(user.iId) || group->qsTemporary.contains(user.iId)
-				|| group->qsTemporary.contains(-static_cast< int >(user.uiSession)))
-				matches = true;
-			if (group->qsRemove.contains(user.iId))
-				matches = false;
+			matches = (totalDepth >= minDepth) && (totalDepth <= maxDepth);
+			break;
+		}
+		case Specification::Type::Named: {
+			// The groups of this name are applied from the root channel downwards, with the last one mentioning the
+			// user deciding about membership. Walking upwards instead, the first group mentioning the user decides.
+			const Channel *channel = contextChannel;
+
+			while (channel) {
+				const Group *group = channel->qhGroups.value(specification.name);
+
+				if (group) {
+					if ((channel != contextChannel) && !group->bInheritable)
+						break;
+					if (group->qsRemove.contains(user.iId)) {
+						matches = false;
+						break;
+					}
+					if (group->qsAdd.contains(user.iId) || group->qsTemporary.contains(user.iId)
+						|| group->qsTemporary.contains(-static_cast< int >(user.uiSession))) {
+						matches = true;
+						break;
+					}
+					if (!group->bInherit)
+						break;
+				}
+
+				channel = channel->cParent;
+			}
+			break;
 		}
 	}
-	return invert ? !matches : matches;
+
+	return specification.invert ? !matches : matches;
 }
 
 #endif
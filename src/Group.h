@@ -29,12 +29,34 @@ public:
 	Group(Channel *assoc, const QString &name);
 
 #ifdef MURMUR
+	/// A group specification as used by ACLs and whisper targets, split into its components
+	struct Specification {
+		enum class Type { Invalid, AccessToken, CertificateHash, None, All, Auth, Strong, In, Out, Sub, Named };
+
+		Type type = Type::Invalid;
+		/// Whether the result of the check is to be inverted (!)
+		bool invert = false;
+		/// Whether the check is performed in the context of the channel defining the ACL rather than the channel the
+		/// ACL is evaluated for (~)
+		bool useACLChannel = false;
+		/// The access token, certificate hash or group name
+		QString name;
+		/// The arguments of a sub specification
+		int requiredChannelOffset = 0;
+		int minDescendantLevel    = 1;
+		int maxDescendantLevel    = 1000;
+
+		static Specification parse(QString groupSpecification);
+	};
+
 	QSet< int > members();
 	static QSet< QString > groupNames(Channel *c);
 	static Group *getGroup(Channel *c, QString name);
 
 	static bool appliesToUser(const Channel &currentChannel, const Channel &aclChannel, QString groupSpecification,
 							  const ServerUser &user);
+	static bool appliesToUser(const Channel &currentChannel, const Channel &aclChannel,
+							  const Specification &specification, const ServerUser &user);
 #endif
 };
 
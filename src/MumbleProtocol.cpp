@@ -23,6 +23,35 @@ namespace Protocol {
 	}
 
 
+	void writeUDPAssociationHeader(byte *buffer, std::uint32_t token) {
+		for (unsigned int i = 0; i < 4; ++i) {
+			buffer[i]     = static_cast< byte >(UDP_ASSOCIATION_MAGIC >> (24 - 8 * i));
+			buffer[i + 4] = static_cast< byte >(token >> (24 - 8 * i));
+		}
+	}
+
+	bool readUDPAssociationHeader(gsl::span< const byte > datagram, std::uint32_t &token) {
+		if (datagram.size() <= UDP_ASSOCIATION_HEADER_SIZE) {
+			return false;
+		}
+
+		std::uint32_t magic = 0;
+		std::uint32_t value = 0;
+		for (std::size_t i = 0; i < 4; ++i) {
+			magic = (magic << 8) | datagram[i];
+			value = (value << 8) | datagram[i + 4];
+		}
+
+		if (magic != UDP_ASSOCIATION_MAGIC) {
+			return false;
+		}
+
+		token = value;
+
+		return true;
+	}
+
+
 	std::size_t getProtobufSize(const ::google::protobuf::Message &message) {
 #if GOOGLE_PROTOBUF_VERSION >= 3002000
 		// ByteSizeLong() was introduced in Protobuf v3.2 as a replacement for ByteSize()
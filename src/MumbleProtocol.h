@@ -113,6 +113,23 @@ namespace Protocol {
 	bool protocolVersionsAreCompatible(Version::full_t lhs, Version::full_t rhs);
 
 
+	/**
+	 * Clients that have been handed a UDP association token (see MumbleProto::CryptSetup) may prefix encrypted UDP
+	 * packets with a header consisting of this magic followed by the token (both in network byte order). This allows
+	 * the server to associate a new UDP endpoint with its user without trying to decrypt the packet with the keys of
+	 * all users connected from the same IP address.
+	 */
+	constexpr std::uint32_t UDP_ASSOCIATION_MAGIC      = 0xFF4D4154;
+	constexpr std::size_t UDP_ASSOCIATION_HEADER_SIZE = 8;
+
+	/// Writes the association header for the given token into the given buffer, which has to be at least
+	/// UDP_ASSOCIATION_HEADER_SIZE bytes long
+	void writeUDPAssociationHeader(byte *buffer, std::uint32_t token);
+	/// @returns Whether the given datagram starts with an association header that is followed by at least one byte.
+	/// If so, the contained token is written to the given variable.
+	bool readUDPAssociationHeader(gsl::span< const byte > datagram, std::uint32_t &token);
+
+
 	template< Role role > class ProtocolHandler {
 	public:
 		ProtocolHandler(Version::full_t protocolVersion = Version::UNKNOWN);
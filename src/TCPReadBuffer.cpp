@@ -0,0 +1,61 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TCPReadBuffer.h"
+
+#include <cstring>
+
+constexpr std::size_t TCPReadBuffer::HEADER_SIZE;
+constexpr std::size_t TCPReadBuffer::MAX_MESSAGE_SIZE;
+constexpr std::size_t TCPReadBuffer::DEFAULT_SIZE;
+
+TCPReadBuffer::TCPReadBuffer() : m_buffer(DEFAULT_SIZE), m_start(0), m_end(0) {
+}
+
+gsl::span< Mumble::Protocol::byte > TCPReadBuffer::writable() {
+	return gsl::span< Mumble::Protocol::byte >(m_buffer.data() + m_end, m_buffer.size() - m_end);
+}
+
+void TCPReadBuffer::commit(std::size_t bytes) {
+	m_end += bytes;
+}
+
+void TCPReadBuffer::clear() {
+	m_start = 0;
+	m_end   = 0;
+
+	makeRoom();
+}
+
+void TCPReadBuffer::makeRoom() {
+	if (m_start == m_end) {
+		m_start = 0;
+		m_end   = 0;
+
+		if (m_buffer.size() > DEFAULT_SIZE) {
+			// Don't hold on to the memory a large message required
+			m_buffer.resize(DEFAULT_SIZE);
+			m_buffer.shrink_to_fit();
+		}
+
+		return;
+	}
+
+	if (m_end < m_buffer.size() && m_start <= m_buffer.size() / 2) {
+		// There is still enough room behind the incomplete message
+		return;
+	}
+
+	std::memmove(m_buffer.data(), m_buffer.data() + m_start, m_end - m_start);
+	m_end -= m_start;
+	m_start = 0;
+
+	if (m_end >= HEADER_SIZE) {
+		const std::size_t messageSize = HEADER_SIZE + qFromBigEndian< quint32 >(m_buffer.data() + 2);
+		if (messageSize > m_buffer.size()) {
+			m_buffer.resize(messageSize);
+		}
+	}
+}
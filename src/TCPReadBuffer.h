@@ -0,0 +1,83 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_TCPREADBUFFER_H_
+#define MUMBLE_TCPREADBUFFER_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QtEndian>
+
+#include <gsl/span>
+
+#include <cstdint>
+#include <vector>
+
+/// Buffers the data received on a TCP connection and splits it into the messages of the Mumble protocol.
+///
+/// Data is read into a buffer that is reused for the lifetime of the connection and complete messages are handed out
+/// as views into it, so that receiving a message doesn't require an allocation. Only the beginning of a message that
+/// hasn't been received completely is moved to the front of the buffer to make room for the rest of it. The buffer
+/// only grows beyond its default size for a message that doesn't fit and shrinks back once that has been handled.
+class TCPReadBuffer {
+public:
+	static constexpr std::size_t HEADER_SIZE      = 6;
+	static constexpr std::size_t MAX_MESSAGE_SIZE = 0x7fffff;
+	static constexpr std::size_t DEFAULT_SIZE     = 4 * 1024;
+
+	TCPReadBuffer();
+
+	/// @returns The space that received data may be written to. Unless the handler passed to process() stopped early,
+	/// it is never empty.
+	gsl::span< Mumble::Protocol::byte > writable();
+	/// Marks the given amount of bytes at the start of writable() as received.
+	void commit(std::size_t bytes);
+
+	/// Passes every message that has been received completely to the given handler, in the order they have been
+	/// received. The message's payload is only valid until the handler returns.
+	///
+	/// @param handler Called as handler(Mumble::Protocol::TCPMessageType, gsl::span< const Mumble::Protocol::byte >)
+	/// 	and returns whether to continue with the next message. Messages not passed to it stay buffered.
+	/// @returns False if a message exceeds MAX_MESSAGE_SIZE (and the connection should be dropped), true otherwise
+	template< typename Handler > bool process(Handler &&handler) {
+		while (m_end - m_start >= HEADER_SIZE) {
+			const Mumble::Protocol::byte *header = m_buffer.data() + m_start;
+			const std::size_t length             = qFromBigEndian< quint32 >(header + 2);
+
+			if (length > MAX_MESSAGE_SIZE) {
+				clear();
+				return false;
+			}
+			if (m_end - m_start < HEADER_SIZE + length) {
+				break;
+			}
+
+			m_start += HEADER_SIZE + length;
+
+			if (!handler(static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(header)),
+						 gsl::span< const Mumble::Protocol::byte >(header + HEADER_SIZE, length))) {
+				break;
+			}
+		}
+
+		makeRoom();
+
+		return true;
+	}
+
+	/// Drops all buffered data.
+	void clear();
+
+private:
+	std::vector< Mumble::Protocol::byte > m_buffer;
+	/// The range of m_buffer that holds received data that hasn't been processed yet
+	std::size_t m_start;
+	std::size_t m_end;
+
+	/// Moves an incomplete message to the front of the buffer and resizes the buffer such that the message fits
+	void makeRoom();
+};
+
+#endif
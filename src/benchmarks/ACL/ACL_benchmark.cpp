@@ -0,0 +1,355 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares the compiled ACL programs used by ChanACL::effectivePermissions against the stack walk it used before on a
+// tree of 5000 channels. Before running the benchmarks, both implementations are checked to grant identical
+// permissions to every user in every channel. Additionally, checking group specifications is measured with and without
+// parsing them beforehand, as is the cost of editing an ACL on a server with 1000 connected users.
+
+#include <benchmark/benchmark.h>
+
+#include "ACL.h"
+#include "Channel.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+#include <QtCore/QStack>
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+constexpr unsigned int CHANNEL_COUNT = 5000;
+constexpr unsigned int FAN_OUT       = 5;
+constexpr int USER_COUNT             = 100;
+constexpr int CONNECTED_USER_COUNT   = 1000;
+constexpr int QUERIED_CHANNEL_COUNT  = 20;
+
+std::mt19937 rng(42);
+
+std::unique_ptr< Channel > root;
+std::vector< Channel * > channels;
+std::vector< std::unique_ptr< ServerUser > > users;
+std::vector< std::unique_ptr< ServerUser > > connectedUsers;
+/// The channels each of the connected users has been sent permissions for
+std::vector< std::vector< Channel * > > queriedChannels;
+
+/// The implementation ChanACL::effectivePermissions used before ACLs were compiled (without the cache handling)
+static ChanACL::Permissions referenceEffectivePermissions(ServerUser *p, Channel *chan) {
+	if (p->iId == 0) {
+		return static_cast< ChanACL::Permissions >(ChanACL::All & ~(ChanACL::Speak | ChanACL::Whisper));
+	}
+
+	QStack< Channel * > chanstack;
+	Channel *ch = chan;
+
+	while (ch) {
+		chanstack.push(ch);
+		ch = ch->cParent;
+	}
+
+	ChanACL::Permissions def = ChanACL::Traverse | ChanACL::Enter | ChanACL::Speak | ChanACL::Whisper
+							   | ChanACL::TextMessage | ChanACL::Listen;
+	ChanACL::Permissions rootOnly =
+		ChanACL::Kick | ChanACL::Ban | ChanACL::ResetUserContent | ChanACL::Register | ChanACL::SelfRegister;
+
+	ChanACL::Permissions granted = def;
+
+	bool traverse = true;
+	bool write    = false;
+
+	while (!chanstack.isEmpty()) {
+		ch = chanstack.pop();
+		if (!ch->bInheritACL)
+			granted = def;
+
+		for (ChanACL *acl : ch->qlACL) {
+			bool matchUser  = (acl->iUserId != -1) && (acl->iUserId == p->iId);
+			bool matchGroup = Group::appliesToUser(*chan, *ch, acl->qsGroup, *p);
+			if (matchUser || matchGroup) {
+				if (acl->pAllow & ChanACL::Traverse)
+					traverse = true;
+				if (acl->pDeny & ChanACL::Traverse)
+					traverse = false;
+				if (acl->pAllow & ChanACL::Write)
+					write = true;
+				if (acl->pDeny & ChanACL::Write)
+					write = false;
+				if (ch->iId == 0 && chan == ch && acl->bApplyHere) {
+					granted |= acl->pAllow & rootOnly;
+				}
+				if ((ch == chan && acl->bApplyHere) || (ch != chan && acl->bApplySubs)) {
+					granted |= (acl->pAllow & ~(rootOnly | ChanACL::Cached));
+					granted &= ~acl->pDeny;
+				}
+			}
+		}
+		if (!traverse && !write) {
+			granted = ChanACL::None;
+			break;
+		}
+	}
+
+	if (granted & ChanACL::Write) {
+		granted |= ChanACL::Traverse | ChanACL::Enter | ChanACL::MuteDeafen | ChanACL::Move | ChanACL::MakeChannel
+				   | ChanACL::LinkChannel | ChanACL::TextMessage | ChanACL::MakeTempChannel | ChanACL::Listen;
+		if (chan->iId == 0)
+			granted |= rootOnly;
+	}
+
+	return granted;
+}
+
+static ChanACL *addACL(Channel *chan, const QString &group, ChanACL::Permissions allow, ChanACL::Permissions deny) {
+	ChanACL *acl = new ChanACL(chan);
+	acl->qsGroup = group;
+	acl->pAllow  = allow;
+	acl->pDeny   = deny;
+
+	return acl;
+}
+
+static std::unique_ptr< ServerUser > createUser(int i) {
+	std::uniform_int_distribution< std::size_t > randomChannel(0, channels.size() - 1);
+
+	std::unique_ptr< ServerUser > user = std::make_unique< ServerUser >();
+	user->uiSession                    = static_cast< unsigned int >(i + 1);
+	// Half of the users are registered (skipping the SuperUser)
+	user->iId       = i % 2 == 0 ? i + 1 : -1;
+	user->bVerified = i % 3 == 0;
+	user->cChannel  = channels[randomChannel(rng)];
+	if (i % 5 == 0) {
+		user->qslAccessTokens << QString::fromLatin1("password%1").arg(i % 3);
+	}
+
+	return user;
+}
+
+void globalInit() {
+	root = std::make_unique< Channel >(0, QLatin1String("Root"));
+	channels.push_back(root.get());
+
+	// The ACLs a new server starts out with
+	Group *admin = new Group(root.get(), QLatin1String("admin"));
+	admin->qsAdd << 1 << 2;
+	addACL(root.get(), QLatin1String("admin"), ChanACL::Write, ChanACL::None);
+	addACL(root.get(), QLatin1String("auth"), ChanACL::MakeTempChannel, ChanACL::None);
+	addACL(root.get(), QLatin1String("all"), ChanACL::SelfRegister, ChanACL::None);
+
+	for (unsigned int i = 1; i < CHANNEL_COUNT; ++i) {
+		Channel *chan = new Channel(i, QString::fromLatin1("Channel %1").arg(i), channels[(i - 1) / FAN_OUT]);
+		channels.push_back(chan);
+
+		if (i % 7 == 0) {
+			// Password protected channel
+			const ChanACL::Permissions access =
+				ChanACL::Enter | ChanACL::Speak | ChanACL::Whisper | ChanACL::TextMessage | ChanACL::LinkChannel;
+			addACL(chan, QLatin1String("all"), ChanACL::None, access);
+			addACL(chan, QString::fromLatin1("#password%1").arg(i % 3), access, ChanACL::None);
+		}
+		if (i % 11 == 0) {
+			addACL(chan, QLatin1String("~sub,0,1"), ChanACL::MakeTempChannel, ChanACL::None);
+			addACL(chan, QLatin1String("!~in"), ChanACL::None, ChanACL::TextMessage);
+		}
+		if (i % 13 == 0) {
+			Group *moderators = new Group(chan, QLatin1String("moderators"));
+			moderators->qsAdd << static_cast< int >(i % USER_COUNT) << static_cast< int >((i + 1) % USER_COUNT);
+			addACL(chan, QLatin1String("moderators"), ChanACL::MuteDeafen | ChanACL::Move, ChanACL::None);
+		}
+		if (i % 17 == 0) {
+			addACL(chan, QLatin1String("auth"), ChanACL::None, ChanACL::Traverse);
+			addACL(chan, QLatin1String("strong"), ChanACL::Traverse, ChanACL::None);
+		}
+		if (i % 50 == 0) {
+			chan->bInheritACL = false;
+		}
+	}
+
+	for (int i = 0; i < USER_COUNT; ++i) {
+		users.push_back(createUser(i));
+	}
+
+	std::uniform_int_distribution< std::size_t > randomChannel(0, channels.size() - 1);
+	for (int i = 0; i < CONNECTED_USER_COUNT; ++i) {
+		connectedUsers.push_back(createUser(i));
+
+		std::vector< Channel * > queried = { connectedUsers.back()->cChannel };
+		while (queried.size() < static_cast< std::size_t >(QUERIED_CHANNEL_COUNT)) {
+			queried.push_back(channels[randomChannel(rng)]);
+		}
+		queriedChannels.push_back(std::move(queried));
+	}
+}
+
+static bool implementationsMatch() {
+	for (const std::unique_ptr< ServerUser > &user : users) {
+		for (Channel *chan : channels) {
+			if (ChanACL::effectivePermissions(user.get(), chan, nullptr)
+				!= referenceEffectivePermissions(user.get(), chan)) {
+				std::fprintf(stderr, "Permission mismatch for user %d in channel %u\n", user->iId, chan->iId);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+static void BM_effectivePermissions_reference(::benchmark::State &state) {
+	std::size_t i = 0;
+	for (auto _ : state) {
+		ServerUser *user = users[i++ % users.size()].get();
+
+		for (Channel *chan : channels) {
+			benchmark::DoNotOptimize(referenceEffectivePermissions(user, chan));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * channels.size()));
+}
+BENCHMARK(BM_effectivePermissions_reference);
+
+static void BM_effectivePermissions(::benchmark::State &state) {
+	std::size_t i = 0;
+	for (auto _ : state) {
+		ServerUser *user = users[i++ % users.size()].get();
+
+		for (Channel *chan : channels) {
+			benchmark::DoNotOptimize(ChanACL::effectivePermissions(user, chan, nullptr));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * channels.size()));
+}
+BENCHMARK(BM_effectivePermissions);
+
+/// Edits the ACL of one of the root's sub-channels (and thereby a fifth of the tree) and evaluates every channel
+/// afterwards, which includes recompiling the programs of the affected subtree.
+static void BM_effectivePermissions_afterEdit(::benchmark::State &state) {
+	Channel *edited = channels[1];
+	ChanACL *acl    = addACL(edited, QLatin1String("auth"), ChanACL::None, ChanACL::None);
+
+	std::size_t i = 0;
+	for (auto _ : state) {
+		acl->pAllow = (i % 2 == 0) ? ChanACL::Permissions(ChanACL::Listen) : ChanACL::Permissions(ChanACL::None);
+		ChanACL::invalidatePrograms(edited);
+
+		ServerUser *user = users[i++ % users.size()].get();
+
+		for (Channel *chan : channels) {
+			benchmark::DoNotOptimize(ChanACL::effectivePermissions(user, chan, nullptr));
+		}
+	}
+
+	edited->qlACL.removeAll(acl);
+	delete acl;
+	ChanACL::invalidatePrograms(edited);
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * channels.size()));
+}
+BENCHMARK(BM_effectivePermissions_afterEdit);
+
+/// The group specifications used throughout the tree, checked by every user against the channel they are in
+static const char *const groupSpecifications[] = { "all", "auth", "strong", "~in", "!~in", "#password1", "~sub,0,1",
+												   "sub,-1", "admin", "moderators" };
+
+static void BM_appliesToUser_unparsed(::benchmark::State &state) {
+	QStringList specifications;
+	for (const char *specification : groupSpecifications) {
+		specifications << QLatin1String(specification);
+	}
+
+	std::size_t i = 0;
+	for (auto _ : state) {
+		ServerUser *user = users[i++ % users.size()].get();
+
+		for (const QString &specification : specifications) {
+			benchmark::DoNotOptimize(Group::appliesToUser(*user->cChannel, *user->cChannel, specification, *user));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * specifications.size()));
+}
+BENCHMARK(BM_appliesToUser_unparsed);
+
+static void BM_appliesToUser_parsed(::benchmark::State &state) {
+	std::vector< Group::Specification > specifications;
+	for (const char *specification : groupSpecifications) {
+		specifications.push_back(Group::Specification::parse(QLatin1String(specification)));
+	}
+
+	std::size_t i = 0;
+	for (auto _ : state) {
+		ServerUser *user = users[i++ % users.size()].get();
+
+		for (const Group::Specification &specification : specifications) {
+			benchmark::DoNotOptimize(Group::appliesToUser(*user->cChannel, *user->cChannel, specification, *user));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * specifications.size()));
+}
+BENCHMARK(BM_appliesToUser_parsed);
+
+/// Evaluates the permissions of every connected user in the channels they have been sent permissions for, as the
+/// server does after an ACL edit in order to find out whom to notify
+static void queryConnectedUsers(ChanACL::ACLCache &cache) {
+	for (std::size_t i = 0; i < connectedUsers.size(); ++i) {
+		for (Channel *chan : queriedChannels[i]) {
+			benchmark::DoNotOptimize(ChanACL::effectivePermissions(connectedUsers[i].get(), chan, &cache));
+		}
+	}
+}
+
+static void clearCache(ChanACL::ACLCache &cache) {
+	for (ChanACL::ChanCache *h : cache) {
+		delete h;
+	}
+	cache.clear();
+}
+
+/// Repeatedly edits the ACL of a channel with a subtree of about 200 channels, each time dropping all cached
+/// permissions (state.range(0) == 0) or relying on the ACL generations to only recompute the outdated ones.
+static void BM_aclEdit(::benchmark::State &state) {
+	const bool flushCache = state.range(0) == 0;
+
+	ChanACL::ACLCache cache;
+	queryConnectedUsers(cache);
+
+	Channel *edited = channels[6];
+	ChanACL *acl    = addACL(edited, QLatin1String("auth"), ChanACL::None, ChanACL::None);
+
+	std::size_t i = 0;
+	for (auto _ : state) {
+		acl->pAllow = (i++ % 2 == 0) ? ChanACL::Permissions(ChanACL::Listen) : ChanACL::Permissions(ChanACL::None);
+		ChanACL::invalidatePrograms(edited);
+
+		if (flushCache) {
+			clearCache(cache);
+		}
+
+		queryConnectedUsers(cache);
+	}
+
+	edited->qlACL.removeAll(acl);
+	delete acl;
+	ChanACL::invalidatePrograms(edited);
+	clearCache(cache);
+}
+BENCHMARK(BM_aclEdit)->Arg(0)->Arg(1);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	if (!implementationsMatch()) {
+		return 1;
+	}
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,17 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+
+// NOTE: This is merely a mock of the ServerUser class
+
+#include "User.h"
+
+#include <QtCore/QStringList>
+
+class ServerUser : public User {
+public:
+	bool bVerified = false;
+	QStringList qslAccessTokens;
+};
@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <random>
+#include <unordered_map>
 #include <vector>
 
 std::random_device rd;
@@ -29,7 +30,7 @@ constexpr const std::size_t DUPLICATE_RANGE      = 1;
 
 constexpr int MULTIPLIER           = 2;
 constexpr int RECEIVER_COUNT_BEGIN = 1;
-constexpr int RECEIVER_COUNT_END   = 512;
+constexpr int RECEIVER_COUNT_END   = 2048;
 
 struct ReceiverData {
 	ServerUser *receiver;
@@ -109,6 +110,72 @@ BENCHMARK_REGISTER_F(Fixture, BM_addReceiver)
 	->ArgsProduct({ benchmark::CreateRange(RECEIVER_COUNT_BEGIN, RECEIVER_COUNT_END, /*multi=*/MULTIPLIER),
 					{ 0, 10, 40, 80 } });
 
+/// Deduplicates receivers the way AudioReceiverBuffer did before it switched to ReceiverIndex. This serves as the
+/// baseline for BM_addReceiver.
+class UnorderedMapReceiverBuffer {
+public:
+	void addReceiver(const ServerUser &sender, ServerUser &receiver, Mumble::Protocol::audio_context_t context,
+					 bool includePositionalData, const VolumeAdjustment &volumeAdjustment) {
+		if (sender.uiSession == receiver.uiSession || receiver.bDeaf || receiver.bSelfDeaf) {
+			return;
+		}
+
+		std::vector< AudioReceiver > &receiverList = includePositionalData ? m_positionalReceivers : m_regularReceivers;
+		std::unordered_map< const ServerUser *, std::size_t > &userEntryIndices =
+			includePositionalData ? m_positionalReceiverIndices : m_regularReceiverIndices;
+
+		auto it = userEntryIndices.find(&receiver);
+		if (it == userEntryIndices.end()) {
+			receiverList.emplace_back(receiver, context, volumeAdjustment);
+			userEntryIndices[&receiver] = receiverList.size() - 1;
+		} else {
+			AudioReceiver &receiverEntry = receiverList[it->second];
+
+			receiverEntry.setContext(std::min(receiverEntry.getContext(), context));
+
+			if (receiverEntry.getVolumeAdjustment().factor < volumeAdjustment.factor) {
+				receiverEntry.setVolumeAdjustment(volumeAdjustment);
+			}
+		}
+	}
+
+	void clear() {
+		m_regularReceivers.clear();
+		m_regularReceiverIndices.clear();
+		m_positionalReceivers.clear();
+		m_positionalReceiverIndices.clear();
+	}
+
+protected:
+	std::vector< AudioReceiver > m_regularReceivers;
+	std::unordered_map< const ServerUser *, std::size_t > m_regularReceiverIndices;
+	std::vector< AudioReceiver > m_positionalReceivers;
+	std::unordered_map< const ServerUser *, std::size_t > m_positionalReceiverIndices;
+};
+
+BENCHMARK_DEFINE_F(Fixture, BM_addReceiver_unorderedMap)(::benchmark::State &state) {
+	UnorderedMapReceiverBuffer buffer;
+
+	ServerUser sender = users[users.size() - 1];
+
+	for (auto _ : state) {
+		for (std::size_t i = 0; i < selectedData.size(); ++i) {
+			ReceiverData &data = selectedData[i];
+
+			buffer.addReceiver(sender, *data.receiver, data.context, data.containsPositionalData,
+							   data.volumeAdjustment);
+		}
+
+		buffer.clear();
+	}
+
+	state.counters["unique receivers"] = getUniqueReceivers(selectedData);
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_addReceiver_unorderedMap)
+	->ArgsProduct({ benchmark::CreateRange(RECEIVER_COUNT_BEGIN, RECEIVER_COUNT_END, /*multi=*/MULTIPLIER),
+					{ 0, 10, 40, 80 } });
+
 
 unsigned int dummyProcessing(const AudioReceiver &receiver) {
 	return receiver.getReceiver().uiSession;
@@ -153,6 +220,66 @@ BENCHMARK_REGISTER_F(Fixture, BM_full)
 					{ 0, 10, 40, 80 } });
 
 
+/// Mirrors the way Server::processMsg walks the receiver ranges and counts how often the encoder has to prepare the
+/// fixed part of the packet (whenever the protocol changes) and how often it has to update the packet (once per range)
+BENCHMARK_DEFINE_F(Fixture, BM_encodesPerPacket)(::benchmark::State &state) {
+	AudioReceiverBuffer buffer;
+
+	ServerUser sender = users[users.size() - 1];
+
+	std::size_t prepares = 0;
+	std::size_t updates  = 0;
+
+	for (auto _ : state) {
+		for (std::size_t i = 0; i < selectedData.size(); ++i) {
+			ReceiverData &data = selectedData[i];
+
+			// Let every fourth receiver share the sender's positional audio context
+			buffer.addReceiver(sender, *data.receiver, data.context, data.receiver->uiSession % 4 == 0,
+							   data.volumeAdjustment);
+		}
+
+		buffer.preprocessBuffer();
+
+		bool isFirstIteration           = true;
+		Version::full_t protocolVersion = Version::UNKNOWN;
+		for (bool includePositionalData : { true, false }) {
+			std::vector< AudioReceiver > &receivers = buffer.getReceivers(includePositionalData);
+			ReceiverRange< std::vector< AudioReceiver >::iterator > currentRange =
+				AudioReceiverBuffer::getReceiverRange(receivers.begin(), receivers.end());
+
+			while (currentRange.begin != currentRange.end) {
+				if (isFirstIteration
+					|| !Mumble::Protocol::protocolVersionsAreCompatible(protocolVersion,
+																		currentRange.begin->getReceiver().m_version)) {
+					protocolVersion  = currentRange.begin->getReceiver().m_version;
+					isFirstIteration = false;
+					prepares++;
+				}
+				updates++;
+
+				for (auto it = currentRange.begin; it != currentRange.end; ++it) {
+					benchmark::DoNotOptimize(dummyProcessing(*it));
+				}
+
+				currentRange = AudioReceiverBuffer::getReceiverRange(currentRange.end, receivers.end());
+			}
+		}
+
+		buffer.clear();
+	}
+
+	state.counters["prepares per packet"] =
+		benchmark::Counter(static_cast< double >(prepares), benchmark::Counter::kAvgIterations);
+	state.counters["updates per packet"] =
+		benchmark::Counter(static_cast< double >(updates), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encodesPerPacket)
+	->ArgsProduct({ benchmark::CreateRange(RECEIVER_COUNT_BEGIN, RECEIVER_COUNT_END, /*multi=*/MULTIPLIER),
+					{ 0, 10, 40, 80 } });
+
+
 int main(int argc, char **argv) {
 	globalInit();
 
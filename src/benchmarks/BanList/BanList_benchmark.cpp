@@ -0,0 +1,119 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares checking incoming connections against 100k bans using BanList with the linear scan over a QList< Ban >
+// (including the filtering of expired bans) Server::newClient used before.
+
+#include <benchmark/benchmark.h>
+
+#include "BanList.h"
+
+#include <random>
+#include <vector>
+
+constexpr int BAN_COUNT     = 100000;
+constexpr int ADDRESS_COUNT = 1024;
+
+std::mt19937 rng(42);
+
+QList< Ban > banList;
+BanList banIndex;
+std::vector< HostAddress > addresses;
+
+static HostAddress randomAddress(bool v6) {
+	HostAddress address;
+	address.reset();
+
+	if (v6) {
+		for (std::size_t i = 0; i < 16; ++i) {
+			address.setByte(i, static_cast< std::uint8_t >(rng()));
+		}
+	} else {
+		address.fromIPv4(static_cast< std::uint32_t >(rng()));
+	}
+
+	return address;
+}
+
+void globalInit() {
+	const QDateTime now = QDateTime::currentDateTime().toUTC();
+
+	for (int i = 0; i < BAN_COUNT; ++i) {
+		Ban ban;
+		// Mostly single IPv4 addresses and ranges as found on abuse lists, with some IPv6 prefixes in between
+		if (i % 10 == 0) {
+			ban.haAddress = randomAddress(true);
+			ban.iMask     = 48 + static_cast< int >(rng() % 17);
+		} else {
+			ban.haAddress = randomAddress(false);
+			ban.iMask     = i % 4 == 0 ? 96 + 16 + static_cast< int >(rng() % 9) : 128;
+		}
+		ban.qsReason = QLatin1String("Abuse list");
+		ban.qdtStart = now;
+		// Some of the bans are temporary (but don't expire while the benchmark is running)
+		ban.iDuration = i % 3 == 0 ? 86400 : 0;
+
+		banList << ban;
+		banIndex.add(ban);
+	}
+
+	for (int i = 0; i < ADDRESS_COUNT; ++i) {
+		addresses.push_back(randomAddress(i % 10 == 0));
+	}
+}
+
+static void BM_linearScan(::benchmark::State &state) {
+	std::size_t i = 0;
+	for (auto _ : state) {
+		const HostAddress &address = addresses[i++ % addresses.size()];
+
+		QList< Ban > tmpBans = banList;
+		foreach (const Ban &ban, banList) {
+			if (ban.isExpired())
+				tmpBans.removeOne(ban);
+		}
+
+		const Ban *match = nullptr;
+		foreach (const Ban &ban, tmpBans) {
+			if (ban.haAddress.match(address, static_cast< unsigned int >(ban.iMask))) {
+				match = &ban;
+				break;
+			}
+		}
+		benchmark::DoNotOptimize(match);
+	}
+}
+BENCHMARK(BM_linearScan);
+
+static void BM_banList(::benchmark::State &state) {
+	std::size_t i = 0;
+	for (auto _ : state) {
+		const HostAddress &address = addresses[i++ % addresses.size()];
+
+		benchmark::DoNotOptimize(banIndex.removeExpired());
+		benchmark::DoNotOptimize(banIndex.match(address));
+	}
+}
+BENCHMARK(BM_banList);
+
+static void BM_banList_add(::benchmark::State &state) {
+	for (auto _ : state) {
+		BanList bans;
+		foreach (const Ban &ban, banList) { bans.add(ban); }
+
+		benchmark::DoNotOptimize(bans.count());
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * banList.size()));
+}
+BENCHMARK(BM_banList_add)->Unit(benchmark::kMillisecond);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,130 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares broadcasting a batch of UserState messages to 1000 clients with one sendAll per message (as e.g.
+// Server::clearACLCache did before) with a single Broadcast. Like most state changes, every message is sent in a
+// variant for clients before and since 1.2.2. Writing to a client's socket is modelled by appending to a buffer; the
+// amount of writes per client is reported as well, as each of them costs a TLS record and usually a syscall.
+
+#include <benchmark/benchmark.h>
+
+#include "Broadcast.h"
+#include "Connection.h"
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+
+#include <string>
+#include <vector>
+
+constexpr unsigned int USER_COUNT = 1000;
+
+struct BenchmarkUser {
+	Version::full_t version;
+	QByteArray socket;
+	std::size_t writes;
+
+	void write(const QByteArray &data) {
+		if (data.isEmpty())
+			return;
+
+		socket.append(data);
+		++writes;
+	}
+};
+
+std::vector< BenchmarkUser > users;
+
+void globalInit() {
+	for (unsigned int i = 0; i < USER_COUNT; ++i) {
+		// A few legacy clients
+		users.push_back({ i % 50 == 0 ? Version::fromComponents(1, 2, 0) : Version::fromComponents(1, 5, 0),
+						  QByteArray(), 0 });
+	}
+}
+
+static void reset() {
+	for (BenchmarkUser &user : users) {
+		user.socket.clear();
+		user.writes = 0;
+	}
+}
+
+static MumbleProto::UserState userState(unsigned int session) {
+	MumbleProto::UserState mpus;
+	mpus.set_session(session);
+	mpus.set_suppress(true);
+	mpus.set_comment(std::string(100, 'c'));
+	return mpus;
+}
+
+/// Like Server::sendProtoAll: serialize once (if there is a recipient at all), then write to every matching user
+static void sendAll(const MumbleProto::UserState &msg, Version::full_t version, Version::CompareMode mode) {
+	QByteArray cache;
+	for (BenchmarkUser &user : users) {
+		if (mode == Version::CompareMode::AtLeast ? user.version >= version : user.version < version) {
+			if (cache.isEmpty()) {
+				Connection::messageToNetwork(msg, Mumble::Protocol::TCPMessageType::UserState, cache);
+			}
+			user.write(cache);
+		}
+	}
+}
+
+static void BM_sendAllEach(::benchmark::State &state) {
+	const unsigned int messages = static_cast< unsigned int >(state.range(0));
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		reset();
+		state.ResumeTiming();
+
+		for (unsigned int i = 0; i < messages; ++i) {
+			MumbleProto::UserState mpus = userState(i);
+			sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+			mpus.clear_comment();
+			mpus.set_comment_hash(std::string(20, 'h'));
+			sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		}
+	}
+
+	state.counters["writesPerUser"] = static_cast< double >(users[1].writes);
+}
+BENCHMARK(BM_sendAllEach)->Arg(1)->Arg(10)->Arg(100);
+
+static void BM_broadcast(::benchmark::State &state) {
+	const unsigned int messages = static_cast< unsigned int >(state.range(0));
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		reset();
+		state.ResumeTiming();
+
+		Broadcast broadcast;
+		for (unsigned int i = 0; i < messages; ++i) {
+			MumbleProto::UserState mpus = userState(i);
+			broadcast.add(mpus, Mumble::Protocol::TCPMessageType::UserState, Version::fromComponents(1, 2, 2),
+						  Version::CompareMode::LessThan);
+			mpus.clear_comment();
+			mpus.set_comment_hash(std::string(20, 'h'));
+			broadcast.add(mpus, Mumble::Protocol::TCPMessageType::UserState, Version::fromComponents(1, 2, 2),
+						  Version::CompareMode::AtLeast);
+		}
+
+		for (BenchmarkUser &user : users) {
+			user.write(broadcast.dataFor(user.version));
+		}
+	}
+
+	state.counters["writesPerUser"] = static_cast< double >(users[1].writes);
+}
+BENCHMARK(BM_broadcast)->Arg(1)->Arg(10)->Arg(100);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
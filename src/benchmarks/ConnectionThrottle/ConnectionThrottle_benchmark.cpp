@@ -0,0 +1,101 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares the autoban bookkeeping during a flood of connection attempts from distinct IPv6 sources using
+// ConnectionThrottle with the per-address QHash< QHostAddress, QList< Timer > > Meta::banCheck used before.
+
+#include <benchmark/benchmark.h>
+
+#include "ConnectionThrottle.h"
+#include "Timer.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtNetwork/QHostAddress>
+
+#include <random>
+#include <vector>
+
+constexpr int ADDRESS_COUNT = 1 << 20;
+
+constexpr int BAN_TRIES                = 10;
+constexpr unsigned long long TIMEFRAME = 120ULL * 1000000;
+constexpr unsigned long long BAN_TIME  = 300ULL * 1000000;
+
+std::vector< QHostAddress > addresses;
+
+void globalInit() {
+	std::mt19937_64 rng(42);
+
+	addresses.reserve(ADDRESS_COUNT);
+	for (int i = 0; i < ADDRESS_COUNT; ++i) {
+		Q_IPV6ADDR address;
+		for (int j = 0; j < 16; ++j) {
+			address[j] = static_cast< quint8 >(rng());
+		}
+		addresses.push_back(QHostAddress(address));
+	}
+}
+
+static void BM_hashOfTimers(::benchmark::State &state) {
+	QHash< QHostAddress, QList< Timer > > attempts;
+	QHash< QHostAddress, Timer > bans;
+
+	std::size_t i = 0;
+	for (auto _ : state) {
+		const QHostAddress &address = addresses[i++ % addresses.size()];
+
+		bool banned = false;
+		if (bans.contains(address)) {
+			Timer t = bans.value(address);
+			if (t.elapsed() < BAN_TIME) {
+				banned = true;
+			} else {
+				bans.remove(address);
+			}
+		}
+
+		if (!banned) {
+			QList< Timer > &ql = attempts[address];
+
+			ql.append(Timer());
+			while (!ql.isEmpty() && (ql.at(0).elapsed() > TIMEFRAME))
+				ql.removeFirst();
+
+			if (ql.count() > BAN_TRIES) {
+				bans.insert(address, Timer());
+				banned = true;
+			}
+		}
+
+		benchmark::DoNotOptimize(banned);
+	}
+
+	state.counters["tracked"] = static_cast< double >(attempts.size());
+}
+BENCHMARK(BM_hashOfTimers);
+
+static void BM_connectionThrottle(::benchmark::State &state) {
+	ConnectionThrottle throttle(BAN_TRIES, TIMEFRAME, BAN_TIME);
+	Timer uptime;
+
+	std::size_t i = 0;
+	for (auto _ : state) {
+		const QHostAddress &address = addresses[i++ % addresses.size()];
+
+		benchmark::DoNotOptimize(throttle.check(HostAddress(address), uptime.elapsed()));
+	}
+
+	state.counters["evictions"] = static_cast< double >(throttle.statistics().evictions);
+}
+BENCHMARK(BM_connectionThrottle);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,217 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares building the channel tree and user list a client receives when connecting by serializing every message
+// (as Server::msgAuthenticate did before) with appending the cached network representations, into which only the
+// permission dependent fields are patched. Before running the benchmarks, both are checked to produce messages that
+// parse to the same content.
+
+#include <benchmark/benchmark.h>
+
+#include "Connection.h"
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QtEndian>
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+constexpr unsigned int CHANNEL_COUNT = 500;
+constexpr unsigned int USER_COUNT    = 200;
+
+struct SyncChannel {
+	unsigned int id;
+	unsigned int parent;
+	std::string name;
+	std::string descriptionHash;
+	bool enterRestricted;
+	bool canEnter;
+};
+
+struct SyncUser {
+	unsigned int session;
+	std::string name;
+	unsigned int userID;
+	unsigned int channelID;
+	std::string commentHash;
+	std::string hash;
+	std::vector< unsigned int > listening;
+};
+
+std::vector< SyncChannel > channels;
+std::vector< SyncUser > users;
+
+std::vector< QByteArray > cachedChannels;
+std::vector< QByteArray > cachedUsers;
+
+static void fillChannelState(const SyncChannel &channel, MumbleProto::ChannelState &mpcs) {
+	mpcs.set_channel_id(channel.id);
+	if (channel.id != 0)
+		mpcs.set_parent(channel.parent);
+	mpcs.set_name(channel.name);
+	mpcs.set_position(0);
+	mpcs.set_description_hash(channel.descriptionHash);
+	mpcs.set_max_users(0);
+}
+
+static void fillUserState(const SyncUser &user, MumbleProto::UserState &mpus) {
+	mpus.set_session(user.session);
+	mpus.set_name(user.name);
+	mpus.set_user_id(user.userID);
+	mpus.set_channel_id(user.channelID);
+	mpus.set_self_mute(user.session % 3 == 0);
+	mpus.set_comment_hash(user.commentHash);
+	mpus.set_hash(user.hash);
+	for (unsigned int channelID : user.listening) {
+		mpus.add_listening_channel_add(channelID);
+	}
+}
+
+static const std::string &permissionFields(bool enterRestricted, bool canEnter) {
+	static const std::array< std::string, 4 > fields = []() {
+		std::array< std::string, 4 > result;
+		for (std::size_t i = 0; i < result.size(); ++i) {
+			MumbleProto::ChannelState mpcs;
+			mpcs.set_is_enter_restricted((i & 2) != 0);
+			mpcs.set_can_enter((i & 1) != 0);
+			result[i] = mpcs.SerializeAsString();
+		}
+		return result;
+	}();
+
+	return fields[(enterRestricted ? 2 : 0) + (canEnter ? 1 : 0)];
+}
+
+/// Builds the messages the way Server::msgAuthenticate did before: one serialization per message
+static std::vector< QByteArray > serializeEach() {
+	std::vector< QByteArray > messages;
+	messages.reserve(CHANNEL_COUNT + USER_COUNT);
+
+	MumbleProto::ChannelState mpcs;
+	for (const SyncChannel &channel : channels) {
+		mpcs.Clear();
+		fillChannelState(channel, mpcs);
+		mpcs.set_is_enter_restricted(channel.enterRestricted);
+		mpcs.set_can_enter(channel.canEnter);
+
+		messages.emplace_back();
+		Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, messages.back());
+	}
+
+	MumbleProto::UserState mpus;
+	for (const SyncUser &user : users) {
+		mpus.Clear();
+		fillUserState(user, mpus);
+
+		messages.emplace_back();
+		Connection::messageToNetwork(mpus, Mumble::Protocol::TCPMessageType::UserState, messages.back());
+	}
+
+	return messages;
+}
+
+/// Builds the messages the way Server::msgAuthenticate does now: appending the cached messages to a single buffer
+static QByteArray appendCached() {
+	QByteArray buffer;
+
+	for (std::size_t i = 0; i < channels.size(); ++i) {
+		const std::string &fields = permissionFields(channels[i].enterRestricted, channels[i].canEnter);
+
+		const int offset = buffer.size();
+		buffer.append(cachedChannels[i]);
+		buffer.append(fields.data(), static_cast< int >(fields.size()));
+		qToBigEndian< quint32 >(static_cast< quint32 >(buffer.size() - offset - 6),
+								reinterpret_cast< unsigned char * >(buffer.data()) + offset + 2);
+	}
+
+	for (const QByteArray &user : cachedUsers) {
+		buffer.append(user);
+	}
+
+	return buffer;
+}
+
+/// @returns The content of the messages in the given network representation
+static std::vector< std::string > parse(const QByteArray &data) {
+	std::vector< std::string > contents;
+
+	int offset = 0;
+	while (offset < data.size()) {
+		const unsigned char *header = reinterpret_cast< const unsigned char * >(data.constData()) + offset;
+		const quint16 type          = qFromBigEndian< quint16 >(header);
+		const int length            = static_cast< int >(qFromBigEndian< quint32 >(header + 2));
+
+		if (type == static_cast< quint16 >(Mumble::Protocol::TCPMessageType::ChannelState)) {
+			MumbleProto::ChannelState mpcs;
+			mpcs.ParseFromArray(header + 6, length);
+			contents.push_back(mpcs.DebugString());
+		} else {
+			MumbleProto::UserState mpus;
+			mpus.ParseFromArray(header + 6, length);
+			contents.push_back(mpus.DebugString());
+		}
+
+		offset += 6 + length;
+	}
+
+	return contents;
+}
+
+void globalInit() {
+	for (unsigned int i = 0; i < CHANNEL_COUNT; ++i) {
+		channels.push_back({ i, i / 5, "Channel " + std::to_string(i), std::string(20, static_cast< char >(i)),
+							 i % 7 == 0, i % 3 != 0 });
+
+		MumbleProto::ChannelState mpcs;
+		fillChannelState(channels.back(), mpcs);
+		cachedChannels.emplace_back();
+		Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, cachedChannels.back());
+	}
+
+	for (unsigned int i = 0; i < USER_COUNT; ++i) {
+		users.push_back({ i + 1, "User " + std::to_string(i), i + 100, i % CHANNEL_COUNT,
+						  std::string(20, static_cast< char >(i)), std::string(40, 'a'), { i % 13, i % 17 } });
+
+		MumbleProto::UserState mpus;
+		fillUserState(users.back(), mpus);
+		cachedUsers.emplace_back();
+		Connection::messageToNetwork(mpus, Mumble::Protocol::TCPMessageType::UserState, cachedUsers.back());
+	}
+
+	QByteArray expected;
+	for (const QByteArray &message : serializeEach()) {
+		expected.append(message);
+	}
+	if (parse(expected) != parse(appendCached())) {
+		std::fprintf(stderr, "Cached sync messages differ from the serialized ones\n");
+		std::exit(1);
+	}
+}
+
+static void BM_serializeEach(::benchmark::State &state) {
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(serializeEach());
+	}
+}
+BENCHMARK(BM_serializeEach);
+
+static void BM_appendCached(::benchmark::State &state) {
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(appendCached());
+	}
+}
+BENCHMARK(BM_appendCached);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,112 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares inserting into the server log of an SQLite database the way ServerDB::prepare used to (substituting the
+// table prefix into the statement and preparing it for every row) with reusing the statement kept by StatementCache.
+// Rows are written in transactions of DBWriter::MAX_BATCH_SIZE rows, as done by the writer thread.
+
+#include <benchmark/benchmark.h>
+
+#include "StatementCache.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+constexpr int BATCH_SIZE = 256;
+
+const QString PREFIX   = QStringLiteral("murmur_");
+const QString TEMPLATE = QStringLiteral("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
+const QString MESSAGE  = QStringLiteral("<1:SuperUser(-1)> Moved to Root[0:0]");
+
+QSqlDatabase database;
+
+void globalInit() {
+	database = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"));
+	database.setDatabaseName(QStringLiteral(":memory:"));
+	if (!database.open()) {
+		qFatal("Failed to open the database: %s", qPrintable(database.lastError().text()));
+	}
+
+	QSqlQuery query(database);
+	if (!query.exec(QStringLiteral("CREATE TABLE `murmur_slog` (`server_id` INTEGER NOT NULL, `msg` TEXT, `msgtime` "
+								   "DATE DEFAULT (datetime('now')))"))) {
+		qFatal("Failed to create the table: %s", qPrintable(query.lastError().text()));
+	}
+}
+
+static void BM_prepareEveryTime(::benchmark::State &state) {
+	QSqlQuery query(database);
+
+	int rows = 0;
+	database.transaction();
+	for (auto _ : state) {
+		query.prepare(TEMPLATE.arg(PREFIX));
+		query.addBindValue(1);
+		query.addBindValue(MESSAGE);
+		if (!query.exec()) {
+			state.SkipWithError("Insert failed");
+			break;
+		}
+
+		if (++rows % BATCH_SIZE == 0) {
+			database.commit();
+			database.transaction();
+		}
+	}
+	database.commit();
+
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_prepareEveryTime);
+
+static void BM_statementCache(::benchmark::State &state) {
+	StatementCache statements;
+	QSqlQuery query(database);
+
+	int rows = 0;
+	database.transaction();
+	statements.begin();
+	for (auto _ : state) {
+		if (!statements.find(TEMPLATE, query)) {
+			query = QSqlQuery(database);
+			query.prepare(TEMPLATE.arg(PREFIX));
+			statements.insert(TEMPLATE, query);
+		}
+		query.addBindValue(1);
+		query.addBindValue(MESSAGE);
+		if (!query.exec()) {
+			state.SkipWithError("Insert failed");
+			break;
+		}
+
+		if (++rows % BATCH_SIZE == 0) {
+			statements.end();
+			database.commit();
+			database.transaction();
+			statements.begin();
+		}
+	}
+	statements.end();
+	database.commit();
+
+	state.SetItemsProcessed(state.iterations());
+	state.counters["prepared"] = static_cast< double >(statements.misses());
+}
+BENCHMARK(BM_statementCache);
+
+
+int main(int argc, char **argv) {
+	// Needed for loading the SQLite driver
+	QCoreApplication app(argc, argv);
+
+	globalInit();
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+
+	database.close();
+}
@@ -0,0 +1,210 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Pushes voice tunnelled through TCP (UDPTunnel messages) for 500 users through the server's receive path, once
+// reading every message into a QByteArray of its own (as Connection::socketRead did before) and once using the
+// TCPReadBuffer each connection keeps. Every user delivers one 20ms frame per round, either in a single read or split
+// across two reads at a random point. The received audio packets are decoded like Server::message does.
+//
+// Besides the time, the amount of reads from the socket per message is reported. With a real QSslSocket, each of them
+// goes through QIODevice's buffering, and each message read before cost an allocation and a signal emission as well.
+
+#include <benchmark/benchmark.h>
+
+#include "MumbleProtocol.h"
+#include "TCPReadBuffer.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+constexpr std::size_t USER_COUNT = 500;
+constexpr std::size_t ROUNDS     = 64;
+
+const Version::full_t PROTOCOL_VERSION = Version::fromComponents(1, 5, 0);
+
+struct Delivery {
+	std::vector< Mumble::Protocol::byte > data;
+	std::size_t split;
+};
+
+/// The frames delivered by all users in all rounds, in network representation
+std::vector< Delivery > deliveries;
+
+void globalInit() {
+	std::mt19937 rng(42);
+	std::normal_distribution< double > payloadSize(80, 20);
+
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Client > encoder(PROTOCOL_VERSION);
+
+	for (std::size_t round = 0; round < ROUNDS; ++round) {
+		for (std::size_t user = 0; user < USER_COUNT; ++user) {
+			std::vector< Mumble::Protocol::byte > payload(
+				static_cast< std::size_t >(std::max(10.0, std::min(250.0, payloadSize(rng)))),
+				static_cast< Mumble::Protocol::byte >(rng()));
+
+			Mumble::Protocol::AudioData audioData;
+			audioData.frameNumber = round;
+			audioData.payload     = payload;
+
+			gsl::span< const Mumble::Protocol::byte > packet = encoder.encodeAudioPacket(audioData);
+
+			Delivery delivery;
+			delivery.data.resize(TCPReadBuffer::HEADER_SIZE + packet.size());
+			qToBigEndian< quint16 >(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel),
+									delivery.data.data());
+			qToBigEndian< quint32 >(static_cast< quint32 >(packet.size()), delivery.data.data() + 2);
+			std::copy(packet.begin(), packet.end(), delivery.data.begin() + TCPReadBuffer::HEADER_SIZE);
+
+			// Every fourth frame arrives in two parts
+			delivery.split = round % 4 == user % 4 ? static_cast< std::size_t >(rng()) % delivery.data.size()
+												   : delivery.data.size();
+
+			deliveries.push_back(std::move(delivery));
+		}
+	}
+}
+
+/// Stands in for the socket's receive buffer of a single connection
+struct SocketStandIn {
+	std::vector< Mumble::Protocol::byte > pending;
+	std::size_t position = 0;
+	std::size_t reads    = 0;
+
+	std::size_t available() const { return pending.size() - position; }
+
+	std::size_t read(Mumble::Protocol::byte *destination, std::size_t size) {
+		++reads;
+
+		size = std::min(size, available());
+		std::memcpy(destination, pending.data() + position, size);
+		position += size;
+		return size;
+	}
+
+	QByteArray read(std::size_t size) {
+		QByteArray result(static_cast< int >(std::min(size, available())), Qt::Uninitialized);
+		read(reinterpret_cast< Mumble::Protocol::byte * >(result.data()), static_cast< std::size_t >(result.size()));
+		return result;
+	}
+
+	void deliver(const Mumble::Protocol::byte *data, std::size_t size) {
+		if (position == pending.size()) {
+			pending.clear();
+		} else {
+			pending.erase(pending.begin(), pending.begin() + static_cast< std::ptrdiff_t >(position));
+		}
+		position = 0;
+		pending.insert(pending.end(), data, data + size);
+	}
+};
+
+static void handleTunnel(Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
+						 gsl::span< const Mumble::Protocol::byte > data) {
+	if (decoder.decode(data) && decoder.getMessageType() == Mumble::Protocol::UDPMessageType::Audio) {
+		benchmark::DoNotOptimize(decoder.getAudioData().frameNumber);
+	}
+}
+
+/// The way Connection::socketRead read messages before
+struct PerMessageConnection {
+	SocketStandIn socket;
+	int packetLength = -1;
+
+	void socketRead(Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder) {
+		while (true) {
+			std::size_t available = socket.available();
+			if (packetLength == -1) {
+				if (available < 6)
+					return;
+
+				Mumble::Protocol::byte header[6];
+				socket.read(header, 6);
+				packetLength = static_cast< int >(qFromBigEndian< quint32 >(&header[2]));
+				available -= 6;
+			}
+
+			if (available < static_cast< std::size_t >(packetLength))
+				return;
+
+			const QByteArray message = socket.read(static_cast< std::size_t >(packetLength));
+			packetLength             = -1;
+
+			handleTunnel(decoder, gsl::span< const Mumble::Protocol::byte >(
+									  reinterpret_cast< const Mumble::Protocol::byte * >(message.constData()),
+									  static_cast< std::size_t >(message.size())));
+		}
+	}
+};
+
+/// The way Connection::socketRead reads messages now
+struct BufferedConnection {
+	SocketStandIn socket;
+	TCPReadBuffer buffer;
+
+	void socketRead(Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder) {
+		while (socket.available() > 0) {
+			gsl::span< Mumble::Protocol::byte > writable = buffer.writable();
+			buffer.commit(socket.read(writable.data(), writable.size()));
+
+			buffer.process(
+				[&decoder](Mumble::Protocol::TCPMessageType, gsl::span< const Mumble::Protocol::byte > data) {
+					handleTunnel(decoder, data);
+					return true;
+				});
+		}
+	}
+};
+
+template< typename Connection > static void pushTunnelledAudio(::benchmark::State &state) {
+	std::vector< Connection > connections(USER_COUNT);
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > decoder(PROTOCOL_VERSION);
+
+	for (auto _ : state) {
+		for (std::size_t i = 0; i < deliveries.size(); ++i) {
+			const Delivery &delivery = deliveries[i];
+			Connection &connection   = connections[i % USER_COUNT];
+
+			connection.socket.deliver(delivery.data.data(), delivery.split);
+			connection.socketRead(decoder);
+
+			if (delivery.split < delivery.data.size()) {
+				connection.socket.deliver(delivery.data.data() + delivery.split, delivery.data.size() - delivery.split);
+				connection.socketRead(decoder);
+			}
+		}
+	}
+
+	std::size_t reads = 0;
+	for (const Connection &connection : connections) {
+		reads += connection.socket.reads;
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * deliveries.size()));
+	state.counters["readsPerMessage"] =
+		static_cast< double >(reads) / static_cast< double >(state.iterations() * deliveries.size());
+}
+
+static void BM_readPerMessage(::benchmark::State &state) {
+	pushTunnelledAudio< PerMessageConnection >(state);
+}
+BENCHMARK(BM_readPerMessage);
+
+static void BM_readBuffer(::benchmark::State &state) {
+	pushTunnelledAudio< BufferedConnection >(state);
+}
+BENCHMARK(BM_readBuffer);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,184 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Replays a trace of voice datagrams over the loopback interface, once with one syscall per datagram (the way the
+// server used to operate) and once using the recvmmsg/sendmmsg based batches the voice thread uses.
+//
+// The trace can be provided via the MUMBLE_UDP_TRACE environment variable. It is expected to be a text file
+// containing the size (in bytes) of one datagram per line. If no trace is given, a synthetic trace resembling
+// Opus voice traffic is used instead.
+
+#include <benchmark/benchmark.h>
+
+#include "MumbleProtocol.h"
+#include "UDPBatch.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <vector>
+
+constexpr const std::size_t BURST_SIZE_RANGE = 0;
+
+constexpr int BURST_SIZE_BEGIN = 1;
+constexpr int BURST_SIZE_END   = 64;
+constexpr int MULTIPLIER       = 2;
+
+constexpr std::size_t SYNTHETIC_TRACE_LENGTH = 4096;
+
+std::vector< std::size_t > trace;
+
+int senderSocket   = -1;
+int receiverSocket = -1;
+sockaddr_storage receiverAddress;
+sockaddr_storage loopbackAddress;
+
+void loadTrace() {
+	const char *tracePath = std::getenv("MUMBLE_UDP_TRACE");
+	if (tracePath) {
+		std::ifstream stream(tracePath);
+		std::size_t size;
+		while (stream >> size) {
+			if (size >= 5 && size <= Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+				trace.push_back(size);
+			}
+		}
+	}
+
+	if (trace.empty()) {
+		// 20ms Opus frames at typical bitrates plus the occasional positional audio and ping packets
+		std::mt19937 rng(42);
+		std::normal_distribution< double > voiceSize(110, 30);
+		std::uniform_int_distribution< int > kind(0, 99);
+
+		for (std::size_t i = 0; i < SYNTHETIC_TRACE_LENGTH; ++i) {
+			const int currentKind = kind(rng);
+			if (currentKind < 5) {
+				trace.push_back(16);
+			} else {
+				double size = voiceSize(rng) + (currentKind < 25 ? 12 : 0);
+				trace.push_back(static_cast< std::size_t >(std::max(20.0, std::min(size, 1000.0))));
+			}
+		}
+	}
+}
+
+void globalInit() {
+	loadTrace();
+
+	memset(&loopbackAddress, 0, sizeof(loopbackAddress));
+	sockaddr_in *loopback     = reinterpret_cast< sockaddr_in * >(&loopbackAddress);
+	loopback->sin_family      = AF_INET;
+	loopback->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	senderSocket   = ::socket(AF_INET, SOCK_DGRAM, 0);
+	receiverSocket = ::socket(AF_INET, SOCK_DGRAM, 0);
+
+	int bufferSize = 4 * 1024 * 1024;
+	setsockopt(receiverSocket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+	receiverAddress = loopbackAddress;
+	::bind(receiverSocket, reinterpret_cast< sockaddr * >(&receiverAddress), sizeof(sockaddr_in));
+	socklen_t addressLength = sizeof(receiverAddress);
+	getsockname(receiverSocket, reinterpret_cast< sockaddr * >(&receiverAddress), &addressLength);
+}
+
+static void BM_perDatagram(::benchmark::State &state) {
+	const std::size_t burstSize = static_cast< std::size_t >(state.range(BURST_SIZE_RANGE));
+
+	unsigned char sendBuffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE] = {};
+	unsigned char receiveBuffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+	std::size_t position  = 0;
+	std::size_t datagrams = 0;
+	std::size_t syscalls  = 0;
+
+	for (auto _ : state) {
+		for (std::size_t i = 0; i < burstSize; ++i) {
+			::sendto(senderSocket, sendBuffer, trace[position], 0, reinterpret_cast< sockaddr * >(&receiverAddress),
+					 sizeof(sockaddr_in));
+			position = (position + 1) % trace.size();
+			syscalls++;
+		}
+
+		for (std::size_t i = 0; i < burstSize; ++i) {
+			sockaddr_storage from;
+			socklen_t fromLength = sizeof(from);
+			if (::recvfrom(receiverSocket, receiveBuffer, sizeof(receiveBuffer), MSG_DONTWAIT,
+						   reinterpret_cast< sockaddr * >(&from), &fromLength)
+				< 0) {
+				break;
+			}
+			syscalls++;
+			datagrams++;
+		}
+	}
+
+	state.counters["datagrams"] = ::benchmark::Counter(static_cast< double >(datagrams), benchmark::Counter::kIsRate);
+	state.counters["syscalls per datagram"] =
+		datagrams == 0 ? 0 : static_cast< double >(syscalls) / static_cast< double >(datagrams);
+}
+
+BENCHMARK(BM_perDatagram)->RangeMultiplier(MULTIPLIER)->Range(BURST_SIZE_BEGIN, BURST_SIZE_END);
+
+
+static void BM_batched(::benchmark::State &state) {
+	const std::size_t burstSize = static_cast< std::size_t >(state.range(BURST_SIZE_RANGE));
+
+	UDPSendDescriptor descriptor;
+	descriptor.update(senderSocket, receiverAddress, loopbackAddress);
+
+	UDPSendBatch sendBatch;
+	UDPReceiveBatch receiveBatch;
+	std::size_t position  = 0;
+	std::size_t datagrams = 0;
+
+	for (auto _ : state) {
+		for (std::size_t i = 0; i < burstSize; ++i) {
+			unsigned char *buffer = sendBatch.prepare(senderSocket);
+			benchmark::DoNotOptimize(buffer);
+			sendBatch.commit(trace[position], descriptor);
+			position = (position + 1) % trace.size();
+		}
+		sendBatch.flush();
+
+		std::size_t received = 0;
+		while (received < burstSize) {
+			const int batchSize = receiveBatch.receive(receiverSocket);
+			if (batchSize <= 0) {
+				break;
+			}
+			received += static_cast< std::size_t >(batchSize);
+		}
+		datagrams += received;
+	}
+
+	const std::uint64_t syscalls = sendBatch.statistics().calls + receiveBatch.statistics().calls;
+
+	state.counters["datagrams"] = ::benchmark::Counter(static_cast< double >(datagrams), benchmark::Counter::kIsRate);
+	state.counters["syscalls per datagram"] =
+		datagrams == 0 ? 0 : static_cast< double >(syscalls) / static_cast< double >(datagrams);
+	state.counters["avg send batch"]    = sendBatch.statistics().averageBatchSize();
+	state.counters["avg receive batch"] = receiveBatch.statistics().averageBatchSize();
+}
+
+BENCHMARK(BM_batched)->RangeMultiplier(MULTIPLIER)->Range(BURST_SIZE_BEGIN, BURST_SIZE_END);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+
+	::close(senderSocket);
+	::close(receiverSocket);
+}
@@ -0,0 +1,88 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Measures how long it takes to rebuild a VoiceRoutingSnapshot from scratch, which the server does (at most once per
+// event loop iteration) whenever state affecting regular speech changes, e.g. a user muting itself.
+
+#include <benchmark/benchmark.h>
+
+#include "VoiceRouting.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+
+/// Users per channel, as seen on large public servers
+constexpr unsigned int USERS_PER_CHANNEL = 10;
+/// Every LINK_INTERVAL-th channel is linked to the next one
+constexpr unsigned int LINK_INTERVAL = 8;
+/// Every LISTENER_INTERVAL-th user listens to another channel
+constexpr unsigned int LISTENER_INTERVAL = 16;
+
+/// Fills a snapshot the same way Server::createVoiceRoutingSnapshot does, from state that has been generated upfront
+static std::unique_ptr< VoiceRoutingSnapshot > createSnapshot(unsigned int userCount) {
+	std::mt19937 rng(42);
+	const unsigned int channelCount = std::max(userCount / USERS_PER_CHANNEL, 1U);
+	std::uniform_int_distribution< unsigned int > randomChannel(0, channelCount - 1);
+
+	std::unique_ptr< VoiceRoutingSnapshot > snapshot = std::make_unique< VoiceRoutingSnapshot >();
+
+	snapshot->users.reserve(userCount);
+	for (unsigned int session = 1; session <= userCount; ++session) {
+		VoiceRoutingSnapshot::User &entry = snapshot->users[session];
+
+		entry.user      = nullptr;
+		entry.session   = session;
+		entry.channelID = randomChannel(rng);
+		entry.canSpeak  = session % 4 != 0;
+		entry.deaf      = session % 32 == 0;
+		entry.context   = session % 2 == 0 ? std::string("game") : std::string();
+	}
+
+	snapshot->channels.reserve(channelCount);
+	for (unsigned int id = 0; id < channelCount; ++id) {
+		snapshot->channels[id].id = id;
+	}
+
+	for (auto &current : snapshot->users) {
+		VoiceRoutingSnapshot::User &entry = current.second;
+		if (entry.deaf) {
+			continue;
+		}
+
+		snapshot->channels[entry.channelID].members.push_back(&entry);
+		if (entry.session % LISTENER_INTERVAL == 0) {
+			snapshot->channels[randomChannel(rng)].listeners.push_back({ &entry, VolumeAdjustment::fromFactor(1.0f) });
+		}
+	}
+
+	for (auto &current : snapshot->users) {
+		VoiceRoutingSnapshot::User &entry = current.second;
+
+		if (entry.canSpeak && entry.channelID % LINK_INTERVAL == 0 && entry.channelID + 1 < channelCount) {
+			entry.speakableLinks.push_back(snapshot->findChannel(entry.channelID + 1));
+		}
+	}
+
+	snapshot->createFanOuts();
+
+	return snapshot;
+}
+
+static void BM_RebuildSnapshot(::benchmark::State &state) {
+	const unsigned int userCount = static_cast< unsigned int >(state.range(0));
+
+	for (auto _ : state) {
+		std::unique_ptr< VoiceRoutingSnapshot > snapshot = createSnapshot(userCount);
+		::benchmark::DoNotOptimize(snapshot);
+	}
+
+	state.SetComplexityN(state.range(0));
+}
+
+BENCHMARK(BM_RebuildSnapshot)->RangeMultiplier(4)->Range(64, 16384)->Complexity()->Unit(::benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
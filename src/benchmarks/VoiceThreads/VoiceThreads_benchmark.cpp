@@ -0,0 +1,267 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Load generator for the server's voice plane. A configurable amount of worker threads, each owning its own
+// SO_REUSEPORT socket, decoder and encoder (just like the server's voice threads), receive encrypted audio packets
+// from many simulated clients over the loopback interface. Every packet is decrypted, decoded and then re-encoded
+// and encrypted once for each of its receivers, which is the work the server performs per voice packet.
+
+#include <benchmark/benchmark.h>
+
+#include "MumbleProtocol.h"
+#include "UDPBatch.h"
+#include "crypto/CryptStateOCB2.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+constexpr const std::size_t WORKER_COUNT_RANGE = 0;
+constexpr const std::size_t FAN_OUT_RANGE      = 1;
+
+constexpr unsigned int CLIENT_COUNT = 256;
+constexpr std::size_t PAYLOAD_SIZE  = 100;
+
+/// A simulated client together with the state the server keeps for it
+struct Client {
+	int socket = -1;
+	std::uint16_t port;
+	unsigned int session;
+
+	CryptStateOCB2 clientCrypt;
+	CryptStateOCB2 serverCrypt;
+	/// Mirrors ServerUser::qmCrypt
+	std::mutex serverCryptMutex;
+
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Client > encoder;
+	std::uint64_t frameNumber = 0;
+};
+
+std::vector< std::unique_ptr< Client > > clients;
+/// Maps the source port of a client to the client (the equivalent of Server::qhPeerUsers)
+std::unordered_map< std::uint16_t, Client * > clientsByPort;
+std::vector< Mumble::Protocol::byte > audioPayload(PAYLOAD_SIZE, 42);
+
+void globalInit() {
+	for (unsigned int i = 0; i < CLIENT_COUNT; ++i) {
+		std::unique_ptr< Client > client = std::make_unique< Client >();
+
+		client->session = i + 1;
+		client->serverCrypt.genKey();
+		client->clientCrypt.setKey(client->serverCrypt.getRawKey(), client->serverCrypt.getDecryptIV(),
+								   client->serverCrypt.getEncryptIV());
+		client->encoder.setProtocolVersion(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+		client->socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family      = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		::bind(client->socket, reinterpret_cast< sockaddr * >(&address), sizeof(address));
+		socklen_t addressLength = sizeof(address);
+		getsockname(client->socket, reinterpret_cast< sockaddr * >(&address), &addressLength);
+		client->port = address.sin_port;
+
+		clientsByPort[client->port] = client.get();
+		clients.push_back(std::move(client));
+	}
+}
+
+class VoiceWorker {
+public:
+	VoiceWorker(int socket, unsigned int fanOut, std::atomic< std::uint64_t > &processed)
+		: m_socket(socket), m_fanOut(fanOut), m_processed(processed) {
+		m_decoder.setProtocolVersion(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+		m_encoder.setProtocolVersion(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+		m_thread = std::thread([this]() { run(); });
+	}
+
+	~VoiceWorker() {
+		stop();
+		::close(m_socket);
+	}
+
+	void stop() {
+		m_running = false;
+		if (m_thread.joinable()) {
+			m_thread.join();
+		}
+	}
+
+	/// @returns The amount of packets encrypted for receivers. Only valid once the worker has been stopped.
+	std::uint64_t encodes() const { return m_encodes; }
+
+protected:
+	int m_socket;
+	unsigned int m_fanOut;
+	std::atomic< std::uint64_t > &m_processed;
+	std::atomic< bool > m_running = { true };
+	std::uint64_t m_encodes       = 0;
+	std::thread m_thread;
+
+	UDPReceiveBatch m_receiveBatch;
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_decoder;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_encoder;
+
+	void run() {
+		unsigned char plain[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+		alignas(8) unsigned char encrypted[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+
+		pollfd fd;
+		fd.fd     = m_socket;
+		fd.events = POLLIN;
+
+		while (m_running) {
+			fd.revents = 0;
+			if (poll(&fd, 1, 10) <= 0) {
+				continue;
+			}
+
+			const int batchSize = m_receiveBatch.receive(m_socket);
+			for (int i = 0; i < batchSize; ++i) {
+				const unsigned int index = static_cast< unsigned int >(i);
+				const std::size_t length = m_receiveBatch.length(index);
+				const sockaddr_in &from  = reinterpret_cast< const sockaddr_in & >(m_receiveBatch.address(index));
+
+				auto it = clientsByPort.find(from.sin_port);
+				if (it == clientsByPort.end() || length < 5 || length > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+					continue;
+				}
+				Client &sender = *it->second;
+
+				{
+					std::lock_guard< std::mutex > lock(sender.serverCryptMutex);
+					if (!sender.serverCrypt.decrypt(m_receiveBatch.data(index), plain,
+													static_cast< unsigned int >(length))) {
+						m_processed++;
+						continue;
+					}
+				}
+
+				if (m_decoder.decode(gsl::span< const Mumble::Protocol::byte >(plain, length - 4))
+					&& m_decoder.getMessageType() == Mumble::Protocol::UDPMessageType::Audio) {
+					Mumble::Protocol::AudioData audioData = m_decoder.getAudioData();
+					audioData.senderSession               = sender.session;
+
+					gsl::span< const Mumble::Protocol::byte > encoded = m_encoder.encodeAudioPacket(audioData);
+
+					for (unsigned int k = 1; k <= m_fanOut; ++k) {
+						Client &receiver = *clients[(sender.session + k) % clients.size()];
+
+						std::lock_guard< std::mutex > lock(receiver.serverCryptMutex);
+						receiver.serverCrypt.encrypt(encoded.data(), encrypted + 4,
+													 static_cast< unsigned int >(encoded.size()));
+						m_encodes++;
+					}
+				}
+
+				m_processed++;
+			}
+		}
+	}
+};
+
+static void BM_voicePlane(::benchmark::State &state) {
+	const unsigned int workerCount = static_cast< unsigned int >(state.range(WORKER_COUNT_RANGE));
+	const unsigned int fanOut      = static_cast< unsigned int >(state.range(FAN_OUT_RANGE));
+
+	std::atomic< std::uint64_t > processed(0);
+	std::vector< std::unique_ptr< VoiceWorker > > workers;
+
+	// All workers share the same port, the kernel distributes the clients across their sockets
+	sockaddr_in serverAddress;
+	memset(&serverAddress, 0, sizeof(serverAddress));
+	serverAddress.sin_family      = AF_INET;
+	serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	for (unsigned int i = 0; i < workerCount; ++i) {
+		int sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+
+		int reuse = 1;
+		setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+		int bufferSize = 4 * 1024 * 1024;
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+		if (::bind(sock, reinterpret_cast< sockaddr * >(&serverAddress), sizeof(serverAddress)) != 0) {
+			state.SkipWithError("Failed to bind worker socket");
+			::close(sock);
+			return;
+		}
+		socklen_t addressLength = sizeof(serverAddress);
+		getsockname(sock, reinterpret_cast< sockaddr * >(&serverAddress), &addressLength);
+
+		workers.push_back(std::make_unique< VoiceWorker >(sock, fanOut, processed));
+	}
+
+	Mumble::Protocol::AudioData audioData;
+	audioData.payload         = { audioPayload.data(), audioPayload.size() };
+	audioData.targetOrContext = Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH;
+	audioData.usedCodec       = Mumble::Protocol::AudioCodec::Opus;
+
+	alignas(8) unsigned char encrypted[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+	std::uint64_t sent = 0;
+
+	for (auto _ : state) {
+		// One audio frame from every client
+		for (std::unique_ptr< Client > &client : clients) {
+			audioData.frameNumber = client->frameNumber++;
+
+			gsl::span< const Mumble::Protocol::byte > encoded = client->encoder.encodeAudioPacket(audioData);
+			client->clientCrypt.encrypt(encoded.data(), encrypted + 4, static_cast< unsigned int >(encoded.size()));
+
+			::sendto(client->socket, encrypted + 4, encoded.size() + 4, 0,
+					 reinterpret_cast< sockaddr * >(&serverAddress), sizeof(serverAddress));
+			sent++;
+		}
+
+		// Wait for the workers to catch up (datagrams that got dropped by the kernel are accounted for by the
+		// timeout)
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+		while (processed.load() < sent && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::yield();
+		}
+	}
+
+	std::uint64_t encodes = 0;
+	for (std::unique_ptr< VoiceWorker > &worker : workers) {
+		worker->stop();
+		encodes += worker->encodes();
+	}
+	const std::uint64_t handled = processed.load();
+
+	state.counters["packets"] = ::benchmark::Counter(static_cast< double >(handled), benchmark::Counter::kIsRate);
+	state.counters["encodes"] = ::benchmark::Counter(static_cast< double >(encodes), benchmark::Counter::kIsRate);
+	state.counters["dropped"] = static_cast< double >(sent - std::min(sent, handled));
+}
+
+BENCHMARK(BM_voicePlane)
+	->ArgsProduct({ { 1, 2, 4, 8 }, { 1, 16 } })
+	->UseRealTime()
+	->Unit(benchmark::kMicrosecond);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+
+	for (std::unique_ptr< Client > &client : clients) {
+		::close(client->socket);
+	}
+}
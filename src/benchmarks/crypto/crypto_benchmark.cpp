@@ -0,0 +1,360 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares CryptStateOCB2's batched OCB2-AES128 implementation against the previous implementation, which ran every
+// block through its own EVP_EncryptInit_ex/EVP_EncryptUpdate/EVP_EncryptFinal_ex sequence. Before running the
+// benchmarks, both implementations are checked to produce identical ciphertexts and tags.
+
+#include <benchmark/benchmark.h>
+
+#include "ByteSwap.h"
+#include "crypto/CryptStateChaCha20Poly1305.h"
+#include "crypto/CryptStateOCB2.h"
+
+#include <openssl/evp.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr const std::size_t PACKET_SIZE_RANGE = 0;
+
+constexpr int PACKET_SIZE_BEGIN = 16;
+constexpr int PACKET_SIZE_END   = 1024;
+constexpr int MULTIPLIER        = 2;
+
+/// The block-by-block OCB2 implementation CryptStateOCB2 used before
+class ReferenceOCB2 {
+public:
+	explicit ReferenceOCB2(const unsigned char *key) : m_encCtx(EVP_CIPHER_CTX_new()), m_decCtx(EVP_CIPHER_CTX_new()) {
+		memcpy(m_key, key, AES_KEY_SIZE_BYTES);
+	}
+
+	~ReferenceOCB2() {
+		EVP_CIPHER_CTX_free(m_encCtx);
+		EVP_CIPHER_CTX_free(m_decCtx);
+	}
+
+	void encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len, const unsigned char *nonce,
+				 unsigned char *tag) {
+		Block checksum, delta, tmp, pad;
+
+		aesEncrypt(nonce, delta);
+		zero(checksum);
+
+		while (len > AES_BLOCK_SIZE) {
+			bool flipABit = false;
+			if (len - AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
+				unsigned char sum = 0;
+				for (int i = 0; i < AES_BLOCK_SIZE - 1; ++i) {
+					sum |= plain[i];
+				}
+				flipABit = sum == 0;
+			}
+
+			s2(delta);
+			xorBlock(tmp, delta, reinterpret_cast< const std::uint64_t * >(plain));
+			if (flipABit) {
+				*reinterpret_cast< unsigned char * >(tmp) ^= 1;
+			}
+			aesEncrypt(tmp, tmp);
+			xorBlock(reinterpret_cast< std::uint64_t * >(encrypted), delta, tmp);
+			xorBlock(checksum, checksum, reinterpret_cast< const std::uint64_t * >(plain));
+			if (flipABit) {
+				*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+			}
+
+			len -= AES_BLOCK_SIZE;
+			plain += AES_BLOCK_SIZE;
+			encrypted += AES_BLOCK_SIZE;
+		}
+
+		s2(delta);
+		zero(tmp);
+		tmp[1] = SWAP64(static_cast< std::uint64_t >(len * 8));
+		xorBlock(tmp, tmp, delta);
+		aesEncrypt(tmp, pad);
+		memcpy(tmp, plain, len);
+		memcpy(reinterpret_cast< unsigned char * >(tmp) + len, reinterpret_cast< const unsigned char * >(pad) + len,
+			   AES_BLOCK_SIZE - len);
+		xorBlock(checksum, checksum, tmp);
+		xorBlock(tmp, pad, tmp);
+		memcpy(encrypted, tmp, len);
+
+		s3(delta);
+		xorBlock(tmp, delta, checksum);
+		aesEncrypt(tmp, tag);
+	}
+
+	void decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce,
+				 unsigned char *tag) {
+		Block checksum, delta, tmp, pad;
+
+		aesEncrypt(nonce, delta);
+		zero(checksum);
+
+		while (len > AES_BLOCK_SIZE) {
+			s2(delta);
+			xorBlock(tmp, delta, reinterpret_cast< const std::uint64_t * >(encrypted));
+			aesDecrypt(tmp, tmp);
+			xorBlock(reinterpret_cast< std::uint64_t * >(plain), delta, tmp);
+			xorBlock(checksum, checksum, reinterpret_cast< const std::uint64_t * >(plain));
+			len -= AES_BLOCK_SIZE;
+			plain += AES_BLOCK_SIZE;
+			encrypted += AES_BLOCK_SIZE;
+		}
+
+		s2(delta);
+		zero(tmp);
+		tmp[1] = SWAP64(static_cast< std::uint64_t >(len * 8));
+		xorBlock(tmp, tmp, delta);
+		aesEncrypt(tmp, pad);
+		memset(tmp, 0, AES_BLOCK_SIZE);
+		memcpy(tmp, encrypted, len);
+		xorBlock(tmp, tmp, pad);
+		xorBlock(checksum, checksum, tmp);
+		memcpy(plain, tmp, len);
+
+		s3(delta);
+		xorBlock(tmp, delta, checksum);
+		aesEncrypt(tmp, tag);
+	}
+
+protected:
+	using Block = std::uint64_t[2];
+
+	unsigned char m_key[AES_KEY_SIZE_BYTES];
+	EVP_CIPHER_CTX *m_encCtx;
+	EVP_CIPHER_CTX *m_decCtx;
+
+	static void zero(Block &block) { block[0] = block[1] = 0; }
+
+	static void xorBlock(std::uint64_t *dst, const std::uint64_t *a, const std::uint64_t *b) {
+		dst[0] = a[0] ^ b[0];
+		dst[1] = a[1] ^ b[1];
+	}
+
+	static void s2(std::uint64_t *block) {
+		const std::uint64_t carry = SWAP64(block[0]) >> 63;
+		block[0]                  = SWAP64((SWAP64(block[0]) << 1) | (SWAP64(block[1]) >> 63));
+		block[1]                  = SWAP64((SWAP64(block[1]) << 1) ^ (carry * 0x87));
+	}
+
+	static void s3(std::uint64_t *block) {
+		const std::uint64_t carry = SWAP64(block[0]) >> 63;
+		block[0] ^= SWAP64((SWAP64(block[0]) << 1) | (SWAP64(block[1]) >> 63));
+		block[1] ^= SWAP64((SWAP64(block[1]) << 1) ^ (carry * 0x87));
+	}
+
+	void aesEncrypt(const void *src, void *dst) {
+		int outlen = 0;
+		EVP_EncryptInit_ex(m_encCtx, EVP_aes_128_ecb(), NULL, m_key, NULL);
+		EVP_CIPHER_CTX_set_padding(m_encCtx, 0);
+		EVP_EncryptUpdate(m_encCtx, reinterpret_cast< unsigned char * >(dst), &outlen,
+						  reinterpret_cast< const unsigned char * >(src), AES_BLOCK_SIZE);
+		EVP_EncryptFinal_ex(m_encCtx, reinterpret_cast< unsigned char * >(dst) + outlen, &outlen);
+	}
+
+	void aesDecrypt(const void *src, void *dst) {
+		int outlen = 0;
+		EVP_DecryptInit_ex(m_decCtx, EVP_aes_128_ecb(), NULL, m_key, NULL);
+		EVP_CIPHER_CTX_set_padding(m_decCtx, 0);
+		EVP_DecryptUpdate(m_decCtx, reinterpret_cast< unsigned char * >(dst), &outlen,
+						  reinterpret_cast< const unsigned char * >(src), AES_BLOCK_SIZE);
+		EVP_DecryptFinal_ex(m_decCtx, reinterpret_cast< unsigned char * >(dst) + outlen, &outlen);
+	}
+};
+
+unsigned char key[AES_KEY_SIZE_BYTES];
+unsigned char nonce[AES_BLOCK_SIZE];
+std::vector< unsigned char > plainText;
+
+void globalInit() {
+	std::mt19937 rng(42);
+	std::uniform_int_distribution< int > randomByte(0, 255);
+
+	for (unsigned char &current : key) {
+		current = static_cast< unsigned char >(randomByte(rng));
+	}
+	for (unsigned char &current : nonce) {
+		current = static_cast< unsigned char >(randomByte(rng));
+	}
+
+	plainText.resize(PACKET_SIZE_END);
+	for (unsigned char &current : plainText) {
+		current = static_cast< unsigned char >(randomByte(rng));
+	}
+}
+
+CryptStateOCB2 &createCryptState(CryptStateOCB2 &state) {
+	const std::string keyString(reinterpret_cast< const char * >(key), AES_KEY_SIZE_BYTES);
+	const std::string ivString(reinterpret_cast< const char * >(nonce), AES_BLOCK_SIZE);
+	state.setKey(keyString, ivString, ivString);
+
+	return state;
+}
+
+bool implementationsMatch() {
+	CryptStateOCB2 state;
+	createCryptState(state);
+	ReferenceOCB2 reference(key);
+
+	std::vector< unsigned char > input(PACKET_SIZE_END + 100);
+	std::vector< unsigned char > expected(input.size());
+	std::vector< unsigned char > actual(input.size());
+	unsigned char expectedTag[AES_BLOCK_SIZE];
+	unsigned char actualTag[AES_BLOCK_SIZE];
+
+	for (unsigned int len = 0; len <= input.size(); ++len) {
+		for (unsigned int i = 0; i < len; ++i) {
+			// Include some all-zero blocks to exercise the XEX* countermeasure
+			input[i] = (len % 3 == 0) ? 0 : static_cast< unsigned char >(i * 7 + len);
+		}
+
+		reference.encrypt(input.data(), expected.data(), len, nonce, expectedTag);
+		state.ocb_encrypt(input.data(), actual.data(), len, nonce, actualTag);
+
+		if (memcmp(expected.data(), actual.data(), len) != 0 || memcmp(expectedTag, actualTag, AES_BLOCK_SIZE) != 0) {
+			std::fprintf(stderr, "Encryption mismatch for %u bytes\n", len);
+			return false;
+		}
+
+		reference.decrypt(expected.data(), expected.data(), len, nonce, expectedTag);
+		state.ocb_decrypt(actual.data(), actual.data(), len, nonce, actualTag);
+
+		if (memcmp(expected.data(), actual.data(), len) != 0 || memcmp(expectedTag, actualTag, AES_BLOCK_SIZE) != 0) {
+			std::fprintf(stderr, "Decryption mismatch for %u bytes\n", len);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+static void BM_encrypt_reference(::benchmark::State &state) {
+	ReferenceOCB2 reference(key);
+	const unsigned int len = static_cast< unsigned int >(state.range(PACKET_SIZE_RANGE));
+	std::vector< unsigned char > encrypted(len);
+	unsigned char tag[AES_BLOCK_SIZE];
+
+	for (auto _ : state) {
+		reference.encrypt(plainText.data(), encrypted.data(), len, nonce, tag);
+		benchmark::DoNotOptimize(encrypted.data());
+		benchmark::DoNotOptimize(tag);
+	}
+
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations()) * len);
+}
+
+BENCHMARK(BM_encrypt_reference)->RangeMultiplier(MULTIPLIER)->Range(PACKET_SIZE_BEGIN, PACKET_SIZE_END);
+
+
+static void BM_encrypt(::benchmark::State &state) {
+	CryptStateOCB2 cryptState;
+	createCryptState(cryptState);
+	const unsigned int len = static_cast< unsigned int >(state.range(PACKET_SIZE_RANGE));
+	std::vector< unsigned char > encrypted(len);
+	unsigned char tag[AES_BLOCK_SIZE];
+
+	for (auto _ : state) {
+		cryptState.ocb_encrypt(plainText.data(), encrypted.data(), len, nonce, tag);
+		benchmark::DoNotOptimize(encrypted.data());
+		benchmark::DoNotOptimize(tag);
+	}
+
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations()) * len);
+}
+
+BENCHMARK(BM_encrypt)->RangeMultiplier(MULTIPLIER)->Range(PACKET_SIZE_BEGIN, PACKET_SIZE_END);
+
+
+static void BM_decrypt_reference(::benchmark::State &state) {
+	ReferenceOCB2 reference(key);
+	const unsigned int len = static_cast< unsigned int >(state.range(PACKET_SIZE_RANGE));
+	std::vector< unsigned char > encrypted(len);
+	std::vector< unsigned char > decrypted(len);
+	unsigned char tag[AES_BLOCK_SIZE];
+
+	reference.encrypt(plainText.data(), encrypted.data(), len, nonce, tag);
+
+	for (auto _ : state) {
+		reference.decrypt(encrypted.data(), decrypted.data(), len, nonce, tag);
+		benchmark::DoNotOptimize(decrypted.data());
+		benchmark::DoNotOptimize(tag);
+	}
+
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations()) * len);
+}
+
+BENCHMARK(BM_decrypt_reference)->RangeMultiplier(MULTIPLIER)->Range(PACKET_SIZE_BEGIN, PACKET_SIZE_END);
+
+
+static void BM_decrypt(::benchmark::State &state) {
+	CryptStateOCB2 cryptState;
+	createCryptState(cryptState);
+	const unsigned int len = static_cast< unsigned int >(state.range(PACKET_SIZE_RANGE));
+	std::vector< unsigned char > encrypted(len);
+	std::vector< unsigned char > decrypted(len);
+	unsigned char tag[AES_BLOCK_SIZE];
+
+	cryptState.ocb_encrypt(plainText.data(), encrypted.data(), len, nonce, tag);
+
+	for (auto _ : state) {
+		cryptState.ocb_decrypt(encrypted.data(), decrypted.data(), len, nonce, tag);
+		benchmark::DoNotOptimize(decrypted.data());
+		benchmark::DoNotOptimize(tag);
+	}
+
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations()) * len);
+}
+
+BENCHMARK(BM_decrypt)->RangeMultiplier(MULTIPLIER)->Range(PACKET_SIZE_BEGIN, PACKET_SIZE_END);
+
+
+/// Encrypts and decrypts whole voice packets (including IV handling) with the given cipher mode
+template< typename CryptStateImpl > static void BM_packetRoundTrip(::benchmark::State &state) {
+	CryptStateImpl sender;
+	CryptStateImpl receiver;
+	sender.genKey();
+	receiver.setKey(sender.getRawKey(), sender.getDecryptIV(), sender.getEncryptIV());
+
+	const unsigned int len = static_cast< unsigned int >(state.range(PACKET_SIZE_RANGE));
+	std::vector< unsigned char > encrypted(len + 4);
+	std::vector< unsigned char > decrypted(len);
+
+	for (auto _ : state) {
+		sender.encrypt(plainText.data(), encrypted.data(), len);
+		if (!receiver.decrypt(encrypted.data(), decrypted.data(), len + 4)) {
+			state.SkipWithError("Decryption failed");
+			break;
+		}
+		benchmark::DoNotOptimize(decrypted.data());
+	}
+
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations()) * len);
+}
+
+BENCHMARK_TEMPLATE(BM_packetRoundTrip, CryptStateOCB2)
+	->RangeMultiplier(MULTIPLIER)
+	->Range(PACKET_SIZE_BEGIN, PACKET_SIZE_END);
+BENCHMARK_TEMPLATE(BM_packetRoundTrip, CryptStateChaCha20Poly1305)
+	->RangeMultiplier(MULTIPLIER)
+	->Range(PACKET_SIZE_BEGIN, PACKET_SIZE_END);
+
+
+int main(int argc, char **argv) {
+	globalInit();
+
+	if (!implementationsMatch()) {
+		return 1;
+	}
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,100 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CryptState.h"
+
+#include <cstdlib>
+
+void CryptState::incrementEncryptIV(unsigned char *encrypt_iv) {
+	for (unsigned int i = 0; i < IV_SIZE; i++)
+		if (++encrypt_iv[i])
+			break;
+}
+
+bool CryptState::advanceDecryptIV(unsigned char *decrypt_iv, const unsigned char *decrypt_history,
+								  unsigned char ivbyte, DecryptIVUpdate &update) {
+	if (((decrypt_iv[0] + 1) & 0xFF) == ivbyte) {
+		// In order as expected.
+		if (ivbyte > decrypt_iv[0]) {
+			decrypt_iv[0] = ivbyte;
+		} else if (ivbyte < decrypt_iv[0]) {
+			decrypt_iv[0] = ivbyte;
+			for (unsigned int i = 1; i < IV_SIZE; i++)
+				if (++decrypt_iv[i])
+					break;
+		} else {
+			return false;
+		}
+
+		return true;
+	}
+
+	// This is either out of order or a repeat.
+	unsigned char saveiv[IV_SIZE];
+	for (unsigned int i = 0; i < IV_SIZE; i++)
+		saveiv[i] = decrypt_iv[i];
+
+	int diff = ivbyte - decrypt_iv[0];
+	if (diff > 128)
+		diff = diff - 256;
+	else if (diff < -128)
+		diff = diff + 256;
+
+	if ((ivbyte < decrypt_iv[0]) && (diff > -30) && (diff < 0)) {
+		// Late packet, but no wraparound.
+		update.late    = 1;
+		update.lost    = -1;
+		decrypt_iv[0]  = ivbyte;
+		update.restore = true;
+	} else if ((ivbyte > decrypt_iv[0]) && (diff > -30) && (diff < 0)) {
+		// Last was 0x02, here comes 0xff from last round
+		update.late   = 1;
+		update.lost   = -1;
+		decrypt_iv[0] = ivbyte;
+		for (unsigned int i = 1; i < IV_SIZE; i++)
+			if (decrypt_iv[i]--)
+				break;
+		update.restore = true;
+	} else if ((ivbyte > decrypt_iv[0]) && (diff > 0)) {
+		// Lost a few packets, but beyond that we're good.
+		update.lost   = ivbyte - decrypt_iv[0] - 1;
+		decrypt_iv[0] = ivbyte;
+	} else if ((ivbyte < decrypt_iv[0]) && (diff > 0)) {
+		// Lost a few packets, and wrapped around
+		update.lost   = 256 - decrypt_iv[0] + ivbyte - 1;
+		decrypt_iv[0] = ivbyte;
+		for (unsigned int i = 1; i < IV_SIZE; i++)
+			if (++decrypt_iv[i])
+				break;
+	} else {
+		return false;
+	}
+
+	if (decrypt_history[decrypt_iv[0]] == decrypt_iv[1]) {
+		for (unsigned int i = 0; i < IV_SIZE; i++)
+			decrypt_iv[i] = saveiv[i];
+		return false;
+	}
+
+	return true;
+}
+
+void CryptState::countGoodPacket(const DecryptIVUpdate &update) {
+	uiGood++;
+	// uiLate += late, but we have to make sure we don't cause wrap-arounds on the unsigned lhs
+	if (update.late > 0) {
+		uiLate += static_cast< unsigned int >(update.late);
+	} else if (static_cast< int >(uiLate) > std::abs(update.late)) {
+		uiLate -= static_cast< unsigned int >(std::abs(update.late));
+	}
+	// uiLost += lost, but we have to make sure we don't cause wrap-arounds on the unsigned lhs
+	if (update.lost > 0) {
+		uiLost += static_cast< unsigned int >(update.lost);
+	} else if (static_cast< int >(uiLost) > std::abs(update.lost)) {
+		uiLost -= static_cast< unsigned int >(std::abs(update.lost));
+	}
+
+	tLastGood.restart();
+}
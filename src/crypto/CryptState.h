@@ -41,6 +41,29 @@ public:
 
 	virtual bool decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) = 0;
 	virtual bool encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length)   = 0;
+
+protected:
+	/// The size of the IVs exchanged via CryptSetup. Only the first byte of the IV is sent along with every packet.
+	static constexpr const unsigned int IV_SIZE = 16;
+
+	/// Describes how CryptState::advanceDecryptIV has changed the decrypt IV
+	struct DecryptIVUpdate {
+		/// Whether the packet arrived late and the IV has to be restored once the packet has been decrypted
+		bool restore = false;
+		int lost     = 0;
+		int late     = 0;
+	};
+
+	/// Increments the given encrypt IV for the next packet
+	static void incrementEncryptIV(unsigned char *encrypt_iv);
+	/// Moves the given decrypt IV to the IV of a packet whose IV starts with the given byte, taking lost, late and
+	/// repeated packets into account.
+	///
+	/// @returns Whether the packet may be decrypted. If not, the decrypt IV is left unchanged.
+	static bool advanceDecryptIV(unsigned char *decrypt_iv, const unsigned char *decrypt_history, unsigned char ivbyte,
+								 DecryptIVUpdate &update);
+	/// Updates the packet statistics after a packet has been decrypted successfully
+	void countGoodPacket(const DecryptIVUpdate &update);
 };
 
 
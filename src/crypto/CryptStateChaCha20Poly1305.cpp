@@ -0,0 +1,139 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CryptStateChaCha20Poly1305.h"
+#include "CryptographicRandom.h"
+
+#include <cstring>
+
+CryptStateChaCha20Poly1305::CryptStateChaCha20Poly1305()
+	: CryptState(), enc_ctx(EVP_CIPHER_CTX_new()), dec_ctx(EVP_CIPHER_CTX_new()) {
+	memset(decrypt_history, 0, sizeof(decrypt_history));
+	memset(raw_key, 0, KEY_SIZE);
+	memset(encrypt_iv, 0, IV_SIZE);
+	memset(decrypt_iv, 0, IV_SIZE);
+
+	// Select the cipher once, every packet only sets the key and nonce
+	EVP_EncryptInit_ex(enc_ctx, EVP_chacha20_poly1305(), NULL, NULL, NULL);
+	EVP_DecryptInit_ex(dec_ctx, EVP_chacha20_poly1305(), NULL, NULL, NULL);
+}
+
+CryptStateChaCha20Poly1305::~CryptStateChaCha20Poly1305() noexcept {
+	EVP_CIPHER_CTX_free(enc_ctx);
+	EVP_CIPHER_CTX_free(dec_ctx);
+}
+
+bool CryptStateChaCha20Poly1305::isValid() const {
+	return bInit;
+}
+
+void CryptStateChaCha20Poly1305::genKey() {
+	CryptographicRandom::fillBuffer(raw_key, KEY_SIZE);
+	CryptographicRandom::fillBuffer(encrypt_iv, IV_SIZE);
+	CryptographicRandom::fillBuffer(decrypt_iv, IV_SIZE);
+	bInit = true;
+}
+
+bool CryptStateChaCha20Poly1305::setKey(const std::string &rkey, const std::string &eiv, const std::string &div) {
+	if (rkey.length() == KEY_SIZE && eiv.length() == IV_SIZE && div.length() == IV_SIZE) {
+		memcpy(raw_key, rkey.data(), KEY_SIZE);
+		memcpy(encrypt_iv, eiv.data(), IV_SIZE);
+		memcpy(decrypt_iv, div.data(), IV_SIZE);
+		bInit = true;
+		return true;
+	}
+	return false;
+}
+
+bool CryptStateChaCha20Poly1305::setRawKey(const std::string &rkey) {
+	if (rkey.length() == KEY_SIZE) {
+		memcpy(raw_key, rkey.data(), KEY_SIZE);
+		return true;
+	}
+	return false;
+}
+
+bool CryptStateChaCha20Poly1305::setEncryptIV(const std::string &iv) {
+	if (iv.length() == IV_SIZE) {
+		memcpy(encrypt_iv, iv.data(), IV_SIZE);
+		return true;
+	}
+	return false;
+}
+
+bool CryptStateChaCha20Poly1305::setDecryptIV(const std::string &iv) {
+	if (iv.length() == IV_SIZE) {
+		memcpy(decrypt_iv, iv.data(), IV_SIZE);
+		return true;
+	}
+	return false;
+}
+
+std::string CryptStateChaCha20Poly1305::getRawKey() {
+	return std::string(reinterpret_cast< const char * >(raw_key), KEY_SIZE);
+}
+
+std::string CryptStateChaCha20Poly1305::getEncryptIV() {
+	return std::string(reinterpret_cast< const char * >(encrypt_iv), IV_SIZE);
+}
+
+std::string CryptStateChaCha20Poly1305::getDecryptIV() {
+	return std::string(reinterpret_cast< const char * >(decrypt_iv), IV_SIZE);
+}
+
+bool CryptStateChaCha20Poly1305::encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length) {
+	unsigned char tag[16];
+	int outlen = 0;
+
+	incrementEncryptIV(encrypt_iv);
+
+	if (EVP_EncryptInit_ex(enc_ctx, NULL, NULL, raw_key, encrypt_iv) != 1
+		|| EVP_EncryptUpdate(enc_ctx, dst + 4, &outlen, source, static_cast< int >(plain_length)) != 1
+		|| EVP_EncryptFinal_ex(enc_ctx, dst + 4 + outlen, &outlen) != 1
+		|| EVP_CIPHER_CTX_ctrl(enc_ctx, EVP_CTRL_AEAD_GET_TAG, sizeof(tag), tag) != 1) {
+		return false;
+	}
+
+	dst[0] = encrypt_iv[0];
+	dst[1] = tag[0];
+	dst[2] = tag[1];
+	dst[3] = tag[2];
+	return true;
+}
+
+bool CryptStateChaCha20Poly1305::decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) {
+	if (crypted_length < 4)
+		return false;
+
+	unsigned int plain_length = crypted_length - 4;
+
+	unsigned char saveiv[IV_SIZE];
+	unsigned char tag[TAG_SIZE];
+	DecryptIVUpdate update;
+	int outlen = 0;
+
+	memcpy(saveiv, decrypt_iv, IV_SIZE);
+	memcpy(tag, source + 1, TAG_SIZE);
+
+	if (!advanceDecryptIV(decrypt_iv, decrypt_history, source[0], update)) {
+		return false;
+	}
+
+	// OpenSSL only compares as many bytes of the tag as it has been given
+	if (EVP_DecryptInit_ex(dec_ctx, NULL, NULL, raw_key, decrypt_iv) != 1
+		|| EVP_CIPHER_CTX_ctrl(dec_ctx, EVP_CTRL_AEAD_SET_TAG, TAG_SIZE, tag) != 1
+		|| EVP_DecryptUpdate(dec_ctx, dst, &outlen, source + 4, static_cast< int >(plain_length)) != 1
+		|| EVP_DecryptFinal_ex(dec_ctx, dst + outlen, &outlen) != 1) {
+		memcpy(decrypt_iv, saveiv, IV_SIZE);
+		return false;
+	}
+	decrypt_history[decrypt_iv[0]] = decrypt_iv[1];
+
+	if (update.restore)
+		memcpy(decrypt_iv, saveiv, IV_SIZE);
+
+	countGoodPacket(update);
+	return true;
+}
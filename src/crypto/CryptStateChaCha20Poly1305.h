@@ -0,0 +1,54 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_CRYPTSTATECHACHA20POLY1305_H
+#define MUMBLE_CRYPTSTATECHACHA20POLY1305_H
+
+#include "CryptState.h"
+
+#include <openssl/evp.h>
+
+/// Encrypts voice packets using the ChaCha20-Poly1305 AEAD (RFC 8439) as provided by OpenSSL.
+///
+/// Packets have the same layout as the ones produced by CryptStateOCB2: the first byte of the IV followed by the
+/// first 3 bytes of the authentication tag and the ciphertext. The IVs are handled in the same way as well, the
+/// nonce passed to the cipher consists of the first 12 bytes of the IV.
+///
+/// Unlike GCM, Poly1305 does not lose more than the removed bits of security when its tag is truncated, which is why
+/// this is the AEAD offered by the server.
+class CryptStateChaCha20Poly1305 : public CryptState {
+public:
+	static constexpr const unsigned int KEY_SIZE   = 32;
+	static constexpr const unsigned int NONCE_SIZE = 12;
+	static constexpr const unsigned int TAG_SIZE   = 3;
+
+	CryptStateChaCha20Poly1305();
+	~CryptStateChaCha20Poly1305() noexcept override;
+
+	virtual bool isValid() const Q_DECL_OVERRIDE;
+	virtual void genKey() Q_DECL_OVERRIDE;
+	virtual bool setKey(const std::string &rkey, const std::string &eiv, const std::string &div) Q_DECL_OVERRIDE;
+	virtual bool setRawKey(const std::string &rkey) Q_DECL_OVERRIDE;
+	virtual bool setEncryptIV(const std::string &iv) Q_DECL_OVERRIDE;
+	virtual bool setDecryptIV(const std::string &iv) Q_DECL_OVERRIDE;
+	virtual std::string getRawKey() Q_DECL_OVERRIDE;
+	virtual std::string getEncryptIV() Q_DECL_OVERRIDE;
+	virtual std::string getDecryptIV() Q_DECL_OVERRIDE;
+
+	virtual bool decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) Q_DECL_OVERRIDE;
+	virtual bool encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length) Q_DECL_OVERRIDE;
+
+private:
+	unsigned char raw_key[KEY_SIZE];
+	unsigned char encrypt_iv[IV_SIZE];
+	unsigned char decrypt_iv[IV_SIZE];
+	unsigned char decrypt_history[0x100];
+
+	EVP_CIPHER_CTX *enc_ctx;
+	EVP_CIPHER_CTX *dec_ctx;
+};
+
+
+#endif // MUMBLE_CRYPTSTATECHACHA20POLY1305_H
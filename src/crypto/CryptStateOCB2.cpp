@@ -25,6 +25,7 @@
 #include "CryptStateOCB2.h"
 #include "CryptographicRandom.h"
 
+#include <algorithm>
 #include <cstring>
 #include <openssl/rand.h>
 
@@ -107,9 +108,7 @@ bool CryptStateOCB2::encrypt(const unsigned char *source, unsigned char *dst, un
 	unsigned char tag[AES_BLOCK_SIZE];
 
 	// First, increase our IV.
-	for (int i = 0; i < AES_BLOCK_SIZE; i++)
-		if (++encrypt_iv[i])
-			break;
+	incrementEncryptIV(encrypt_iv);
 
 	if (!ocb_encrypt(source, dst + 4, plain_length, encrypt_iv, tag)) {
 		return false;
@@ -129,70 +128,13 @@ bool CryptStateOCB2::decrypt(const unsigned char *source, unsigned char *dst, un
 	unsigned int plain_length = crypted_length - 4;
 
 	unsigned char saveiv[AES_BLOCK_SIZE];
-	unsigned char ivbyte = source[0];
-	bool restore         = false;
 	unsigned char tag[AES_BLOCK_SIZE];
-
-	int lost = 0;
-	int late = 0;
+	DecryptIVUpdate update;
 
 	memcpy(saveiv, decrypt_iv, AES_BLOCK_SIZE);
 
-	if (((decrypt_iv[0] + 1) & 0xFF) == ivbyte) {
-		// In order as expected.
-		if (ivbyte > decrypt_iv[0]) {
-			decrypt_iv[0] = ivbyte;
-		} else if (ivbyte < decrypt_iv[0]) {
-			decrypt_iv[0] = ivbyte;
-			for (int i = 1; i < AES_BLOCK_SIZE; i++)
-				if (++decrypt_iv[i])
-					break;
-		} else {
-			return false;
-		}
-	} else {
-		// This is either out of order or a repeat.
-
-		int diff = ivbyte - decrypt_iv[0];
-		if (diff > 128)
-			diff = diff - 256;
-		else if (diff < -128)
-			diff = diff + 256;
-
-		if ((ivbyte < decrypt_iv[0]) && (diff > -30) && (diff < 0)) {
-			// Late packet, but no wraparound.
-			late          = 1;
-			lost          = -1;
-			decrypt_iv[0] = ivbyte;
-			restore       = true;
-		} else if ((ivbyte > decrypt_iv[0]) && (diff > -30) && (diff < 0)) {
-			// Last was 0x02, here comes 0xff from last round
-			late          = 1;
-			lost          = -1;
-			decrypt_iv[0] = ivbyte;
-			for (int i = 1; i < AES_BLOCK_SIZE; i++)
-				if (decrypt_iv[i]--)
-					break;
-			restore = true;
-		} else if ((ivbyte > decrypt_iv[0]) && (diff > 0)) {
-			// Lost a few packets, but beyond that we're good.
-			lost          = ivbyte - decrypt_iv[0] - 1;
-			decrypt_iv[0] = ivbyte;
-		} else if ((ivbyte < decrypt_iv[0]) && (diff > 0)) {
-			// Lost a few packets, and wrapped around
-			lost          = 256 - decrypt_iv[0] + ivbyte - 1;
-			decrypt_iv[0] = ivbyte;
-			for (int i = 1; i < AES_BLOCK_SIZE; i++)
-				if (++decrypt_iv[i])
-					break;
-		} else {
-			return false;
-		}
-
-		if (decrypt_history[decrypt_iv[0]] == decrypt_iv[1]) {
-			memcpy(decrypt_iv, saveiv, AES_BLOCK_SIZE);
-			return false;
-		}
+	if (!advanceDecryptIV(decrypt_iv, decrypt_history, source[0], update)) {
+		return false;
 	}
 
 	bool ocb_success = ocb_decrypt(source + 4, dst, plain_length, decrypt_iv, tag);
@@ -203,24 +145,10 @@ bool CryptStateOCB2::decrypt(const unsigned char *source, unsigned char *dst, un
 	}
 	decrypt_history[decrypt_iv[0]] = decrypt_iv[1];
 
-	if (restore)
+	if (update.restore)
 		memcpy(decrypt_iv, saveiv, AES_BLOCK_SIZE);
 
-	uiGood++;
-	// uiLate += late, but we have to make sure we don't cause wrap-arounds on the unsigned lhs
-	if (late > 0) {
-		uiLate += static_cast< unsigned int >(late);
-	} else if (static_cast< int >(uiLate) > std::abs(late)) {
-		uiLate -= static_cast< unsigned int >(std::abs(late));
-	}
-	// uiLost += lost, but we have to make sure we don't cause wrap-arounds on the unsigned lhs
-	if (lost > 0) {
-		uiLost += static_cast< unsigned int >(lost);
-	} else if (static_cast< int >(uiLost) > std::abs(lost)) {
-		uiLost -= static_cast< unsigned int >(std::abs(lost));
-	}
-
-	tLastGood.restart();
+	countGoodPacket(update);
 	return true;
 }
 
@@ -269,83 +197,107 @@ static void inline ZERO(keyblock &block) {
 		block[i] = 0;
 }
 
-#define AESencrypt_ctx(src, dst, key, enc_ctx)                                                      \
-	{                                                                                               \
-		int outlen = 0;                                                                             \
-		EVP_EncryptInit_ex(enc_ctx, EVP_aes_128_ecb(), NULL, key, NULL);                            \
-		EVP_CIPHER_CTX_set_padding(enc_ctx, 0);                                                     \
-		EVP_EncryptUpdate(enc_ctx, reinterpret_cast< unsigned char * >(dst), &outlen,               \
-						  reinterpret_cast< const unsigned char * >(src), AES_BLOCK_SIZE);          \
-		EVP_EncryptFinal_ex(enc_ctx, reinterpret_cast< unsigned char * >((dst) + outlen), &outlen); \
-	}
-#define AESdecrypt_ctx(src, dst, key, dec_ctx)                                                      \
-	{                                                                                               \
-		int outlen = 0;                                                                             \
-		EVP_DecryptInit_ex(dec_ctx, EVP_aes_128_ecb(), NULL, key, NULL);                            \
-		EVP_CIPHER_CTX_set_padding(dec_ctx, 0);                                                     \
-		EVP_DecryptUpdate(dec_ctx, reinterpret_cast< unsigned char * >(dst), &outlen,               \
-						  reinterpret_cast< const unsigned char * >(src), AES_BLOCK_SIZE);          \
-		EVP_DecryptFinal_ex(dec_ctx, reinterpret_cast< unsigned char * >((dst) + outlen), &outlen); \
+/// XORs the given amount of consecutive blocks. Operating on whole batches lets the compiler vectorize the loop.
+static void inline XORBlocks(subblock *dst, const subblock *a, const subblock *b, unsigned int blocks) {
+	for (unsigned int i = 0; i < blocks * BLOCKSIZE; i++) {
+		dst[i] = a[i] ^ b[i];
 	}
+}
+
+/// The maximum amount of blocks passed to OpenSSL at once. Regular voice packets fit into a single batch.
+static constexpr unsigned int OCB_BATCH_BLOCKS = 64;
+
+static void inline AESinit(EVP_CIPHER_CTX *ctx, const unsigned char *key, bool encrypt) {
+	EVP_CipherInit_ex(ctx, EVP_aes_128_ecb(), NULL, key, NULL, encrypt ? 1 : 0);
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+}
+
+/// Runs AES-ECB over the given amount of blocks. The context must have been set up by AESinit. As there is no
+/// padding, all blocks are processed by the update call and there is nothing left to finalize.
+static void inline AESblocks(EVP_CIPHER_CTX *ctx, const void *src, void *dst, unsigned int blocks) {
+	int outlen = 0;
+	EVP_CipherUpdate(ctx, reinterpret_cast< unsigned char * >(dst), &outlen,
+					 reinterpret_cast< const unsigned char * >(src), static_cast< int >(blocks * AES_BLOCK_SIZE));
+}
 
-#define AESencrypt(src, dst, key) AESencrypt_ctx(src, dst, key, enc_ctx_ocb_enc)
-#define AESdecrypt(src, dst, key) AESdecrypt_ctx(src, dst, key, dec_ctx_ocb_enc)
+// Both functions compute the offsets (delta) of as many blocks as fit into a batch up front, such that all of
+// these blocks can be run through AES in a single call. That way OpenSSL can pipeline the blocks (e.g. using
+// AES-NI) instead of setting up the key schedule for every single block. The result is the same as processing
+// the blocks one by one.
 
 bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack) {
 	keyblock checksum, delta, tmp, pad;
+	keyblock deltas[OCB_BATCH_BLOCKS];
+	// One additional block for the pad of the final (partial) block
+	keyblock blocks[OCB_BATCH_BLOCKS + 1];
 	bool success = true;
 
 	// Initialize
-	AESencrypt(nonce, delta, raw_key);
+	AESinit(enc_ctx_ocb_enc, raw_key, true);
+	AESblocks(enc_ctx_ocb_enc, nonce, delta, 1);
 	ZERO(checksum);
 
-	while (len > AES_BLOCK_SIZE) {
-		// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
-		// For an attack, the second to last block (i.e. the last iteration of this loop)
-		// must be all 0 except for the last byte (which may be 0 - 128).
-		bool flipABit = false; // *plain is const, so we can't directly modify it
-		if (len - AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
-			unsigned char sum = 0;
-			for (int i = 0; i < AES_BLOCK_SIZE - 1; ++i) {
-				sum |= plain[i];
-			}
-			if (sum == 0) {
-				if (modifyPlainOnXEXStarAttack) {
-					// The assumption that critical packets do not turn up by pure chance turned out to be incorrect
-					// since digital silence appears to produce them in mass.
-					// So instead we now modify the packet in a way which should not affect the audio but will
-					// prevent the attack.
-					flipABit = true;
-				} else {
-					// This option still exists but only to allow us to test ocb_decrypt's detection.
-					success = false;
+	// All blocks but the last one (which may or may not be a full block)
+	unsigned int remainingBlocks = len > 0 ? (len - 1) / AES_BLOCK_SIZE : 0;
+	len -= remainingBlocks * AES_BLOCK_SIZE;
+
+	bool lastBatch = false;
+	unsigned int count;
+	do {
+		count     = std::min(remainingBlocks, OCB_BATCH_BLOCKS);
+		lastBatch = count == remainingBlocks;
+
+		for (unsigned int i = 0; i < count; i++) {
+			S2(delta);
+			memcpy(deltas[i], delta, AES_BLOCK_SIZE);
+		}
+		XORBlocks(blocks[0], deltas[0], reinterpret_cast< const subblock * >(plain), count);
+		for (unsigned int i = 0; i < count; i++) {
+			XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain + i * AES_BLOCK_SIZE));
+		}
+
+		if (lastBatch) {
+			if (count > 0) {
+				// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
+				// For an attack, the second to last block must be all 0 except for the last byte (which may be
+				// 0 - 128).
+				const unsigned char *critical = plain + (count - 1) * AES_BLOCK_SIZE;
+				unsigned char sum             = 0;
+				for (int i = 0; i < AES_BLOCK_SIZE - 1; ++i) {
+					sum |= critical[i];
+				}
+				if (sum == 0) {
+					if (modifyPlainOnXEXStarAttack) {
+						// The assumption that critical packets do not turn up by pure chance turned out to be
+						// incorrect since digital silence appears to produce them in mass.
+						// So instead we now modify the packet in a way which should not affect the audio but will
+						// prevent the attack.
+						*reinterpret_cast< unsigned char * >(blocks[count - 1]) ^= 1;
+						*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+					} else {
+						// This option still exists but only to allow us to test ocb_decrypt's detection.
+						success = false;
+					}
 				}
 			}
-		}
 
-		S2(delta);
-		XOR(tmp, delta, reinterpret_cast< const subblock * >(plain));
-		if (flipABit) {
-			*reinterpret_cast< unsigned char * >(tmp) ^= 1;
-		}
-		AESencrypt(tmp, tmp, raw_key);
-		XOR(reinterpret_cast< subblock * >(encrypted), delta, tmp);
-		XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
-		if (flipABit) {
-			*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+			// The pad for the final block only depends on the offset, so it can be part of the same batch
+			S2(delta);
+			ZERO(blocks[count]);
+			blocks[count][BLOCKSIZE - 1] = SWAPPED(len * 8);
+			XOR(blocks[count], blocks[count], delta);
 		}
 
-		len -= AES_BLOCK_SIZE;
-		plain += AES_BLOCK_SIZE;
-		encrypted += AES_BLOCK_SIZE;
-	}
+		AESblocks(enc_ctx_ocb_enc, blocks, blocks, lastBatch ? count + 1 : count);
+		XORBlocks(reinterpret_cast< subblock * >(encrypted), deltas[0], blocks[0], count);
 
-	S2(delta);
-	ZERO(tmp);
-	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
-	XOR(tmp, tmp, delta);
-	AESencrypt(tmp, pad, raw_key);
+		remainingBlocks -= count;
+		plain += count * AES_BLOCK_SIZE;
+		encrypted += count * AES_BLOCK_SIZE;
+	} while (!lastBatch);
+
+	memcpy(pad, blocks[count], AES_BLOCK_SIZE);
 	memcpy(tmp, plain, len);
 	memcpy(reinterpret_cast< unsigned char * >(tmp) + len, reinterpret_cast< const unsigned char * >(pad) + len,
 		   AES_BLOCK_SIZE - len);
@@ -355,42 +307,54 @@ bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encr
 
 	S3(delta);
 	XOR(tmp, delta, checksum);
-	AESencrypt(tmp, tag, raw_key);
+	AESblocks(enc_ctx_ocb_enc, tmp, tag, 1);
 
 	return success;
 }
 
-#undef AESencrypt
-#undef AESdecrypt
-
-#define AESencrypt(src, dst, key) AESencrypt_ctx(src, dst, key, enc_ctx_ocb_dec)
-#define AESdecrypt(src, dst, key) AESdecrypt_ctx(src, dst, key, dec_ctx_ocb_dec)
-
 bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag) {
 	keyblock checksum, delta, tmp, pad;
+	keyblock deltas[OCB_BATCH_BLOCKS];
+	keyblock blocks[OCB_BATCH_BLOCKS];
 	bool success = true;
 
 	// Initialize
-	AESencrypt(nonce, delta, raw_key);
+	AESinit(enc_ctx_ocb_dec, raw_key, true);
+	AESblocks(enc_ctx_ocb_dec, nonce, delta, 1);
 	ZERO(checksum);
 
-	while (len > AES_BLOCK_SIZE) {
-		S2(delta);
-		XOR(tmp, delta, reinterpret_cast< const subblock * >(encrypted));
-		AESdecrypt(tmp, tmp, raw_key);
-		XOR(reinterpret_cast< subblock * >(plain), delta, tmp);
-		XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
-		len -= AES_BLOCK_SIZE;
-		plain += AES_BLOCK_SIZE;
-		encrypted += AES_BLOCK_SIZE;
+	unsigned int remainingBlocks = len > 0 ? (len - 1) / AES_BLOCK_SIZE : 0;
+	len -= remainingBlocks * AES_BLOCK_SIZE;
+
+	if (remainingBlocks > 0) {
+		AESinit(dec_ctx_ocb_dec, raw_key, false);
+	}
+
+	while (remainingBlocks > 0) {
+		const unsigned int count = std::min(remainingBlocks, OCB_BATCH_BLOCKS);
+
+		for (unsigned int i = 0; i < count; i++) {
+			S2(delta);
+			memcpy(deltas[i], delta, AES_BLOCK_SIZE);
+		}
+		XORBlocks(blocks[0], deltas[0], reinterpret_cast< const subblock * >(encrypted), count);
+		AESblocks(dec_ctx_ocb_dec, blocks, blocks, count);
+		XORBlocks(reinterpret_cast< subblock * >(plain), deltas[0], blocks[0], count);
+		for (unsigned int i = 0; i < count; i++) {
+			XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain + i * AES_BLOCK_SIZE));
+		}
+
+		remainingBlocks -= count;
+		plain += count * AES_BLOCK_SIZE;
+		encrypted += count * AES_BLOCK_SIZE;
 	}
 
 	S2(delta);
 	ZERO(tmp);
 	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
 	XOR(tmp, tmp, delta);
-	AESencrypt(tmp, pad, raw_key);
+	AESblocks(enc_ctx_ocb_dec, tmp, pad, 1);
 	memset(tmp, 0, AES_BLOCK_SIZE);
 	memcpy(tmp, encrypted, len);
 	XOR(tmp, tmp, pad);
@@ -408,13 +372,11 @@ bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *
 
 	S3(delta);
 	XOR(tmp, delta, checksum);
-	AESencrypt(tmp, tag, raw_key);
+	AESblocks(enc_ctx_ocb_dec, tmp, tag, 1);
 
 	return success;
 }
 
-#undef AESencrypt
-#undef AESdecrypt
 #undef BLOCKSIZE
 #undef SHIFTBITS
 #undef SWAPPED
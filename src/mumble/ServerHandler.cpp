@@ -30,6 +30,8 @@
 #include "ServerResolverRecord.h"
 #include "User.h"
 #include "Utils.h"
+#include "crypto/CryptStateChaCha20Poly1305.h"
+#include "crypto/CryptStateOCB2.h"
 #include "Global.h"
 
 #include <QPainter>
@@ -273,6 +275,31 @@ void ServerHandler::udpReady() {
 	}
 }
 
+void ServerHandler::setCipherMode(MumbleProto::CryptSetup::CipherMode mode) {
+	ConnectionPtr connection(cConnection);
+	if (!connection)
+		return;
+
+	std::unique_ptr< CryptState > cryptState;
+	switch (mode) {
+		case MumbleProto::CryptSetup_CipherMode_OCB2AES128:
+			if (!dynamic_cast< CryptStateOCB2 * >(connection->csCrypt.get()))
+				cryptState = std::make_unique< CryptStateOCB2 >();
+			break;
+		case MumbleProto::CryptSetup_CipherMode_ChaCha20Poly1305:
+			if (!dynamic_cast< CryptStateChaCha20Poly1305 * >(connection->csCrypt.get()))
+				cryptState = std::make_unique< CryptStateChaCha20Poly1305 >();
+			break;
+	}
+
+	if (cryptState) {
+		// The crypt state is used by this thread (UDP reception, pings) and by the audio input thread, which only
+		// accesses it while holding qmUdp. The key is set once the message has been passed on to the MainWindow.
+		QMutexLocker qml(&qmUdp);
+		connection->csCrypt = std::move(cryptState);
+	}
+}
+
 void ServerHandler::handleVoicePacket(const Mumble::Protocol::AudioData &audioData) {
 	if (audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
 		qWarning("Dropping audio packet using invalid codec (not Opus): %d", static_cast< int >(audioData.usedCodec));
@@ -291,7 +318,7 @@ void ServerHandler::handleVoicePacket(const Mumble::Protocol::AudioData &audioDa
 
 void ServerHandler::sendMessage(const unsigned char *data, int len, bool force) {
 	static std::vector< unsigned char > crypto;
-	crypto.resize(static_cast< std::size_t >(len + 4));
+	crypto.resize(Mumble::Protocol::UDP_ASSOCIATION_HEADER_SIZE + static_cast< std::size_t >(len + 4));
 
 	QMutexLocker qml(&qmUdp);
 
@@ -315,11 +342,20 @@ void ServerHandler::sendMessage(const unsigned char *data, int len, bool force)
 		QApplication::postEvent(this,
 								new ServerHandlerMessageEvent(qba, Mumble::Protocol::TCPMessageType::UDPTunnel, true));
 	} else {
-		if (!connection->csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data), crypto.data(),
+		// Pings (which are forced) keep the server informed about our UDP endpoint, which may change at any time.
+		// Until the server has answered via UDP, it might not know the endpoint yet.
+		std::size_t headerSize = 0;
+		if (m_udpAssociationToken != 0 && (force || connection->csCrypt->uiGood == 0)) {
+			Mumble::Protocol::writeUDPAssociationHeader(crypto.data(), m_udpAssociationToken);
+			headerSize = Mumble::Protocol::UDP_ASSOCIATION_HEADER_SIZE;
+		}
+
+		if (!connection->csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data), crypto.data() + headerSize,
 										  static_cast< unsigned int >(len))) {
 			return;
 		}
-		qusUdp->writeDatagram(reinterpret_cast< const char * >(crypto.data()), len + 4, qhaRemote, usResolvedPort);
+		qusUdp->writeDatagram(reinterpret_cast< const char * >(crypto.data()),
+							  static_cast< qint64 >(headerSize) + len + 4, qhaRemote, usResolvedPort);
 	}
 }
 
@@ -677,6 +713,16 @@ void ServerHandler::message(Mumble::Protocol::TCPMessageType type, const QByteAr
 			}
 		}
 	} else {
+		if (type == Mumble::Protocol::TCPMessageType::CryptSetup) {
+			MumbleProto::CryptSetup msg;
+			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size()) && msg.has_key()) {
+				setCipherMode(msg.mode());
+
+				QMutexLocker qml(&qmUdp);
+				m_udpAssociationToken = msg.udp_association_token();
+			}
+		}
+
 		ServerHandlerMessageEvent *shme = new ServerHandlerMessageEvent(qbaMsg, type, false);
 		QApplication::postEvent(Global::get().mw, shme);
 	}
@@ -790,6 +836,18 @@ void ServerHandler::serverConnectionConnected() {
 
 	sendMessage(mpv);
 
+	{
+		QMutexLocker qml(&qmUdp);
+		m_udpAssociationToken = 0;
+	}
+
+	// Servers not knowing about other cipher modes or UDP association tokens ignore this as we are not
+	// authenticated yet
+	MumbleProto::CryptSetup mpcs;
+	mpcs.add_supported_modes(MumbleProto::CryptSetup_CipherMode_ChaCha20Poly1305);
+	mpcs.set_udp_association_supported(true);
+	sendMessage(mpcs);
+
 	MumbleProto::Authenticate mpa;
 	mpa.set_username(u8(qsUserName));
 	mpa.set_password(u8(qsPassword));
@@ -886,6 +944,36 @@ bool ServerHandler::isStrong() const {
 	return bStrong;
 }
 
+CryptStatistics ServerHandler::cryptStatistics() {
+	CryptStatistics statistics;
+
+	ConnectionPtr connection(cConnection);
+	if (!connection) {
+		return statistics;
+	}
+
+	QMutexLocker qml(&qmUdp);
+
+	const CryptState *crypt = connection->csCrypt.get();
+	if (!crypt) {
+		return statistics;
+	}
+
+	statistics.chaCha20Poly1305 = dynamic_cast< const CryptStateChaCha20Poly1305 * >(crypt) != nullptr;
+
+	statistics.good   = crypt->uiGood;
+	statistics.late   = crypt->uiLate;
+	statistics.lost   = crypt->uiLost;
+	statistics.resync = crypt->uiResync;
+
+	statistics.remoteGood   = crypt->uiRemoteGood;
+	statistics.remoteLate   = crypt->uiRemoteLate;
+	statistics.remoteLost   = crypt->uiRemoteLost;
+	statistics.remoteResync = crypt->uiRemoteResync;
+
+	return statistics;
+}
+
 void ServerHandler::requestUserStats(unsigned int uiSession, bool statsOnly) {
 	MumbleProto::UserStats mpus;
 	mpus.set_session(uiSession);
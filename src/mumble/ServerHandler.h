@@ -54,6 +54,22 @@ public:
 
 typedef boost::shared_ptr< Connection > ConnectionPtr;
 
+/// A copy of what is shown to the user about the encryption of the voice channel (UDP)
+struct CryptStatistics {
+	/// Whether ChaCha20-Poly1305 is used rather than OCB-AES128
+	bool chaCha20Poly1305 = false;
+
+	unsigned int good   = 0;
+	unsigned int late   = 0;
+	unsigned int lost   = 0;
+	unsigned int resync = 0;
+
+	unsigned int remoteGood   = 0;
+	unsigned int remoteLate   = 0;
+	unsigned int remoteLost   = 0;
+	unsigned int remoteResync = 0;
+};
+
 class ServerHandler : public QThread {
 private:
 	Q_OBJECT
@@ -90,8 +106,14 @@ protected:
 	QHostAddress qhaLocal;
 	QUdpSocket *qusUdp;
 	QMutex qmUdp;
+	/// The token the server has handed out for prefixing our UDP packets with an association header or 0 if it
+	/// didn't. Protected by qmUdp.
+	std::uint32_t m_udpAssociationToken = 0;
 
 	void handleVoicePacket(const Mumble::Protocol::AudioData &audioData);
+	/// Replaces the connection's crypt state if it doesn't use the given mode yet. Must only be called from the
+	/// ServerHandler's thread.
+	void setCipherMode(MumbleProto::CryptSetup::CipherMode mode);
 
 public:
 	Timer tTimestamp;
@@ -147,6 +169,10 @@ public:
 	/// @param synchronized Whether the server has finished synchronization
 	void setServerSynchronized(bool synchronized);
 
+	/// @returns A copy of the current connection's crypt state statistics. Unlike the crypt state itself (which is
+	/// 	replaced whenever the server changes the cipher), this may be used from any thread.
+	CryptStatistics cryptStatistics();
+
 #define PROCESS_MUMBLE_TCP_MESSAGE(name, value) \
 	void sendMessage(const MumbleProto::name &msg) { sendProtoMessage(msg, Mumble::Protocol::TCPMessageType::name); }
 	MUMBLE_ALL_TCP_MESSAGES
@@ -133,10 +133,17 @@ void ServerInformation::updateConnectionDetails() {
 		const float deviation =
 			static_cast< float >(std::sqrt(boost::accumulators::variance(Global::get().sh->accUDP)));
 
-		connection_udp_encryption->setText("128 bit OCB-AES128");
+		// The crypt state may be replaced by the ServerHandler's thread at any time
+		const CryptStatistics statistics = Global::get().sh->cryptStatistics();
+
+		if (statistics.chaCha20Poly1305) {
+			connection_udp_encryption->setText("256 bit ChaCha20-Poly1305");
+		} else {
+			connection_udp_encryption->setText("128 bit OCB-AES128");
+		}
 		connection_udp_latency->setText(latencyString.arg(latency, 0, 'f', 1).arg(deviation, 0, 'f', 1));
 
-		populateUDPStatistics(*connection);
+		populateUDPStatistics(statistics);
 	}
 
 
@@ -161,7 +168,7 @@ void ServerInformation::updateConnectionDetails() {
 	qgbTCPParameters->updateAccessibleText();
 }
 
-void ServerInformation::populateUDPStatistics(const Connection &connection) {
+void ServerInformation::populateUDPStatistics(const CryptStatistics &statistics) {
 	// statistics
 	constexpr int TO_SERVER_COL   = 0;
 	constexpr int FROM_SERVER_COL = 1;
@@ -170,14 +177,14 @@ void ServerInformation::populateUDPStatistics(const Connection &connection) {
 	constexpr int LOST_ROW        = 2;
 	constexpr int RESYNC_ROW      = 3;
 
-	QTableWidgetItem *toGoodItem     = new QTableWidgetItem(QString::number(connection.csCrypt->uiRemoteGood));
-	QTableWidgetItem *fromGoodItem   = new QTableWidgetItem(QString::number(connection.csCrypt->uiGood));
-	QTableWidgetItem *toLateItem     = new QTableWidgetItem(QString::number(connection.csCrypt->uiRemoteLate));
-	QTableWidgetItem *fromLateItem   = new QTableWidgetItem(QString::number(connection.csCrypt->uiLate));
-	QTableWidgetItem *toLostItem     = new QTableWidgetItem(QString::number(connection.csCrypt->uiRemoteLost));
-	QTableWidgetItem *fromLostItem   = new QTableWidgetItem(QString::number(connection.csCrypt->uiLost));
-	QTableWidgetItem *toResyncItem   = new QTableWidgetItem(QString::number(connection.csCrypt->uiRemoteResync));
-	QTableWidgetItem *fromResyncItem = new QTableWidgetItem(QString::number(connection.csCrypt->uiResync));
+	QTableWidgetItem *toGoodItem     = new QTableWidgetItem(QString::number(statistics.remoteGood));
+	QTableWidgetItem *fromGoodItem   = new QTableWidgetItem(QString::number(statistics.good));
+	QTableWidgetItem *toLateItem     = new QTableWidgetItem(QString::number(statistics.remoteLate));
+	QTableWidgetItem *fromLateItem   = new QTableWidgetItem(QString::number(statistics.late));
+	QTableWidgetItem *toLostItem     = new QTableWidgetItem(QString::number(statistics.remoteLost));
+	QTableWidgetItem *fromLostItem   = new QTableWidgetItem(QString::number(statistics.lost));
+	QTableWidgetItem *toResyncItem   = new QTableWidgetItem(QString::number(statistics.remoteResync));
+	QTableWidgetItem *fromResyncItem = new QTableWidgetItem(QString::number(statistics.resync));
 
 	connection_udp_statisticsTable->setItem(GOOD_ROW, TO_SERVER_COL, toGoodItem);
 	connection_udp_statisticsTable->setItem(GOOD_ROW, FROM_SERVER_COL, fromGoodItem);
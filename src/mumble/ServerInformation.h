@@ -10,7 +10,7 @@
 
 #include "ui_ServerInformation.h"
 
-class Connection;
+struct CryptStatistics;
 
 class ServerInformation : public QDialog, private Ui::ServerInformation {
 	Q_OBJECT
@@ -31,7 +31,7 @@ private:
 	void updateServerInformation();
 	void updateAudioBandwidth();
 	void updateConnectionDetails();
-	void populateUDPStatistics(const Connection &connection);
+	void populateUDPStatistics(const CryptStatistics &statistics);
 };
 
 #endif // MUMBLE_MUMBLE_SERVERINFORMATION_H_
@@ -6,7 +6,11 @@
 #include "AudioReceiverBuffer.h"
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 #include <tracy/Tracy.hpp>
 
@@ -48,6 +52,96 @@ void AudioReceiver::setVolumeAdjustment(VolumeAdjustment &&adjustment) {
 	m_volumeAdjustment = std::move(adjustment);
 }
 
+ReceiverIndex::ReceiverIndex() {
+	// Power of two that comfortably fits the receiver lists of most packets
+	m_slots.resize(128);
+	m_shift = 32 - 7;
+}
+
+std::uint32_t &ReceiverIndex::lookup(unsigned int session) {
+	// Keep the load factor at or below 1/2 so that probe sequences stay short
+	if ((m_size + 1) * 2 > m_slots.size()) {
+		grow();
+	}
+
+	const std::size_t mask = m_slots.size() - 1;
+	// Fibonacci hashing spreads the (mostly consecutive) session IDs across the table
+	std::size_t i = static_cast< std::uint32_t >(session * 2654435769U) >> m_shift;
+
+	while (true) {
+		Slot &slot = m_slots[i];
+
+		if (slot.generation != m_generation) {
+			slot.generation = m_generation;
+			slot.session    = session;
+			slot.position   = NO_ENTRY;
+			m_size++;
+
+			return slot.position;
+		}
+		if (slot.session == session) {
+			return slot.position;
+		}
+
+		i = (i + 1) & mask;
+	}
+}
+
+void ReceiverIndex::clear() {
+	m_size = 0;
+
+	if (++m_generation == 0) {
+		// After the generation counter wrapped around, stale slots could appear to be in use again
+		for (Slot &slot : m_slots) {
+			slot.generation = 0;
+		}
+		m_generation = 1;
+	}
+}
+
+void ReceiverIndex::grow() {
+	std::vector< Slot > previous(m_slots.size() * 2);
+	previous.swap(m_slots);
+	m_shift--;
+
+	const std::uint32_t generation = m_generation;
+	clear();
+
+	for (const Slot &slot : previous) {
+		if (slot.generation == generation) {
+			lookup(slot.session) = slot.position;
+		}
+	}
+}
+
+
+namespace {
+/// Below this amount of receivers, std::sort beats setting up the radix sort's histograms
+constexpr const std::size_t RADIX_SORT_THRESHOLD = 64;
+/// The amount of bytes of a sort key that are actually in use
+constexpr const unsigned int SORT_KEY_BYTES = 6;
+
+bool usesLegacyProtocol(const AudioReceiver &receiver) {
+	return !Mumble::Protocol::protocolVersionsAreCompatible(receiver.getReceiver().m_version,
+															Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+}
+
+/// Creates a key whose ascending order groups the receivers by protocol class and context and orders every group by
+/// descending volume adjustment
+std::uint64_t createSortKey(const AudioReceiver &receiver, bool legacyProtocolFirst) {
+	const std::uint64_t protocolClass = usesLegacyProtocol(receiver) == legacyProtocolFirst ? 0 : 1;
+
+	std::uint32_t factorBits;
+	const float factor = receiver.getVolumeAdjustment().factor;
+	std::memcpy(&factorBits, &factor, sizeof(factorBits));
+	// Map the float onto an unsigned integer of the same order and invert the latter to get a descending order
+	factorBits = (factorBits & 0x80000000U) ? ~factorBits : (factorBits | 0x80000000U);
+	factorBits = ~factorBits;
+
+	return (protocolClass << 40) | (static_cast< std::uint64_t >(receiver.getContext()) << 32) | factorBits;
+}
+} // namespace
+
 AudioReceiverBuffer::AudioReceiverBuffer() {
 	// These are just educated guesses at reasonable starting capacities for these vectors
 	m_regularReceivers.reserve(50);
@@ -70,17 +164,16 @@ void AudioReceiverBuffer::forceAddReceiver(ServerUser &receiver, Mumble::Protoco
 	ZoneScoped;
 
 	std::vector< AudioReceiver > &receiverList = includePositionalData ? m_positionalReceivers : m_regularReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > &userEntryIndices =
-		includePositionalData ? m_positionalReceiverIndices : m_regularReceiverIndices;
+	ReceiverIndex &userEntryIndices = includePositionalData ? m_positionalReceiverIndices : m_regularReceiverIndices;
 
-	auto it = userEntryIndices.find(&receiver);
-	if (it == userEntryIndices.end()) {
+	std::uint32_t &position = userEntryIndices.lookup(receiver.uiSession);
+	if (position == ReceiverIndex::NO_ENTRY) {
 		// No entry for that user yet
+		position = static_cast< std::uint32_t >(receiverList.size());
 		receiverList.emplace_back(receiver, context, volumeAdjustment);
-		userEntryIndices[&receiver] = receiverList.size() - 1;
 	} else {
 		// We already have an entry for the given user -> update that instead of adding a new one
-		AudioReceiver &receiverEntry = receiverList[it->second];
+		AudioReceiver &receiverEntry = receiverList[position];
 
 		assert(receiverEntry.getReceiver().uiSession == receiver.uiSession);
 
@@ -92,11 +185,21 @@ void AudioReceiverBuffer::forceAddReceiver(ServerUser &receiver, Mumble::Protoco
 	}
 }
 
+void AudioReceiverBuffer::addUniqueReceiver(ServerUser &receiver, Mumble::Protocol::audio_context_t context,
+											bool includePositionalData, const VolumeAdjustment &volumeAdjustment) {
+	std::vector< AudioReceiver > &receiverList = includePositionalData ? m_positionalReceivers : m_regularReceivers;
+
+	receiverList.emplace_back(receiver, context, volumeAdjustment);
+}
+
 void AudioReceiverBuffer::preprocessBuffer() {
 	ZoneScoped;
 
-	preprocessBuffer(m_regularReceivers);
-	preprocessBuffer(m_positionalReceivers);
+	// The positional receivers are served first. Starting the regular receivers with the protocol the positional ones
+	// ended with saves the encoder from re-encoding the fixed part of the packet once more when switching lists.
+	preprocessBuffer(m_positionalReceivers, true);
+	preprocessBuffer(m_regularReceivers,
+					 m_positionalReceivers.empty() || usesLegacyProtocol(m_positionalReceivers.back()));
 }
 
 void AudioReceiverBuffer::clear() {
@@ -114,7 +217,7 @@ std::vector< AudioReceiver > &AudioReceiverBuffer::getReceivers(bool receivePosi
 	}
 }
 
-void AudioReceiverBuffer::preprocessBuffer(std::vector< AudioReceiver > &receiverList) {
+void AudioReceiverBuffer::preprocessBuffer(std::vector< AudioReceiver > &receiverList, bool legacyProtocolFirst) {
 	ZoneScoped;
 
 #ifndef NDEBUG
@@ -133,19 +236,71 @@ void AudioReceiverBuffer::preprocessBuffer(std::vector< AudioReceiver > &receive
 
 	// Sort the receivers, such that we can efficiently partition them into different regions
 	// Note: The list doesn't contains any duplicate receivers
-	std::sort(receiverList.begin(), receiverList.end(), [](const AudioReceiver &lhs, const AudioReceiver &rhs) {
-		// 1. Sort into block of compatible protocol versions
-		if (!Mumble::Protocol::protocolVersionsAreCompatible(lhs.getReceiver().m_version,
-															 rhs.getReceiver().m_version)) {
-			return lhs.getReceiver().m_version < rhs.getReceiver().m_version;
+	m_sortEntries.clear();
+	for (std::size_t i = 0; i < receiverList.size(); ++i) {
+		m_sortEntries.push_back(
+			{ createSortKey(receiverList[i], legacyProtocolFirst), static_cast< std::uint32_t >(i) });
+	}
+
+	radixSort(m_sortEntries, m_sortScratch);
+
+	m_sortedReceivers.clear();
+	for (const SortEntry &entry : m_sortEntries) {
+		m_sortedReceivers.push_back(receiverList[entry.index]);
+	}
+	std::copy(m_sortedReceivers.begin(), m_sortedReceivers.end(), receiverList.begin());
+}
+
+bool AudioReceiverBuffer::receiveSamePacket(const AudioReceiver &lhs, const AudioReceiver &rhs) {
+	return lhs.getContext() == rhs.getContext()
+		   && Mumble::Protocol::protocolVersionsAreCompatible(lhs.getReceiver().m_version, rhs.getReceiver().m_version)
+		   // The factor difference caps audible differences for high volume adjustments (where 1dB is already a big
+		   // difference). Thus, this is a cap on the absolute loudness difference.
+		   && std::abs(lhs.getVolumeAdjustment().factor - rhs.getVolumeAdjustment().factor) < maxFactorDiff
+		   // The dB difference caps audible difference for low volume adjustments. E.g. a factor difference of 0.05 for
+		   // an adjustment of -24dB is a difference of more than 5dB and therefore audible. Thus, this is a cap on the
+		   // relative loudness difference.
+		   && std::abs(lhs.getVolumeAdjustment().dbAdjustment - rhs.getVolumeAdjustment().dbAdjustment)
+				  < maxDecibelDiff;
+}
+
+void AudioReceiverBuffer::radixSort(std::vector< SortEntry > &entries, std::vector< SortEntry > &scratch) {
+	if (entries.size() < RADIX_SORT_THRESHOLD) {
+		std::sort(entries.begin(), entries.end(),
+				  [](const SortEntry &lhs, const SortEntry &rhs) { return lhs.key < rhs.key; });
+
+		return;
+	}
+
+	// Least significant digit first, one byte per pass. The histograms of all bytes are built in a single pass.
+	std::array< std::array< std::uint32_t, 256 >, SORT_KEY_BYTES > counts = {};
+	for (const SortEntry &entry : entries) {
+		for (unsigned int byte = 0; byte < SORT_KEY_BYTES; ++byte) {
+			counts[byte][(entry.key >> (8 * byte)) & 0xFF]++;
+		}
+	}
+
+	scratch.resize(entries.size());
+
+	for (unsigned int byte = 0; byte < SORT_KEY_BYTES; ++byte) {
+		std::array< std::uint32_t, 256 > &offsets = counts[byte];
+
+		// Skip bytes that are the same for all entries (e.g. the volume adjustment if nobody has one)
+		if (offsets[(entries.front().key >> (8 * byte)) & 0xFF] == entries.size()) {
+			continue;
 		}
 
-		// 2. Within each block, sort based on the audio context
-		if (lhs.getContext() != rhs.getContext()) {
-			return lhs.getContext() < rhs.getContext();
+		std::uint32_t offset = 0;
+		for (std::uint32_t &count : offsets) {
+			const std::uint32_t current = count;
+			count                       = offset;
+			offset += current;
 		}
 
-		// 3. Within each context, sort based on volume adjustments (but in descending order!)
-		return lhs.getVolumeAdjustment().factor > rhs.getVolumeAdjustment().factor;
-	});
+		for (const SortEntry &entry : entries) {
+			scratch[offsets[(entry.key >> (8 * byte)) & 0xFF]++] = entry;
+		}
+
+		entries.swap(scratch);
+	}
 }
@@ -10,8 +10,11 @@
 #include "ServerUser.h"
 #include "VolumeAdjustment.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
-#include <unordered_map>
+#include <iterator>
+#include <limits>
 #include <vector>
 
 #include <tracy/Tracy.hpp>
@@ -39,6 +42,39 @@ protected:
 };
 
 
+/// Maps session IDs to positions in a list of receivers. It uses open addressing with linear probing on a flat array
+/// and marks its slots with a generation counter, so that clearing the index is O(1). Once the index has grown to the
+/// size required by the largest receiver list it has seen, neither adding entries nor clearing it allocates memory.
+class ReceiverIndex {
+public:
+	static constexpr const std::uint32_t NO_ENTRY = std::numeric_limits< std::uint32_t >::max();
+
+	ReceiverIndex();
+
+	/// @returns A reference to the position stored for the given session. If there is no entry for the session yet,
+	/// one is created and the returned position is NO_ENTRY.
+	std::uint32_t &lookup(unsigned int session);
+
+	void clear();
+
+protected:
+	struct Slot {
+		/// The slot is only in use if this matches the index' current generation
+		std::uint32_t generation = 0;
+		unsigned int session     = 0;
+		std::uint32_t position   = NO_ENTRY;
+	};
+
+	std::vector< Slot > m_slots;
+	std::uint32_t m_generation = 1;
+	std::size_t m_size         = 0;
+	/// Amount of bits to shift the hash by in order to obtain a slot index
+	unsigned int m_shift;
+
+	void grow();
+};
+
+
 template< typename Iterator > struct ReceiverRange {
 	Iterator begin;
 	Iterator end;
@@ -54,6 +90,11 @@ public:
 					 const VolumeAdjustment &volumeAdjustment = VolumeAdjustment::fromFactor(1.0f));
 	void forceAddReceiver(ServerUser &receiver, Mumble::Protocol::audio_context_t context, bool includePositionalData,
 						  const VolumeAdjustment &volumeAdjustment = VolumeAdjustment::fromFactor(1.0f));
+	/// Adds the given receiver without checking whether there already is an entry for it. This must only be used
+	/// if the caller guarantees that the receiver is not (and won't be) added to this buffer in any other way until
+	/// the buffer is cleared.
+	void addUniqueReceiver(ServerUser &receiver, Mumble::Protocol::audio_context_t context, bool includePositionalData,
+						   const VolumeAdjustment &volumeAdjustment);
 
 	void preprocessBuffer();
 
@@ -73,6 +114,9 @@ public:
 	 */
 	constexpr static const int maxDecibelDiff = 5;
 
+	/// @returns Whether the given receivers can be sent the exact same audio packet
+	static bool receiveSamePacket(const AudioReceiver &lhs, const AudioReceiver &rhs);
+
 	template< typename Iterator > static ReceiverRange< Iterator > getReceiverRange(Iterator begin, Iterator end) {
 		ZoneScoped;
 
@@ -89,30 +133,37 @@ public:
 
 		// Find a range, such that all receivers in [begin, end) are compatible in the sense that they will all receive
 		// the exact same audio packet (thus: no re-encoding required between sending the packet to them).
-		range.end = std::lower_bound(begin, end, *begin, [](const AudioReceiver &lhs, const AudioReceiver &rhs) {
-			return lhs.getContext() == rhs.getContext()
-				   && Mumble::Protocol::protocolVersionsAreCompatible(lhs.getReceiver().m_version,
-																	  rhs.getReceiver().m_version)
-				   // The factor difference caps audible differences for high volume adjustments (where 1dB is already a
-				   // big difference). Thus, this is a cap on the absolute loudness difference.
-				   && std::abs(lhs.getVolumeAdjustment().factor - rhs.getVolumeAdjustment().factor) < maxFactorDiff
-				   // The dB difference caps audible difference for low volume adjustments. E.g. a factor difference of
-				   // 0.05 for an adjustment of -24dB is a difference of more than 5dB and therefore audible. Thus, this
-				   // is a cap on the relative loudness difference.
-				   && std::abs(lhs.getVolumeAdjustment().dbAdjustment - rhs.getVolumeAdjustment().dbAdjustment)
-						  < maxDecibelDiff;
+		// preprocessBuffer has grouped the receivers by protocol and context and has ordered each group by descending
+		// volume adjustment, so the range simply extends up to the first receiver that isn't compatible with the
+		// range's first one. Splitting a list into ranges thus visits every receiver only once.
+		range.end = std::find_if_not(std::next(begin), end, [begin](const AudioReceiver &receiver) {
+			return receiveSamePacket(*begin, receiver);
 		});
 
 		return range;
 	}
 
 protected:
+	struct SortEntry {
+		std::uint64_t key;
+		std::uint32_t index;
+	};
+
 	std::vector< AudioReceiver > m_regularReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > m_regularReceiverIndices;
+	ReceiverIndex m_regularReceiverIndices;
 	std::vector< AudioReceiver > m_positionalReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > m_positionalReceiverIndices;
-
-	void preprocessBuffer(std::vector< AudioReceiver > &receiverList);
+	ReceiverIndex m_positionalReceiverIndices;
+	/// Scratch space for preprocessBuffer, kept around to avoid allocations
+	std::vector< SortEntry > m_sortEntries;
+	std::vector< SortEntry > m_sortScratch;
+	std::vector< AudioReceiver > m_sortedReceivers;
+
+	/// @param legacyProtocolFirst Whether receivers using the pre-protobuf protocol should be ordered before the
+	/// other ones
+	void preprocessBuffer(std::vector< AudioReceiver > &receiverList, bool legacyProtocolFirst);
+
+	/// Sorts the given entries by key in linear time. The scratch vector is used as temporary storage.
+	static void radixSort(std::vector< SortEntry > &entries, std::vector< SortEntry > &scratch);
 };
 
 #endif // MUMBLE_MURMUR_AUDIORECEIVERBUFFER_H_
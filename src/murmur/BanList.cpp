@@ -0,0 +1,254 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BanList.h"
+
+#include <QtCore/QDateTime>
+
+#include <algorithm>
+
+namespace {
+constexpr unsigned int ADDRESS_BITS = 128;
+
+using Address = std::array< std::uint8_t, 16 >;
+
+unsigned int bitAt(const Address &address, unsigned int index) {
+	return (address[index / 8] >> (7 - index % 8)) & 1;
+}
+
+/// @returns The given address with all bits after the first prefixLength ones cleared
+Address truncate(const Address &address, unsigned int prefixLength) {
+	Address truncated = {};
+	for (unsigned int i = 0; i < prefixLength / 8; ++i) {
+		truncated[i] = address[i];
+	}
+	if (prefixLength % 8 != 0) {
+		truncated[prefixLength / 8] =
+			static_cast< std::uint8_t >(address[prefixLength / 8] & (0xFF << (8 - prefixLength % 8)));
+	}
+
+	return truncated;
+}
+
+/// @returns The amount of leading bits (but at most limit) that both addresses have in common
+unsigned int commonPrefixLength(const Address &first, const Address &second, unsigned int limit) {
+	for (unsigned int i = 0; i * 8 < limit; ++i) {
+		const unsigned int difference = first[i] ^ second[i];
+		if (difference != 0) {
+			unsigned int length = i * 8;
+			for (unsigned int mask = 0x80; (difference & mask) == 0; mask >>= 1) {
+				++length;
+			}
+
+			return std::min(length, limit);
+		}
+	}
+
+	return limit;
+}
+
+unsigned int prefixLengthOf(const Ban &ban) {
+	return static_cast< unsigned int >(std::max(0, std::min(ban.iMask, static_cast< int >(ADDRESS_BITS))));
+}
+} // namespace
+
+void BanList::add(const Ban &ban) {
+	const BanID id = m_nextID++;
+	m_bans.emplace(id, ban);
+
+	const unsigned int prefixLength = prefixLengthOf(ban);
+	const Address prefix            = truncate(ban.haAddress.getByteRepresentation(), prefixLength);
+
+	std::unique_ptr< Node > *slot = &m_root;
+	while (true) {
+		Node *node = slot->get();
+
+		if (!node) {
+			*slot                 = std::make_unique< Node >();
+			(*slot)->prefix       = prefix;
+			(*slot)->prefixLength = prefixLength;
+			(*slot)->bans.push_back(id);
+			break;
+		}
+
+		const unsigned int common =
+			commonPrefixLength(node->prefix, prefix, std::min(node->prefixLength, prefixLength));
+
+		if (common == node->prefixLength) {
+			if (common == prefixLength) {
+				node->bans.push_back(id);
+				break;
+			}
+
+			slot = &node->children[bitAt(prefix, common)];
+			continue;
+		}
+
+		// The new prefix diverges from (or ends within) the prefix of this node, so a node for their common prefix
+		// has to be inserted in its place
+		std::unique_ptr< Node > parent = std::make_unique< Node >();
+		parent->prefix                 = truncate(prefix, common);
+		parent->prefixLength           = common;
+
+		const unsigned int nodeBit = bitAt(node->prefix, common);
+		parent->children[nodeBit]  = std::move(*slot);
+
+		if (common == prefixLength) {
+			parent->bans.push_back(id);
+		} else {
+			std::unique_ptr< Node > leaf = std::make_unique< Node >();
+			leaf->prefix                 = prefix;
+			leaf->prefixLength           = prefixLength;
+			leaf->bans.push_back(id);
+
+			parent->children[1 - nodeBit] = std::move(leaf);
+		}
+
+		*slot = std::move(parent);
+		break;
+	}
+
+	// Most bans are for addresses only. Indexing them by their empty hash would make removing them from m_hashes
+	// linear in the amount of such bans.
+	if (!ban.qsHash.isEmpty()) {
+		m_hashes.insert(ban.qsHash, id);
+	}
+
+	// Bans without a (valid) start never expire
+	if (ban.iDuration > 0 && ban.qdtStart.isValid()) {
+		m_expiries.push({ ban.qdtStart.toMSecsSinceEpoch() + static_cast< qint64 >(ban.iDuration) * 1000, id });
+	}
+}
+
+void BanList::clear() {
+	m_bans.clear();
+	m_root.reset();
+	m_hashes.clear();
+	m_expiries = decltype(m_expiries)();
+}
+
+bool BanList::removeExpired() {
+	const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+	bool removed = false;
+	// The expiry times are only accurate to the second Ban::isExpired works with, so bans close to expiring are put
+	// back until they actually have
+	std::vector< Expiry > pending;
+
+	while (!m_expiries.empty() && m_expiries.top().time <= now) {
+		const Expiry expiry = m_expiries.top();
+		m_expiries.pop();
+
+		auto it = m_bans.find(expiry.id);
+		if (it == m_bans.end()) {
+			continue;
+		}
+
+		if (it->second.isExpired()) {
+			remove(expiry.id);
+			removed = true;
+		} else {
+			pending.push_back(expiry);
+		}
+	}
+
+	for (const Expiry &expiry : pending) {
+		m_expiries.push(expiry);
+	}
+
+	return removed;
+}
+
+const Ban *BanList::match(const HostAddress &address) const {
+	const Address &bytes = address.getByteRepresentation();
+
+	const Node *node = m_root.get();
+	const Node *best = nullptr;
+
+	while (node && commonPrefixLength(node->prefix, bytes, node->prefixLength) == node->prefixLength) {
+		if (!node->bans.empty()) {
+			best = node;
+		}
+		if (node->prefixLength == ADDRESS_BITS) {
+			break;
+		}
+
+		node = node->children[bitAt(bytes, node->prefixLength)].get();
+	}
+
+	return best ? &m_bans.at(best->bans.front()) : nullptr;
+}
+
+QList< Ban > BanList::matchHash(const QString &hash) const {
+	QList< BanID > ids = m_hashes.values(hash);
+	std::sort(ids.begin(), ids.end());
+
+	QList< Ban > matches;
+	for (BanID id : ids) {
+		matches << m_bans.at(id);
+	}
+
+	return matches;
+}
+
+QList< Ban > BanList::bans() const {
+	QList< Ban > list;
+	list.reserve(static_cast< int >(m_bans.size()));
+
+	for (const auto &entry : m_bans) {
+		list << entry.second;
+	}
+
+	return list;
+}
+
+int BanList::count() const {
+	return static_cast< int >(m_bans.size());
+}
+
+bool BanList::isEmpty() const {
+	return m_bans.empty();
+}
+
+void BanList::remove(BanID id) {
+	auto it = m_bans.find(id);
+	if (it == m_bans.end()) {
+		return;
+	}
+
+	const unsigned int prefixLength = prefixLengthOf(it->second);
+	removeFromTree(m_root, truncate(it->second.haAddress.getByteRepresentation(), prefixLength), prefixLength, id);
+
+	if (!it->second.qsHash.isEmpty()) {
+		m_hashes.remove(it->second.qsHash, id);
+	}
+	m_bans.erase(it);
+}
+
+void BanList::removeFromTree(std::unique_ptr< Node > &slot, const Address &prefix, unsigned int prefixLength,
+							 BanID id) {
+	Node *node = slot.get();
+	if (!node || node->prefixLength > prefixLength
+		|| commonPrefixLength(node->prefix, prefix, node->prefixLength) != node->prefixLength) {
+		return;
+	}
+
+	if (node->prefixLength == prefixLength) {
+		node->bans.erase(std::remove(node->bans.begin(), node->bans.end(), id), node->bans.end());
+	} else {
+		removeFromTree(node->children[bitAt(prefix, node->prefixLength)], prefix, prefixLength, id);
+	}
+
+	if (!node->bans.empty()) {
+		return;
+	}
+
+	// Nodes without bans are only needed where the tree branches
+	if (!node->children[0]) {
+		slot = std::move(node->children[1]);
+	} else if (!node->children[1]) {
+		slot = std::move(node->children[0]);
+	}
+}
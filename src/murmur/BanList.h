@@ -0,0 +1,85 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BANLIST_H_
+#define MUMBLE_MURMUR_BANLIST_H_
+
+#include "Ban.h"
+#include "HostAddress.h"
+
+#include <QtCore/QList>
+#include <QtCore/QMultiHash>
+#include <QtCore/QString>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+
+/// The bans of a server, indexed for checking incoming connections.
+///
+/// Banned address ranges are stored in a path-compressed binary radix tree over the 128 bit address space (IPv4
+/// addresses being mapped into it), so that matching an address takes at most one step per address bit, regardless
+/// of the amount of bans. Temporary bans are additionally kept in a heap ordered by the time they expire at, such that
+/// dropping expired bans doesn't require looking at the permanent ones.
+class BanList {
+public:
+	/// Adds the given ban, which is expected to be valid (see Ban::isValid)
+	void add(const Ban &ban);
+	void clear();
+	/// Removes all bans that have expired
+	///
+	/// @returns Whether any ban has been removed
+	bool removeExpired();
+
+	/// @returns The ban with the longest mask matching the given address or nullptr, if the address is not banned. The
+	/// 	pointer stays valid until the list is modified.
+	const Ban *match(const HostAddress &address) const;
+	/// @returns All bans for the given (non-empty) certificate hash in the order they have been added in
+	QList< Ban > matchHash(const QString &hash) const;
+
+	/// @returns All bans in the order they have been added in
+	QList< Ban > bans() const;
+	int count() const;
+	bool isEmpty() const;
+
+private:
+	using BanID   = std::uint64_t;
+	using Address = std::array< std::uint8_t, 16 >;
+
+	struct Node {
+		/// The bits the addresses below this node start with (all other bits are zero)
+		Address prefix;
+		unsigned int prefixLength;
+		/// The sub-trees for addresses continuing with a 0 or a 1 bit after the prefix
+		std::unique_ptr< Node > children[2];
+		/// The bans for exactly this prefix
+		std::vector< BanID > bans;
+	};
+
+	struct Expiry {
+		/// The time (in milliseconds since the epoch) at which the ban expires at the earliest
+		qint64 time;
+		BanID id;
+
+		bool operator>(const Expiry &other) const { return time > other.time; }
+	};
+
+	BanID m_nextID = 0;
+	/// All bans by their ID, which also reflects the order they have been added in
+	std::map< BanID, Ban > m_bans;
+	std::unique_ptr< Node > m_root;
+	QMultiHash< QString, BanID > m_hashes;
+	std::priority_queue< Expiry, std::vector< Expiry >, std::greater< Expiry > > m_expiries;
+
+	void remove(BanID id);
+	static void removeFromTree(std::unique_ptr< Node > &node, const Address &prefix, unsigned int prefixLength,
+							   BanID id);
+};
+
+#endif
@@ -0,0 +1,84 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Broadcast.h"
+
+#include "Connection.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+void Broadcast::add(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
+					Version::full_t version, Version::CompareMode mode) {
+	assert(mode == Version::CompareMode::AtLeast || mode == Version::CompareMode::LessThan);
+
+	Part part;
+	part.version = version;
+	part.mode    = mode;
+	Connection::messageToNetwork(msg, type, part.data);
+
+	if (part.data.isEmpty()) {
+		// Too large to be sent
+		return;
+	}
+
+	if (version != Version::UNKNOWN) {
+		auto it = std::lower_bound(m_thresholds.begin(), m_thresholds.end(), version);
+		if (it == m_thresholds.end() || *it != version) {
+			m_thresholds.insert(it, version);
+		}
+	}
+
+	m_parts.push_back(std::move(part));
+
+	// The version ranges may have changed
+	m_variants.assign(m_thresholds.size() + 1, QByteArray());
+	m_variantsBuilt.assign(m_thresholds.size() + 1, false);
+}
+
+bool Broadcast::isEmpty() const {
+	return m_parts.empty();
+}
+
+const QByteArray &Broadcast::dataFor(Version::full_t version) {
+	const std::size_t range = static_cast< std::size_t >(
+		std::upper_bound(m_thresholds.begin(), m_thresholds.end(), version) - m_thresholds.begin());
+
+	if (m_variants.empty()) {
+		// Nothing has been added yet
+		m_variants.resize(1);
+		m_variantsBuilt.resize(1, false);
+	}
+
+	if (!m_variantsBuilt[range]) {
+		std::vector< const QByteArray * > matching;
+		int size = 0;
+		for (const Part &part : m_parts) {
+			const bool matches =
+				part.version == Version::UNKNOWN
+				|| (part.mode == Version::CompareMode::AtLeast ? version >= part.version : version < part.version);
+			if (matches) {
+				matching.push_back(&part.data);
+				size += part.data.size();
+			}
+		}
+
+		QByteArray &variant = m_variants[range];
+		if (matching.size() == 1) {
+			// A single message can be shared as it is
+			variant = *matching.front();
+		} else {
+			variant.reserve(size);
+			for (const QByteArray *data : matching) {
+				variant.append(*data);
+			}
+		}
+
+		m_variantsBuilt[range] = true;
+	}
+
+	return m_variants[range];
+}
@@ -0,0 +1,58 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BROADCAST_H_
+#define MUMBLE_MURMUR_BROADCAST_H_
+
+#include "MumbleProtocol.h"
+#include "Version.h"
+
+#include <QtCore/QByteArray>
+
+#include <vector>
+
+namespace google {
+namespace protobuf {
+	class Message;
+}
+} // namespace google
+
+/// A batch of messages that is sent to many clients at once.
+///
+/// Every message is serialized exactly once, when it is added. Each message may be restricted to clients of certain
+/// versions. The messages a client gets are concatenated into a single buffer that is shared (not copied) by all
+/// clients getting the same messages, so every client receives the whole batch with a single write.
+class Broadcast {
+public:
+	/// Serializes the given message and appends it to the batch.
+	///
+	/// @param version The version the message is restricted to (Version::UNKNOWN for sending it to all clients)
+	/// @param mode Whether clients need to have at least or less than the given version
+	void add(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
+			 Version::full_t version = Version::UNKNOWN, Version::CompareMode mode = Version::CompareMode::AtLeast);
+
+	bool isEmpty() const;
+
+	/// @returns The network representation of all messages meant for a client of the given version, in the order they
+	/// have been added. Clients for which the same messages are meant get the same (implicitly shared) buffer.
+	const QByteArray &dataFor(Version::full_t version);
+
+private:
+	struct Part {
+		QByteArray data;
+		Version::full_t version;
+		Version::CompareMode mode;
+	};
+
+	std::vector< Part > m_parts;
+	/// The distinct versions the parts are restricted by, in ascending order. Clients whose version lies between the
+	/// same two of them get the same messages.
+	std::vector< Version::full_t > m_thresholds;
+	/// The concatenated messages for each of the version ranges separated by the thresholds
+	std::vector< QByteArray > m_variants;
+	std::vector< bool > m_variantsBuilt;
+};
+
+#endif
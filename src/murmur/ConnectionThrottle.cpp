@@ -0,0 +1,179 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ConnectionThrottle.h"
+
+#include "crypto/CryptographicRandom.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+static_assert((ConnectionThrottle::BUCKETS & (ConnectionThrottle::BUCKETS - 1)) == 0,
+			  "BUCKETS must be a power of two");
+
+namespace {
+std::uint64_t mix(std::uint64_t value) {
+	// Finalizer of splitmix64
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+	return value ^ (value >> 31);
+}
+
+std::uint64_t readWord(const std::array< std::uint8_t, 16 > &bytes, std::size_t offset) {
+	std::uint64_t word = 0;
+	for (std::size_t i = 0; i < 8; ++i) {
+		word = (word << 8) | bytes[offset + i];
+	}
+
+	return word;
+}
+} // namespace
+
+ConnectionThrottle::ConnectionThrottle(unsigned int maxAttempts, std::uint64_t timeframe, std::uint64_t banTime)
+	: m_maxAttempts(maxAttempts), m_timeframe(timeframe > 0 ? timeframe : 1), m_banTime(banTime), m_seed(0),
+	  m_entries(BUCKETS * WAYS, Entry()) {
+	CryptographicRandom::fillBuffer(&m_seed, static_cast< int >(sizeof(m_seed)));
+}
+
+bool ConnectionThrottle::check(const HostAddress &address, std::uint64_t now) {
+	++m_statistics.attempts;
+
+	Entry &entry = findOrInsert(keyFor(address), now);
+
+	if (entry.bannedUntil > now) {
+		++m_statistics.rejected;
+		return true;
+	}
+
+	advance(entry, now);
+	if (entry.current != std::numeric_limits< std::uint32_t >::max()) {
+		++entry.current;
+	}
+
+	if (estimate(entry, now) > m_maxAttempts) {
+		entry.bannedUntil = now + m_banTime;
+
+		++m_statistics.bans;
+		++m_statistics.rejected;
+		return true;
+	}
+
+	return false;
+}
+
+void ConnectionThrottle::reset(const HostAddress &address, std::uint64_t now) {
+	Entry *entry = find(keyFor(address));
+	if (!entry) {
+		return;
+	}
+
+	advance(*entry, now);
+	entry->current  = 0;
+	entry->previous = 0;
+}
+
+const ConnectionThrottleStatistics &ConnectionThrottle::statistics() const {
+	return m_statistics;
+}
+
+ConnectionThrottle::Key ConnectionThrottle::keyFor(const HostAddress &address) {
+	const std::array< std::uint8_t, 16 > &bytes = address.getByteRepresentation();
+
+	// IPv4 addresses are mapped into ::ffff:0:0/96, so their relevant bits are in the lower half
+	return { readWord(bytes, 0), address.isV6() ? 0 : readWord(bytes, 8) };
+}
+
+std::size_t ConnectionThrottle::bucketFor(const Key &key) const {
+	return static_cast< std::size_t >(mix(mix(key.high ^ m_seed) ^ key.low) & (BUCKETS - 1));
+}
+
+ConnectionThrottle::Entry *ConnectionThrottle::find(const Key &key) {
+	const std::size_t bucket = bucketFor(key);
+
+	for (std::size_t i = bucket * WAYS; i < (bucket + 1) * WAYS; ++i) {
+		if (m_entries[i].used && m_entries[i].key == key) {
+			return &m_entries[i];
+		}
+	}
+
+	return nullptr;
+}
+
+ConnectionThrottle::Entry &ConnectionThrottle::findOrInsert(const Key &key, std::uint64_t now) {
+	const std::size_t bucket = bucketFor(key);
+
+	// If the source isn't tracked yet, prefer an unused entry, then the unbanned one with the fewest recent attempts
+	// (the oldest one among equals) and finally the ban that ends first
+	Entry *victim = nullptr;
+	std::tuple< bool, std::uint64_t, std::uint64_t > victimRank;
+	for (std::size_t i = bucket * WAYS; i < (bucket + 1) * WAYS; ++i) {
+		Entry &candidate = m_entries[i];
+		if (!candidate.used) {
+			if (!victim || victim->used) {
+				victim = &candidate;
+			}
+			continue;
+		}
+		if (candidate.key == key) {
+			return candidate;
+		}
+		if (victim && !victim->used) {
+			continue;
+		}
+
+		const bool banned = candidate.bannedUntil > now;
+		const std::tuple< bool, std::uint64_t, std::uint64_t > rank(
+			banned, banned ? candidate.bannedUntil : estimate(candidate, now), candidate.windowStart);
+		if (!victim || rank < victimRank) {
+			victim     = &candidate;
+			victimRank = rank;
+		}
+	}
+
+	if (victim->used && (std::get< 0 >(victimRank) || std::get< 1 >(victimRank) > 0)) {
+		++m_statistics.evictions;
+	}
+
+	victim->key         = key;
+	victim->windowStart = now;
+	victim->bannedUntil = 0;
+	victim->current     = 0;
+	victim->previous    = 0;
+	victim->used        = true;
+
+	return *victim;
+}
+
+void ConnectionThrottle::advance(Entry &entry, std::uint64_t now) const {
+	if (now < entry.windowStart + m_timeframe) {
+		return;
+	}
+
+	const std::uint64_t elapsedTimeframes = (now - entry.windowStart) / m_timeframe;
+
+	entry.previous = elapsedTimeframes == 1 ? entry.current : 0;
+	entry.current  = 0;
+	entry.windowStart += elapsedTimeframes * m_timeframe;
+}
+
+std::uint64_t ConnectionThrottle::estimate(const Entry &entry, std::uint64_t now) const {
+	const std::uint64_t elapsed = now - entry.windowStart;
+	if (elapsed >= 2 * m_timeframe) {
+		return 0;
+	}
+	if (elapsed >= m_timeframe) {
+		// The current timeframe of the entry has become the previous one
+		return static_cast< std::uint64_t >(
+			std::ceil(entry.current * (1.0 - static_cast< double >(elapsed - m_timeframe) / m_timeframe)));
+	}
+
+	// The part of the previous timeframe that still lies within the sliding window. Its attempts are assumed to be
+	// spread evenly and rounded up, erring on the side of banning.
+	const double previousWeight = 1.0 - static_cast< double >(elapsed) / m_timeframe;
+
+	return entry.current + static_cast< std::uint64_t >(std::ceil(entry.previous * previousWeight));
+}
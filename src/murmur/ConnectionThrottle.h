@@ -0,0 +1,99 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CONNECTIONTHROTTLE_H_
+#define MUMBLE_MURMUR_CONNECTIONTHROTTLE_H_
+
+#include "HostAddress.h"
+
+#include <cstdint>
+#include <vector>
+
+/// Counters describing the work done by a ConnectionThrottle.
+struct ConnectionThrottleStatistics {
+	/// The amount of connection attempts that have been checked
+	std::uint64_t attempts = 0;
+	/// The amount of connection attempts that have been rejected because their source was (or got) banned
+	std::uint64_t rejected = 0;
+	/// The amount of times a source has been banned for exceeding the allowed amount of attempts
+	std::uint64_t bans = 0;
+	/// The amount of sources that have been forgotten while still being tracked, in order to make room for others
+	std::uint64_t evictions = 0;
+};
+
+/// Limits the amount of connection attempts per source (the autoban) using a fixed amount of memory.
+///
+/// Sources are tracked in a set-associative table: each source is hashed to a bucket of WAYS entries, so looking a
+/// source up never takes more than WAYS comparisons. If a bucket is full, the entry with the least recent attempts
+/// makes room for a new source, such that sources hammering the server are kept while a flood of sources making
+/// only few attempts each can't grow memory. Bans are only dropped once all entries of a bucket are banned.
+///
+/// Each entry counts its attempts in the current and in the previous timeframe. The sliding timeframe is
+/// approximated by weighting the latter by the part of it that still overlaps with the sliding window.
+///
+/// IPv6 sources are tracked per /64 prefix, as that is what a single host usually gets assigned.
+class ConnectionThrottle {
+public:
+	static constexpr std::size_t BUCKETS = 4096;
+	static constexpr std::size_t WAYS    = 8;
+
+	/// @param maxAttempts The amount of attempts a source may make within the timeframe without getting banned
+	/// @param timeframe The length of the sliding window attempts are counted in (in microseconds)
+	/// @param banTime How long a source that exceeded the limit stays banned (in microseconds)
+	ConnectionThrottle(unsigned int maxAttempts, std::uint64_t timeframe, std::uint64_t banTime);
+
+	/// Records a connection attempt from the given address.
+	///
+	/// @param now The current time (in microseconds), which must not decrease between calls
+	/// @returns Whether the address is banned and the connection should be dropped
+	bool check(const HostAddress &address, std::uint64_t now);
+	/// Forgets the attempts recorded for the given address (but not a ban that has already been issued).
+	void reset(const HostAddress &address, std::uint64_t now);
+
+	const ConnectionThrottleStatistics &statistics() const;
+
+private:
+	struct Key {
+		std::uint64_t high;
+		std::uint64_t low;
+
+		bool operator==(const Key &other) const { return high == other.high && low == other.low; }
+	};
+
+	struct Entry {
+		Key key;
+		/// The start of the current timeframe of this source
+		std::uint64_t windowStart;
+		/// The time until which this source is banned
+		std::uint64_t bannedUntil;
+		/// The attempts in the current and in the previous timeframe
+		std::uint32_t current;
+		std::uint32_t previous;
+		bool used;
+	};
+
+	unsigned int m_maxAttempts;
+	std::uint64_t m_timeframe;
+	std::uint64_t m_banTime;
+
+	/// Random hash seed, so that sources can't deliberately be chosen to compete for the same bucket
+	std::uint64_t m_seed;
+	/// BUCKETS buckets of WAYS entries each
+	std::vector< Entry > m_entries;
+
+	ConnectionThrottleStatistics m_statistics;
+
+	static Key keyFor(const HostAddress &address);
+	std::size_t bucketFor(const Key &key) const;
+	Entry *find(const Key &key);
+	/// @returns The entry for the given source, making room for it if it isn't tracked yet
+	Entry &findOrInsert(const Key &key, std::uint64_t now);
+	/// Moves the given entry on to the timeframe the given time lies in
+	void advance(Entry &entry, std::uint64_t now) const;
+	/// @returns The estimated amount of attempts of the given entry within the sliding window
+	std::uint64_t estimate(const Entry &entry, std::uint64_t now) const;
+};
+
+#endif
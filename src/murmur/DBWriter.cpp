@@ -0,0 +1,133 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "DBWriter.h"
+
+#include "Timer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <utility>
+
+constexpr std::size_t DBWriter::MAX_BATCH_SIZE;
+
+double DBWriterStatistics::averageBatchTime() const {
+	return batches > 0 ? static_cast< double >(totalBatchTime) / static_cast< double >(batches) : 0.0;
+}
+
+DBWriter::DBWriter() {
+}
+
+DBWriter::~DBWriter() {
+	// The thread has to be stopped by the subclass, as it calls the subclass' hooks
+	assert(!isRunning());
+}
+
+std::uint64_t DBWriter::enqueue(Command command) {
+	QMutexLocker l(&m_mutex);
+
+	m_queue.push_back(std::move(command));
+	++m_enqueuedCount;
+	m_statistics.maxQueueDepth = std::max< std::uint64_t >(m_statistics.maxQueueDepth, m_queue.size());
+
+	m_queued.wakeOne();
+
+	return m_enqueuedCount;
+}
+
+void DBWriter::flush() {
+	assert(QThread::currentThread() != this);
+
+	QMutexLocker l(&m_mutex);
+
+	const std::uint64_t target = m_enqueuedCount;
+	while (m_committedCount < target && !m_finished) {
+		m_committed.wait(&m_mutex);
+	}
+}
+
+void DBWriter::stop() {
+	{
+		QMutexLocker l(&m_mutex);
+		m_stopping = true;
+		m_queued.wakeOne();
+	}
+
+	wait();
+}
+
+std::size_t DBWriter::queueDepth() const {
+	QMutexLocker l(&m_mutex);
+
+	return m_queue.size();
+}
+
+std::uint64_t DBWriter::committed() const {
+	QMutexLocker l(&m_mutex);
+
+	return m_committedCount;
+}
+
+DBWriterStatistics DBWriter::statistics() const {
+	QMutexLocker l(&m_mutex);
+
+	return m_statistics;
+}
+
+void DBWriter::run() {
+	setUp();
+
+	std::vector< Command > batch;
+	batch.reserve(MAX_BATCH_SIZE);
+
+	while (true) {
+		{
+			QMutexLocker l(&m_mutex);
+
+			while (m_queue.empty() && !m_stopping) {
+				m_queued.wait(&m_mutex);
+			}
+			if (m_queue.empty()) {
+				break;
+			}
+
+			const auto end = m_queue.begin() + static_cast< std::ptrdiff_t >(std::min(m_queue.size(), MAX_BATCH_SIZE));
+			std::move(m_queue.begin(), end, std::back_inserter(batch));
+			m_queue.erase(m_queue.begin(), end);
+		}
+
+		Timer timer;
+
+		beginBatch();
+		for (Command &command : batch) {
+			command();
+		}
+		commitBatch();
+
+		const std::uint64_t elapsed = timer.elapsed();
+
+		{
+			QMutexLocker l(&m_mutex);
+
+			m_committedCount += batch.size();
+			m_statistics.commands += batch.size();
+			m_statistics.batches++;
+			m_statistics.totalBatchTime += elapsed;
+			m_statistics.maxBatchTime = std::max(m_statistics.maxBatchTime, elapsed);
+
+			m_committed.wakeAll();
+		}
+
+		batch.clear();
+	}
+
+	tearDown();
+
+	// Wake anyone still waiting in flush(), as nothing is going to be committed anymore
+	QMutexLocker l(&m_mutex);
+	m_finished = true;
+	m_committed.wakeAll();
+}
@@ -0,0 +1,97 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_DBWRITER_H_
+#define MUMBLE_MURMUR_DBWRITER_H_
+
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+/// Counters describing the work done by a DBWriter.
+struct DBWriterStatistics {
+	/// The amount of commands that have been executed
+	std::uint64_t commands = 0;
+	/// The amount of batches (transactions) these commands have been executed in
+	std::uint64_t batches = 0;
+	/// The biggest amount of commands that have been waiting to be executed at once
+	std::uint64_t maxQueueDepth = 0;
+	/// The total time it took to execute and commit all batches (in microseconds)
+	std::uint64_t totalBatchTime = 0;
+	/// The longest time it took to execute and commit a single batch (in microseconds)
+	std::uint64_t maxBatchTime = 0;
+
+	double averageBatchTime() const;
+};
+
+/// Executes writes to the database on a thread of its own, such that the thread queueing them doesn't have to wait
+/// for the database.
+///
+/// Commands are executed in the order they have been queued. All commands that are waiting when the thread gets to
+/// them (up to MAX_BATCH_SIZE) are executed as a single batch, between one call to beginBatch and one call to
+/// commitBatch. Subclasses use these to run the batch in a single transaction, so that small writes share a commit.
+class DBWriter : public QThread {
+private:
+	Q_DISABLE_COPY(DBWriter)
+
+public:
+	using Command = std::function< void() >;
+
+	/// The maximum amount of commands that are executed in a single batch
+	static constexpr std::size_t MAX_BATCH_SIZE = 256;
+
+	DBWriter();
+	/// Subclasses have to call stop() in their destructor
+	~DBWriter() Q_DECL_OVERRIDE;
+
+	/// Queues the given command. It must not refer to any state that may be changed by other threads.
+	///
+	/// @returns The command's ticket. Tickets increase with every command, such that the command has been committed
+	/// once committed() has reached its ticket.
+	std::uint64_t enqueue(Command command);
+	/// Blocks until all commands that have been queued before have been executed and committed. Must not be called
+	/// from within a command.
+	void flush();
+	/// Executes all remaining commands and ends the thread
+	void stop();
+
+	/// @returns The amount of commands currently waiting to be executed
+	std::size_t queueDepth() const;
+	/// @returns The ticket of the last command that has been committed (0 if there is none)
+	std::uint64_t committed() const;
+	DBWriterStatistics statistics() const;
+
+protected:
+	/// Called on the writer thread before any command is executed, e.g. to open a database connection
+	virtual void setUp() {}
+	/// Called on the writer thread after all commands have been executed
+	virtual void tearDown() {}
+	virtual void beginBatch() {}
+	virtual void commitBatch() {}
+
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	mutable QMutex m_mutex;
+	/// Signalled when commands have been queued or the thread should stop
+	QWaitCondition m_queued;
+	/// Signalled when a batch has been committed
+	QWaitCondition m_committed;
+	std::deque< Command > m_queue;
+	/// The amount of commands that have been queued and that have been committed so far. Used by flush().
+	std::uint64_t m_enqueuedCount  = 0;
+	std::uint64_t m_committedCount = 0;
+	bool m_stopping                = false;
+	/// Whether the thread has ended, after which nothing is going to be committed anymore
+	bool m_finished = false;
+	DBWriterStatistics m_statistics;
+};
+
+#endif
@@ -517,51 +517,58 @@ void MurmurDBus::setACL(int id, const QList< ACLInfo > &acls, const QList< Group
 	ACLInfo ai;
 	GroupInfo gi;
 
-	QHash< QString, QSet< int > > hOldTemp;
+	{
+		QWriteLocker wl(&server->qrwlVoiceThread);
 
-	foreach (g, cChannel->qhGroups) {
-		hOldTemp.insert(g->qsName, g->qsTemporary);
-		delete g;
-	}
-	foreach (a, cChannel->qlACL)
-		delete a;
-	cChannel->qhGroups.clear();
-	cChannel->qlACL.clear();
+		QHash< QString, QSet< int > > hOldTemp;
+
+		foreach (g, cChannel->qhGroups) {
+			hOldTemp.insert(g->qsName, g->qsTemporary);
+			delete g;
+		}
+		foreach (a, cChannel->qlACL)
+			delete a;
+		cChannel->qhGroups.clear();
+		cChannel->qlACL.clear();
 
-	cChannel->bInheritACL = inherit;
+		cChannel->bInheritACL = inherit;
 
-	foreach (gi, groups) {
-		g               = new Group(cChannel, gi.name);
-		g->bInherit     = gi.inherit;
-		g->bInheritable = gi.inheritable;
+		foreach (gi, groups) {
+			g               = new Group(cChannel, gi.name);
+			g->bInherit     = gi.inherit;
+			g->bInheritable = gi.inheritable;
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-		g->qsAdd    = QSet< int >(gi.add.begin(), gi.add.end());
-		g->qsRemove = QSet< int >(gi.remove.begin(), gi.remove.end());
+			g->qsAdd    = QSet< int >(gi.add.begin(), gi.add.end());
+			g->qsRemove = QSet< int >(gi.remove.begin(), gi.remove.end());
 #else
-		// In Qt 5.14 QList::toSet() has been deprecated as there exists a dedicated constructor of QSet for this now
-		g->qsAdd    = gi.add.toSet();
-		g->qsRemove = gi.remove.toSet();
+			// In Qt 5.14 QList::toSet() has been deprecated as there exists a dedicated constructor of QSet for this
+			// now
+			g->qsAdd    = gi.add.toSet();
+			g->qsRemove = gi.remove.toSet();
 #endif
-		g->qsTemporary = hOldTemp.value(gi.name);
-	}
+			g->qsTemporary = hOldTemp.value(gi.name);
+		}
+
+		foreach (ai, acls) {
+			a             = new ChanACL(cChannel);
+			a->bApplyHere = ai.applyHere;
+			a->bApplySubs = ai.applySubs;
+			a->iUserId    = ai.playerid;
+			a->qsGroup    = ai.group;
+			a->pDeny      = static_cast< ChanACL::Permissions >(ai.deny) & ChanACL::All;
+			a->pAllow     = static_cast< ChanACL::Permissions >(ai.allow) & ChanACL::All;
+		}
 
-	foreach (ai, acls) {
-		a             = new ChanACL(cChannel);
-		a->bApplyHere = ai.applyHere;
-		a->bApplySubs = ai.applySubs;
-		a->iUserId    = ai.playerid;
-		a->qsGroup    = ai.group;
-		a->pDeny      = static_cast< ChanACL::Permissions >(ai.deny) & ChanACL::All;
-		a->pAllow     = static_cast< ChanACL::Permissions >(ai.allow) & ChanACL::All;
+		ChanACL::invalidatePrograms(cChannel);
 	}
 
-	server->clearACLCache();
+	server->clearChannelACLCache(cChannel);
 	server->updateChannel(cChannel);
 }
 
 void MurmurDBus::getBans(QList< BanInfo > &bi) {
 	bi.clear();
-	foreach (const Ban &b, server->qlBans) {
+	foreach (const Ban &b, server->m_bans.bans()) {
 		if (!b.haAddress.isV6())
 			bi << BanInfo(b);
 	}
@@ -0,0 +1,100 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LogBuffer.h"
+
+#include <algorithm>
+#include <utility>
+
+constexpr std::size_t LogBuffer::FLUSH_SIZE;
+
+bool LogBuffer::append(int serverId, unsigned int time, const QString &message) {
+	QMutexLocker l(&m_mutex);
+
+	m_pending.push_back({ serverId, time, message });
+	return m_pending.size() == 1;
+}
+
+std::vector< BufferedLogRecord > LogBuffer::pending() const {
+	QMutexLocker l(&m_mutex);
+
+	return std::vector< BufferedLogRecord >(m_pending.begin(), m_pending.end());
+}
+
+std::size_t LogBuffer::pendingCount() const {
+	QMutexLocker l(&m_mutex);
+
+	return m_pending.size();
+}
+
+void LogBuffer::sent(std::size_t count, std::uint64_t ticket) {
+	QMutexLocker l(&m_mutex);
+
+	count = std::min(count, m_pending.size());
+	for (std::size_t i = 0; i < count; ++i) {
+		m_sent.push_back({ std::move(m_pending.front()), ticket });
+		m_pending.pop_front();
+	}
+}
+
+void LogBuffer::committed(std::uint64_t ticket) {
+	QMutexLocker l(&m_mutex);
+
+	while (!m_sent.empty() && m_sent.front().ticket <= ticket) {
+		m_sent.pop_front();
+	}
+}
+
+bool LogBuffer::hasCommitted(std::uint64_t ticket) const {
+	QMutexLocker l(&m_mutex);
+
+	return !m_sent.empty() && m_sent.front().ticket <= ticket;
+}
+
+std::vector< BufferedLogRecord > LogBuffer::records(int serverId) const {
+	QMutexLocker l(&m_mutex);
+
+	std::vector< BufferedLogRecord > records;
+	for (auto it = m_pending.rbegin(); it != m_pending.rend(); ++it) {
+		if (it->serverId == serverId) {
+			records.push_back(*it);
+		}
+	}
+	for (auto it = m_sent.rbegin(); it != m_sent.rend(); ++it) {
+		if (it->record.serverId == serverId) {
+			records.push_back(it->record);
+		}
+	}
+
+	return records;
+}
+
+int LogBuffer::count(int serverId) const {
+	QMutexLocker l(&m_mutex);
+
+	const auto matches = std::count_if(m_pending.begin(), m_pending.end(), [serverId](const BufferedLogRecord &r) {
+		return r.serverId == serverId;
+	});
+	const auto sentMatches = std::count_if(m_sent.begin(), m_sent.end(), [serverId](const SentRecord &r) {
+		return r.record.serverId == serverId;
+	});
+
+	return static_cast< int >(matches + sentMatches);
+}
+
+void LogBuffer::remove(int serverId) {
+	QMutexLocker l(&m_mutex);
+
+	m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(),
+								   [serverId](const BufferedLogRecord &r) { return r.serverId == serverId; }),
+					m_pending.end());
+}
+
+void LogBuffer::clear() {
+	QMutexLocker l(&m_mutex);
+
+	m_pending.clear();
+	m_sent.clear();
+}
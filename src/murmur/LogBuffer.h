@@ -0,0 +1,69 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_LOGBUFFER_H_
+#define MUMBLE_MURMUR_LOGBUFFER_H_
+
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/// A line of a server's log that may not have been written to the database yet
+struct BufferedLogRecord {
+	int serverId;
+	/// The time the line has been logged at (seconds since the epoch)
+	unsigned int time;
+	QString message;
+};
+
+/// Keeps the lines of the servers' logs until they have been written to the database, such that they can be written
+/// in batches and can be read in the meantime.
+///
+/// Records are pending until they are sent to the database and are then kept until the write they have been sent with
+/// has been committed. Writes are identified by increasing tickets, such that a single number tells which of them have
+/// been committed.
+class LogBuffer {
+public:
+	/// The amount of pending records at which they should be written without waiting any longer
+	static constexpr std::size_t FLUSH_SIZE = 64;
+
+	/// @returns Whether the record is the first pending one, i.e. whether writing it has to be scheduled
+	bool append(int serverId, unsigned int time, const QString &message);
+
+	/// @returns The records that are pending, oldest first
+	std::vector< BufferedLogRecord > pending() const;
+	std::size_t pendingCount() const;
+	/// Marks the given amount of the oldest pending records as sent with the write that has the given ticket
+	void sent(std::size_t count, std::uint64_t ticket);
+	/// Forgets about all records that have been sent with writes up to the given ticket, as they are in the database
+	void committed(std::uint64_t ticket);
+	/// @returns Whether there are records left that have been sent with writes up to the given ticket
+	bool hasCommitted(std::uint64_t ticket) const;
+
+	/// @returns The records of the given server that are still kept, newest first
+	std::vector< BufferedLogRecord > records(int serverId) const;
+	/// @returns The amount of records of the given server that are still kept
+	int count(int serverId) const;
+
+	/// Forgets about the pending records of the given server
+	void remove(int serverId);
+	void clear();
+
+private:
+	struct SentRecord {
+		BufferedLogRecord record;
+		std::uint64_t ticket;
+	};
+
+	mutable QMutex m_mutex;
+	/// Ordered by ticket
+	std::deque< SentRecord > m_sent;
+	std::deque< BufferedLogRecord > m_pending;
+};
+
+#endif
@@ -19,11 +19,17 @@
 #include "User.h"
 #include "Version.h"
 #include "crypto/CryptState.h"
+#include "crypto/CryptStateChaCha20Poly1305.h"
+#include "crypto/CryptographicRandom.h"
 
+#include <QtCore/QPointer>
 #include <QtCore/QStack>
 #include <QtCore/QtEndian>
 
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <string>
 #include <unordered_map>
 
 #include <tracy/Tracy.hpp>
@@ -162,6 +168,172 @@ bool isChannelEnterRestricted(Channel *c) {
 	return false;
 }
 
+namespace {
+/// @returns The network representation of a ChannelState only consisting of the given permission dependent fields.
+/// 	Appended to a serialized ChannelState, these fields are merged into it by the receiver.
+const std::string &channelPermissionFields(bool enterRestricted, bool canEnter) {
+	static const std::array< std::string, 4 > fields = []() {
+		std::array< std::string, 4 > result;
+		for (std::size_t i = 0; i < result.size(); ++i) {
+			MumbleProto::ChannelState mpcs;
+			mpcs.set_is_enter_restricted((i & 2) != 0);
+			mpcs.set_can_enter((i & 1) != 0);
+			result[i] = mpcs.SerializeAsString();
+		}
+		return result;
+	}();
+
+	return fields[(enterRestricted ? 2 : 0) + (canEnter ? 1 : 0)];
+}
+} // namespace
+
+void Server::fillChannelSyncState(Channel *c, bool sendHashes, MumbleProto::ChannelState &mpcs) const {
+	mpcs.set_channel_id(c->iId);
+	if (c->cParent)
+		mpcs.set_parent(c->cParent->iId);
+	if (c->iId == 0)
+		mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
+	else
+		mpcs.set_name(u8(c->qsName));
+
+	mpcs.set_position(c->iPosition);
+
+	if (sendHashes && !c->qbaDescHash.isEmpty())
+		mpcs.set_description_hash(blob(c->qbaDescHash));
+	else if (!c->qsDesc.isEmpty())
+		mpcs.set_description(u8(c->qsDesc));
+
+	mpcs.set_max_users(c->uiMaxUsers);
+}
+
+void Server::fillUserSyncState(ServerUser *u, bool sendHashes, bool sendTexture, MumbleProto::UserState &mpus) {
+	mpus.set_session(u->uiSession);
+	mpus.set_name(u8(u->qsName));
+	if (u->iId >= 0)
+		mpus.set_user_id(static_cast< unsigned int >(u->iId));
+	if (sendHashes) {
+		if (!u->qbaTextureHash.isEmpty())
+			mpus.set_texture_hash(blob(u->qbaTextureHash));
+		else if (!u->qbaTexture.isEmpty())
+			mpus.set_texture(blob(u->qbaTexture));
+	} else if (sendTexture) {
+		mpus.set_texture(blob(u->qbaTexture));
+	}
+	if (u->cChannel->iId != 0)
+		mpus.set_channel_id(u->cChannel->iId);
+	if (u->bDeaf)
+		mpus.set_deaf(true);
+	else if (u->bMute)
+		mpus.set_mute(true);
+	if (u->bSuppress)
+		mpus.set_suppress(true);
+	if (u->bPrioritySpeaker)
+		mpus.set_priority_speaker(true);
+	if (u->bRecording)
+		mpus.set_recording(true);
+	if (u->bSelfDeaf)
+		mpus.set_self_deaf(true);
+	else if (u->bSelfMute)
+		mpus.set_self_mute(true);
+	if (sendHashes && !u->qbaCommentHash.isEmpty())
+		mpus.set_comment_hash(blob(u->qbaCommentHash));
+	else if (!u->qsComment.isEmpty())
+		mpus.set_comment(u8(u->qsComment));
+	if (!u->qsHash.isEmpty())
+		mpus.set_hash(u8(u->qsHash));
+
+	for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
+		mpus.add_listening_channel_add(channelID);
+
+		if (broadcastListenerVolumeAdjustments) {
+			VolumeAdjustment volume = m_channelListenerManager.getListenerVolumeAdjustment(u->uiSession, channelID);
+			MumbleProto::UserState::VolumeAdjustment *adjustment = mpus.add_listening_volume_adjustment();
+			adjustment->set_listening_channel(channelID);
+			adjustment->set_volume_adjustment(volume.factor);
+		}
+	}
+}
+
+void Server::appendChannelSyncState(QByteArray &buffer, Channel *c, ServerUser *recipient) {
+	QByteArray uncached;
+	const QByteArray *state = &uncached;
+
+	if (recipient->m_version >= Version::fromComponents(1, 2, 2)) {
+		auto it = m_channelSyncStates.find(c->iId);
+		if (it == m_channelSyncStates.end()) {
+			MumbleProto::ChannelState mpcs;
+			fillChannelSyncState(c, true, mpcs);
+			it = m_channelSyncStates.insert(c->iId, QByteArray());
+			Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, it.value());
+		}
+		state = &it.value();
+	} else {
+		MumbleProto::ChannelState mpcs;
+		fillChannelSyncState(c, false, mpcs);
+		Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, uncached);
+	}
+
+	if (state->isEmpty()) {
+		return;
+	}
+
+	const std::string &permissionFields =
+		channelPermissionFields(isChannelEnterRestricted(c), hasPermission(recipient, c, ChanACL::Enter));
+
+	const int offset = buffer.size();
+	buffer.append(*state);
+	buffer.append(permissionFields.data(), static_cast< int >(permissionFields.size()));
+
+	// Account for the appended fields in the length of the message
+	qToBigEndian< quint32 >(static_cast< quint32 >(buffer.size() - offset - 6),
+							reinterpret_cast< unsigned char * >(buffer.data()) + offset + 2);
+}
+
+void Server::appendChannelSyncLinks(QByteArray &buffer, Channel *c) {
+	auto it = m_channelSyncLinks.find(c->iId);
+	if (it == m_channelSyncLinks.end()) {
+		it = m_channelSyncLinks.insert(c->iId, QByteArray());
+
+		if (c->qhLinks.count() > 0) {
+			MumbleProto::ChannelState mpcs;
+			mpcs.set_channel_id(c->iId);
+
+			foreach (Channel *l, c->qhLinks.keys())
+				mpcs.add_links(l->iId);
+			Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, it.value());
+		}
+	}
+
+	buffer.append(it.value());
+}
+
+void Server::appendUserSyncState(QByteArray &buffer, ServerUser *u, ServerUser *recipient) {
+	if (recipient->m_version >= Version::fromComponents(1, 2, 2)) {
+		auto it = m_userSyncStates.find(u->uiSession);
+		if (it == m_userSyncStates.end()) {
+			MumbleProto::UserState mpus;
+			fillUserSyncState(u, true, false, mpus);
+			it = m_userSyncStates.insert(u->uiSession, QByteArray());
+			Connection::messageToNetwork(mpus, Mumble::Protocol::TCPMessageType::UserState, it.value());
+		}
+
+		buffer.append(it.value());
+	} else {
+		// Clients < 1.2.2 only get to see textures if they use an old style texture themselves
+		const bool sendTexture = (recipient->qbaTexture.length() >= 4)
+								 && (qFromBigEndian< unsigned int >(reinterpret_cast< const unsigned char * >(
+										 recipient->qbaTexture.constData()))
+									 == 600 * 60 * 4);
+
+		MumbleProto::UserState mpus;
+		fillUserSyncState(u, false, sendTexture, mpus);
+
+		QByteArray serialized;
+		Connection::messageToNetwork(mpus, Mumble::Protocol::TCPMessageType::UserState, serialized);
+		buffer.append(serialized);
+	}
+}
+
 void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg) {
 	ZoneScoped;
 
@@ -193,6 +365,11 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	}
 	MSG_SETUP(ServerUser::Connected);
 
+	// The client has authenticated already and is waiting for its password to be checked
+	if (uSource->m_verifyingPassword) {
+		return;
+	}
+
 	// As the first thing, assign a session ID to this client. Given that the client initiated
 	// the authentication procedure we can be sure that this is not just a random TCP connection.
 	// Thus it is about time we assign the ID to this client in order to be able to reference it
@@ -202,13 +379,64 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		uSource->uiSession = qqIds.dequeue();
 		qhUsers.insert(uSource->uiSession, uSource);
 		qhHostUsers[uSource->haAddress].insert(uSource);
+
+		if (uSource->m_udpAssociationSupported) {
+			std::uint32_t token;
+			do {
+				token = CryptographicRandom::uint32();
+			} while (token == 0 || m_udpAssociationTokens.contains(token));
+
+			uSource->m_udpAssociationToken = token;
+			m_udpAssociationTokens.insert(token, uSource);
+		}
 	}
 
+	uSource->qsName = u8(msg.username()).trimmed();
+
+	// Checking a password against its PBKDF2 hash deliberately takes long, which is why the hash is computed on the
+	// password hashing threads. Authentication is finished once it is done.
+	const QString pw           = u8(msg.password());
+	const RegisteredUser *user = nullptr;
+	if (!pw.isEmpty() && !bForceExternalAuth) {
+		user = userDirectory().find(userDirectory().findByName(uSource->qsName));
+	}
+
+	if (user && !user->passwordHash.isEmpty() && user->kdfIterations > 0) {
+		QPointer< ServerUser > source(uSource);
+
+		const bool started = meta->m_passwordHasher.hash(
+			this, uSource->haAddress, user->salt, pw, user->kdfIterations,
+			[this, source, msg](const PasswordHash &passwordHash) {
+				// The user may have disconnected in the meantime
+				if (source && qhUsers.value(source->uiSession) == source) {
+					source->m_verifyingPassword = false;
+					finishAuthenticate(source, msg, &passwordHash);
+				}
+			});
+
+		if (!started) {
+			log(uSource, QString("Rejected connection from %1: Too many concurrent password checks")
+							 .arg(addressToString(uSource->peerAddress(), uSource->peerPort())));
+			MumbleProto::Reject mpr;
+			mpr.set_reason("Too many login attempts from your address. Please try again later");
+			mpr.set_type(MumbleProto::Reject_RejectType_AuthenticatorFail);
+			sendMessage(uSource, mpr);
+			uSource->disconnectSocket();
+			return;
+		}
+
+		uSource->m_verifyingPassword = true;
+		return;
+	}
+
+	finishAuthenticate(uSource, msg, nullptr);
+}
+
+void Server::finishAuthenticate(ServerUser *uSource, const MumbleProto::Authenticate &msg,
+								const PasswordHash *passwordHash) {
 	Channel *root = qhChannels.value(0);
 	Channel *c;
 
-	uSource->qsName = u8(msg.username()).trimmed();
-
 	bool ok     = false;
 	bool nameok = validateUserName(uSource->qsName);
 	QString pw  = u8(msg.password());
@@ -217,7 +445,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	// Since this may call DBus, which may recall our dbus messages, this function needs
 	// to support re-entrancy, and also to support the fact that sessions may go away.
 	int id = authenticate(uSource->qsName, pw, static_cast< int >(uSource->uiSession), uSource->qslEmail,
-						  uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain());
+						  uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain(), passwordHash);
 
 	uSource->iId = id >= 0 ? id : -1;
 
@@ -340,12 +568,21 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	{
 		QMutexLocker l(&uSource->qmCrypt);
 
+		MumbleProto::CryptSetup mpcrypt;
+		if (uSource->qlCipherModes.contains(MumbleProto::CryptSetup_CipherMode_ChaCha20Poly1305)) {
+			// The voice threads only access the crypt state while holding qmCrypt
+			uSource->csCrypt = std::make_unique< CryptStateChaCha20Poly1305 >();
+			mpcrypt.set_mode(MumbleProto::CryptSetup_CipherMode_ChaCha20Poly1305);
+		}
+
 		uSource->csCrypt->genKey();
 
-		MumbleProto::CryptSetup mpcrypt;
 		mpcrypt.set_key(uSource->csCrypt->getRawKey());
 		mpcrypt.set_server_nonce(uSource->csCrypt->getEncryptIV());
 		mpcrypt.set_client_nonce(uSource->csCrypt->getDecryptIV());
+		if (uSource->m_udpAssociationToken != 0) {
+			mpcrypt.set_udp_association_token(uSource->m_udpAssociationToken);
+		}
 		sendMessage(uSource, mpcrypt);
 	}
 
@@ -374,56 +611,25 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 						  "talk to or hear most clients. Please make sure your client was built with CELT support."));
 	}
 
-	// Transmit channel tree
+	// Transmit channel tree and links in one go. Most of it is serialized once and shared by all clients.
+	QByteArray sync;
 	QQueue< Channel * > q;
-	QSet< Channel * > chans;
+	QList< Channel * > chans;
 	q << root;
-	MumbleProto::ChannelState mpcs;
 
 	while (!q.isEmpty()) {
 		c = q.dequeue();
-		chans.insert(c);
-
-		mpcs.Clear();
-
-		mpcs.set_channel_id(c->iId);
-		if (c->cParent)
-			mpcs.set_parent(c->cParent->iId);
-		if (c->iId == 0)
-			mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
-		else
-			mpcs.set_name(u8(c->qsName));
-
-		mpcs.set_position(c->iPosition);
-
-		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !c->qbaDescHash.isEmpty())
-			mpcs.set_description_hash(blob(c->qbaDescHash));
-		else if (!c->qsDesc.isEmpty())
-			mpcs.set_description(u8(c->qsDesc));
-
-		mpcs.set_max_users(c->uiMaxUsers);
+		chans << c;
 
-		// Include info about enter restrictions of this channel
-		mpcs.set_is_enter_restricted(isChannelEnterRestricted(c));
-		mpcs.set_can_enter(hasPermission(uSource, c, ChanACL::Enter));
-
-		sendMessage(uSource, mpcs);
+		appendChannelSyncState(sync, c, uSource);
 
 		foreach (c, c->qlChannels)
 			q.enqueue(c);
 	}
 
-	// Transmit links
-	foreach (c, chans) {
-		if (c->qhLinks.count() > 0) {
-			mpcs.Clear();
-			mpcs.set_channel_id(c->iId);
+	foreach (c, chans) { appendChannelSyncLinks(sync, c); }
 
-			foreach (Channel *l, c->qhLinks.keys())
-				mpcs.add_links(l->iId);
-			sendMessage(uSource, mpcs);
-		}
-	}
+	uSource->sendMessage(sync);
 
 	loadChannelListenersOf(*uSource);
 
@@ -436,6 +642,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		QWriteLocker wl(&qrwlVoiceThread);
 		uSource->sState = ServerUser::Authenticated;
 	}
+	scheduleVoiceRoutingUpdate();
 
 	mpus.set_session(uSource->uiSession);
 	mpus.set_name(u8(uSource->qsName));
@@ -463,7 +670,8 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 
 	mpus.set_channel_id(uSource->cChannel->iId);
 
-	sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+	Broadcast joined;
+	addToBroadcast(joined, mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
 
 	if ((uSource->qbaTexture.length() >= 4)
 		&& (qFromBigEndian< unsigned int >(reinterpret_cast< const unsigned char * >(uSource->qbaTexture.constData()))
@@ -471,9 +679,12 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		mpus.set_texture(blob(uSource->qbaTexture));
 	if (!uSource->qsComment.isEmpty())
 		mpus.set_comment(u8(uSource->qsComment));
-	sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+	addToBroadcast(joined, mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+
+	sendBroadcast(joined);
 
 	// Transmit other users profiles
+	sync.clear();
 	foreach (ServerUser *u, qhUsers) {
 		if (u->sState != ServerUser::Authenticated)
 			continue;
@@ -481,60 +692,11 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		if (u == uSource)
 			continue;
 
-		mpus.Clear();
-		mpus.set_session(u->uiSession);
-		mpus.set_name(u8(u->qsName));
-		if (u->iId >= 0)
-			mpus.set_user_id(static_cast< unsigned int >(u->iId));
-		if (uSource->m_version >= Version::fromComponents(1, 2, 2)) {
-			if (!u->qbaTextureHash.isEmpty())
-				mpus.set_texture_hash(blob(u->qbaTextureHash));
-			else if (!u->qbaTexture.isEmpty())
-				mpus.set_texture(blob(u->qbaTexture));
-		} else if ((uSource->qbaTexture.length() >= 4)
-				   && (qFromBigEndian< unsigned int >(
-						   reinterpret_cast< const unsigned char * >(uSource->qbaTexture.constData()))
-					   == 600 * 60 * 4)) {
-			mpus.set_texture(blob(u->qbaTexture));
-		}
-		if (u->cChannel->iId != 0)
-			mpus.set_channel_id(u->cChannel->iId);
-		if (u->bDeaf)
-			mpus.set_deaf(true);
-		else if (u->bMute)
-			mpus.set_mute(true);
-		if (u->bSuppress)
-			mpus.set_suppress(true);
-		if (u->bPrioritySpeaker)
-			mpus.set_priority_speaker(true);
-		if (u->bRecording)
-			mpus.set_recording(true);
-		if (u->bSelfDeaf)
-			mpus.set_self_deaf(true);
-		else if (u->bSelfMute)
-			mpus.set_self_mute(true);
-		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !u->qbaCommentHash.isEmpty())
-			mpus.set_comment_hash(blob(u->qbaCommentHash));
-		else if (!u->qsComment.isEmpty())
-			mpus.set_comment(u8(u->qsComment));
-		if (!u->qsHash.isEmpty())
-			mpus.set_hash(u8(u->qsHash));
-
-
-		for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
-			mpus.add_listening_channel_add(channelID);
-
-			if (broadcastListenerVolumeAdjustments) {
-				VolumeAdjustment volume = m_channelListenerManager.getListenerVolumeAdjustment(u->uiSession, channelID);
-				MumbleProto::UserState::VolumeAdjustment *adjustment = mpus.add_listening_volume_adjustment();
-				adjustment->set_listening_channel(channelID);
-				adjustment->set_volume_adjustment(volume.factor);
-			}
-		}
-
-		sendMessage(uSource, mpus);
+		appendUserSyncState(sync, u, uSource);
 	}
 
+	uSource->sendMessage(sync);
+
 	// Send synchronisation packet
 	MumbleProto::ServerSync mpss;
 	mpss.set_session(uSource->uiSession);
@@ -547,7 +709,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	} else {
 		QMutexLocker qml(&qmCache);
 		ChanACL::hasPermission(uSource, root, ChanACL::Enter, &acCache);
-		mpss.set_permissions(acCache.value(uSource)->value(root));
+		mpss.set_permissions(acCache.value(uSource)->value(root).permissions);
 	}
 
 	sendMessage(uSource, mpss);
@@ -663,7 +825,7 @@ void Server::msgBanList(ServerUser *uSource, MumbleProto::BanList &msg) {
 	if (msg.query()) {
 		msg.clear_query();
 		msg.clear_bans();
-		foreach (const Ban &b, qlBans) {
+		foreach (const Ban &b, m_bans.bans()) {
 			MumbleProto::BanList_BanEntry *be = msg.add_bans();
 			be->set_address(b.haAddress.toStdString());
 			be->set_mask(static_cast< unsigned int >(b.iMask));
@@ -675,13 +837,14 @@ void Server::msgBanList(ServerUser *uSource, MumbleProto::BanList &msg) {
 		}
 		sendMessage(uSource, msg);
 	} else {
+		QList< Ban > bans = m_bans.bans();
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-		previousBans = QSet< Ban >(qlBans.begin(), qlBans.end());
+		previousBans = QSet< Ban >(bans.begin(), bans.end());
 #else
 		// In Qt 5.14 QList::toSet() has been deprecated as there exists a dedicated constructor of QSet for this now
-		previousBans = qlBans.toSet();
+		previousBans = bans.toSet();
 #endif
-		qlBans.clear();
+		bans.clear();
 		for (int i = 0; i < msg.bans_size(); ++i) {
 			const MumbleProto::BanList_BanEntry &be = msg.bans(i);
 
@@ -699,14 +862,18 @@ void Server::msgBanList(ServerUser *uSource, MumbleProto::BanList &msg) {
 			}
 			b.iDuration = be.duration();
 			if (b.isValid()) {
-				qlBans << b;
+				bans << b;
 			}
 		}
+
+		m_bans.clear();
+		foreach (const Ban &b, bans) { m_bans.add(b); }
+
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-		newBans = QSet< Ban >(qlBans.begin(), qlBans.end());
+		newBans = QSet< Ban >(bans.begin(), bans.end());
 #else
 		// In Qt 5.14 QList::toSet() has been deprecated as there exists a dedicated constructor of QSet for this now
-		newBans = qlBans.toSet();
+		newBans = bans.toSet();
 #endif
 		QSet< Ban > removed = previousBans - newBans;
 		QSet< Ban > added   = newBans - previousBans;
@@ -943,6 +1110,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 
 	// Writing to bSelfMute, bSelfDeaf and ssContext
 	// requires holding a write lock on qrwlVoiceThread.
+	const bool voiceRoutingChanged = msg.has_self_deaf() || msg.has_self_mute() || msg.has_plugin_context();
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 
@@ -969,6 +1137,9 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 			msg.clear_plugin_context();
 		}
 	}
+	if (voiceRoutingChanged) {
+		scheduleVoiceRoutingUpdate();
+	}
 
 	if (msg.has_plugin_identity()) {
 		pDstServerUser->qsIdentity = u8(msg.plugin_identity());
@@ -1012,6 +1183,8 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		if (msg.has_priority_speaker())
 			pDstServerUser->bPrioritySpeaker = msg.priority_speaker();
 
+		scheduleVoiceRoutingUpdate();
+
 		log(uSource, QString("Changed speak-state of %1 (%2 %3 %4 %5)")
 						 .arg(QString(*pDstServerUser), QString::number(pDstServerUser->bMute),
 							  QString::number(pDstServerUser->bDeaf), QString::number(pDstServerUser->bSuppress),
@@ -1219,7 +1392,7 @@ void Server::msgUserRemove(ServerUser *uSource, MumbleProto::UserRemove &msg) {
 		b.qsHash     = pDstServerUser->qsHash;
 		b.qdtStart   = QDateTime::currentDateTime().toUTC();
 		b.iDuration  = 0;
-		qlBans << b;
+		m_bans.add(b);
 		saveBans();
 	}
 
@@ -1354,7 +1527,8 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 			a->pDeny  = ChanACL::None;
 			a->pAllow = ChanACL::Write | ChanACL::Traverse;
 
-			clearACLCache();
+			ChanACL::invalidatePrograms(c);
+			clearChannelACLCache(c);
 		}
 		updateChannel(c);
 
@@ -1362,12 +1536,14 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 		log(uSource, QString("Added channel %1 under %2").arg(QString(*c), QString(*p)));
 		emit channelCreated(c);
 
-		sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+		Broadcast created;
+		addToBroadcast(created, msg, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 		if (!c->qbaDescHash.isEmpty()) {
 			msg.clear_description();
 			msg.set_description_hash(blob(c->qbaDescHash));
 		}
-		sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		addToBroadcast(created, msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		sendBroadcast(created);
 
 		if (c->bTemporary) {
 			// If a temporary channel has been created move the creator right in there
@@ -1508,12 +1684,14 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 		updateChannel(c);
 		emit channelStateChanged(c);
 
-		sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+		Broadcast changed;
+		addToBroadcast(changed, msg, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 		if (msg.has_description() && !c->qbaDescHash.isEmpty()) {
 			msg.clear_description();
 			msg.set_description_hash(blob(c->qbaDescHash));
 		}
-		sendAll(msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		addToBroadcast(changed, msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		sendBroadcast(changed);
 	}
 }
 
@@ -1917,12 +2095,14 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 				a->pAllow = static_cast< ChanACL::Permissions >(mpacl.grant()) & ChanACL::All;
 			}
 
+			ChanACL::invalidatePrograms(c);
+
 			if (Meta::mp.bLogACLChanges) {
 				logACLs(this, c, QLatin1String("And these are the new ACLs:"));
 			}
 		}
 
-		clearACLCache();
+		clearChannelACLCache(c);
 
 		if (!hasPermission(uSource, c, ChanACL::Write) && ((uSource->iId >= 0) || !uSource->qsHash.isEmpty())) {
 			{
@@ -1938,9 +2118,11 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 				a->iUserId = uSource->iId;
 				a->pDeny   = ChanACL::None;
 				a->pAllow  = ChanACL::Write | ChanACL::Traverse;
+
+				ChanACL::invalidatePrograms(c);
 			}
 
-			clearACLCache();
+			clearChannelACLCache(c);
 		}
 
 
@@ -2023,6 +2205,17 @@ void Server::msgPing(ServerUser *uSource, MumbleProto::Ping &msg) {
 void Server::msgCryptSetup(ServerUser *uSource, MumbleProto::CryptSetup &msg) {
 	ZoneScoped;
 
+	if (uSource->sState == ServerUser::Connected) {
+		// Before authenticating, clients may announce the cipher modes they support and whether they can use UDP
+		// association tokens. Both are handed out in msgAuthenticate.
+		uSource->qlCipherModes.clear();
+		for (int i = 0; i < msg.supported_modes_size(); ++i) {
+			uSource->qlCipherModes.append(msg.supported_modes(i));
+		}
+		uSource->m_udpAssociationSupported = msg.udp_association_supported();
+		return;
+	}
+
 	MSG_SETUP_NO_UNIDLE(ServerUser::Authenticated);
 
 	QMutexLocker l(&uSource->qmCrypt);
@@ -2206,7 +2399,8 @@ void Server::msgVoiceTarget(ServerUser *uSource, MumbleProto::VoiceTarget &msg)
 					wtc.includeChildren = t.children();
 					wtc.includeLinks    = t.links();
 					if (t.has_group()) {
-						wtc.targetGroup = u8(t.group());
+						wtc.targetGroup              = u8(t.group());
+						wtc.targetGroupSpecification = Group::Specification::parse(wtc.targetGroup);
 					}
 
 					wt.channels.push_back(wtc);
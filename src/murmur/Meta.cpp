@@ -10,6 +10,7 @@
 #include "FFDHE.h"
 #include "Net.h"
 #include "OSInfo.h"
+#include "PBKDF2.h"
 #include "SSL.h"
 #include "Server.h"
 #include "ServerDB.h"
@@ -17,6 +18,7 @@
 
 #include <QtCore/QCoreApplication>
 #include <QtCore/QSettings>
+#include <QtCore/QThread>
 
 #ifdef Q_OS_WIN
 #	include <QtCore/QStandardPaths>
@@ -39,6 +41,8 @@
 #	include <QRandomGenerator>
 #endif
 
+#include <algorithm>
+
 MetaParams Meta::mp;
 
 #ifdef Q_OS_WIN
@@ -80,6 +84,7 @@ MetaParams::MetaParams() {
 	bSendVersion       = true;
 	bBonjour           = true;
 	bAllowPing         = true;
+	iVoiceThreads      = 1;
 	bCertRequired      = false;
 	bForceExternalAuth = false;
 
@@ -391,6 +396,19 @@ void MetaParams::read(QString fname) {
 	bSendVersion = typeCheckedFromSettings("sendversion", bSendVersion);
 	bAllowPing   = typeCheckedFromSettings("allowping", bAllowPing);
 
+	iVoiceThreads = typeCheckedFromSettings("voicethreads", iVoiceThreads);
+	if (iVoiceThreads < 1) {
+		qWarning("MetaParams: voicethreads must be at least 1. Falling back to a single voice thread.");
+		iVoiceThreads = 1;
+	}
+	// More threads than cores only compete with each other
+	const unsigned int maxVoiceThreads = static_cast< unsigned int >(std::max(QThread::idealThreadCount(), 1));
+	if (iVoiceThreads > maxVoiceThreads) {
+		qWarning("MetaParams: voicethreads must not exceed the number of CPU cores. Using %u voice threads.",
+				 maxVoiceThreads);
+		iVoiceThreads = maxVoiceThreads;
+	}
+
 	if (!loadSSLSettings()) {
 		qFatal("MetaParams: Failed to load SSL settings. See previous errors.");
 	}
@@ -635,7 +653,12 @@ bool MetaParams::loadSSLSettings() {
 	return true;
 }
 
-Meta::Meta() {
+Meta::Meta()
+	: m_connectionThrottle(static_cast< unsigned int >(std::max(mp.iBanTries, 0)),
+						   1000000ULL * static_cast< unsigned long long >(std::max(mp.iBanTimeframe, 0)),
+						   1000000ULL * static_cast< unsigned long long >(std::max(mp.iBanTime, 0))),
+	  // Leaves half of the cores to the main and voice threads, however many logins are being verified
+	  m_passwordHasher(PBKDF2::getHash, std::max(QThread::idealThreadCount() / 2, 1)) {
 #ifdef Q_OS_WIN
 	QOS_VERSION qvVer;
 	qvVer.MajorVersion = 1;
@@ -761,14 +784,7 @@ void Meta::killAll() {
 
 void Meta::successfulConnectionFrom(const QHostAddress &addr) {
 	if (!mp.bBanSuccessful) {
-		QList< Timer > &ql = qhAttempts[addr];
-		// Seems like this is the most efficient way to clear the list, given:
-		// 1. ql.clear() allocates a new array
-		// 2. ql has less than iBanAttempts members
-		// 3. seems like ql.removeFirst() might actually copy elements to shift to the front
-		while (!ql.empty()) {
-			ql.removeLast();
-		}
+		m_connectionThrottle.reset(HostAddress(addr), tUptime.elapsed());
 	}
 }
 
@@ -776,22 +792,21 @@ bool Meta::banCheck(const QHostAddress &addr) {
 	if ((mp.iBanTries <= 0) || (mp.iBanTimeframe <= 0))
 		return false;
 
-	if (qhBans.contains(addr)) {
-		Timer t = qhBans.value(addr);
-		if (t.elapsed() < (1000000ULL * static_cast< unsigned long long >(mp.iBanTime)))
-			return true;
-		qhBans.remove(addr);
-	}
+	const std::uint64_t previousBans = m_connectionThrottle.statistics().bans;
 
-	QList< Timer > &ql = qhAttempts[addr];
-
-	ql.append(Timer());
-	while (!ql.isEmpty() && (ql.at(0).elapsed() > (1000000ULL * static_cast< unsigned long long >(mp.iBanTimeframe))))
-		ql.removeFirst();
+	if (!m_connectionThrottle.check(HostAddress(addr), tUptime.elapsed())) {
+		return false;
+	}
 
-	if (ql.count() > mp.iBanTries) {
-		qhBans.insert(addr, Timer());
-		return true;
+	const ConnectionThrottleStatistics &statistics = m_connectionThrottle.statistics();
+	if (statistics.bans != previousBans) {
+		qWarning("Meta: Autobanned %s for %d seconds (so far %llu autobans, %llu of %llu connection attempts rejected, "
+				 "%llu sources evicted from tracking)",
+				 qPrintable(addr.toString()), mp.iBanTime, static_cast< unsigned long long >(statistics.bans),
+				 static_cast< unsigned long long >(statistics.rejected),
+				 static_cast< unsigned long long >(statistics.attempts),
+				 static_cast< unsigned long long >(statistics.evictions));
 	}
-	return false;
+
+	return true;
 }
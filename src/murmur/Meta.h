@@ -6,6 +6,8 @@
 #ifndef MUMBLE_MURMUR_META_H_
 #define MUMBLE_MURMUR_META_H_
 
+#include "ConnectionThrottle.h"
+#include "PasswordHasher.h"
 #include "Timer.h"
 
 #include "Version.h"
@@ -80,6 +82,8 @@ public:
 	int iObfuscate;
 	bool bSendVersion;
 	bool bAllowPing;
+	/// The amount of threads each virtual server uses to process UDP voice packets
+	unsigned int iVoiceThreads;
 
 	QString qsDBus;
 	QString qsDBusService;
@@ -180,8 +184,10 @@ private:
 public:
 	static MetaParams mp;
 	QHash< int, Server * > qhServers;
-	QHash< QHostAddress, QList< Timer > > qhAttempts;
-	QHash< QHostAddress, Timer > qhBans;
+	/// Tracks connection attempts for the autoban (see MetaParams::iBanTries)
+	ConnectionThrottle m_connectionThrottle;
+	/// Verifies the passwords of users logging in to any of the servers
+	PasswordHasher m_passwordHasher;
 	QString qsOS, qsOSVersion;
 	Timer tUptime;
 
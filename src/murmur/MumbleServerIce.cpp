@@ -1137,7 +1137,7 @@ static void impl_Server_getCertificateList(const ::MumbleServer::AMD_Server_getC
 static void impl_Server_getBans(const ::MumbleServer::AMD_Server_getBansPtr cb, int server_id) {
 	NEED_SERVER;
 	::MumbleServer::BanList bl;
-	foreach (const ::Ban &ban, server->qlBans) {
+	foreach (const ::Ban &ban, server->m_bans.bans()) {
 		::MumbleServer::Ban mb;
 		banToBan(ban, mb);
 		bl.push_back(mb);
@@ -1150,11 +1150,11 @@ static void impl_Server_setBans(const ::MumbleServer::AMD_Server_setBansPtr cb,
 	NEED_SERVER;
 	{
 		QWriteLocker wl(&server->qrwlVoiceThread);
-		server->qlBans.clear();
+		server->m_bans.clear();
 		foreach (const ::MumbleServer::Ban &mb, bans) {
 			::Ban ban;
 			banToBan(mb, ban);
-			server->qlBans << ban;
+			server->m_bans.add(ban);
 		}
 	}
 
@@ -1509,9 +1509,11 @@ static void impl_Server_setACL(const ::MumbleServer::AMD_Server_setACLPtr cb, in
 			acl->pDeny      = static_cast< ChanACL::Permissions >(ai.deny) & ChanACL::All;
 			acl->pAllow     = static_cast< ChanACL::Permissions >(ai.allow) & ChanACL::All;
 		}
+
+		ChanACL::invalidatePrograms(channel);
 	}
 
-	server->clearACLCache();
+	server->clearChannelACLCache(channel);
 	server->updateChannel(channel);
 	cb->ice_response();
 }
@@ -1677,12 +1679,14 @@ static void impl_Server_setTexture(const ::MumbleServer::AMD_Server_setTexturePt
 			mpus.set_session(user->uiSession);
 			mpus.set_texture(blob(user->qbaTexture));
 
-			server->sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+			Broadcast broadcast;
+			server->addToBroadcast(broadcast, mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 			if (!user->qbaTextureHash.isEmpty()) {
 				mpus.clear_texture();
 				mpus.set_texture_hash(blob(user->qbaTextureHash));
 			}
-			server->sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+			server->addToBroadcast(broadcast, mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+			server->sendBroadcast(broadcast);
 		}
 
 		cb->ice_response();
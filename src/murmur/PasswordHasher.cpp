@@ -0,0 +1,151 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PasswordHasher.h"
+
+#include <QtCore/QMetaObject>
+#include <QtCore/QRunnable>
+
+#include <algorithm>
+
+constexpr int PasswordHasher::MAX_JOBS_PER_SOURCE;
+
+class PasswordHasher::Runnable : public QRunnable {
+public:
+	Runnable(PasswordHasher *hasher, std::uint64_t id, const QString &salt, const QString &password, int iterations)
+		: m_hasher(hasher), m_id(id), m_salt(salt), m_password(password), m_iterations(iterations) {}
+
+	void run() Q_DECL_OVERRIDE { m_hasher->compute(m_id, m_salt, m_password, m_iterations); }
+
+private:
+	PasswordHasher *m_hasher;
+	std::uint64_t m_id;
+	QString m_salt;
+	QString m_password;
+	int m_iterations;
+};
+
+PasswordHasher::PasswordHasher(HashFunction hashFunction, int threadCount, int maxJobsPerSource)
+	: m_maxJobsPerSource(maxJobsPerSource), m_hashFunction(std::move(hashFunction)) {
+	m_pool.setMaxThreadCount(std::max(threadCount, 1));
+}
+
+PasswordHasher::~PasswordHasher() {
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+
+bool PasswordHasher::hash(const QObject *owner, const HostAddress &source, const QString &salt,
+						  const QString &password, int iterations, Callback callback) {
+	const HostAddress key = sourceFor(source);
+	std::uint64_t id;
+
+	{
+		QMutexLocker l(&m_mutex);
+
+		if (m_jobsPerSource.value(key, 0) >= m_maxJobsPerSource) {
+			return false;
+		}
+		++m_jobsPerSource[key];
+
+		id = ++m_nextId;
+		m_jobs.insert(id, { owner, key, std::move(callback) });
+	}
+
+	m_pool.start(new Runnable(this, id, salt, password, iterations));
+
+	return true;
+}
+
+void PasswordHasher::cancel(const QObject *owner) {
+	QMutexLocker l(&m_mutex);
+
+	auto it = m_jobs.begin();
+	while (it != m_jobs.end()) {
+		if (it->owner == owner) {
+			it = remove(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+int PasswordHasher::jobCount(const HostAddress &source) const {
+	QMutexLocker l(&m_mutex);
+
+	return m_jobsPerSource.value(sourceFor(source), 0);
+}
+
+HostAddress PasswordHasher::sourceFor(const HostAddress &address) {
+	HostAddress source = address;
+	if (source.isV6()) {
+		for (std::size_t i = 8; i < 16; ++i) {
+			source.setByte(i, 0);
+		}
+	}
+
+	return source;
+}
+
+void PasswordHasher::compute(std::uint64_t id, const QString &salt, const QString &password, int iterations) {
+	{
+		QMutexLocker l(&m_mutex);
+
+		// Nobody is waiting for jobs that have been cancelled
+		if (!m_jobs.contains(id)) {
+			return;
+		}
+	}
+
+	PasswordHash result;
+	result.salt       = salt;
+	result.iterations = iterations;
+	result.hash       = m_hashFunction(salt, password, iterations);
+
+	bool first;
+	{
+		QMutexLocker l(&m_mutex);
+
+		first = m_computed.empty();
+		m_computed.emplace_back(id, std::move(result));
+	}
+
+	// A single delivery takes care of all hashes that have been computed until then
+	if (first) {
+		QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+	}
+}
+
+void PasswordHasher::deliver() {
+	std::vector< std::pair< std::uint64_t, PasswordHash > > computed;
+	std::vector< std::pair< Callback, PasswordHash > > callbacks;
+
+	{
+		QMutexLocker l(&m_mutex);
+
+		computed.swap(m_computed);
+		for (auto &entry : computed) {
+			auto it = m_jobs.find(entry.first);
+			if (it != m_jobs.end()) {
+				callbacks.emplace_back(std::move(it->callback), std::move(entry.second));
+				remove(it);
+			}
+		}
+	}
+
+	// The callbacks may start or cancel jobs
+	for (auto &entry : callbacks) {
+		entry.first(entry.second);
+	}
+}
+
+QHash< std::uint64_t, PasswordHasher::Job >::iterator PasswordHasher::remove(QHash< std::uint64_t, Job >::iterator it) {
+	auto count = m_jobsPerSource.find(it->source);
+	if (count != m_jobsPerSource.end() && --*count <= 0) {
+		m_jobsPerSource.erase(count);
+	}
+
+	return m_jobs.erase(it);
+}
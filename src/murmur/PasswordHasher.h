@@ -0,0 +1,105 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PASSWORDHASHER_H_
+#define MUMBLE_MURMUR_PASSWORDHASHER_H_
+
+#include "HostAddress.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QThreadPool>
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/// A password hash along with the parameters it has been computed with
+struct PasswordHash {
+	QString salt;
+	int iterations = 0;
+	QString hash;
+};
+
+/// Computes password hashes on a bounded pool of threads, such that the thread verifying a password doesn't have to
+/// wait for the (deliberately slow) key derivation.
+///
+/// Jobs are started and their callbacks are called on the thread the hasher lives in. The amount of jobs a single
+/// source may have at once is limited, so that a single client can't keep all threads busy. Like in
+/// ConnectionThrottle, IPv6 sources are counted per /64 prefix, as that is what a single host usually gets assigned.
+class PasswordHasher : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(PasswordHasher)
+
+public:
+	using HashFunction = std::function< QString(const QString &salt, const QString &password, int iterations) >;
+	using Callback     = std::function< void(const PasswordHash &hash) >;
+
+	/// The amount of jobs a single source address may have at once by default
+	static constexpr int MAX_JOBS_PER_SOURCE = 2;
+
+	/// @param hashFunction Computes a hash (e.g. PBKDF2::getHash()). Called on the pool's threads.
+	/// @param threadCount The maximum amount of threads hashes are computed on
+	PasswordHasher(HashFunction hashFunction, int threadCount, int maxJobsPerSource = MAX_JOBS_PER_SOURCE);
+	/// Waits for the jobs that are being computed, without calling their callbacks
+	~PasswordHasher() Q_DECL_OVERRIDE;
+
+	/// Starts computing the hash of the given password.
+	///
+	/// @param owner The object the callback belongs to. Its jobs have to be cancelled before it is destroyed.
+	/// @param source The address the job is counted against
+	/// @param callback Called with the hash once it has been computed, unless the job is cancelled before
+	/// @returns Whether the job has been started. It isn't if the source has too many jobs already.
+	bool hash(const QObject *owner, const HostAddress &source, const QString &salt, const QString &password,
+			  int iterations, Callback callback);
+	/// Cancels all jobs of the given owner, such that their callbacks are never called
+	void cancel(const QObject *owner);
+
+	/// @returns The amount of jobs of the given source (or of its /64 prefix) whose callbacks haven't been called yet
+	int jobCount(const HostAddress &source) const;
+
+private slots:
+	/// Calls the callbacks of the jobs that have been computed
+	void deliver();
+
+private:
+	class Runnable;
+
+	struct Job {
+		const QObject *owner;
+		HostAddress source;
+		Callback callback;
+	};
+
+	int m_maxJobsPerSource;
+	HashFunction m_hashFunction;
+
+	mutable QMutex m_mutex;
+	std::uint64_t m_nextId = 0;
+	/// The jobs that haven't been delivered or cancelled, by ID
+	QHash< std::uint64_t, Job > m_jobs;
+	/// Keyed by sourceFor()
+	QHash< HostAddress, int > m_jobsPerSource;
+	/// The hashes that have been computed, but not delivered yet
+	std::vector< std::pair< std::uint64_t, PasswordHash > > m_computed;
+
+	/// Declared last, such that its threads are done before the rest is destroyed
+	QThreadPool m_pool;
+
+	/// @returns The address the jobs of the given one are counted against
+	static HostAddress sourceFor(const HostAddress &address);
+	/// Called on the pool's threads
+	void compute(std::uint64_t id, const QString &salt, const QString &password, int iterations);
+	/// Forgets about the given job. Must be called while holding m_mutex.
+	///
+	/// @returns The iterator following the job
+	QHash< std::uint64_t, Job >::iterator remove(QHash< std::uint64_t, Job >::iterator it);
+};
+
+#endif
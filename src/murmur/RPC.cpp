@@ -70,6 +70,7 @@ void Server::setUserState(User *pUser, Channel *cChannel, bool mute, bool deaf,
 		pUser->bMute     = mute;
 		pUser->bSuppress = suppressed;
 	}
+	scheduleVoiceRoutingUpdate();
 
 	pUser->bPrioritySpeaker = prioritySpeaker;
 	pUser->qsName           = name;
@@ -82,12 +83,14 @@ void Server::setUserState(User *pUser, Channel *cChannel, bool mute, bool deaf,
 	}
 
 	if (changed) {
-		sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+		Broadcast broadcast;
+		addToBroadcast(broadcast, mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 		if (mpus.has_comment() && !pUser->qbaCommentHash.isEmpty()) {
 			mpus.clear_comment();
 			mpus.set_comment_hash(blob(pUser->qbaCommentHash));
 		}
-		sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		addToBroadcast(broadcast, mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		sendBroadcast(broadcast);
 
 		emit userStateChanged(pUser);
 	}
@@ -171,12 +174,14 @@ bool Server::setChannelState(Channel *cChannel, Channel *cParent, const QString
 	if (updated)
 		updateChannel(cChannel);
 	if (changed) {
-		sendAll(mpcs, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
+		Broadcast broadcast;
+		addToBroadcast(broadcast, mpcs, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 		if (mpcs.has_description() && !cChannel->qbaDescHash.isEmpty()) {
 			mpcs.clear_description();
 			mpcs.set_description_hash(blob(cChannel->qbaDescHash));
 		}
-		sendAll(mpcs, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		addToBroadcast(broadcast, mpcs, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		sendBroadcast(broadcast);
 		emit channelStateChanged(cChannel);
 	}
 
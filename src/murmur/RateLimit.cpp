@@ -0,0 +1,159 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "RateLimit.h"
+
+#include <algorithm>
+
+constexpr std::uint32_t BandwidthRecord::MAX_REPORTED_BANDWIDTH;
+
+namespace {
+constexpr std::uint64_t USEC_PER_SEC = 1000000ULL;
+
+/// The bits of BandwidthRecord::m_usage used for the second and for each of the two amounts of bytes
+constexpr unsigned int SECOND_BITS = 24;
+constexpr unsigned int BYTES_BITS  = 20;
+
+constexpr std::uint64_t SECOND_MASK = (1ULL << SECOND_BITS) - 1;
+constexpr std::uint64_t BYTES_MASK  = (1ULL << BYTES_BITS) - 1;
+
+static_assert(SECOND_BITS + 2 * BYTES_BITS <= 64, "The usage doesn't fit into 64 bits");
+static_assert(BandwidthRecord::MAX_REPORTED_BANDWIDTH == BYTES_MASK, "Reported bandwidth doesn't match the packing");
+
+/// @returns The time (in microseconds) it takes to drain the given amount of tokens, rounded up
+std::uint64_t drainTime(std::uint64_t tokens, std::uint64_t tokensPerSec) {
+	return (tokens * USEC_PER_SEC + tokensPerSec - 1) / tokensPerSec;
+}
+} // namespace
+
+bool TokenBucket::add(std::uint64_t tokens, std::uint64_t tokensPerSec, std::uint64_t maxTokens, std::uint64_t now) {
+	if (tokens > maxTokens) {
+		return false;
+	}
+	if (tokensPerSec == 0) {
+		// The bucket never drains
+		return tokens == 0;
+	}
+
+	const std::uint64_t cost     = drainTime(tokens, tokensPerSec);
+	const std::uint64_t capacity = drainTime(maxTokens, tokensPerSec);
+
+	std::uint64_t emptyAt = m_emptyAt.load(std::memory_order_relaxed);
+	std::uint64_t next;
+	do {
+		// Whatever was in the bucket before has drained if that point in time has passed already
+		const std::uint64_t start = std::max(emptyAt, now);
+		next                      = start + cost;
+
+		if (next - now > capacity) {
+			return false;
+		}
+	} while (!m_emptyAt.compare_exchange_weak(emptyAt, next, std::memory_order_relaxed));
+
+	return true;
+}
+
+LeakyBucket::LeakyBucket(unsigned int tokensPerSec, unsigned int maxTokens)
+	: m_tokensPerSec(tokensPerSec), m_maxTokens(maxTokens), m_timer(), m_bucket() {
+}
+
+bool LeakyBucket::ratelimit(int tokens) {
+	const std::uint64_t amount = static_cast< std::uint64_t >(std::max(tokens, 0));
+
+	return !m_bucket.add(amount, m_tokensPerSec, m_maxTokens, m_timer.elapsed());
+}
+
+BandwidthRecord::BandwidthRecord() : m_created() {
+}
+
+bool BandwidthRecord::addFrame(int size, int maxpersec) {
+	return addFrame(size, maxpersec, m_created.elapsed());
+}
+
+bool BandwidthRecord::addFrame(int size, int maxpersec, std::uint64_t now) {
+	const std::uint64_t bytes = static_cast< std::uint64_t >(std::max(size, 0));
+
+	// A second's worth of the bandwidth may be used at once
+	const std::uint64_t bytesPerSec = static_cast< std::uint64_t >(std::max(maxpersec, 0));
+	if (!m_bucket.add(bytes, bytesPerSec, std::max(bytesPerSec, bytes), now)) {
+		return false;
+	}
+
+	m_lastFrame.store(now, std::memory_order_relaxed);
+
+	const std::uint32_t second = static_cast< std::uint32_t >((now / USEC_PER_SEC) & SECOND_MASK);
+
+	std::uint64_t packed = m_usage.load(std::memory_order_relaxed);
+	std::uint64_t next;
+	do {
+		Usage usage   = advance(unpack(packed), second);
+		usage.current = static_cast< std::uint32_t >(std::min< std::uint64_t >(usage.current + bytes, BYTES_MASK));
+		next          = pack(usage);
+	} while (!m_usage.compare_exchange_weak(packed, next, std::memory_order_relaxed));
+
+	return true;
+}
+
+int BandwidthRecord::onlineSeconds() const {
+	return static_cast< int >(m_created.elapsed() / USEC_PER_SEC);
+}
+
+int BandwidthRecord::idleSeconds() const {
+	return idleSeconds(m_created.elapsed());
+}
+
+int BandwidthRecord::idleSeconds(std::uint64_t now) const {
+	const std::uint64_t lastActive =
+		std::max(m_lastFrame.load(std::memory_order_relaxed), m_lastActivity.load(std::memory_order_relaxed));
+
+	return static_cast< int >((now - std::min(lastActive, now)) / USEC_PER_SEC);
+}
+
+void BandwidthRecord::resetIdleSeconds() {
+	resetIdleSeconds(m_created.elapsed());
+}
+
+void BandwidthRecord::resetIdleSeconds(std::uint64_t now) {
+	m_lastActivity.store(now, std::memory_order_relaxed);
+}
+
+int BandwidthRecord::bandwidth() const {
+	return bandwidth(m_created.elapsed());
+}
+
+int BandwidthRecord::bandwidth(std::uint64_t now) const {
+	const std::uint32_t second = static_cast< std::uint32_t >((now / USEC_PER_SEC) & SECOND_MASK);
+	const Usage usage          = advance(unpack(m_usage.load(std::memory_order_relaxed)), second);
+
+	// Approximate the last second by the current one and the part of the previous one that is still within it
+	const std::uint64_t remaining = USEC_PER_SEC - now % USEC_PER_SEC;
+	const std::uint64_t bytes     = usage.current + usage.previous * remaining / USEC_PER_SEC;
+
+	return static_cast< int >(std::min< std::uint64_t >(bytes, MAX_REPORTED_BANDWIDTH));
+}
+
+std::uint64_t BandwidthRecord::pack(const Usage &usage) {
+	return (static_cast< std::uint64_t >(usage.second) << (2 * BYTES_BITS))
+		   | (static_cast< std::uint64_t >(usage.previous) << BYTES_BITS) | usage.current;
+}
+
+BandwidthRecord::Usage BandwidthRecord::unpack(std::uint64_t packed) {
+	Usage usage;
+	usage.second   = static_cast< std::uint32_t >((packed >> (2 * BYTES_BITS)) & SECOND_MASK);
+	usage.previous = static_cast< std::uint32_t >((packed >> BYTES_BITS) & BYTES_MASK);
+	usage.current  = static_cast< std::uint32_t >(packed & BYTES_MASK);
+	return usage;
+}
+
+BandwidthRecord::Usage BandwidthRecord::advance(Usage usage, std::uint32_t second) {
+	if (usage.second == second) {
+		return usage;
+	}
+
+	usage.previous = ((usage.second + 1) & SECOND_MASK) == second ? usage.current : 0;
+	usage.current  = 0;
+	usage.second   = second;
+	return usage;
+}
@@ -0,0 +1,111 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_RATELIMIT_H_
+#define MUMBLE_MURMUR_RATELIMIT_H_
+
+#include "Timer.h"
+
+#include <atomic>
+#include <cstdint>
+
+/// A token bucket whose whole state is a single atomic value, so that it can be used from any thread without locking.
+///
+/// It is implemented as the generic cell rate algorithm (GCRA): Instead of the amount of tokens in the bucket and the
+/// time at which that amount has last been updated, only the point in time at which the bucket will be empty again is
+/// stored. Adding tokens moves that point into the future, the passing of time drains the bucket.
+class TokenBucket {
+public:
+	/// Adds the given amount of tokens, if they fit into the bucket.
+	///
+	/// @param tokens The amount of tokens to add
+	/// @param tokensPerSec The amount of tokens that are drained per second
+	/// @param maxTokens The capacity of the bucket
+	/// @param now The current time (in microseconds) of a monotonic clock
+	/// @returns Whether the tokens fit into the bucket and have been added
+	bool add(std::uint64_t tokens, std::uint64_t tokensPerSec, std::uint64_t maxTokens, std::uint64_t now);
+
+private:
+	/// The time (in microseconds) at which the bucket will be empty
+	std::atomic< std::uint64_t > m_emptyAt = { 0 };
+};
+
+/// A simple implementation for rate-limiting.
+/// See https://en.wikipedia.org/wiki/Leaky_bucket
+class LeakyBucket {
+private:
+	/// The amount of tokens that are drained per second.
+	/// (The size of the hole in the bucket)
+	unsigned int m_tokensPerSec;
+	/// The maximum amount of tokens that may be encountered.
+	/// (The capacity of the bucket)
+	unsigned int m_maxTokens;
+	/// Measures the time since the bucket has been created (on a monotonic clock)
+	Timer m_timer;
+	TokenBucket m_bucket;
+
+public:
+	/// @param tokens The amount of tokens that should be added.
+	/// @returns Whether adding this amount of tokens triggers rate
+	/// 	limiting (true means the corresponding packet has to be
+	/// 	discared and false means the packet may be processed)
+	bool ratelimit(int tokens);
+
+	LeakyBucket(unsigned int tokensPerSec, unsigned int maxTokens);
+};
+
+/// Limits the bandwidth used by a user's voice packets and keeps the statistics about it.
+///
+/// The voice threads add frames while the main thread and RPC query the statistics, so all state is kept in atomic
+/// values. Neither side ever waits for the other.
+///
+/// All functions taking the current time expect it in microseconds since the record has been created.
+class BandwidthRecord {
+public:
+	/// The largest amount of bytes per second that bandwidth() reports
+	static constexpr std::uint32_t MAX_REPORTED_BANDWIDTH = (1 << 20) - 1;
+
+	BandwidthRecord();
+
+	/// Records a frame of the given size (in bytes), unless that exceeds the given bandwidth (in bytes per second).
+	/// Short bursts of up to a second's worth of the bandwidth are allowed.
+	///
+	/// @returns Whether the frame has been recorded and may be sent
+	bool addFrame(int size, int maxpersec);
+	bool addFrame(int size, int maxpersec, std::uint64_t now);
+	int onlineSeconds() const;
+	/// @returns The seconds since the last frame or the last call to resetIdleSeconds(), whatever happened later
+	int idleSeconds() const;
+	int idleSeconds(std::uint64_t now) const;
+	void resetIdleSeconds();
+	void resetIdleSeconds(std::uint64_t now);
+	/// @returns The bytes per second used by the frames recorded within the last second
+	int bandwidth() const;
+	int bandwidth(std::uint64_t now) const;
+
+private:
+	Timer m_created;
+	TokenBucket m_bucket;
+	/// The time at which the last frame has been recorded
+	std::atomic< std::uint64_t > m_lastFrame = { 0 };
+	/// The time at which resetIdleSeconds() has last been called
+	std::atomic< std::uint64_t > m_lastActivity = { 0 };
+	/// The bytes recorded in the current and in the previous second, packed together with the (truncated) number of
+	/// the current second. See pack().
+	std::atomic< std::uint64_t > m_usage = { 0 };
+
+	struct Usage {
+		std::uint32_t second;
+		std::uint32_t previous;
+		std::uint32_t current;
+	};
+
+	static std::uint64_t pack(const Usage &usage);
+	static Usage unpack(std::uint64_t packed);
+	/// @returns The given usage, moved on to the given second
+	static Usage advance(Usage usage, std::uint32_t second);
+};
+
+#endif
@@ -19,8 +19,10 @@
 #include "QtUtils.h"
 #include "ServerDB.h"
 #include "ServerUser.h"
+#include "UDPBatch.h"
 #include "User.h"
 #include "Version.h"
+#include "VoiceThread.h"
 
 #ifdef USE_ZEROCONF
 #	include "Zeroconf.h"
@@ -43,6 +45,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <utility>
 #include <vector>
 
 #ifdef Q_OS_WIN
@@ -87,22 +90,40 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 	bUsingMetaCert = false;
 
-#ifdef Q_OS_UNIX
-	aiNotify[0] = aiNotify[1] = -1;
-#else
-	hNotify = nullptr;
-#endif
 	qtTimeout = new QTimer(this);
 
 	iCodecAlpha = iCodecBeta = 0;
 	bPreferAlpha             = false;
 	bOpus                    = true;
 
+#ifdef Q_OS_LINUX
+	m_tcpSendBatch = std::make_unique< UDPSendBatch >();
+#endif
+
 	qnamNetwork = nullptr;
 
 	readParams();
 	initialize();
 
+#ifdef Q_OS_LINUX
+	// Multiple voice threads rely on SO_REUSEPORT distributing the datagrams of different clients across the
+	// threads' sockets, which is a Linux-specific behavior.
+	const unsigned int voiceThreadCount = std::max(Meta::mp.iVoiceThreads, 1U);
+#else
+	const unsigned int voiceThreadCount = 1;
+	if (Meta::mp.iVoiceThreads > 1) {
+		log("Multiple voice threads are only supported on Linux. Using a single voice thread.");
+	}
+#endif
+	for (unsigned int i = 0; i < voiceThreadCount; ++i) {
+		m_voiceContexts.push_back(std::make_unique< VoiceThreadContext >(i));
+	}
+	m_voiceRouting = std::make_unique< VoiceRouting >(voiceThreadCount);
+
+	m_voiceRoutingReclaimTimer.setInterval(50);
+	m_voiceRoutingReclaimTimer.setSingleShot(true);
+	connect(&m_voiceRoutingReclaimTimer, SIGNAL(timeout()), this, SLOT(reclaimVoiceRouting()));
+
 	foreach (const QHostAddress &qha, qlBind) {
 		SslServer *ss = new SslServer(this);
 
@@ -131,101 +152,117 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 		memset(&addr, 0, sizeof(addr));
 		getsockname(tcpsock, reinterpret_cast< struct sockaddr * >(&addr), &len);
+
+		// Every voice thread gets its own socket per bind address
+		for (std::unique_ptr< VoiceThreadContext > &context : m_voiceContexts) {
 #ifdef Q_OS_UNIX
-		int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
+			int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
 #	ifdef Q_OS_LINUX
-		int sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
-		sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			int sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
 #	endif
 #else
 #	ifndef SIO_UDP_CONNRESET
 #		define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
 #	endif
-		SOCKET sock           = ::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED);
-		DWORD dwBytesReturned = 0;
-		BOOL bNewBehaviour    = FALSE;
-		if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
-					 nullptr, nullptr)
-			== SOCKET_ERROR) {
-			log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
-		}
+			SOCKET sock =
+				::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED);
+			DWORD dwBytesReturned = 0;
+			BOOL bNewBehaviour    = FALSE;
+			if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
+						 nullptr, nullptr)
+				== SOCKET_ERROR) {
+				log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
+			}
 #endif
-		if (sock == INVALID_SOCKET) {
-			log("Failed to create UDP Socket");
-			bValid = false;
-			return;
-		} else {
-			if (addr.ss_family == AF_INET6) {
-				// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
-				// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
-				// This will fail for WindowsXP which is ok. Our TCP code will have split that up
-				// into two sockets.
-				int ipv6only     = 0;
-				socklen_t optlen = sizeof(ipv6only);
-				if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
-					== 0) {
-					if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
-									 optlen)
-						== SOCKET_ERROR) {
-						log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+			if (sock == INVALID_SOCKET) {
+				log("Failed to create UDP Socket");
+				bValid = false;
+				return;
+			} else {
+				if (addr.ss_family == AF_INET6) {
+					// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
+					// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
+					// This will fail for WindowsXP which is ok. Our TCP code will have split that up
+					// into two sockets.
+					int ipv6only     = 0;
+					socklen_t optlen = sizeof(ipv6only);
+					if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
+						== 0) {
+						if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
+										 optlen)
+							== SOCKET_ERROR) {
+							log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+						}
 					}
 				}
-			}
 
-			if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
+#ifdef Q_OS_LINUX
+				if (m_voiceContexts.size() > 1) {
+					int reuse = 1;
+					if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)))
+						log(QString("Failed to set SO_REUSEPORT for %1")
+								.arg(addressToString(ss->serverAddress(), usPort)));
+				}
+#endif
+
+				if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
 #ifdef Q_OS_WIN
-				log(QString("Failed to bind UDP Socket to %1: %2")
-						.arg(addressToString(ss->serverAddress(), usPort), WSAGetLastError()));
+					log(QString("Failed to bind UDP Socket to %1: %2")
+							.arg(addressToString(ss->serverAddress(), usPort), WSAGetLastError()));
 #else
-				log(QString("Failed to bind UDP Socket to %1: %2")
-						.arg(addressToString(ss->serverAddress(), usPort), errno));
+					log(QString("Failed to bind UDP Socket to %1: %2")
+							.arg(addressToString(ss->serverAddress(), usPort), errno));
 #endif
-			} else {
+				} else {
 #ifdef Q_OS_UNIX
-				int val = 0xe0;
-				if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
-					val = 0x80;
-					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
-						log("Server: Failed to set TOS for UDP Socket");
-				}
+					int val = 0xe0;
+					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
+						val = 0x80;
+						if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
+							log("Server: Failed to set TOS for UDP Socket");
+					}
 #	if defined(SO_PRIORITY)
-				socklen_t optlen = sizeof(val);
-				if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
-					if (val == 0) {
-						val = 6;
-						setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+					socklen_t optlen = sizeof(val);
+					if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
+						if (val == 0) {
+							val = 6;
+							setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+						}
 					}
-				}
 #	endif
 #endif
+				}
+				QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
+				connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
+				qlUdpSocket << sock;
+				qlUdpNotifier << qsn;
+				context->sockets << sock;
 			}
-			QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
-			connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
-			qlUdpSocket << sock;
-			qlUdpNotifier << qsn;
 		}
 	}
 
-	bValid = bValid && (qlServer.count() == qlBind.count()) && (qlUdpSocket.count() == qlBind.count());
+	bValid = bValid && (qlServer.count() == qlBind.count())
+			 && (qlUdpSocket.count() == qlBind.count() * static_cast< int >(m_voiceContexts.size()));
 	if (!bValid)
 		return;
 
-#ifdef Q_OS_UNIX
-	if (socketpair(AF_UNIX, SOCK_STREAM, 0, aiNotify) != 0) {
-		log("Failed to create notify socket");
-		bValid = false;
-		return;
+	for (std::unique_ptr< VoiceThreadContext > &context : m_voiceContexts) {
+		if (!context->createNotify()) {
+			log("Failed to create notify socket");
+			bValid = false;
+			return;
+		}
+	}
+
+	for (std::size_t i = 1; i < m_voiceContexts.size(); ++i) {
+		m_voiceThreads.push_back(std::make_unique< VoiceThread >(*this, *m_voiceContexts[i]));
 	}
-#else
-	hNotify = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-#endif
 
-	connect(this, SIGNAL(tcpTransmit(QByteArray, unsigned int)), this, SLOT(tcpTransmitData(QByteArray, unsigned int)),
-			Qt::QueuedConnection);
 	connect(this, SIGNAL(reqSync(unsigned int)), this, SLOT(doSync(unsigned int)));
 
 	for (unsigned int i = 1; i < iMaxUsers * 2; ++i)
@@ -238,6 +275,8 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 	readLinks();
 	initializeCert();
 
+	publishVoiceRouting();
+
 	if (bValid) {
 #ifdef USE_ZEROCONF
 		if (bBonjour)
@@ -249,12 +288,19 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 
 void Server::startThread() {
 	if (!isRunning()) {
-		log("Starting voice thread");
+		if (m_voiceThreads.empty()) {
+			log("Starting voice thread");
+		} else {
+			log(QString("Starting %1 voice threads").arg(m_voiceThreads.size() + 1));
+		}
 		bRunning = true;
 
 		foreach (QSocketNotifier *qsn, qlUdpNotifier)
 			qsn->setEnabled(false);
 		start(QThread::HighestPriority);
+		for (std::unique_ptr< VoiceThread > &thread : m_voiceThreads) {
+			thread->start(QThread::HighestPriority);
+		}
 #ifdef Q_OS_LINUX
 		// QThread::HighestPriority == Same as everything else...
 		int policy;
@@ -277,14 +323,30 @@ void Server::stopThread() {
 	if (isRunning()) {
 		log("Ending voice thread");
 
-#ifdef Q_OS_UNIX
-		unsigned char val = 0;
-		if (::write(aiNotify[1], &val, 1) != 1)
-			log("Failed to signal voice thread");
-#else
-		SetEvent(hNotify);
-#endif
+		for (std::unique_ptr< VoiceThreadContext > &context : m_voiceContexts) {
+			if (!context->wakeUp())
+				log("Failed to signal voice thread");
+		}
 		wait();
+		for (std::unique_ptr< VoiceThread > &thread : m_voiceThreads) {
+			thread->wait();
+		}
+
+#ifdef Q_OS_LINUX
+		UDPBatchStatistics received;
+		UDPBatchStatistics sent;
+		for (const std::unique_ptr< VoiceThreadContext > &context : m_voiceContexts) {
+			received.merge(context->receiveBatch.statistics());
+			sent.merge(context->sendBatch.statistics());
+		}
+		log(QString("UDP batching: received %1 datagrams in %2 calls (max %3), sent %4 datagrams in %5 calls (max %6)")
+				.arg(received.datagrams)
+				.arg(received.calls)
+				.arg(received.maxBatchSize)
+				.arg(sent.datagrams)
+				.arg(sent.calls)
+				.arg(sent.maxBatchSize));
+#endif
 
 		foreach (QSocketNotifier *qsn, qlUdpNotifier)
 			qsn->setEnabled(true);
@@ -293,11 +355,16 @@ void Server::stopThread() {
 }
 
 Server::~Server() {
+	// Nobody is going to finish the authentications that are waiting for password hashes
+	meta->m_passwordHasher.cancel(this);
+
 #ifdef USE_ZEROCONF
 	removeZeroconf();
 #endif
 
 	stopThread();
+	// No voice thread is accessing the routing state anymore
+	m_voiceRouting->reclaim();
 
 	foreach (QSocketNotifier *qsn, qlUdpNotifier)
 		delete qsn;
@@ -305,16 +372,9 @@ Server::~Server() {
 #ifdef Q_OS_UNIX
 	foreach (int s, qlUdpSocket)
 		close(s);
-
-	if (aiNotify[0] >= 0)
-		close(aiNotify[0]);
-	if (aiNotify[1] >= 0)
-		close(aiNotify[1]);
 #else
 	foreach (SOCKET s, qlUdpSocket)
 		closesocket(s);
-	if (hNotify)
-		CloseHandle(hNotify);
 #endif
 	clearACLCache();
 
@@ -547,6 +607,8 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 		QString text = !v.isNull() ? v : Meta::mp.qsRegName;
 		if (text != qsRegName) {
 			qsRegName = text;
+			// The name of the root channel falls back to "Root" without a registration name
+			m_channelSyncStates.remove(0);
 			if (!qsRegName.isEmpty()) {
 				MumbleProto::ChannelState mpcs;
 				mpcs.set_channel_id(0);
@@ -673,7 +735,11 @@ void Server::customEvent(QEvent *evt) {
 void Server::udpActivated(int socket) {
 	// At this part we are only expecting pings of clients we don't know yet -> thus we also don't know which protocol
 	// version they are using.
-	m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
+	// Note: This function is only called while the voice threads are stopped, so we can borrow the first voice
+	// thread's decoder and encoder.
+	VoiceThreadContext &context = *m_voiceContexts.front();
+
+	context.decoder.setProtocolVersion(Version::UNKNOWN);
 
 	qint32 len;
 
@@ -683,8 +749,8 @@ void Server::udpActivated(int socket) {
 	struct msghdr msg;
 	struct iovec iov[1];
 
-	iov[0].iov_base = m_udpDecoder.getBuffer().data();
-	iov[0].iov_len  = m_udpDecoder.getBuffer().size();
+	iov[0].iov_base = context.decoder.getBuffer().data();
+	iov[0].iov_len  = context.decoder.getBuffer().size();
 
 	uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
 
@@ -701,22 +767,22 @@ void Server::udpActivated(int socket) {
 #	else
 	socklen_t fromlen = sizeof(from);
 	int &sock         = socket;
-	len = static_cast< qint32 >(::recvfrom(sock, m_udpDecoder.getBuffer().data(), m_udpDecoder.getBuffer().size(),
+	len = static_cast< qint32 >(::recvfrom(sock, context.decoder.getBuffer().data(), context.decoder.getBuffer().size(),
 										   MSG_TRUNC, reinterpret_cast< struct sockaddr * >(&from), &fromlen));
 #	endif
 #else
 	int fromlen = static_cast< int >(sizeof(from));
 	SOCKET sock = static_cast< SOCKET >(socket);
-	len         = ::recvfrom(sock, reinterpret_cast< char * >(m_udpDecoder.getBuffer().data()),
-                     static_cast< int >(m_udpDecoder.getBuffer().size()), 0,
+	len         = ::recvfrom(sock, reinterpret_cast< char * >(context.decoder.getBuffer().data()),
+                     static_cast< int >(context.decoder.getBuffer().size()), 0,
                      reinterpret_cast< struct sockaddr * >(&from), &fromlen);
 #endif
 
-	gsl::span< Mumble::Protocol::byte > inputData(&m_udpDecoder.getBuffer()[0], static_cast< std::size_t >(len));
+	gsl::span< Mumble::Protocol::byte > inputData(&context.decoder.getBuffer()[0], static_cast< std::size_t >(len));
 
-	if (bAllowPing && m_udpDecoder.decodePing(inputData)
-		&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
-		gsl::span< const Mumble::Protocol::byte > encodedPing = handlePing(m_udpDecoder, m_udpPingEncoder, true);
+	if (bAllowPing && context.decoder.decodePing(inputData)
+		&& context.decoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
+		gsl::span< const Mumble::Protocol::byte > encodedPing = handlePing(context.decoder, context.pingEncoder, true);
 
 		if (!encodedPing.empty()) {
 #ifdef Q_OS_LINUX
@@ -740,32 +806,40 @@ void Server::udpActivated(int socket) {
 }
 
 void Server::run() {
+	runVoiceThread(*m_voiceContexts.front());
+}
+
+void Server::runVoiceThread(VoiceThreadContext &context) {
 	tracy::SetThreadName("Audio");
 
 	qint32 len;
-#if defined(__LP64__)
+#ifndef Q_OS_LINUX
+#	if defined(__LP64__)
 	unsigned char encbuff[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
 	unsigned char *encrypt = encbuff + 4;
-#else
+#	else
 	unsigned char encrypt[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+#	endif
+	sockaddr_storage from;
 #endif
 	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
 
-	sockaddr_storage from;
-	unsigned int nfds = static_cast< unsigned int >(qlUdpSocket.count());
+	unsigned int nfds = static_cast< unsigned int >(context.sockets.count());
 
 #ifdef Q_OS_UNIX
+#	ifndef Q_OS_LINUX
 	socklen_t fromlen;
+#	endif
 	std::vector< struct pollfd > fds;
 	fds.resize(static_cast< std::size_t >(nfds + 1));
 
 	for (unsigned int i = 0; i < nfds; ++i) {
-		fds[i].fd      = qlUdpSocket.at(static_cast< int >(i));
+		fds[i].fd      = context.sockets.at(static_cast< int >(i));
 		fds[i].events  = POLLIN;
 		fds[i].revents = 0;
 	}
 
-	fds[nfds].fd      = aiNotify[0];
+	fds[nfds].fd      = context.notify[0];
 	fds[nfds].events  = POLLIN;
 	fds[nfds].revents = 0;
 #else
@@ -775,11 +849,11 @@ void Server::run() {
 	std::vector< HANDLE > events;
 	events.resize(nfds + 1);
 	for (unsigned int i = 0; i < nfds; ++i) {
-		fds[i]    = qlUdpSocket.at(i);
+		fds[i]    = context.sockets.at(i);
 		events[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 		::WSAEventSelect(fds[i], events[i], FD_READ);
 	}
-	events[nfds] = hNotify;
+	events[nfds] = context.notify;
 #endif
 
 	++nfds;
@@ -800,7 +874,7 @@ void Server::run() {
 		if (fds[nfds - 1].revents) {
 			// Drain pipe
 			unsigned char val;
-			while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
+			while (::recv(context.notify[0], &val, 1, MSG_DONTWAIT) == 1) {
 			};
 			break;
 		}
@@ -829,173 +903,220 @@ void Server::run() {
 				SOCKET sock = fds[ret - WAIT_OBJECT_0];
 #endif
 
+#ifdef Q_OS_LINUX
+				// Drain as many datagrams as possible with a single syscall
+				const int batchSize = context.receiveBatch.receive(sock);
+				if (batchSize < 0) {
+					break;
+				}
+
+				for (unsigned int packet = 0; packet < static_cast< unsigned int >(batchSize); ++packet) {
+					unsigned char *encrypt = context.receiveBatch.data(packet);
+					sockaddr_storage &from = context.receiveBatch.address(packet);
+					struct msghdr &msg     = context.receiveBatch.header(packet);
+					struct iovec *iov      = msg.msg_iov;
+
+					len = static_cast< qint32 >(context.receiveBatch.length(packet));
+#else
 				fromlen = sizeof(from);
-#ifdef Q_OS_WIN
+#	ifdef Q_OS_WIN
 				len = ::recvfrom(sock, reinterpret_cast< char * >(encrypt), Mumble::Protocol::MAX_UDP_PACKET_SIZE, 0,
 								 reinterpret_cast< struct sockaddr * >(&from), &fromlen);
-#else
-#	ifdef Q_OS_LINUX
-				struct msghdr msg;
-				struct iovec iov[1];
-
-				iov[0].iov_base = encrypt;
-				iov[0].iov_len  = Mumble::Protocol::MAX_UDP_PACKET_SIZE;
-
-				uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
-
-				memset(&msg, 0, sizeof(msg));
-				msg.msg_name       = reinterpret_cast< struct sockaddr * >(&from);
-				msg.msg_namelen    = sizeof(from);
-				msg.msg_iov        = iov;
-				msg.msg_iovlen     = 1;
-				msg.msg_control    = controldata;
-				msg.msg_controllen = sizeof(controldata);
-
-				len = static_cast< qint32 >(::recvmsg(sock, &msg, MSG_TRUNC));
-				Q_UNUSED(fromlen);
 #	else
 				len = static_cast< qint32 >(::recvfrom(sock, encrypt, Mumble::Protocol::MAX_UDP_PACKET_SIZE, MSG_TRUNC,
 													   reinterpret_cast< struct sockaddr * >(&from), &fromlen));
 #	endif
-#endif
-
-				// Capture only the processing without the polling
-				ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
 
 				if (len == 0) {
 					break;
 				} else if (len == SOCKET_ERROR) {
 					break;
-				} else if (len < 5) {
-					// 4 bytes crypt header + type + session
-					continue;
-				} else if (static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
-					// This will also catch the len == -1 case (indicating error)
-					static_assert(static_cast< unsigned int >(-1) > Mumble::Protocol::MAX_UDP_PACKET_SIZE,
-								  "Invalid assumption");
-					continue;
 				}
 
-				QReadLocker rl(&qrwlVoiceThread);
+				for (unsigned int packet = 0; packet < 1; ++packet) {
+#endif
 
-				quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast< sockaddr_in6 * >(&from)->sin6_port)
-															: (reinterpret_cast< sockaddr_in * >(&from)->sin_port);
-				const HostAddress &ha = HostAddress(from);
+					// Capture only the processing without the polling
+					ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
 
-				const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(ha, port);
+					if (len < 5) {
+						// 4 bytes crypt header + type + session
+						continue;
+					} else if (static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+						static_assert(static_cast< unsigned int >(-1) > Mumble::Protocol::MAX_UDP_PACKET_SIZE,
+									  "Invalid assumption");
+						continue;
+					}
 
-				ServerUser *u = qhPeerUsers.value(key);
+					VoiceRouting::ReadGuard routingGuard(*m_voiceRouting, context.index);
+					const VoiceRoutingSnapshot &routing = routingGuard.snapshot();
 
-				if (u) {
-					m_udpDecoder.setProtocolVersion(u->m_version);
-				} else {
-					m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
-				}
-				// This may be a general ping requesting server details, unencrypted.
-				if (bAllowPing
-					&& m_udpDecoder.decodePing(
-						gsl::span< Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)))
-					&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
-					ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
+					quint16 port = (from.ss_family == AF_INET6)
+									   ? (reinterpret_cast< sockaddr_in6 * >(&from)->sin6_port)
+									   : (reinterpret_cast< sockaddr_in * >(&from)->sin_port);
+					const HostAddress &ha = HostAddress(from);
 
-					gsl::span< const Mumble::Protocol::byte > encodedPing =
-						handlePing(m_udpDecoder, m_udpPingEncoder, true);
+					const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(ha, port);
 
-					if (!encodedPing.empty()) {
+					ServerUser *u = routing.peers.value(key);
+					if (!u) {
+						// The peer might have been associated after the snapshot has been created
+						QReadLocker rl(&qrwlVoiceThread);
+						u = qhPeerUsers.value(key);
+					}
+
+					if (u) {
+						context.decoder.setProtocolVersion(u->m_version);
+					} else {
+						context.decoder.setProtocolVersion(Version::UNKNOWN);
+					}
+					// Clients that have been handed an association token prefix their pings with it. This identifies
+					// the sending user without having to try the keys of everyone connected from the same address.
+					bool decrypted      = false;
+					std::uint32_t token = 0;
+					if (Mumble::Protocol::readUDPAssociationHeader(
+							gsl::span< const Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)),
+							token)) {
+						QReadLocker rl(&qrwlVoiceThread);
+
+						ServerUser *usr = m_udpAssociationTokens.value(token);
+						const int cryptLength =
+							len - static_cast< int >(Mumble::Protocol::UDP_ASSOCIATION_HEADER_SIZE);
+
+						if (usr && usr->haAddress == ha
+							&& checkDecrypt(usr, encrypt + Mumble::Protocol::UDP_ASSOCIATION_HEADER_SIZE, buffer,
+											static_cast< unsigned int >(cryptLength))) {
+							decrypted = true;
+							len       = cryptLength;
+
+							if (usr != u) {
+								// The user is new or its endpoint has changed (e.g. due to a new NAT mapping)
+								u = associateUdpPeer(usr, sock, from, key, rl);
+								if (!u) {
+									continue;
+								}
+							}
+
+							context.decoder.setProtocolVersion(u->m_version);
+						}
+					}
+
+					// This may be a general ping requesting server details, unencrypted.
+					if (!decrypted && bAllowPing
+						&& context.decoder.decodePing(
+							gsl::span< Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)))
+						&& context.decoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
+						ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
+
+						QReadLocker rl(&qrwlVoiceThread);
+
+						gsl::span< const Mumble::Protocol::byte > encodedPing =
+							handlePing(context.decoder, context.pingEncoder, true);
+
+						if (!encodedPing.empty()) {
 #ifdef Q_OS_LINUX
-						// We are only reading from the buffer and thus the const_cast should be fine
-						iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
-						iov[0].iov_len  = encodedPing.size();
-						::sendmsg(sock, &msg, 0);
+							// We are only reading from the buffer and thus the const_cast should be fine
+							iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
+							iov[0].iov_len  = encodedPing.size();
+							::sendmsg(sock, &msg, 0);
 #else
 #	ifdef Q_OS_WIN
-						using size_type = int;
+							using size_type = int;
 #	else
-						using size_type = std::size_t;
+							using size_type = std::size_t;
 #	endif
-						::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
-								 static_cast< size_type >(encodedPing.size()), 0,
-								 reinterpret_cast< struct sockaddr * >(&from), fromlen);
+							::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
+									 static_cast< size_type >(encodedPing.size()), 0,
+									 reinterpret_cast< struct sockaddr * >(&from), fromlen);
 #endif
+						}
+
+						continue;
 					}
 
-					continue;
-				}
 
+					if (u && !decrypted) {
+						if (!checkDecrypt(u, encrypt, buffer, static_cast< unsigned int >(len))) {
+							continue;
+						}
+					} else if (!u) {
+						ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
 
-				if (u) {
-					if (!checkDecrypt(u, encrypt, buffer, static_cast< unsigned int >(len))) {
-						continue;
-					}
-				} else {
-					ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
-
-					// Unknown peer
-					foreach (ServerUser *usr, qhHostUsers.value(ha)) {
-						if (checkDecrypt(
-								usr, encrypt, buffer,
-								static_cast< unsigned int >(len))) { // checkDecrypt takes the User's qrwlCrypt lock.
-							// Every time we relock, reverify users' existence.
-							// The main thread might delete the user while the lock isn't held.
-							unsigned int uiSession = usr->uiSession;
-							rl.unlock();
-							qrwlVoiceThread.lockForWrite();
-							if (qhUsers.contains(uiSession)) {
-								u             = usr;
-								u->sUdpSocket = sock;
-								memcpy(&u->saiUdpAddress, &from, sizeof(from));
-								qhHostUsers[from].remove(u);
-								qhPeerUsers.insert(key, u);
+						QReadLocker rl(&qrwlVoiceThread);
+
+						// Unknown peer. Clients that have been handed an association token identify themselves
+						// using it, so only the ones that haven't need to be tried.
+						foreach (ServerUser *usr, qhHostUsers.value(ha)) {
+							if (usr->m_udpAssociationToken != 0) {
+								continue;
+							}
+							if (checkDecrypt(usr, encrypt, buffer,
+											 static_cast< unsigned int >(
+												 len))) { // checkDecrypt takes the User's qrwlCrypt lock.
+								u = associateUdpPeer(usr, sock, from, key, rl);
+								break;
 							}
-							qrwlVoiceThread.unlock();
-							rl.relock();
-							if (u && !qhUsers.contains(uiSession))
-								u = nullptr;
-							break;
+						}
+						if (!u) {
+							continue;
 						}
 					}
-					if (!u) {
-						continue;
-					}
-				}
-				len -= 4;
-
-				if (m_udpDecoder.decode(gsl::span< Mumble::Protocol::byte >(buffer, static_cast< std::size_t >(len)))) {
-					switch (m_udpDecoder.getMessageType()) {
-						case Mumble::Protocol::UDPMessageType::Audio: {
-							Mumble::Protocol::AudioData audioData = m_udpDecoder.getAudioData();
-
-							// Allow all voice packets through by default.
-							bool ok = true;
-							// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
-							if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
-								ok = false;
-							}
+					len -= 4;
+
+					if (context.decoder.decode(
+							gsl::span< Mumble::Protocol::byte >(buffer, static_cast< std::size_t >(len)))) {
+						switch (context.decoder.getMessageType()) {
+							case Mumble::Protocol::UDPMessageType::Audio: {
+								Mumble::Protocol::AudioData audioData = context.decoder.getAudioData();
+
+								// Allow all voice packets through by default.
+								bool ok = true;
+								// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
+								if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
+									ok = false;
+								}
 
-							if (ok) {
-								u->aiUdpFlag = 1;
+								if (ok) {
+									u->aiUdpFlag = 1;
 
-								// Add session id
-								audioData.senderSession = u->uiSession;
+									// Add session id
+									audioData.senderSession = u->uiSession;
 
-								processMsg(u, audioData, m_udpAudioReceivers, m_udpAudioEncoder);
+#ifdef Q_OS_LINUX
+									UDPSendBatch *sendBatch = &context.sendBatch;
+#else
+									UDPSendBatch *sendBatch = nullptr;
+#endif
+									const std::uint32_t target = audioData.targetOrContext;
+									if (target == Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH
+										|| target == Mumble::Protocol::ReservedTargetIDs::SERVER_LOOPBACK) {
+										// Routed exclusively through the snapshot
+										processMsg(u, routing, audioData, context.audioReceivers,
+												   context.audioEncoder, sendBatch);
+									} else {
+										// Whisper and shout targets are resolved using the live state
+										QReadLocker rl(&qrwlVoiceThread);
+										if (qhUsers.contains(u->uiSession)) {
+											processMsg(u, routing, audioData, context.audioReceivers,
+													   context.audioEncoder, sendBatch);
+										}
+									}
+								}
+								break;
 							}
-							break;
-						}
-						case Mumble::Protocol::UDPMessageType::Ping: {
-							ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
-
-							Mumble::Protocol::PingData pingData = m_udpDecoder.getPingData();
-							if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
-								// At this point here, we only want to handle connectivity pings
-								gsl::span< const Mumble::Protocol::byte > encodedPing =
-									handlePing(m_udpDecoder, m_udpPingEncoder, false);
-
-								QByteArray cache;
-								sendMessage(*u, encodedPing.data(), static_cast< int >(encodedPing.size()), cache,
-											true);
+							case Mumble::Protocol::UDPMessageType::Ping: {
+								ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
+
+								Mumble::Protocol::PingData pingData = context.decoder.getPingData();
+								if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
+									// At this point here, we only want to handle connectivity pings
+									gsl::span< const Mumble::Protocol::byte > encodedPing =
+										handlePing(context.decoder, context.pingEncoder, false);
+
+									sendMessage(*u, encodedPing.data(), static_cast< int >(encodedPing.size()), true);
+								}
+								break;
 							}
-							break;
 						}
 					}
 				}
@@ -1031,95 +1152,151 @@ bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned
 	return false;
 }
 
-void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force) {
+#ifdef Q_OS_WIN
+ServerUser *Server::associateUdpPeer(ServerUser *u, SOCKET sock, const struct sockaddr_storage &from,
+									 const QPair< HostAddress, quint16 > &key, QReadLocker &rl) {
+#else
+ServerUser *Server::associateUdpPeer(ServerUser *u, int sock, const struct sockaddr_storage &from,
+									 const QPair< HostAddress, quint16 > &key, QReadLocker &rl) {
+#endif
+	// Every time we relock, reverify users' existence.
+	// The main thread might delete the user while the lock isn't held.
+	const unsigned int uiSession = u->uiSession;
+
+	rl.unlock();
+	qrwlVoiceThread.lockForWrite();
+
+	const bool exists = qhUsers.value(uiSession) == u;
+	if (exists) {
+		if (u->sUdpSocket != INVALID_SOCKET) {
+			// The user's previous endpoint is no longer valid
+			const quint16 port = (u->saiUdpAddress.ss_family == AF_INET6)
+									 ? (reinterpret_cast< sockaddr_in6 * >(&u->saiUdpAddress)->sin6_port)
+									 : (reinterpret_cast< sockaddr_in * >(&u->saiUdpAddress)->sin_port);
+			const QPair< HostAddress, quint16 > previousKey(u->haAddress, port);
+			if (qhPeerUsers.value(previousKey) == u) {
+				qhPeerUsers.remove(previousKey);
+			}
+		}
+
+		{
+			// Voice threads sending to this user only hold the user's crypt lock
+			QMutexLocker l(&u->qmCrypt);
+			u->sUdpSocket = sock;
+			memcpy(&u->saiUdpAddress, &from, sizeof(from));
+			u->m_udpSendDescriptor.update(sock, u->saiUdpAddress, u->saiTcpLocalAddress);
+		}
+		qhHostUsers[from].remove(u);
+		qhPeerUsers.insert(key, u);
+		scheduleVoiceRoutingUpdate();
+	}
+
+	qrwlVoiceThread.unlock();
+	rl.relock();
+
+	if (!exists || !qhUsers.contains(uiSession)) {
+		return nullptr;
+	}
+
+	return u;
+}
+
+namespace {
+/// Scratch space for sending a single datagram. Its payload buffer is laid out like the ones of UDPSendBatch.
+struct SendArena {
+	alignas(8) unsigned char storage[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+	UDPSendDescriptor descriptor;
+
+	unsigned char *payload() { return storage + 4; }
+};
+} // namespace
+
+void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, bool force, UDPSendBatch *batch) {
 	ZoneScoped;
 
+	// Whether the user has a UDP endpoint is only known while holding its crypt lock (see below)
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-	if ((u.aiUdpFlag.loadRelaxed() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET)) {
+	if (u.aiUdpFlag.loadRelaxed() == 1 || force) {
 #else
 	// Qt 5.14 introduced QAtomicInteger::loadRelaxed() which deprecates QAtomicInteger::load()
-	if ((u.aiUdpFlag.load() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET)) {
+	if (u.aiUdpFlag.load() == 1 || force) {
 #endif
-#if defined(__LP64__)
-		static std::vector< char > ebuffer;
-		ebuffer.resize(static_cast< std::size_t >(len + 4 + 16));
-		char *buffer = reinterpret_cast< char * >(
-			((reinterpret_cast< quint64 >(ebuffer.data()) + 8) & static_cast< quint64 >(~7)) + 4);
+		if (static_cast< std::size_t >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+			// Neither the send buffers nor the receiving clients can handle such datagrams
+			return;
+		}
+#ifdef Q_OS_LINUX
+		if (batch) {
+			// The UDP endpoint (including the socket) may be changed by another voice thread, which holds the crypt
+			// lock while doing so. The datagram is thus queued for the socket of the very descriptor it is committed
+			// with. It is encrypted directly into the batch's (suitably aligned) buffer and only sent once the caller
+			// flushes the batch.
+			QMutexLocker wl(&u.qmCrypt);
+
+			if (!u.m_udpSendDescriptor.valid || !u.csCrypt->isValid()) {
+				return;
+			}
+
+			unsigned char *buffer = batch->prepare(u.m_udpSendDescriptor.socket);
+			if (!u.csCrypt->encrypt(data, buffer, static_cast< unsigned int >(len))) {
+				return;
+			}
+
+			batch->commit(static_cast< std::size_t >(len + 4), u.m_udpSendDescriptor);
+			return;
+		}
 #else
-		std::vector< char > bufVec;
-		bufVec.resize(len + 4);
-		char *buffer    = bufVec.data();
+		Q_UNUSED(batch);
 #endif
+		// Multiple voice threads (and the main thread) may send at the same time
+		thread_local SendArena arena;
+		unsigned char *buffer         = arena.payload();
+		UDPSendDescriptor &descriptor = arena.descriptor;
+
+		// The UDP endpoint may be changed by another voice thread, which holds the crypt lock while doing so
 		{
 			QMutexLocker wl(&u.qmCrypt);
 
-			if (!u.csCrypt->isValid()) {
+			if (!u.m_udpSendDescriptor.valid || !u.csCrypt->isValid()) {
 				return;
 			}
 
-			if (!u.csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data),
-									reinterpret_cast< unsigned char * >(buffer), static_cast< unsigned int >(len))) {
+			if (!u.csCrypt->encrypt(data, buffer, static_cast< unsigned int >(len))) {
 				return;
 			}
+
+			descriptor = u.m_udpSendDescriptor;
 		}
+
 #ifdef Q_OS_WIN
 		DWORD dwFlow = 0;
 		if (Meta::hQoS)
-			QOSAddSocketToFlow(Meta::hQoS, u.sUdpSocket, reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress),
-							   QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&dwFlow));
+			QOSAddSocketToFlow(Meta::hQoS, descriptor.socket, &descriptor.address.generic, QOSTrafficTypeVoice,
+							   QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&dwFlow));
 #endif
 #ifdef Q_OS_LINUX
-		struct msghdr msg;
-		struct iovec iov[1];
-
-		iov[0].iov_base = buffer;
-		iov[0].iov_len  = static_cast< unsigned int >(len + 4);
+		struct iovec iov;
+		iov.iov_base = buffer;
+		iov.iov_len  = static_cast< std::size_t >(len + 4);
 
-		uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
-		memset(controldata, 0, sizeof(controldata));
-
-		memset(&msg, 0, sizeof(msg));
-		msg.msg_name    = reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress);
-		msg.msg_namelen = static_cast< socklen_t >(
-			(u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
-		msg.msg_iov        = iov;
+		struct msghdr msg;
+		msg.msg_name       = &descriptor.address;
+		msg.msg_namelen    = descriptor.addressLength;
+		msg.msg_iov        = &iov;
 		msg.msg_iovlen     = 1;
-		msg.msg_control    = controldata;
-		msg.msg_controllen = CMSG_SPACE((u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo)
-																				: sizeof(struct in_pktinfo));
-
-		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-		HostAddress tcpha(u.saiTcpLocalAddress);
-		if (u.saiUdpAddress.ss_family == AF_INET6) {
-			cmsg->cmsg_level            = IPPROTO_IPV6;
-			cmsg->cmsg_type             = IPV6_PKTINFO;
-			cmsg->cmsg_len              = CMSG_LEN(sizeof(struct in6_pktinfo));
-			struct in6_pktinfo *pktinfo = reinterpret_cast< struct in6_pktinfo * >(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			memcpy(&pktinfo->ipi6_addr.s6_addr[0], tcpha.getByteRepresentation().data(),
-				   sizeof(pktinfo->ipi6_addr.s6_addr));
-		} else {
-			cmsg->cmsg_level           = IPPROTO_IP;
-			cmsg->cmsg_type            = IP_PKTINFO;
-			cmsg->cmsg_len             = CMSG_LEN(sizeof(struct in_pktinfo));
-			struct in_pktinfo *pktinfo = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			if (tcpha.isV6())
-				return;
-			pktinfo->ipi_spec_dst.s_addr = tcpha.toIPv4();
-		}
+		msg.msg_control    = descriptor.control;
+		msg.msg_controllen = descriptor.controlLength;
+		msg.msg_flags      = 0;
 
-
-		::sendmsg(u.sUdpSocket, &msg, 0);
+		::sendmsg(descriptor.socket, &msg, 0);
 #else
 #	ifdef Q_OS_WIN
 		using size_type = int;
 #	else
 		using size_type = std::size_t;
 #	endif
-		::sendto(u.sUdpSocket, buffer, static_cast< size_type >(len + 4), 0,
-				 reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress),
-				 (u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+		::sendto(descriptor.socket, reinterpret_cast< const char * >(buffer), static_cast< size_type >(len + 4), 0,
+				 &descriptor.address.generic, descriptor.addressLength);
 #endif
 #ifdef Q_OS_WIN
 		if (Meta::hQoS && dwFlow)
@@ -1127,9 +1304,163 @@ void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByt
 #else
 #endif
 	} else {
-		if (cache.isEmpty())
-			cache = QByteArray(reinterpret_cast< const char * >(data), len);
-		emit tcpTransmit(cache, u.uiSession);
+		queueTunnelledVoice(u, data, len);
+	}
+}
+
+void Server::queueTunnelledVoice(ServerUser &u, const unsigned char *data, int len) {
+	bool schedule = false;
+
+	{
+		QMutexLocker l(&m_tcpTunnelMutex);
+
+		QByteArray &queue = u.m_tcpTunnelQueue;
+		if (queue.isEmpty()) {
+			// Only the first user to receive tunnelled voice since the last flush has to schedule one
+			schedule = m_tcpTunnelPending.empty();
+			m_tcpTunnelPending.push_back(u.uiSession);
+		}
+
+		// Frame the packet directly in the queue
+		const int offset = queue.size();
+		queue.resize(offset + len + 6);
+		unsigned char *uc = reinterpret_cast< unsigned char * >(queue.data()) + offset;
+		qToBigEndian(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel), uc);
+		qToBigEndian(static_cast< quint32 >(len), uc + 2);
+		memcpy(uc + 6, data, static_cast< std::size_t >(len));
+	}
+
+	if (schedule) {
+		QMetaObject::invokeMethod(this, "flushTunnelledVoice", Qt::QueuedConnection);
+	}
+}
+
+void Server::flushTunnelledVoice() {
+	ZoneScoped;
+
+	std::vector< std::pair< ServerUser *, QByteArray > > queues;
+
+	{
+		QMutexLocker l(&m_tcpTunnelMutex);
+
+		queues.reserve(m_tcpTunnelPending.size());
+		for (unsigned int session : m_tcpTunnelPending) {
+			// Users that have disconnected in the meantime don't get their voice anymore
+			ServerUser *u = qhUsers.value(session);
+			if (u && !u->m_tcpTunnelQueue.isEmpty()) {
+				queues.emplace_back(u, QByteArray());
+				queues.back().second.swap(u->m_tcpTunnelQueue);
+			}
+		}
+		m_tcpTunnelPending.clear();
+	}
+
+	// Everything that has been queued for a user since the last flush goes out in a single write
+	for (std::pair< ServerUser *, QByteArray > &queue : queues) {
+		queue.first->sendMessage(queue.second);
+		queue.first->forceFlush();
+	}
+}
+
+void Server::scheduleVoiceRoutingUpdate() {
+	if (!m_voiceRoutingUpdatePending.exchange(true)) {
+		QMetaObject::invokeMethod(this, "publishVoiceRouting", Qt::QueuedConnection);
+	}
+}
+
+std::unique_ptr< VoiceRoutingSnapshot > Server::createVoiceRoutingSnapshot() {
+	ZoneScoped;
+
+	std::unique_ptr< VoiceRoutingSnapshot > snapshot = std::make_unique< VoiceRoutingSnapshot >();
+
+	snapshot->users.reserve(static_cast< std::size_t >(qhUsers.size()));
+	for (ServerUser *u : qhUsers) {
+		VoiceRoutingSnapshot::User &entry = snapshot->users[u->uiSession];
+
+		entry.user      = u;
+		entry.session   = u->uiSession;
+		entry.channelID = u->cChannel ? static_cast< unsigned int >(u->cChannel->iId) : 0;
+		entry.canSpeak  = u->cChannel && u->sState == ServerUser::Authenticated && !u->bMute && !u->bSuppress
+						 && !u->bSelfMute;
+		entry.deaf      = u->bDeaf || u->bSelfDeaf;
+		entry.context   = u->ssContext;
+	}
+
+	snapshot->channels.reserve(static_cast< std::size_t >(qhChannels.size()));
+	for (Channel *c : qhChannels) {
+		VoiceRoutingSnapshot::Channel &entry = snapshot->channels[static_cast< unsigned int >(c->iId)];
+
+		entry.id = static_cast< unsigned int >(c->iId);
+
+		for (User *p : c->qlUsers) {
+			auto it = snapshot->users.find(p->uiSession);
+			if (it != snapshot->users.end() && !it->second.deaf) {
+				entry.members.push_back(&it->second);
+			}
+		}
+
+		for (unsigned int session : m_channelListenerManager.getListenersForChannel(entry.id)) {
+			auto it = snapshot->users.find(session);
+			if (it != snapshot->users.end() && !it->second.deaf) {
+				entry.listeners.push_back(
+					{ &it->second, m_channelListenerManager.getListenerVolumeAdjustment(session, entry.id) });
+			}
+		}
+	}
+
+	{
+		QMutexLocker qml(&qmCache);
+
+		for (auto &current : snapshot->users) {
+			VoiceRoutingSnapshot::User &entry = current.second;
+			ServerUser *u                     = entry.user;
+
+			if (!entry.canSpeak || u->cChannel->qhLinks.isEmpty()) {
+				continue;
+			}
+
+			QSet< Channel * > chans = u->cChannel->allLinks();
+			chans.remove(u->cChannel);
+
+			for (Channel *l : chans) {
+				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache)) {
+					entry.speakableLinks.push_back(snapshot->findChannel(static_cast< unsigned int >(l->iId)));
+				}
+			}
+		}
+	}
+
+	snapshot->createFanOuts();
+
+	{
+		// Peers get associated by the voice threads
+		QReadLocker rl(&qrwlVoiceThread);
+		snapshot->peers = qhPeerUsers;
+	}
+
+	return snapshot;
+}
+
+void Server::publishVoiceRouting() {
+	ZoneScoped;
+
+	// Reset the flag first, such that changes made while the snapshot is created schedule another update
+	m_voiceRoutingUpdatePending = false;
+
+	m_voiceRouting->publish(createVoiceRoutingSnapshot());
+
+	for (ServerUser *u : m_retiringUsers) {
+		m_voiceRouting->retire([u]() { u->deleteLater(); });
+	}
+	m_retiringUsers.clear();
+
+	reclaimVoiceRouting();
+}
+
+void Server::reclaimVoiceRouting() {
+	if (m_voiceRouting->reclaim()) {
+		// Some voice thread is still processing a packet using an old snapshot
+		m_voiceRoutingReclaimTimer.start();
 	}
 }
 
@@ -1144,16 +1475,17 @@ void Server::addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, Ser
 	}
 }
 
-void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-						Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder) {
+void Server::processMsg(ServerUser *u, const VoiceRoutingSnapshot &routing, Mumble::Protocol::AudioData audioData,
+						AudioReceiverBuffer &buffer,
+						Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder,
+						UDPSendBatch *sendBatch) {
 	ZoneScoped;
 
-	// Note that in this function we never have to acquire a read-lock on qrwlVoiceThread
-	// as all places that call this function will hold that lock at the point of calling
-	// this function.
-	// This function is currently called from Server::msgUDPTunnel, Server::run and
-	// Server::message
-	if (u->sState != ServerUser::Authenticated || u->bMute || u->bSuppress || u->bSelfMute)
+	// Regular speech and loopback audio are routed using the given snapshot only. For all other targets the
+	// caller has to hold a read-lock on qrwlVoiceThread, as they are resolved using the live state.
+	// This function is currently called from Server::runVoiceThread and Server::message
+	const VoiceRoutingSnapshot::User *sender = routing.findUser(u->uiSession);
+	if (!sender || !sender->canSpeak)
 		return;
 
 	// Check the voice data rate limit.
@@ -1174,51 +1506,17 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 	if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::SERVER_LOOPBACK) {
 		buffer.forceAddReceiver(*u, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
 	} else if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) {
-		Channel *c = u->cChannel;
-
-		// Send audio to all users that are listening to the channel
-		foreach (unsigned int currentSession, m_channelListenerManager.getListenersForChannel(c->iId)) {
-			ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-			if (pDst) {
-				buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								   m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, c->iId));
-			}
-		}
-
-		// Send audio to all users in the same channel
-		for (User *p : c->qlUsers) {
-			ServerUser *pDst = static_cast< ServerUser * >(p);
-
-			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
+		// Send audio to everyone in (or listening to) the user's channel and the linked channels the user may speak
+		// in. The fan-out list has been deduplicated (and excludes deafened users) already.
+		if (!sender->fanOut) {
+			return;
 		}
 
-		// Send audio to all linked channels the user has speak-permission
-		if (!c->qhLinks.isEmpty()) {
-			QSet< Channel * > chans = c->allLinks();
-			chans.remove(c);
-
-			QMutexLocker qml(&qmCache);
-
-			for (Channel *l : chans) {
-				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache)) {
-					// Send the audio stream to all users that are listening to the linked channel
-					for (unsigned int currentSession : m_channelListenerManager.getListenersForChannel(l->iId)) {
-						ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-						if (pDst) {
-							buffer.addReceiver(
-								*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, l->iId));
-						}
-					}
-
-					// Send audio to users in the linked channel
-					for (User *p : l->qlUsers) {
-						ServerUser *pDst = static_cast< ServerUser * >(p);
-
-						buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL,
-										   audioData.containsPositionalData);
-					}
-				}
+		for (const VoiceRoutingSnapshot::FanOut::Receiver &receiver : sender->fanOut->receivers) {
+			if (receiver.session != sender->session) {
+				buffer.addUniqueReceiver(*receiver.user, receiver.context,
+										 audioData.containsPositionalData && receiver.contextID == sender->contextID,
+										 receiver.volumeAdjustment);
 			}
 		}
 	} else if (u->qmTargets.contains(static_cast< int >(audioData.targetOrContext))) { // Whisper/Shout
@@ -1286,7 +1584,6 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 	buffer.preprocessBuffer();
 
 	bool isFirstIteration = true;
-	QByteArray tcpCache;
 	for (bool includePositionalData : { true, false }) {
 		std::vector< AudioReceiver > &receiverList = buffer.getReceivers(includePositionalData);
 
@@ -1328,19 +1625,22 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 			gsl::span< const Mumble::Protocol::byte > encodedPacket = encoder.updateAudioPacket(audioData);
 			TracyCZoneEnd(__tracy_zone);
 
-			// Clear TCP cache
-			tcpCache.clear();
-
 			// Send encoded packet to all receivers of this range
 			for (auto it = currentRange.begin; it != currentRange.end; ++it) {
-				sendMessage(it->getReceiver(), encodedPacket.data(), static_cast< int >(encodedPacket.size()),
-							tcpCache);
+				sendMessage(it->getReceiver(), encodedPacket.data(), static_cast< int >(encodedPacket.size()), false,
+							sendBatch);
 			}
 
 			// Find next range
 			currentRange = AudioReceiverBuffer::getReceiverRange(currentRange.end, receiverList.end());
 		}
 	}
+
+#ifdef Q_OS_LINUX
+	if (sendBatch) {
+		sendBatch->flush();
+	}
+#endif
 }
 
 void Server::log(ServerUser *u, const QString &str) const {
@@ -1374,25 +1674,18 @@ void Server::newClient() {
 
 		HostAddress ha(adr);
 
-		QList< Ban > tmpBans = qlBans;
-		foreach (const Ban &ban, qlBans) {
-			if (ban.isExpired())
-				tmpBans.removeOne(ban);
-		}
-		if (qlBans.count() != tmpBans.count()) {
-			qlBans = tmpBans;
+		if (m_bans.removeExpired()) {
 			saveBans();
 		}
 
-		foreach (const Ban &ban, qlBans) {
-			if (ban.haAddress.match(ha, static_cast< unsigned int >(ban.iMask))) {
-				log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
-						.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban.qsReason, ban.qsUsername,
-							 ban.qsHash));
-				sock->disconnectFromHost();
-				sock->deleteLater();
-				return;
-			}
+		const Ban *ban = m_bans.match(ha);
+		if (ban) {
+			log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
+					.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban->qsReason, ban->qsUsername,
+						 ban->qsHash));
+			sock->disconnectFromHost();
+			sock->deleteLater();
+			return;
 		}
 
 #ifdef Q_OS_MAC
@@ -1467,8 +1760,6 @@ void Server::newClient() {
 		HostAddress(sock->localAddress()).toSockaddr(&u->saiTcpLocalAddress);
 
 		connect(u, &ServerUser::connectionClosed, this, &Server::connectionClosed);
-		connect(u, SIGNAL(message(Mumble::Protocol::TCPMessageType, const QByteArray &)), this,
-				SLOT(message(Mumble::Protocol::TCPMessageType, const QByteArray &)));
 		connect(u, &ServerUser::handleSslErrors, this, &Server::sslError);
 		connect(u, &ServerUser::encrypted, this, &Server::encrypted);
 
@@ -1529,12 +1820,10 @@ void Server::encrypted() {
 							 .arg(issuer));
 		}
 
-		foreach (const Ban &ban, qlBans) {
-			if (ban.qsHash == uSource->qsHash) {
-				log(uSource, QString("Certificate hash is banned: %1, Username: %2, Reason: %3.")
-								 .arg(ban.qsHash, ban.qsUsername, ban.qsReason));
-				uSource->disconnectSocket();
-			}
+		foreach (const Ban &ban, m_bans.matchHash(uSource->qsHash)) {
+			log(uSource, QString("Certificate hash is banned: %1, Username: %2, Reason: %3.")
+							 .arg(ban.qsHash, ban.qsUsername, ban.qsReason));
+			uSource->disconnectSocket();
 		}
 	}
 }
@@ -1664,7 +1953,13 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 						   ? (reinterpret_cast< sockaddr_in6 * >(&u->saiUdpAddress)->sin6_port)
 						   : (reinterpret_cast< sockaddr_in * >(&u->saiUdpAddress)->sin_port);
 		const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(u->haAddress, port);
-		qhPeerUsers.remove(key);
+		// Another user may have taken over the endpoint in the meantime
+		if (qhPeerUsers.value(key) == u) {
+			qhPeerUsers.remove(key);
+		}
+		if (u->m_udpAssociationToken != 0) {
+			m_udpAssociationTokens.remove(u->m_udpAssociationToken);
+		}
 
 		if (old)
 			old->removeUser(u);
@@ -1682,26 +1977,25 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 		recheckCodecVersions(); // Maybe can choose a better codec now
 	}
 
-	u->deleteLater();
+	// The user is deleted once no voice thread can reach it through a routing snapshot anymore
+	m_retiringUsers.push_back(u);
+	scheduleVoiceRoutingUpdate();
 
 	if (qhUsers.isEmpty())
 		stopThread();
 }
 
-void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qbaMsg, ServerUser *u) {
+void Server::message(Mumble::Protocol::TCPMessageType type, gsl::span< const Mumble::Protocol::byte > data,
+					 ServerUser *u) {
 	ZoneScopedN(TracyConstants::TCP_PACKET_PROCESSING_ZONE);
 
-	if (!u) {
-		u = static_cast< ServerUser * >(sender());
-	}
-
 	if (u->sState == ServerUser::Authenticated) {
 		u->resetActivityTime();
 	}
 
 	if (type == Mumble::Protocol::TCPMessageType::UDPTunnel) {
-		int len = qbaMsg.size();
-		if (len < 2 || static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+		// Tunnelled voice packets go straight to the decoder, without being copied
+		if (data.size() < 2 || data.size() > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
 			// Drop messages that are too small to be senseful or that are bigger than allowed
 			return;
 		}
@@ -1712,9 +2006,7 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 
 		m_tcpTunnelDecoder.setProtocolVersion(u->m_version);
 
-		if (m_tcpTunnelDecoder.decode(gsl::span< const Mumble::Protocol::byte >(
-				reinterpret_cast< const Mumble::Protocol::byte * >(qbaMsg.constData()),
-				static_cast< std::size_t >(qbaMsg.size())))) {
+		if (m_tcpTunnelDecoder.decode(data)) {
 			if (m_tcpTunnelDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Audio) {
 				Mumble::Protocol::AudioData audioData = m_tcpTunnelDecoder.getAudioData();
 				// Allow all voice packets through by default.
@@ -1728,7 +2020,9 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 					// Add session id
 					audioData.senderSession = u->uiSession;
 
-					processMsg(u, std::move(audioData), m_tcpAudioReceivers, m_tcpAudioEncoder);
+					// The main thread publishes the snapshots, so the current one can't be reclaimed while it is used
+					processMsg(u, m_voiceRouting->current(), std::move(audioData), m_tcpAudioReceivers,
+							   m_tcpAudioEncoder, m_tcpSendBatch.get());
 				}
 			}
 		}
@@ -1736,29 +2030,32 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 		return;
 	}
 
+	const void *payload = data.data();
+	const int length    = static_cast< int >(data.size());
+
 #ifdef QT_NO_DEBUG
-#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                      \
-		case Mumble::Protocol::TCPMessageType::name: {                   \
-			MumbleProto::name msg;                                       \
-			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-				msg.DiscardUnknownFields();                              \
-				msg##name(u, msg);                                       \
-			}                                                            \
-			break;                                                       \
+#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)     \
+		case Mumble::Protocol::TCPMessageType::name: { \
+			MumbleProto::name msg;                     \
+			if (msg.ParseFromArray(payload, length)) { \
+				msg.DiscardUnknownFields();            \
+				msg##name(u, msg);                     \
+			}                                          \
+			break;                                     \
 		}
 #else
-#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                      \
-		case Mumble::Protocol::TCPMessageType::name: {                   \
-			MumbleProto::name msg;                                       \
-			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-				if (type != Mumble::Protocol::TCPMessageType::Ping) {    \
-					printf("== %s:\n", #name);                           \
-					msg.PrintDebugString();                              \
-				}                                                        \
-				msg.DiscardUnknownFields();                              \
-				msg##name(u, msg);                                       \
-			}                                                            \
-			break;                                                       \
+#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                    \
+		case Mumble::Protocol::TCPMessageType::name: {                \
+			MumbleProto::name msg;                                    \
+			if (msg.ParseFromArray(payload, length)) {                \
+				if (type != Mumble::Protocol::TCPMessageType::Ping) { \
+					printf("== %s:\n", #name);                        \
+					msg.PrintDebugString();                           \
+				}                                                     \
+				msg.DiscardUnknownFields();                           \
+				msg##name(u, msg);                                    \
+			}                                                         \
+			break;                                                    \
 		}
 #endif
 
@@ -1782,24 +2079,6 @@ void Server::checkTimeout() {
 		u->disconnectSocket(true);
 }
 
-void Server::tcpTransmitData(QByteArray a, unsigned int id) {
-	Connection *c = qhUsers.value(id);
-	if (c) {
-		QByteArray qba;
-		int len = a.size();
-
-		qba.resize(len + 6);
-		unsigned char *uc = reinterpret_cast< unsigned char * >(qba.data());
-		*reinterpret_cast< quint16 * >(&uc[0]) =
-			qToBigEndian(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel));
-		*reinterpret_cast< quint32 * >(&uc[2]) = qToBigEndian(static_cast< quint32 >(len));
-		memcpy(uc + 6, a.constData(), static_cast< std::size_t >(len));
-
-		c->sendMessage(qba);
-		c->forceFlush();
-	}
-}
-
 void Server::doSync(unsigned int id) {
 	ServerUser *u = qhUsers.value(id);
 	if (u) {
@@ -1837,6 +2116,45 @@ void Server::sendProtoExcept(ServerUser *u, const ::google::protobuf::Message &m
 		}
 }
 
+void Server::sendBroadcast(Broadcast &broadcast, ServerUser *except) {
+	if (broadcast.isEmpty())
+		return;
+
+	foreach (ServerUser *usr, qhUsers)
+		if ((usr != except) && (usr->sState == ServerUser::Authenticated))
+			usr->sendMessage(broadcast.dataFor(usr->m_version));
+}
+
+void Server::forgetSyncState(const MumbleProto::ChannelState &msg) {
+	m_channelSyncStates.remove(msg.channel_id());
+	m_channelSyncLinks.remove(msg.channel_id());
+
+	if (msg.links_size() > 0) {
+		// The links have been replaced, so links of other channels may have been removed as well
+		m_channelSyncLinks.clear();
+	}
+	for (int i = 0; i < msg.links_add_size(); ++i) {
+		m_channelSyncLinks.remove(msg.links_add(i));
+	}
+	for (int i = 0; i < msg.links_remove_size(); ++i) {
+		m_channelSyncLinks.remove(msg.links_remove(i));
+	}
+}
+
+void Server::forgetSyncState(const MumbleProto::ChannelRemove &msg) {
+	m_channelSyncStates.remove(msg.channel_id());
+	// Removed channels are unlinked from all other channels
+	m_channelSyncLinks.clear();
+}
+
+void Server::forgetSyncState(const MumbleProto::UserState &msg) {
+	m_userSyncStates.remove(msg.session());
+}
+
+void Server::forgetSyncState(const MumbleProto::UserRemove &msg) {
+	m_userSyncStates.remove(msg.session());
+}
+
 void Server::removeChannel(unsigned int id) {
 	Channel *c = qhChannels.value(id);
 	if (c)
@@ -1854,6 +2172,7 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 		QWriteLocker wl(&qrwlVoiceThread);
 		chan->unlink(nullptr);
 	}
+	scheduleVoiceRoutingUpdate();
 
 	foreach (c, chan->qlChannels) { removeChannel(c, dest); }
 
@@ -1930,8 +2249,10 @@ bool Server::unregisterUser(int id) {
 				bool remrem = g->qsRemove.remove(id);
 				write       = write || addrem || remrem;
 			}
-			if (write)
+			if (write) {
+				ChanACL::invalidatePrograms(c);
 				updateChannel(c);
+			}
 		}
 	}
 
@@ -1979,6 +2300,7 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 			mpus.set_priority_speaker(p->bPrioritySpeaker);
 		}
 	}
+	scheduleVoiceRoutingUpdate();
 
 	clearACLCache(p);
 	setLastChannel(p);
@@ -2014,7 +2336,7 @@ void Server::sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequ
 		// Abuse that hasPermission will update acCache with the latest permissions (all of them,
 		// not only the requested one) so that we can pull this information out of it afterwards.
 		ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-		perm = acCache.value(u)->value(c);
+		perm = acCache.value(u)->value(c).permissions;
 	}
 
 	if (explicitlyRequested) {
@@ -2052,7 +2374,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 			match = false;
 		} else {
 			ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-			unsigned int perm = acCache.value(u)->value(c);
+			unsigned int perm = acCache.value(u)->value(c).permissions;
 			if (perm != i.value())
 				match = false;
 		}
@@ -2070,7 +2392,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 	}
 
 	ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-	unsigned int perm = acCache.value(u)->value(c);
+	unsigned int perm = acCache.value(u)->value(c).permissions;
 	u->qmPermissionSent.insert(static_cast< int >(c->iId), perm);
 
 	mppq.Clear();
@@ -2104,6 +2426,7 @@ void Server::clearACLCache(User *p) {
 
 		// A change in ACLs could also change a user's suppression state
 		MumbleProto::UserState mpus;
+		Broadcast suppressionChanges;
 		auto processingFunction = [&](ServerUser *user) {
 			bool maySpeak = ChanACL::hasPermission(user, user->cChannel, ChanACL::Speak, &acCache);
 
@@ -2115,7 +2438,7 @@ void Server::clearACLCache(User *p) {
 				mpus.Clear();
 				mpus.set_session(user->uiSession);
 				mpus.set_suppress(true);
-				sendAll(mpus);
+				addToBroadcast(suppressionChanges, mpus);
 			}
 		};
 
@@ -2126,11 +2449,111 @@ void Server::clearACLCache(User *p) {
 				processingFunction(currentUser);
 			}
 		}
+
+		sendBroadcast(suppressionChanges);
 	}
 
 	// A change in ACLs means that the user might be able to whisper
 	// to users it didn't have permission to do before (or vice versa)
 	clearWhisperTargetCache();
+	// ...or speak into linked channels
+	scheduleVoiceRoutingUpdate();
+}
+
+void Server::clearChannelACLCache(Channel *chan) {
+	// Changes to the ACLs or groups of a channel only affect the permissions in its subtree
+	auto isAffected = [chan](const Channel *c) {
+		for (; c; c = c->cParent) {
+			if (c == chan)
+				return true;
+		}
+		return false;
+	};
+
+	MumbleProto::PermissionQuery mppq;
+
+	{
+		QMutexLocker qml(&qmCache);
+
+		// The cached permissions of the affected channels have been outdated by ChanACL::invalidatePrograms already.
+		// Only users that have been sent permissions for one of these channels have to be checked for changes.
+		foreach (ServerUser *u, qhUsers) {
+			if (u->sState != ServerUser::Authenticated)
+				continue;
+
+			for (auto i = u->qmPermissionSent.constBegin(); i != u->qmPermissionSent.constEnd(); ++i) {
+				Channel *c = qhChannels.value(static_cast< unsigned int >(i.key()));
+				if (!c || isAffected(c)) {
+					flushClientPermissionCache(u, mppq);
+					break;
+				}
+			}
+		}
+
+		// A change in ACLs could also change a user's suppression state
+		MumbleProto::UserState mpus;
+		Broadcast suppressionChanges;
+		for (ServerUser *user : qhUsers) {
+			if (!isAffected(user->cChannel))
+				continue;
+
+			bool maySpeak = ChanACL::hasPermission(user, user->cChannel, ChanACL::Speak, &acCache);
+
+			if (maySpeak == user->bSuppress) {
+				user->bSuppress = !maySpeak;
+
+				mpus.Clear();
+				mpus.set_session(user->uiSession);
+				mpus.set_suppress(true);
+				addToBroadcast(suppressionChanges, mpus);
+			}
+		}
+
+		sendBroadcast(suppressionChanges);
+	}
+
+	{
+		QWriteLocker lock(&qrwlVoiceThread);
+
+		// Only drop the cached whisper targets that involve an affected channel. Linked channels are not followed,
+		// so targets including them are always dropped.
+		auto isParentOfAffected = [chan](const Channel *c) {
+			for (const Channel *parent = chan->cParent; parent; parent = parent->cParent) {
+				if (parent == c)
+					return true;
+			}
+			return false;
+		};
+		auto targetIsAffected = [&](const WhisperTarget &target) {
+			for (const WhisperTarget::Channel &currentTarget : target.channels) {
+				const Channel *targetChannel = qhChannels.value(currentTarget.id);
+				if (!targetChannel || isAffected(targetChannel) || currentTarget.includeLinks
+					|| (currentTarget.includeChildren && isParentOfAffected(targetChannel))) {
+					return true;
+				}
+			}
+			for (unsigned int session : target.sessions) {
+				const ServerUser *pDst = qhUsers.value(session);
+				if (!pDst || isAffected(pDst->cChannel))
+					return true;
+			}
+			return false;
+		};
+
+		foreach (ServerUser *u, qhUsers) {
+			for (auto i = u->qmTargetCache.begin(); i != u->qmTargetCache.end();) {
+				auto target = u->qmTargets.constFind(i.key());
+				if (target == u->qmTargets.constEnd() || targetIsAffected(target.value())) {
+					i = u->qmTargetCache.erase(i);
+				} else {
+					++i;
+				}
+			}
+		}
+	}
+
+	// ...or speak into linked channels
+	scheduleVoiceRoutingUpdate();
 }
 
 void Server::clearWhisperTargetCache() {
@@ -2410,8 +2833,11 @@ WhisperTargetCache Server::createWhisperTargetCacheFor(ServerUser &speaker, cons
 
 					// The target group might be changed by a redirect set up via RPC (Ice/gRPC). In that
 					// case the shout is sent to the redirection target instead the originally specified group
-					const QString &redirect    = speaker.qmWhisperRedirect.value(currentTarget.targetGroup);
-					const QString &targetGroup = redirect.isEmpty() ? currentTarget.targetGroup : redirect;
+					const QString redirect = speaker.qmWhisperRedirect.value(currentTarget.targetGroup);
+					const Group::Specification redirectSpecification =
+						redirect.isEmpty() ? Group::Specification() : Group::Specification::parse(redirect);
+					const Group::Specification &targetGroup =
+						redirect.isEmpty() ? currentTarget.targetGroupSpecification : redirectSpecification;
 
 					for (Channel *subTargetChan : channels) {
 						if (ChanACL::hasPermission(&speaker, subTargetChan, ChanACL::Whisper, &acCache)) {
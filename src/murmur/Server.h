@@ -15,13 +15,17 @@
 #include "ACL.h"
 #include "AudioReceiverBuffer.h"
 #include "Ban.h"
+#include "BanList.h"
+#include "Broadcast.h"
 #include "ChannelListenerManager.h"
 #include "HostAddress.h"
 #include "Mumble.pb.h"
 #include "MumbleProtocol.h"
 #include "Timer.h"
 #include "User.h"
+#include "UserDirectory.h"
 #include "Version.h"
+#include "VoiceRouting.h"
 #include "VolumeAdjustment.h"
 
 #ifndef Q_MOC_RUN
@@ -45,6 +49,11 @@
 #	include <QtNetwork/QSslDiffieHellmanParameters>
 #endif
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 #ifdef Q_OS_WIN
 #	include <winsock2.h>
 #endif
@@ -55,6 +64,10 @@ class PacketDataStream;
 class ServerUser;
 class User;
 class QNetworkAccessManager;
+class UDPSendBatch;
+class VoiceThread;
+struct VoiceThreadContext;
+struct PasswordHash;
 
 struct TextMessage {
 	QList< unsigned int > qlSessions;
@@ -177,10 +190,7 @@ public:
 	ChannelListenerManager m_channelListenerManager;
 
 
-	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_udpDecoder;
 	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_tcpTunnelDecoder;
-	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > m_udpPingEncoder;
-	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_udpAudioEncoder;
 	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_tcpAudioEncoder;
 
 	gsl::span< const Mumble::Protocol::byte >
@@ -209,9 +219,66 @@ private:
 	int iChannelNestingLimit;
 	int iChannelCountLimit;
 
-	AudioReceiverBuffer m_udpAudioReceivers;
 	AudioReceiverBuffer m_tcpAudioReceivers;
 
+	/// Batch used to send the voice datagrams resulting from tunnelled (TCP) audio with as few syscalls as
+	/// possible. This is only available on Linux (sendmmsg) and is nullptr on other platforms.
+	std::unique_ptr< UDPSendBatch > m_tcpSendBatch;
+
+	/// Guards ServerUser::m_tcpTunnelQueue of all users and m_tcpTunnelPending
+	QMutex m_tcpTunnelMutex;
+	/// The sessions of the users with a non-empty ServerUser::m_tcpTunnelQueue. A call to flushTunnelledVoice is
+	/// queued whenever this stops being empty.
+	std::vector< unsigned int > m_tcpTunnelPending;
+
+	/// The per-thread state of all voice threads. The first context belongs to the Server's own thread, the
+	/// remaining ones to the threads in m_voiceThreads.
+	std::vector< std::unique_ptr< VoiceThreadContext > > m_voiceContexts;
+	/// The voice threads that run in addition to the Server's own thread
+	std::vector< std::unique_ptr< VoiceThread > > m_voiceThreads;
+
+	/// The routing state the voice threads use for regular speech
+	std::unique_ptr< VoiceRouting > m_voiceRouting;
+	/// Whether a call to publishVoiceRouting has already been queued
+	std::atomic< bool > m_voiceRoutingUpdatePending = { false };
+	/// Users that have disconnected but may still be referenced by a voice thread through a routing snapshot
+	std::vector< ServerUser * > m_retiringUsers;
+	/// Retries reclaiming retired routing state that was still in use during the last publication
+	QTimer m_voiceRoutingReclaimTimer;
+
+	/// Builds a new routing snapshot from the current state of the server
+	std::unique_ptr< VoiceRoutingSnapshot > createVoiceRoutingSnapshot();
+
+	/// The network representation of the ChannelState of each channel as sent to clients >= 1.2.2 when they
+	/// connect, lacking the fields that depend on the client's permissions. As every change of a channel is
+	/// broadcast, entries are dropped by forgetSyncState.
+	QHash< unsigned int, QByteArray > m_channelSyncStates;
+	/// Like m_channelSyncStates, but for the links of each channel (empty for channels without links)
+	QHash< unsigned int, QByteArray > m_channelSyncLinks;
+	/// Like m_channelSyncStates, but for the UserState of each authenticated user (by session)
+	QHash< unsigned int, QByteArray > m_userSyncStates;
+
+	void fillChannelSyncState(Channel *c, bool sendHashes, MumbleProto::ChannelState &mpcs) const;
+	void fillUserSyncState(ServerUser *u, bool sendHashes, bool sendTexture, MumbleProto::UserState &mpus);
+	/// Appends the ChannelState of the given channel, as the given client has to receive it when connecting, to the
+	/// given buffer
+	void appendChannelSyncState(QByteArray &buffer, Channel *c, ServerUser *recipient);
+	void appendChannelSyncLinks(QByteArray &buffer, Channel *c);
+	void appendUserSyncState(QByteArray &buffer, ServerUser *u, ServerUser *recipient);
+
+	/// Drops the cached sync states a broadcast message of the given type makes outdated
+	template< typename Message > void forgetSyncState(const Message &) {}
+	void forgetSyncState(const MumbleProto::ChannelState &msg);
+	void forgetSyncState(const MumbleProto::ChannelRemove &msg);
+	void forgetSyncState(const MumbleProto::UserState &msg);
+	void forgetSyncState(const MumbleProto::UserRemove &msg);
+
+private slots:
+	void publishVoiceRouting();
+	void reclaimVoiceRouting();
+	/// Writes the tunnelled voice that has been queued by queueTunnelledVoice to the users' sockets
+	void flushTunnelledVoice();
+
 public slots:
 	void regSslError(const QList< QSslError > &);
 	void finished();
@@ -232,27 +299,27 @@ public slots:
 	void newClient();
 	void connectionClosed(QAbstractSocket::SocketError, const QString &);
 	void sslError(const QList< QSslError > &);
-	void message(Mumble::Protocol::TCPMessageType, const QByteArray &, ServerUser *cCon = nullptr);
 	void checkTimeout();
-	void tcpTransmitData(QByteArray, unsigned int);
 	void doSync(unsigned int);
 	void encrypted();
 	void udpActivated(int);
 signals:
 	void reqSync(unsigned int);
-	void tcpTransmit(QByteArray, unsigned int id);
 
 public:
+	/// Handles a message received from the given user via TCP.
+	///
+	/// @param data The message's payload, which is only valid until this function returns
+	void message(Mumble::Protocol::TCPMessageType type, gsl::span< const Mumble::Protocol::byte > data, ServerUser *u);
+
 	int iServerNum;
 	QQueue< unsigned int > qqIds;
 	QList< SslServer * > qlServer;
 	QTimer *qtTimeout;
 
 #ifdef Q_OS_UNIX
-	int aiNotify[2];
 	QList< int > qlUdpSocket;
 #else
-	HANDLE hNotify;
 	QList< SOCKET > qlUdpSocket;
 #endif
 	QList< QSocketNotifier * > qlUdpNotifier;
@@ -261,8 +328,12 @@ public:
 	/// main thread (where control channel messages and
 	/// RPC happens), and the Server's voice thread.
 	///
-	/// These are the only two threads in Murmur that
-	/// access a Server's data.
+	/// These are the only threads in Murmur that
+	/// access a Server's data. If the server is configured
+	/// to use multiple voice threads, each of them follows
+	/// the same rules as "the" voice thread described below.
+	/// As voice threads only read shared data, they don't
+	/// need to synchronize with each other.
 	///
 	/// The easiest way to understand the locking strategy
 	/// and synchronization between the main thread and the
@@ -302,10 +373,19 @@ public:
 	///    by itself, it DOES NOT hold a lock on qrwlVoiceThread.
 	///    That is because ownership of data guarantees that no
 	///    other thread can write to that data.
+	///
+	/// Regular speech (which is the vast majority of voice
+	/// packets) is routed without taking this lock. Instead,
+	/// the voice threads read an immutable copy of the
+	/// relevant state (see VoiceRoutingSnapshot). Therefore,
+	/// whenever the main thread changes any of that state, it
+	/// must also call scheduleVoiceRoutingUpdate.
 	QReadWriteLock qrwlVoiceThread;
 	QHash< unsigned int, ServerUser * > qhUsers;
 	QHash< QPair< HostAddress, quint16 >, ServerUser * > qhPeerUsers;
 	QHash< HostAddress, QSet< ServerUser * > > qhHostUsers;
+	/// Maps UDP association tokens to the users they have been assigned to
+	QHash< std::uint32_t, ServerUser * > m_udpAssociationTokens;
 	QHash< unsigned int, Channel * > qhChannels;
 
 	QMutex qmCache;
@@ -313,25 +393,55 @@ public:
 
 	QHash< int, QString > qhUserNameCache;
 	QHash< QString, int > qhUserIDCache;
+	/// The registered users stored in the database. Use userDirectory(), which loads them when needed.
+	UserDirectory m_userDirectory;
+
+	BanList m_bans;
 
-	QList< Ban > qlBans;
+	/// Schedules the publication of a new routing snapshot for the voice threads. This has to be called whenever
+	/// state that is part of VoiceRoutingSnapshot changes. Multiple calls within the same iteration of the main
+	/// thread's event loop result in a single snapshot. This function may be called from any thread.
+	void scheduleVoiceRoutingUpdate();
 
 	void addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user, const Channel &channel);
-	void processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-					Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder);
-	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force = false);
+	void processMsg(ServerUser *u, const VoiceRoutingSnapshot &routing, Mumble::Protocol::AudioData audioData,
+					AudioReceiverBuffer &buffer,
+					Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder,
+					UDPSendBatch *sendBatch = nullptr);
+	void sendMessage(ServerUser &u, const unsigned char *data, int len, bool force = false,
+					 UDPSendBatch *batch = nullptr);
+	/// Queues the given voice packet for the given user, who is receiving voice through the TCP connection. Packets
+	/// queued within the same iteration of the main thread's event loop are written to the socket at once. This
+	/// function may be called from any thread.
+	void queueTunnelledVoice(ServerUser &u, const unsigned char *data, int len);
 	void run();
+	/// The voice packet loop, which is run by all voice threads of this server
+	void runVoiceThread(VoiceThreadContext &context);
 
 	bool validateChannelName(const QString &name);
 	bool validateUserName(const QString &name);
 
 	bool checkDecrypt(ServerUser *u, const unsigned char *encrypted, unsigned char *plain, unsigned int cryptlen);
+	/// Makes the given UDP endpoint the one of the given user. Must be called while holding a read lock on
+	/// qrwlVoiceThread, which is temporarily released.
+	///
+	/// @returns The user or nullptr if it has been removed in the meantime
+#ifdef Q_OS_WIN
+	ServerUser *associateUdpPeer(ServerUser *u, SOCKET sock, const struct sockaddr_storage &from,
+								 const QPair< HostAddress, quint16 > &key, QReadLocker &rl);
+#else
+	ServerUser *associateUdpPeer(ServerUser *u, int sock, const struct sockaddr_storage &from,
+								 const QPair< HostAddress, quint16 > &key, QReadLocker &rl);
+#endif
 
 	bool hasPermission(ServerUser *p, Channel *c, QFlags< ChanACL::Perm > perm);
 	QFlags< ChanACL::Perm > effectivePermissions(ServerUser *p, Channel *c);
 	void sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequested = false);
 	void flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mpqq);
 	void clearACLCache(User *p = nullptr);
+	/// Like clearACLCache, but restricted to users whose permissions may have changed due to a change of the ACLs or
+	/// groups of the given channel (which ChanACL::invalidatePrograms has to be called for first)
+	void clearChannelACLCache(Channel *chan);
 	void clearWhisperTargetCache();
 
 	void sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
@@ -339,20 +449,32 @@ public:
 	void sendProtoExcept(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
 						 Version::full_t version, Version::CompareMode mode);
 	void sendProtoMessage(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type);
+	/// Sends the messages of the given batch to all authenticated users but the given one, with a single write per
+	/// user.
+	void sendBroadcast(Broadcast &broadcast, ServerUser *except = nullptr);
 
 	// sendAll sends a protobuf message to all users on the server whose version is either bigger than v or
-	// lower than ~v. If v == 0 the message is sent to everyone.
+	// lower than ~v. If v == 0 the message is sent to everyone. addToBroadcast adds it to a batch sent by
+	// sendBroadcast instead.
 #define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                                                        \
 	void sendAll(const MumbleProto::name &msg, Version::full_t v = Version::UNKNOWN,                   \
 				 Version::CompareMode mode = Version::CompareMode::AtLeast) {                          \
+		forgetSyncState(msg);                                                                          \
 		sendProtoAll(msg, Mumble::Protocol::TCPMessageType::name, v, mode);                            \
 	}                                                                                                  \
 	void sendExcept(ServerUser *u, const MumbleProto::name &msg, Version::full_t v = Version::UNKNOWN, \
 					Version::CompareMode mode = Version::CompareMode::AtLeast) {                       \
+		forgetSyncState(msg);                                                                          \
 		sendProtoExcept(u, msg, Mumble::Protocol::TCPMessageType::name, v, mode);                      \
 	}                                                                                                  \
 	void sendMessage(ServerUser *u, const MumbleProto::name &msg) {                                    \
 		sendProtoMessage(u, msg, Mumble::Protocol::TCPMessageType::name);                              \
+	}                                                                                                  \
+	void addToBroadcast(Broadcast &broadcast, const MumbleProto::name &msg,                            \
+						Version::full_t v = Version::UNKNOWN,                                          \
+						Version::CompareMode mode = Version::CompareMode::AtLeast) {                   \
+		forgetSyncState(msg);                                                                          \
+		broadcast.add(msg, Mumble::Protocol::TCPMessageType::name, v, mode);                           \
 	}
 
 	MUMBLE_ALL_TCP_MESSAGES
@@ -431,9 +553,12 @@ public:
 
 	// Database / DBus functions. Implementation in ServerDB.cpp
 	void initialize();
+	/// @param passwordHash The hash of the password, if it has been computed already. It is only used if it has been
+	/// computed with the parameters stored for the user.
 	int authenticate(QString &name, const QString &pw, int sessionId = 0, const QStringList &emails = QStringList(),
 					 const QString &certhash = QString(), bool bStrongCert = false,
-					 const QList< QSslCertificate > & = QList< QSslCertificate >());
+					 const QList< QSslCertificate > & = QList< QSslCertificate >(),
+					 const PasswordHash *passwordHash = nullptr);
 	Channel *addChannel(Channel *c, const QString &name, bool temporary = false, int position = 0,
 						unsigned int maxUsers = 0);
 	void removeChannelDB(const Channel *c);
@@ -447,6 +572,8 @@ public:
 	/// Set last_disconnect of a registered user to the current time
 	void setLastDisconnect(const User *u);
 	void dumpChannel(const Channel *c);
+	/// @returns The registered users stored in the database, which are loaded when this is called for the first time
+	UserDirectory &userDirectory();
 	int getUserID(const QString &name);
 	QString getUserName(int id);
 	QByteArray getUserTexture(int id);
@@ -479,6 +606,9 @@ public:
 #define PROCESS_MUMBLE_TCP_MESSAGE(name, value) void msg##name(ServerUser *, MumbleProto::name &);
 	MUMBLE_ALL_TCP_MESSAGES
 #undef PROCESS_MUMBLE_TCP_MESSAGE
+	/// The part of msgAuthenticate that runs once the user's password hash has been computed (if needed)
+	void finishAuthenticate(ServerUser *uSource, const MumbleProto::Authenticate &msg,
+							const PasswordHash *passwordHash);
 };
 
 #endif
@@ -14,19 +14,27 @@
 #include "ACL.h"
 #include "Channel.h"
 #include "Connection.h"
+#include "DBWriter.h"
 #include "Group.h"
 #include "Meta.h"
 #include "PBKDF2.h"
 #include "PasswordGenerator.h"
+#include "PasswordHasher.h"
 #include "Server.h"
 #include "ServerUser.h"
+#include "StatementCache.h"
 #include "User.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QTimer>
+#include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
 
+#include <algorithm>
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 #ifdef Q_OS_WIN
 #	include <winsock2.h>
@@ -43,27 +51,135 @@
 #define SQLEXECBATCH() ServerDB::execBatch(query)
 #define SOFTEXEC() ServerDB::exec(query, QString(), false)
 
+/// How long a line of a server's log is buffered at most before it is written (in milliseconds)
+static const int LOG_FLUSH_INTERVAL = 1000;
+/// The maximum amount of lines of the servers' logs that are inserted by a single statement
+static const std::size_t MAX_LOG_ROWS = 64;
+/// How long an SQLite connection waits for another one to release its lock before giving up (in milliseconds)
+static const int SQLITE_BUSY_TIMEOUT = 5000;
+
+/// @returns The options every SQLite connection is opened with
+static QString sqliteConnectOptions() {
+	return QString::fromLatin1("QSQLITE_BUSY_TIMEOUT=%1").arg(SQLITE_BUSY_TIMEOUT);
+}
+
+/// @returns The statements that have been prepared on the connection the current thread uses (ServerDB::db)
+static StatementCache &preparedStatements() {
+	thread_local StatementCache statements;
+	return statements;
+}
 
 class TransactionHolder {
 public:
 	QSqlQuery *qsqQuery;
 	TransactionHolder() {
-		ServerDB::db->transaction();
-		qsqQuery = new QSqlQuery();
+		begin();
+		qsqQuery = new QSqlQuery(*ServerDB::db);
 	}
 
 	~TransactionHolder() {
 		qsqQuery->clear();
 		delete qsqQuery;
+		preparedStatements().end();
 		ServerDB::db->commit();
+		--depth;
 	}
 	TransactionHolder(const TransactionHolder &other) {
-		ServerDB::db->transaction();
+		begin();
 		qsqQuery = other.qsqQuery ? new QSqlQuery(*other.qsqQuery) : 0;
 	}
+
+	/// @returns Whether the main thread is within a transaction
+	static bool active() { return depth > 0; }
+
+private:
+	/// The amount of TransactionHolders that currently exist (they may be nested)
+	static int depth;
+
+	void begin() {
+		// The outermost transaction has to see everything that has been queued for the writer thread before. Waiting
+		// within a nested one could deadlock, as the writer may be waiting for the outer transaction's locks.
+		if (depth++ == 0) {
+			ServerDB::flushWrites();
+		}
+		ServerDB::db->transaction();
+		preparedStatements().begin();
+	}
+};
+
+int TransactionHolder::depth = 0;
+
+/// Executes the writes queued by ServerDB::enqueue on a database connection of its own.
+class ServerDBWriter : public DBWriter {
+public:
+	/// @param databaseName The name of the database the main connection has opened
+	explicit ServerDBWriter(const QString &databaseName) : m_databaseName(databaseName) {}
+	~ServerDBWriter() Q_DECL_OVERRIDE { stop(); }
+
+protected:
+	static const QString CONNECTION_NAME;
+
+	QString m_databaseName;
+	QSqlDatabase m_database;
+
+	void setUp() Q_DECL_OVERRIDE {
+		// Connections may only be used by the thread that created them
+		m_database = QSqlDatabase::addDatabase(Meta::mp.qsDBDriver, CONNECTION_NAME);
+		m_database.setDatabaseName(m_databaseName);
+		if (Meta::mp.qsDBDriver != "QSQLITE") {
+			m_database.setHostName(Meta::mp.qsDBHostName);
+			m_database.setPort(Meta::mp.iDBPort);
+			m_database.setUserName(Meta::mp.qsDBUserName);
+			m_database.setPassword(Meta::mp.qsDBPassword);
+			m_database.setConnectOptions(Meta::mp.qsDBOpts);
+		} else {
+			m_database.setConnectOptions(sqliteConnectOptions());
+		}
+
+		if (!m_database.open()) {
+			qFatal("ServerDB: Failed to open the connection for writing: %s",
+				   qPrintable(m_database.lastError().text()));
+		}
+
+		ServerDB::db = &m_database;
+
+		// The journal mode is persistent, but the synchronous mode is set per connection
+		if (Meta::mp.qsDBDriver == "QSQLITE" && Meta::mp.iSQLiteWAL > 0) {
+			QSqlQuery query(m_database);
+			if (Meta::mp.iSQLiteWAL == 1) {
+				SQLMAY("PRAGMA synchronous=NORMAL;");
+			} else {
+				SQLMAY("PRAGMA synchronous=FULL;");
+			}
+		}
+	}
+
+	void tearDown() Q_DECL_OVERRIDE {
+		preparedStatements().clear();
+		ServerDB::db = nullptr;
+		m_database.close();
+		m_database = QSqlDatabase();
+		QSqlDatabase::removeDatabase(CONNECTION_NAME);
+	}
+
+	void beginBatch() Q_DECL_OVERRIDE {
+		m_database.transaction();
+		preparedStatements().begin();
+	}
+
+	void commitBatch() Q_DECL_OVERRIDE {
+		preparedStatements().end();
+		if (!m_database.commit()) {
+			qWarning("ServerDB: Failed to commit queued writes: %s", qPrintable(m_database.lastError().text()));
+		}
+	}
 };
 
-QSqlDatabase *ServerDB::db = nullptr;
+const QString ServerDBWriter::CONNECTION_NAME = QStringLiteral("writer");
+
+thread_local QSqlDatabase *ServerDB::db = nullptr;
+DBWriter *ServerDB::writer              = nullptr;
+LogBuffer ServerDB::logBuffer;
 Timer ServerDB::tLogClean;
 QString ServerDB::qsUpgradeSuffix;
 
@@ -116,8 +232,13 @@ ServerDB::ServerDB() {
 	qsUpgradeSuffix = QString::fromLatin1("_old_%1").arg(QDateTime::currentDateTime().toTime_t());
 
 	bool found = false;
+	// Whether the writer thread's transactions can run alongside those of the main thread. SQLite's rollback journal
+	// lets a writer lock out all readers (and vice versa), so SQLite databases only qualify in WAL mode.
+	bool concurrentWrites = Meta::mp.qsDBDriver != "QSQLITE";
 
 	if (Meta::mp.qsDBDriver == "QSQLITE") {
+		db->setConnectOptions(sqliteConnectOptions());
+
 		if (!Meta::mp.qsDatabase.isEmpty()) {
 			db->setDatabaseName(Meta::mp.qsDatabase);
 			found = db->open();
@@ -200,6 +321,8 @@ ServerDB::ServerDB() {
 
 			if (okversion) {
 				SQLDO("PRAGMA journal_mode=WAL;");
+				// In-memory databases keep their journal in memory no matter what has been requested
+				concurrentWrites = query.next() && query.value(0).toString().toLower() == QLatin1String("wal");
 				if (Meta::mp.iSQLiteWAL == 1) {
 					SQLDO("PRAGMA synchronous=NORMAL;");
 					qWarning("ServerDB: Configured SQLite for journal_mode=WAL, synchronous=NORMAL");
@@ -873,19 +996,88 @@ ServerDB::ServerDB() {
 		}
 	}
 	query.clear();
+
+	// The statements used for creating or upgrading the tables aren't needed again, and some databases don't reuse
+	// plans across changes of the tables they refer to
+	preparedStatements().clear();
+
+	if (!concurrentWrites) {
+		qWarning("ServerDB: Writing to the database synchronously, as SQLite isn't in WAL mode");
+	} else {
+		writer = new ServerDBWriter(db->databaseName());
+		writer->start();
+	}
 }
 
 ServerDB::~ServerDB() {
+	flushLog();
+
+	if (writer) {
+		writer->stop();
+
+		const DBWriterStatistics statistics = writer->statistics();
+		qWarning("ServerDB: Wrote %llu queued changes in %llu transactions (at most %llu queued at once), taking "
+				 "%.2f ms on average and %.2f ms at most",
+				 static_cast< unsigned long long >(statistics.commands),
+				 static_cast< unsigned long long >(statistics.batches),
+				 static_cast< unsigned long long >(statistics.maxQueueDepth), statistics.averageBatchTime() / 1000.0,
+				 static_cast< double >(statistics.maxBatchTime) / 1000.0);
+
+		delete writer;
+		writer = nullptr;
+	}
+
+	preparedStatements().clear();
 	db->close();
 	delete db;
 	db = nullptr;
 }
 
+std::uint64_t ServerDB::enqueue(Write write) {
+	if (!writer) {
+		TransactionHolder th;
+		write(*th.qsqQuery);
+		return 0;
+	}
+
+	if (TransactionHolder::active()) {
+		// Were the writer to commit while the transaction is open, the transaction couldn't write anymore (SQLite
+		// reports its snapshot as outdated, no matter how long it waits). The transaction has flushed everything
+		// queued before it, so the writes are still executed in order.
+		QSqlQuery query(*db);
+		write(query);
+		return 0;
+	}
+
+	return writer->enqueue([write = std::move(write)]() {
+		QSqlQuery query(*ServerDB::db);
+		write(query);
+	});
+}
+
+std::uint64_t ServerDB::committedWrites() {
+	return writer ? writer->committed() : 0;
+}
+
+void ServerDB::flushWrites() {
+	if (writer) {
+		writer->flush();
+	}
+}
+
 bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
 	if (!db->isValid()) {
 		qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
 		return false;
 	}
+
+	// The prefix and the upgrade suffix are set before anything is prepared and don't change afterwards, so the
+	// statement only depends on the string it is prepared from
+	StatementCache &statements = preparedStatements();
+	if (statements.find(str, query)) {
+		return true;
+	}
+
 	QString q;
 	if (str.contains(QLatin1String("%1"))) {
 		if (str.contains(QLatin1String("%2")))
@@ -900,16 +1092,22 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 		q.replace("`", "\"");
 	}
 
+	// The query may share a cached statement, which preparing another one would replace
+	query = QSqlQuery(*db);
 	if (query.prepare(q)) {
+		statements.insert(str, query);
 		return true;
 	} else {
+		// The cached statements belong to the connection that is lost
+		statements.clear();
 		db->close();
 		if (!db->open()) {
 			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(db->lastError().text()));
 		}
-		query = QSqlQuery();
+		query = QSqlQuery(*db);
 		if (query.prepare(q)) {
 			qWarning("SQL Connection lost, reconnection OK");
+			statements.insert(str, query);
 			return true;
 		}
 
@@ -943,6 +1141,8 @@ bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn
 			q.replace("`", "\"");
 		}
 
+		// The query may share a cached statement, which executing another one would replace
+		query = QSqlQuery(*db);
 		if (query.exec(q)) {
 			return true;
 		} else {
@@ -1151,6 +1351,7 @@ int Server::registerUser(const QMap< int, QString > &info) {
 	}
 
 	qhUserNameCache.remove(id);
+	userDirectory().insert(id, name);
 
 	setInfo(id, info);
 
@@ -1188,6 +1389,8 @@ bool Server::unregisterUserDB(int id) {
 	query.addBindValue(id);
 	SQLEXEC();
 
+	userDirectory().remove(id);
+
 	return true;
 }
 
@@ -1227,17 +1430,39 @@ QMap< int, QString > Server::getRegisteredUsers(const QString &filter) {
 
 	emit getRegisteredUsersSig(filter, m);
 
+	// Filters that match a single name or the names starting with a prefix are looked up in memory. Only PostgreSQL's
+	// LIKE is case-sensitive.
+	QString prefix   = filter;
+	const bool exact = !prefix.endsWith(QLatin1Char('%'));
+	if (!exact) {
+		prefix.chop(1);
+	}
+	if (!prefix.contains(QLatin1Char('%')) && !prefix.contains(QLatin1Char('_'))
+		&& !prefix.contains(QLatin1Char('\\'))) {
+		const Qt::CaseSensitivity sensitivity =
+			Meta::mp.qsDBDriver == "QPSQL" ? Qt::CaseSensitive : Qt::CaseInsensitive;
+
+		QMap< int, QString > users;
+		if (filter.isEmpty()) {
+			users = userDirectory().names();
+		} else if (exact) {
+			users = userDirectory().findAllByName(prefix, sensitivity);
+		} else {
+			users = userDirectory().findByPrefix(prefix, sensitivity);
+		}
+
+		for (auto it = users.constBegin(); it != users.constEnd(); ++it) {
+			m.insert(it.key(), it.value());
+		}
+		return m;
+	}
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
-	if (filter.isEmpty()) {
-		SQLPREP("SELECT `user_id`, `name` FROM `%1users` WHERE `server_id` = ?");
-		query.addBindValue(iServerNum);
-	} else {
-		SQLPREP("SELECT `user_id`, `name` FROM `%1users` WHERE `server_id` = ? AND `name` LIKE ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(filter);
-	}
+	SQLPREP("SELECT `user_id`, `name` FROM `%1users` WHERE `server_id` = ? AND `name` LIKE ?");
+	query.addBindValue(iServerNum);
+	query.addBindValue(filter);
 	SQLEXEC();
 
 	while (query.next()) {
@@ -1255,17 +1480,7 @@ bool Server::isUserId(int id) {
 	if (res >= 0)
 		return (res > 0);
 
-	TransactionHolder th;
-
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("SELECT `user_id` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(id);
-	SQLEXEC();
-	if (query.next()) {
-		return true;
-	}
-	return false;
+	return userDirectory().find(id) != nullptr;
 }
 
 QMap< int, QString > Server::getRegistration(int id) {
@@ -1299,10 +1514,37 @@ QMap< int, QString > Server::getRegistration(int id) {
 	return info;
 }
 
+/// Stores a single entry of the given user's information, replacing the one that is stored for the same key
+static void storeUserInfo(QSqlQuery &query, int serverId, int userId, int key, const QString &value) {
+	if (Meta::mp.qsDBDriver == "QPSQL") {
+		SQLPREP("INSERT INTO `%1user_info` (`server_id`, `user_id`, `key`, `value`) VALUES (:server_id, :user_id, "
+				":key, :value) ON CONFLICT (`server_id`, `user_id`, `key`) DO UPDATE SET `value` = :u_value WHERE "
+				"`%1user_info`.`server_id` = :u_server_id AND `%1user_info`.`user_id` = :u_user_id AND "
+				"`%1user_info`.`key` = :u_key");
+		query.bindValue(":server_id", serverId);
+		query.bindValue(":user_id", userId);
+		query.bindValue(":key", key);
+		query.bindValue(":value", value);
+		query.bindValue(":u_server_id", serverId);
+		query.bindValue(":u_user_id", userId);
+		query.bindValue(":u_key", key);
+		query.bindValue(":u_value", value);
+		SQLEXEC();
+	} else {
+		SQLPREP("REPLACE INTO `%1user_info` (`server_id`, `user_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
+		query.addBindValue(serverId);
+		query.addBindValue(userId);
+		query.addBindValue(key);
+		query.addBindValue(value);
+		SQLEXEC();
+	}
+}
+
 /// @return UserID of authenticated user, -1 for authentication failures, -2 for unknown user (fallthrough),
 ///         -3 for authentication failures where the data could (temporarily) not be verified.
 int Server::authenticate(QString &name, const QString &password, int sessionId, const QStringList &emails,
-						 const QString &certhash, bool bStrongCert, const QList< QSslCertificate > &certs) {
+						 const QString &certhash, bool bStrongCert, const QList< QSslCertificate > &certs,
+						 const PasswordHash *passwordHash) {
 	int res = bForceExternalAuth ? -3 : -2;
 
 	emit authenticateSig(res, name, sessionId, certs, certhash, bStrongCert, password);
@@ -1331,6 +1573,13 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 				query.bindValue(":u_name", name);
 				query.bindValue(":u_lastchannel", lchan);
 				SQLEXEC();
+
+				// Only the name has been updated if the user exists
+				if (userDirectory().find(res)) {
+					userDirectory().setName(res, name);
+				} else {
+					userDirectory().insert(res, name);
+				}
 			} else {
 				SQLPREP("REPLACE INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES (?,?,?,?)");
 				query.addBindValue(iServerNum);
@@ -1338,6 +1587,8 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 				query.addBindValue(name);
 				query.addBindValue(lchan);
 				SQLEXEC();
+
+				userDirectory().insert(res, name);
 			}
 		}
 		if (res >= 0) {
@@ -1347,20 +1598,16 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 		return res;
 	}
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	UserDirectory &users = userDirectory();
 
-	SQLPREP("SELECT `user_id`,`name`,`pw`, `salt`, `kdfiterations` FROM `%1users` WHERE `server_id` = ? AND "
-			"LOWER(`name`) = LOWER(?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(name);
-	SQLEXEC();
-	if (query.next()) {
-		const int userId                 = query.value(0).toInt();
-		const QString storedPasswordHash = query.value(2).toString();
-		const QString storedSalt         = query.value(3).toString();
-		const int storedKdfIterations    = query.value(4).toInt();
-		res                              = -1;
+	const int userId = users.findByName(name);
+	if (userId >= 0) {
+		// Copied, as upgrading the password hash changes the directory
+		const RegisteredUser user         = *users.find(userId);
+		const QString &storedPasswordHash = user.passwordHash;
+		const QString &storedSalt         = user.salt;
+		const int storedKdfIterations     = user.kdfIterations;
+		res                               = -1;
 
 		if (!storedPasswordHash.isEmpty()) {
 			// A user has password authentication enabled if there is a password hash.
@@ -1369,8 +1616,8 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 				// If storedKdfIterations is <=0 this means this is an old-style SHA1 hash
 				// that hasn't been converted yet. Or we are operating in legacy mode.
 				if (ServerDB::getLegacySHA1Hash(password) == storedPasswordHash) {
-					name = query.value(1).toString();
-					res  = query.value(0).toInt();
+					name = user.name;
+					res  = userId;
 
 					if (!Meta::mp.legacyPasswordHash) {
 						// Unless disabled upgrade the user password hash
@@ -1385,9 +1632,14 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 					}
 				}
 			} else {
-				if (PBKDF2::getHash(storedSalt, password, storedKdfIterations) == storedPasswordHash) {
-					name = query.value(1).toString();
-					res  = query.value(0).toInt();
+				const bool precomputed = passwordHash && passwordHash->salt == storedSalt
+										 && passwordHash->iterations == storedKdfIterations;
+				const QString hash =
+					precomputed ? passwordHash->hash : PBKDF2::getHash(storedSalt, password, storedKdfIterations);
+
+				if (hash == storedPasswordHash) {
+					name = user.name;
+					res  = userId;
 
 					if (Meta::mp.legacyPasswordHash) {
 						// Downgrade the password to the legacy hash
@@ -1424,80 +1676,43 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 
 	// No password match. Try cert or email match, but only for non-SuperUser.
 	if (!certhash.isEmpty() && (res < 0)) {
-		SQLPREP("SELECT `user_id` FROM `%1user_info` WHERE `server_id` = ? AND `key` = ? AND `value` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(ServerDB::User_Hash);
-		query.addBindValue(certhash);
-		SQLEXEC();
-		if (query.next()) {
-			res = query.value(0).toInt();
-		} else if (bStrongCert) {
+		res = users.findByCertHash(certhash);
+		if (res < 0 && bStrongCert) {
 			foreach (const QString &email, emails) {
 				if (!email.isEmpty()) {
-					query.addBindValue(iServerNum);
-					query.addBindValue(ServerDB::User_Email);
-					query.addBindValue(email);
-					SQLEXEC();
-					if (query.next()) {
-						res = query.value(0).toInt();
+					res = users.findByEmail(email);
+					if (res >= 0) {
 						break;
 					}
 				}
 			}
 		}
 		if (res > 0) {
-			SQLPREP("SELECT `name` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
-			query.addBindValue(iServerNum);
-			query.addBindValue(res);
-			SQLEXEC();
-			if (!query.next()) {
+			const RegisteredUser *user = users.find(res);
+			if (!user) {
 				res = -1;
 			} else {
-				name = query.value(0).toString();
+				name = user->name;
 			}
 		}
 	}
 	if (!certhash.isEmpty() && (res > 0)) {
-		if (Meta::mp.qsDBDriver == "QPSQL") {
-			SQLPREP("INSERT INTO `%1user_info` (`server_id`, `user_id`, `key`, `value`) VALUES (:server_id, :user_id, "
-					":key, :value) ON CONFLICT (`server_id`, `user_id`, `key`) DO UPDATE SET `value` = :u_value WHERE "
-					"`%1user_info`.`server_id` = :u_server_id AND `%1user_info`.`user_id` = :u_user_id AND "
-					"`%1user_info`.`key` = :u_key");
-			query.bindValue(":server_id", iServerNum);
-			query.bindValue(":user_id", res);
-			query.bindValue(":key", ServerDB::User_Hash);
-			query.bindValue(":value", certhash);
-			query.bindValue(":u_server_id", iServerNum);
-			query.bindValue(":u_user_id", res);
-			query.bindValue(":u_key", ServerDB::User_Hash);
-			query.bindValue(":u_value", certhash);
-			SQLEXEC();
-		} else {
-			SQLPREP("REPLACE INTO `%1user_info` (`server_id`, `user_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
-			query.addBindValue(iServerNum);
-			query.addBindValue(res);
-			query.addBindValue(ServerDB::User_Hash);
-			query.addBindValue(certhash);
-			SQLEXEC();
-		}
+		const RegisteredUser *user = users.find(res);
+		const bool storeHash       = user->certHash != certhash;
+		const bool storeEmail      = !emails.isEmpty() && user->email != emails.at(0);
 
-		if (!emails.isEmpty()) {
-			if (Meta::mp.qsDBDriver == "QPSQL") {
-				query.bindValue(":server_id", iServerNum);
-				query.bindValue(":user_id", res);
-				query.bindValue(":key", ServerDB::User_Email);
-				query.bindValue(":value", emails.at(0));
-				query.bindValue(":u_server_id", iServerNum);
-				query.bindValue(":u_user_id", res);
-				query.bindValue(":u_key", ServerDB::User_Email);
-				query.bindValue(":u_value", emails.at(0));
-				SQLEXEC();
-			} else {
-				query.addBindValue(iServerNum);
-				query.addBindValue(res);
-				query.addBindValue(ServerDB::User_Email);
-				query.addBindValue(emails.at(0));
-				SQLEXEC();
+		// Logging in usually doesn't change any of these, so they are only written if they do
+		if (storeHash || storeEmail) {
+			TransactionHolder th;
+			QSqlQuery &query = *th.qsqQuery;
+
+			if (storeHash) {
+				storeUserInfo(query, iServerNum, res, ServerDB::User_Hash, certhash);
+				users.setCertHash(res, certhash);
+			}
+			if (storeEmail) {
+				storeUserInfo(query, iServerNum, res, ServerDB::User_Email, emails.at(0));
+				users.setEmail(res, emails.at(0));
 			}
 		}
 	}
@@ -1562,6 +1777,7 @@ bool Server::setInfo(int id, const QMap< int, QString > &setinfo) {
 		query.addBindValue(iServerNum);
 		query.addBindValue(id);
 		SQLEXEC();
+		userDirectory().setPassword(id, passwordHash, salt, kdfIterations);
 		info.remove(ServerDB::User_Password);
 	}
 	if (info.contains(ServerDB::User_Name)) {
@@ -1571,6 +1787,9 @@ bool Server::setInfo(int id, const QMap< int, QString > &setinfo) {
 		query.addBindValue(iServerNum);
 		query.addBindValue(id);
 		SQLEXEC();
+		if (userDirectory().find(id)) {
+			userDirectory().setName(id, name);
+		}
 		info.remove(ServerDB::User_Name);
 	}
 	if (!info.isEmpty()) {
@@ -1605,6 +1824,13 @@ bool Server::setInfo(int id, const QMap< int, QString > &setinfo) {
 			query.addBindValue(values);
 			SQLEXECBATCH();
 		}
+
+		if (info.contains(ServerDB::User_Hash)) {
+			userDirectory().setCertHash(id, info.value(ServerDB::User_Hash));
+		}
+		if (info.contains(ServerDB::User_Email)) {
+			userDirectory().setEmail(id, info.value(ServerDB::User_Email));
+		}
 	}
 
 	return true;
@@ -1665,6 +1891,12 @@ void ServerDB::writeSUPW(int srvnum, const QString &pwHash, const QString &saltH
 	query.addBindValue(srvnum);
 	query.addBindValue(0);
 	SQLEXEC();
+
+	// The running server has to read the new password from the database
+	Server *server = meta ? meta->qhServers.value(srvnum) : nullptr;
+	if (server) {
+		server->m_userDirectory.clear();
+	}
 }
 
 
@@ -1701,14 +1933,9 @@ QString Server::getUserName(int id) {
 		return name;
 	}
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("SELECT `name` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(id);
-	SQLEXEC();
-	if (query.next()) {
-		name = query.value(0).toString();
+	const RegisteredUser *user = userDirectory().find(id);
+	if (user) {
+		name = user->name;
 		qhUserIDCache.insert(name, id);
 		qhUserNameCache.insert(id, name);
 	}
@@ -1730,19 +1957,50 @@ int Server::getUserID(const QString &name) {
 		return id;
 	}
 
-	TransactionHolder th;
+	const int userId = userDirectory().findByName(name);
+	if (userId >= 0) {
+		id = userId;
+		qhUserIDCache.insert(name, id);
+		qhUserNameCache.insert(id, name);
+	}
+	return id;
+}
+
+UserDirectory &Server::userDirectory() {
+	if (m_userDirectory.isLoaded()) {
+		return m_userDirectory;
+	}
+
+	// SQLite's LOWER() only folds ASCII letters
+	m_userDirectory = UserDirectory(Meta::mp.qsDBDriver == "QSQLITE" ? UserDirectory::CaseFolding::Ascii
+																	 : UserDirectory::CaseFolding::Unicode);
 
+	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("SELECT `user_id` FROM `%1users` WHERE `server_id` = ? AND LOWER(`name`) = LOWER(?)");
+
+	SQLPREP("SELECT `user_id`, `name`, `pw`, `salt`, `kdfiterations` FROM `%1users` WHERE `server_id` = ?");
 	query.addBindValue(iServerNum);
-	query.addBindValue(name);
 	SQLEXEC();
-	if (query.next()) {
-		id = query.value(0).toInt();
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+	while (query.next()) {
+		m_userDirectory.insert(query.value(0).toInt(), query.value(1).toString(), query.value(2).toString(),
+							   query.value(3).toString(), query.value(4).toInt());
 	}
-	return id;
+
+	SQLPREP("SELECT `user_id`, `key`, `value` FROM `%1user_info` WHERE `server_id` = ? AND (`key` = ? OR `key` = ?)");
+	query.addBindValue(iServerNum);
+	query.addBindValue(ServerDB::User_Hash);
+	query.addBindValue(ServerDB::User_Email);
+	SQLEXEC();
+	while (query.next()) {
+		if (query.value(1).toInt() == ServerDB::User_Hash) {
+			m_userDirectory.setCertHash(query.value(0).toInt(), query.value(2).toString());
+		} else {
+			m_userDirectory.setEmail(query.value(0).toInt(), query.value(2).toString());
+		}
+	}
+
+	m_userDirectory.setLoaded();
+	return m_userDirectory;
 }
 
 QByteArray Server::getUserTexture(int id) {
@@ -1773,6 +2031,7 @@ void Server::addLink(Channel *c, Channel *l) {
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->link(l);
 	}
+	scheduleVoiceRoutingUpdate();
 
 	if (c->bTemporary || l->bTemporary)
 		return;
@@ -1796,6 +2055,7 @@ void Server::removeLink(Channel *c, Channel *l) {
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->unlink(l);
 	}
+	scheduleVoiceRoutingUpdate();
 
 	if (c->bTemporary || l->bTemporary)
 		return;
@@ -1882,161 +2142,208 @@ void Server::removeChannelDB(const Channel *c) {
 	qhChannels.remove(c->iId);
 }
 
+namespace {
+/// The part of a channel's state that is stored by Server::updateChannel, copied such that it can be written on the
+/// writer thread while the channel itself may change
+struct ChannelRecord {
+	struct GroupRecord {
+		QString name;
+		bool inherit;
+		bool inheritable;
+		QList< int > add;
+		QList< int > remove;
+	};
+
+	struct ACLRecord {
+		int userId;
+		QString group;
+		bool applyHere;
+		bool applySubs;
+		int allow;
+		int deny;
+	};
+
+	unsigned int id;
+	QString name;
+	QVariant parentId;
+	bool inheritACL;
+	QString description;
+	int position;
+	unsigned int maxUsers;
+	QList< GroupRecord > groups;
+	QList< ACLRecord > acls;
+
+	explicit ChannelRecord(const Channel *c)
+		: id(c->iId), name(c->qsName), parentId(c->cParent ? c->cParent->iId : QVariant()),
+		  inheritACL(c->bInheritACL), description(c->qsDesc), position(c->iPosition), maxUsers(c->uiMaxUsers) {
+		foreach (const Group *g, c->qhGroups) {
+			groups.append({ g->qsName, g->bInherit, g->bInheritable, g->qsAdd.values(), g->qsRemove.values() });
+		}
+		foreach (const ChanACL *acl, c->qlACL) {
+			acls.append({ acl->iUserId, acl->qsGroup, acl->bApplyHere, acl->bApplySubs, static_cast< int >(acl->pAllow),
+						  static_cast< int >(acl->pDeny) });
+		}
+	}
+};
+} // namespace
+
 void Server::updateChannel(const Channel *c) {
 	if (c->bTemporary)
 		return;
-	TransactionHolder th;
-	Group *g;
-	ChanACL *acl;
 
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("UPDATE `%1channels` SET `name` = ?, `parent_id` = ?, `inheritacl` = ? WHERE `server_id` = ? AND "
-			"`channel_id` = ?");
-	query.addBindValue(c->qsName);
-	query.addBindValue(c->cParent ? c->cParent->iId : QVariant());
-	query.addBindValue(c->bInheritACL ? 1 : 0);
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
-	SQLEXEC();
+	const int serverId = iServerNum;
 
-	// Update channel description information
-	if (Meta::mp.qsDBDriver == "QPSQL") {
-		SQLPREP("INSERT INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (:server_id, "
-				":channel_id, :key, :value) ON CONFLICT (`server_id`, `channel_id`, `key`) DO UPDATE SET `value` = "
-				":u_value WHERE `%1channel_info`.`server_id` = :u_server_id AND `%1channel_info`.`channel_id` = "
-				":u_channel_id AND `%1channel_info`.`key` = :u_key");
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
-		query.bindValue(":key", ServerDB::Channel_Description);
-		query.bindValue(":value", c->qsDesc);
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
-		query.bindValue(":u_key", ServerDB::Channel_Description);
-		query.bindValue(":u_value", c->qsDesc);
-		SQLEXEC();
-	} else {
-		SQLPREP("REPLACE INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
-		query.addBindValue(ServerDB::Channel_Description);
-		query.addBindValue(c->qsDesc);
-		SQLEXEC();
-	}
-	// Update channel position information
-	if (Meta::mp.qsDBDriver == "QPSQL") {
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
-		query.bindValue(":key", ServerDB::Channel_Position);
-		query.bindValue(":value", QVariant(c->iPosition).toString());
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
-		query.bindValue(":u_key", ServerDB::Channel_Position);
-		query.bindValue(":u_value", QVariant(c->iPosition).toString());
-		SQLEXEC();
-	} else {
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
-		query.addBindValue(ServerDB::Channel_Position);
-		query.addBindValue(QVariant(c->iPosition).toString());
-		SQLEXEC();
-	}
-	// Update channel maximum channels
-	if (Meta::mp.qsDBDriver == "QPSQL") {
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
-		query.bindValue(":key", ServerDB::Channel_Max_Users);
-		query.bindValue(":value", QVariant(c->uiMaxUsers).toString());
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
-		query.bindValue(":u_key", ServerDB::Channel_Max_Users);
-		query.bindValue(":u_value", QVariant(c->uiMaxUsers).toString());
-		SQLEXEC();
-	} else {
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
-		query.addBindValue(ServerDB::Channel_Max_Users);
-		query.addBindValue(QVariant(c->uiMaxUsers).toString());
+	ServerDB::enqueue([serverId, channel = ChannelRecord(c)](QSqlQuery &query) {
+		SQLPREP("UPDATE `%1channels` SET `name` = ?, `parent_id` = ?, `inheritacl` = ? WHERE `server_id` = ? AND "
+				"`channel_id` = ?");
+		query.addBindValue(channel.name);
+		query.addBindValue(channel.parentId);
+		query.addBindValue(channel.inheritACL ? 1 : 0);
+		query.addBindValue(serverId);
+		query.addBindValue(channel.id);
 		SQLEXEC();
-	}
-
-	SQLPREP("DELETE FROM `%1groups` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
-	SQLEXEC();
-
-	SQLPREP("DELETE FROM `%1acl` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
-	SQLEXEC();
-
-	foreach (g, c->qhGroups) {
-		int id = 0;
-		int pid;
 
+		// Update channel description information
 		if (Meta::mp.qsDBDriver == "QPSQL") {
-			SQLPREP("INSERT INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
-					"(?,?,?,?,?) RETURNING group_id");
-			query.addBindValue(iServerNum);
-			query.addBindValue(g->c->iId);
-			query.addBindValue(g->qsName);
-			query.addBindValue(g->bInherit ? 1 : 0);
-			query.addBindValue(g->bInheritable ? 1 : 0);
+			SQLPREP("INSERT INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (:server_id, "
+					":channel_id, :key, :value) ON CONFLICT (`server_id`, `channel_id`, `key`) DO UPDATE SET `value` = "
+					":u_value WHERE `%1channel_info`.`server_id` = :u_server_id AND `%1channel_info`.`channel_id` = "
+					":u_channel_id AND `%1channel_info`.`key` = :u_key");
+			query.bindValue(":server_id", serverId);
+			query.bindValue(":channel_id", channel.id);
+			query.bindValue(":key", ServerDB::Channel_Description);
+			query.bindValue(":value", channel.description);
+			query.bindValue(":u_server_id", serverId);
+			query.bindValue(":u_channel_id", channel.id);
+			query.bindValue(":u_key", ServerDB::Channel_Description);
+			query.bindValue(":u_value", channel.description);
 			SQLEXEC();
-
-			if (query.next()) {
-				id = query.value(0).toInt();
-			} else {
-				qFatal(
-					"ServerDB: internal query failure: PostgreSQL query did not return the inserted group's group_id");
-			}
 		} else {
-			SQLPREP("REPLACE INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
-					"(?,?,?,?,?)");
-			query.addBindValue(iServerNum);
-			query.addBindValue(g->c->iId);
-			query.addBindValue(g->qsName);
-			query.addBindValue(g->bInherit ? 1 : 0);
-			query.addBindValue(g->bInheritable ? 1 : 0);
+			SQLPREP(
+				"REPLACE INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
+			query.addBindValue(serverId);
+			query.addBindValue(channel.id);
+			query.addBindValue(ServerDB::Channel_Description);
+			query.addBindValue(channel.description);
 			SQLEXEC();
-
-			id = query.lastInsertId().toInt();
 		}
-
-		foreach (pid, g->qsAdd) {
-			SQLPREP("INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
-			query.addBindValue(id);
-			query.addBindValue(iServerNum);
-			query.addBindValue(pid);
-			query.addBindValue(1);
+		// Update channel position information
+		if (Meta::mp.qsDBDriver == "QPSQL") {
+			query.bindValue(":server_id", serverId);
+			query.bindValue(":channel_id", channel.id);
+			query.bindValue(":key", ServerDB::Channel_Position);
+			query.bindValue(":value", QVariant(channel.position).toString());
+			query.bindValue(":u_server_id", serverId);
+			query.bindValue(":u_channel_id", channel.id);
+			query.bindValue(":u_key", ServerDB::Channel_Position);
+			query.bindValue(":u_value", QVariant(channel.position).toString());
+			SQLEXEC();
+		} else {
+			query.addBindValue(serverId);
+			query.addBindValue(channel.id);
+			query.addBindValue(ServerDB::Channel_Position);
+			query.addBindValue(QVariant(channel.position).toString());
 			SQLEXEC();
 		}
-		foreach (pid, g->qsRemove) {
-			SQLPREP("INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
-			query.addBindValue(id);
-			query.addBindValue(iServerNum);
-			query.addBindValue(pid);
-			query.addBindValue(0);
+		// Update channel maximum channels
+		if (Meta::mp.qsDBDriver == "QPSQL") {
+			query.bindValue(":server_id", serverId);
+			query.bindValue(":channel_id", channel.id);
+			query.bindValue(":key", ServerDB::Channel_Max_Users);
+			query.bindValue(":value", QVariant(channel.maxUsers).toString());
+			query.bindValue(":u_server_id", serverId);
+			query.bindValue(":u_channel_id", channel.id);
+			query.bindValue(":u_key", ServerDB::Channel_Max_Users);
+			query.bindValue(":u_value", QVariant(channel.maxUsers).toString());
+			SQLEXEC();
+		} else {
+			query.addBindValue(serverId);
+			query.addBindValue(channel.id);
+			query.addBindValue(ServerDB::Channel_Max_Users);
+			query.addBindValue(QVariant(channel.maxUsers).toString());
 			SQLEXEC();
 		}
-	}
 
-	int pri = 5;
+		SQLPREP("DELETE FROM `%1groups` WHERE `server_id` = ? AND `channel_id` = ?");
+		query.addBindValue(serverId);
+		query.addBindValue(channel.id);
+		SQLEXEC();
 
-	foreach (acl, c->qlACL) {
-		SQLPREP("INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `user_id`, `group_name`, `apply_here`, "
-				"`apply_sub`, `grantpriv`, `revokepriv`) VALUES (?,?,?,?,?,?,?,?,?)");
-		query.addBindValue(iServerNum);
-		query.addBindValue(acl->c->iId);
-		query.addBindValue(pri++);
-
-		query.addBindValue((acl->iUserId == -1) ? QVariant() : acl->iUserId);
-		query.addBindValue((acl->qsGroup.isEmpty()) ? QVariant() : acl->qsGroup);
-		query.addBindValue(acl->bApplyHere ? 1 : 0);
-		query.addBindValue(acl->bApplySubs ? 1 : 0);
-		query.addBindValue(static_cast< int >(acl->pAllow));
-		query.addBindValue(static_cast< int >(acl->pDeny));
+		SQLPREP("DELETE FROM `%1acl` WHERE `server_id` = ? AND `channel_id` = ?");
+		query.addBindValue(serverId);
+		query.addBindValue(channel.id);
 		SQLEXEC();
-	}
+
+		for (const ChannelRecord::GroupRecord &g : channel.groups) {
+			int id = 0;
+
+			if (Meta::mp.qsDBDriver == "QPSQL") {
+				SQLPREP("INSERT INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
+						"(?,?,?,?,?) RETURNING group_id");
+				query.addBindValue(serverId);
+				query.addBindValue(channel.id);
+				query.addBindValue(g.name);
+				query.addBindValue(g.inherit ? 1 : 0);
+				query.addBindValue(g.inheritable ? 1 : 0);
+				SQLEXEC();
+
+				if (query.next()) {
+					id = query.value(0).toInt();
+				} else {
+					qFatal("ServerDB: internal query failure: PostgreSQL query did not return the inserted group's "
+						   "group_id");
+				}
+			} else {
+				SQLPREP("REPLACE INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
+						"(?,?,?,?,?)");
+				query.addBindValue(serverId);
+				query.addBindValue(channel.id);
+				query.addBindValue(g.name);
+				query.addBindValue(g.inherit ? 1 : 0);
+				query.addBindValue(g.inheritable ? 1 : 0);
+				SQLEXEC();
+
+				id = query.lastInsertId().toInt();
+			}
+
+			for (int pid : g.add) {
+				SQLPREP(
+					"INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
+				query.addBindValue(id);
+				query.addBindValue(serverId);
+				query.addBindValue(pid);
+				query.addBindValue(1);
+				SQLEXEC();
+			}
+			for (int pid : g.remove) {
+				SQLPREP(
+					"INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
+				query.addBindValue(id);
+				query.addBindValue(serverId);
+				query.addBindValue(pid);
+				query.addBindValue(0);
+				SQLEXEC();
+			}
+		}
+
+		int pri = 5;
+
+		for (const ChannelRecord::ACLRecord &acl : channel.acls) {
+			SQLPREP("INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `user_id`, `group_name`, "
+					"`apply_here`, `apply_sub`, `grantpriv`, `revokepriv`) VALUES (?,?,?,?,?,?,?,?,?)");
+			query.addBindValue(serverId);
+			query.addBindValue(channel.id);
+			query.addBindValue(pri++);
+
+			query.addBindValue((acl.userId == -1) ? QVariant() : acl.userId);
+			query.addBindValue((acl.group.isEmpty()) ? QVariant() : acl.group);
+			query.addBindValue(acl.applyHere ? 1 : 0);
+			query.addBindValue(acl.applySubs ? 1 : 0);
+			query.addBindValue(acl.allow);
+			query.addBindValue(acl.deny);
+			SQLEXEC();
+		}
+	});
 }
 
 /** Reads the channel privileges (group and acl) as well as the channel information key/value pairs from the database.
@@ -2167,6 +2474,8 @@ void Server::readLinks() {
 			c->link(l);
 		}
 	}
+
+	scheduleVoiceRoutingUpdate();
 }
 
 void Server::setLastChannel(const User *p) {
@@ -2176,18 +2485,22 @@ void Server::setLastChannel(const User *p) {
 	if (p->cChannel->bTemporary)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	const int serverId         = iServerNum;
+	const int userId           = p->iId;
+	const unsigned int channel = p->cChannel->iId;
 
-	if (Meta::mp.qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(p->cChannel->iId);
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	ServerDB::enqueue([serverId, userId, channel](QSqlQuery &query) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
+		} else {
+			SQLPREP(
+				"UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		}
+		query.addBindValue(channel);
+		query.addBindValue(serverId);
+		query.addBindValue(userId);
+		SQLEXEC();
+	});
 }
 
 int Server::readLastChannel(int id) {
@@ -2255,18 +2568,21 @@ void Server::setLastDisconnect(const User *p) {
 	if (p->iId < 0)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	const int serverId = iServerNum;
+	const int userId   = p->iId;
 
-	if (Meta::mp.qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		// MySQL or PostgreSQL
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	ServerDB::enqueue([serverId, userId](QSqlQuery &query) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			SQLPREP(
+				"UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
+		} else {
+			// MySQL or PostgreSQL
+			SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		}
+		query.addBindValue(serverId);
+		query.addBindValue(userId);
+		SQLEXEC();
+	});
 }
 
 void Server::dumpChannel(const Channel *c) {
@@ -2301,7 +2617,7 @@ void Server::dumpChannel(const Channel *c) {
 void Server::getBans() {
 	TransactionHolder th;
 
-	qlBans.clear();
+	m_bans.clear();
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT `base`,`mask`,`name`,`hash`,`reason`,`start`,`duration` FROM `%1bans` WHERE `server_id` = ?");
@@ -2320,7 +2636,7 @@ void Server::getBans() {
 		ban.iDuration = query.value(6).toUInt();
 
 		if (ban.isValid())
-			qlBans << ban;
+			m_bans.add(ban);
 	}
 }
 
@@ -2334,7 +2650,7 @@ void Server::saveBans() {
 
 	SQLPREP("INSERT INTO `%1bans` (`server_id`, `base`,`mask`,`name`,`hash`,`reason`,`start`,`duration`) VALUES "
 			"(?,?,?,?,?,?,?,?)");
-	foreach (const Ban &ban, qlBans) {
+	foreach (const Ban &ban, m_bans.bans()) {
 		query.addBindValue(iServerNum);
 		query.addBindValue(ban.haAddress.toByteArray());
 		query.addBindValue(ban.iMask);
@@ -2385,17 +2701,35 @@ void Server::setConf(const QString &key, const QVariant &value) {
 }
 
 void Server::dblog(const QString &str) const {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
 	// Is logging disabled?
 	if (Meta::mp.iLogDays < 0)
 		return;
 
+	ServerDB::log(iServerNum, str);
+}
+
+void ServerDB::log(int server_id, const QString &str) {
+	if (logBuffer.append(server_id, QDateTime::currentDateTime().toTime_t(), str)) {
+		QTimer::singleShot(LOG_FLUSH_INTERVAL, &ServerDB::flushLog);
+	}
+
+	if (logBuffer.pendingCount() >= LogBuffer::FLUSH_SIZE) {
+		flushLog();
+	}
+}
+
+void ServerDB::flushLog() {
+	if (!db) {
+		// The database has been closed before the timer fired
+		return;
+	}
+
+	logBuffer.committed(committedWrites());
+
 	// Once per hour
+	QString qstr;
 	if (Meta::mp.iLogDays > 0) {
 		if (ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL)) {
-			QString qstr;
 			if (Meta::mp.qsDBDriver == "QSQLITE") {
 				qstr = QString::fromLatin1("msgtime < datetime('now','-%1 days')").arg(Meta::mp.iLogDays);
 			} else if (Meta::mp.qsDBDriver == "QPSQL") {
@@ -2403,15 +2737,47 @@ void Server::dblog(const QString &str) const {
 			} else {
 				qstr = QString::fromLatin1("msgtime < now() - INTERVAL %1 day").arg(Meta::mp.iLogDays);
 			}
+		}
+	}
+
+	const std::vector< BufferedLogRecord > records = logBuffer.pending();
+	if (records.empty() && qstr.isEmpty()) {
+		return;
+	}
+
+	const std::uint64_t ticket = ServerDB::enqueue([records, qstr](QSqlQuery &query) {
+		if (!qstr.isEmpty()) {
 			ServerDB::prepare(query, QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr);
 			SQLEXEC();
 		}
-	}
 
-	SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(str);
-	SQLEXEC();
+		// Insert the lines using statements for powers of two of them, such that only a few statements are prepared
+		std::size_t offset = 0;
+		while (offset < records.size()) {
+			std::size_t rows = MAX_LOG_ROWS;
+			while (rows > records.size() - offset) {
+				rows /= 2;
+			}
+
+			QString str = QLatin1String("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
+			for (std::size_t i = 1; i < rows; ++i) {
+				str += QLatin1String(",(?,?)");
+			}
+
+			ServerDB::prepare(query, str);
+			for (std::size_t i = offset; i < offset + rows; ++i) {
+				query.addBindValue(records[i].serverId);
+				query.addBindValue(records[i].message);
+			}
+			SQLEXEC();
+
+			offset += rows;
+		}
+	});
+
+	logBuffer.sent(records.size(), ticket);
+	// Without a writer thread, the lines have been written already
+	logBuffer.committed(committedWrites());
 }
 
 void Server::loadChannelListenersOf(const ServerUser &user) {
@@ -2443,39 +2809,45 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 		m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, channelID,
 															 VolumeAdjustment::fromFactor(volume));
 	}
+
+	scheduleVoiceRoutingUpdate();
 }
 
 void Server::addChannelListener(const ServerUser &user, const Channel &channel) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
+		const int serverId           = iServerNum;
+		const int userId             = user.iId;
+		const unsigned int channelId = channel.iId;
 
-		// Update or insert entry
-		SQLPREP(
-			"SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
+		ServerDB::enqueue([serverId, userId, channelId](QSqlQuery &query) {
+			// Update or insert entry
+			SQLPREP("SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND "
+					"`channel_id` = ?");
+			query.addBindValue(serverId);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
 
-		SQLEXEC();
+			SQLEXEC();
 
-		bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
+			bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
 
-		if (entryAlreadyExists) {
-			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
-					"`channel_id` = ?");
-		} else {
-			SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
-		}
+			if (entryAlreadyExists) {
+				SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
+						"`channel_id` = ?");
+			} else {
+				SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
+			}
 
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
+			query.addBindValue(serverId);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
 
-		SQLEXEC();
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.addListener(user.uiSession, channel.iId);
+	scheduleVoiceRoutingUpdate();
 }
 
 void Server::disableChannelListener(const ServerUser &user, const Channel &channel) {
@@ -2484,20 +2856,24 @@ void Server::disableChannelListener(const ServerUser &user, const Channel &chann
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
+		const int serverId           = iServerNum;
+		const int userId             = user.iId;
+		const unsigned int channelId = channel.iId;
 
-		SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		// Explicit cast to int is required for Postgresql
-		query.addBindValue(static_cast< int >(false));
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		ServerDB::enqueue([serverId, userId, channelId](QSqlQuery &query) {
+			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
+					"`channel_id` = ?");
+			// Explicit cast to int is required for Postgresql
+			query.addBindValue(static_cast< int >(false));
+			query.addBindValue(serverId);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
+	scheduleVoiceRoutingUpdate();
 }
 
 void Server::deleteChannelListener(const ServerUser &user, const Channel &channel) {
@@ -2506,38 +2882,48 @@ void Server::deleteChannelListener(const ServerUser &user, const Channel &channe
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverId           = iServerNum;
+		const int userId             = user.iId;
+		const unsigned int channelId = channel.iId;
+
+		ServerDB::enqueue([serverId, userId, channelId](QSqlQuery &query) {
+			SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
+			query.addBindValue(serverId);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
+	scheduleVoiceRoutingUpdate();
 }
 
 void Server::setChannelListenerVolume(const ServerUser &user, const Channel &channel, float volumeAdjustment) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		query.addBindValue(volumeAdjustment);
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverId           = iServerNum;
+		const int userId             = user.iId;
+		const unsigned int channelId = channel.iId;
+
+		ServerDB::enqueue([serverId, userId, channelId, volumeAdjustment](QSqlQuery &query) {
+			SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND `user_id` = ? "
+					"AND `channel_id` = ?");
+			query.addBindValue(volumeAdjustment);
+			query.addBindValue(serverId);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, channel.iId,
 														 VolumeAdjustment::fromFactor(volumeAdjustment));
+	scheduleVoiceRoutingUpdate();
 }
 
 void ServerDB::wipeLogs() {
+	logBuffer.clear();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2545,76 +2931,116 @@ void ServerDB::wipeLogs() {
 }
 
 QList< QPair< unsigned int, QString > > ServerDB::getLog(int server_id, unsigned int offs_min, unsigned int offs_max) {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	QList< QPair< unsigned int, QString > > ql;
 
-	if (Meta::mp.qsDBDriver == "QPSQL") {
-		SQLPREP("SELECT `msgtime`, `msg` FROM `%1slog` WHERE `server_id` = ? ORDER BY `msgtime` DESC LIMIT ? OFFSET ?");
-		query.addBindValue(server_id);
-		query.addBindValue(offs_max);
-		query.addBindValue(offs_min);
-		SQLEXEC();
-	} else {
-		SQLPREP("SELECT `msgtime`, `msg` FROM `%1slog` WHERE `server_id` = ? ORDER BY `msgtime` DESC LIMIT ?, ?");
-		query.addBindValue(server_id);
-		query.addBindValue(offs_min);
-		query.addBindValue(offs_max);
-		SQLEXEC();
-	}
+	// The lines that are still buffered are newer than the ones in the database. Reading doesn't wait for the writer
+	// thread, but has to be repeated if lines that were buffered have been committed while the database was read.
+	for (int attempt = 0; attempt < 3; ++attempt) {
+		if (attempt == 2) {
+			flushWrites();
+		}
+		logBuffer.committed(committedWrites());
 
-	QList< QPair< unsigned int, QString > > ql;
-	while (query.next()) {
-		QDateTime qdt = query.value(0).toDateTime();
-		QString msg   = query.value(1).toString();
-		ql << QPair< unsigned int, QString >(qdt.toLocalTime().toTime_t(), msg);
+		ql.clear();
+		const std::vector< BufferedLogRecord > buffered = logBuffer.records(server_id);
+		for (std::size_t i = offs_min; i < buffered.size() && static_cast< unsigned int >(ql.size()) < offs_max; ++i) {
+			ql << QPair< unsigned int, QString >(buffered[i].time, buffered[i].message);
+		}
+
+		const unsigned int limit  = offs_max - static_cast< unsigned int >(ql.size());
+		const unsigned int offset = offs_min - std::min(offs_min, static_cast< unsigned int >(buffered.size()));
+		if (limit > 0) {
+			QSqlQuery query(*db);
+
+			if (Meta::mp.qsDBDriver == "QPSQL") {
+				SQLPREP("SELECT `msgtime`, `msg` FROM `%1slog` WHERE `server_id` = ? ORDER BY `msgtime` DESC LIMIT ? "
+						"OFFSET ?");
+				query.addBindValue(server_id);
+				query.addBindValue(limit);
+				query.addBindValue(offset);
+				SQLEXEC();
+			} else {
+				SQLPREP("SELECT `msgtime`, `msg` FROM `%1slog` WHERE `server_id` = ? ORDER BY `msgtime` DESC LIMIT "
+						"?, ?");
+				query.addBindValue(server_id);
+				query.addBindValue(offset);
+				query.addBindValue(limit);
+				SQLEXEC();
+			}
+
+			while (query.next()) {
+				QDateTime qdt = query.value(0).toDateTime();
+				QString msg   = query.value(1).toString();
+				ql << QPair< unsigned int, QString >(qdt.toLocalTime().toTime_t(), msg);
+			}
+		}
+
+		if (!logBuffer.hasCommitted(committedWrites())) {
+			break;
+		}
 	}
+
 	return ql;
 }
 
 int ServerDB::getLogLen(int server_id) {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	int len = -1;
 
-	SQLPREP("SELECT COUNT(`msgtime`) FROM `%1slog` WHERE `server_id` = ?");
-	query.addBindValue(server_id);
-	SQLEXEC();
+	// See getLog()
+	for (int attempt = 0; attempt < 3; ++attempt) {
+		if (attempt == 2) {
+			flushWrites();
+		}
+		logBuffer.committed(committedWrites());
 
-	while (query.next()) {
-		return query.value(0).toInt();
+		const int buffered = logBuffer.count(server_id);
+
+		QSqlQuery query(*db);
+		SQLPREP("SELECT COUNT(`msgtime`) FROM `%1slog` WHERE `server_id` = ?");
+		query.addBindValue(server_id);
+		SQLEXEC();
+
+		len = query.next() ? query.value(0).toInt() + buffered : -1;
+
+		if (!logBuffer.hasCommitted(committedWrites())) {
+			break;
+		}
 	}
 
-	return -1;
+	return len;
 }
 
 void ServerDB::setConf(int server_id, const QString &k, const QVariant &value) {
-	TransactionHolder th;
-
-	const QString &key = (k == "serverpassword") ? "password" : k;
-
-	QSqlQuery &query = *th.qsqQuery;
-	if (value.isNull() || value.toString().trimmed().isEmpty()) {
-		SQLPREP("DELETE FROM `%1config` WHERE `server_id` = ? AND `key` = ?");
-		query.addBindValue(server_id);
-		query.addBindValue(key);
-	} else {
-		if (Meta::mp.qsDBDriver == "QPSQL") {
-			SQLPREP("INSERT INTO `%1config` (`server_id`, `key`, `value`) VALUES (:server_id, :key, :value) ON "
-					"CONFLICT (`server_id`, `key`) DO UPDATE SET `value` = :u_value WHERE `%1config`.`server_id` = "
-					":u_server_id AND `%1config`.`key` = :u_key");
-			query.bindValue(":server_id", server_id);
-			query.bindValue(":key", key);
-			query.bindValue(":value", value.toString());
-			query.bindValue(":u_server_id", server_id);
-			query.bindValue(":u_key", key);
-			query.bindValue(":u_value", value.toString());
-		} else {
-			SQLPREP("REPLACE INTO `%1config` (`server_id`, `key`, `value`) VALUES (?,?,?)");
+	const QString key = (k == "serverpassword") ? "password" : k;
+	// The value is converted here, as a QVariant may hold types that can't be shared across threads
+	const bool remove  = value.isNull() || value.toString().trimmed().isEmpty();
+	const QString text = remove ? QString() : value.toString();
+
+	ServerDB::enqueue([server_id, key, remove, text](QSqlQuery &query) {
+		if (remove) {
+			SQLPREP("DELETE FROM `%1config` WHERE `server_id` = ? AND `key` = ?");
 			query.addBindValue(server_id);
 			query.addBindValue(key);
-			query.addBindValue(value.toString());
+		} else {
+			if (Meta::mp.qsDBDriver == "QPSQL") {
+				SQLPREP("INSERT INTO `%1config` (`server_id`, `key`, `value`) VALUES (:server_id, :key, :value) ON "
+						"CONFLICT (`server_id`, `key`) DO UPDATE SET `value` = :u_value WHERE `%1config`.`server_id` = "
+						":u_server_id AND `%1config`.`key` = :u_key");
+				query.bindValue(":server_id", server_id);
+				query.bindValue(":key", key);
+				query.bindValue(":value", text);
+				query.bindValue(":u_server_id", server_id);
+				query.bindValue(":u_key", key);
+				query.bindValue(":u_value", text);
+			} else {
+				SQLPREP("REPLACE INTO `%1config` (`server_id`, `key`, `value`) VALUES (?,?,?)");
+				query.addBindValue(server_id);
+				query.addBindValue(key);
+				query.addBindValue(text);
+			}
 		}
-	}
-	SQLEXEC();
+		SQLEXEC();
+	});
 }
 
 
@@ -2674,6 +3100,8 @@ int ServerDB::addServer() {
 }
 
 void ServerDB::deleteServer(int server_id) {
+	logBuffer.remove(server_id);
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("DELETE FROM `%1servers` WHERE `server_id` = ?");
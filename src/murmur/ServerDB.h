@@ -8,12 +8,17 @@
 
 #include <QtCore/QVariant>
 
+#include "LogBuffer.h"
 #include "Timer.h"
 
+#include <cstdint>
+#include <functional>
+
 class Server;
 class Channel;
 class User;
 class Connection;
+class DBWriter;
 class QSqlDatabase;
 class QSqlQuery;
 
@@ -42,7 +47,8 @@ public:
 	~ServerDB();
 	typedef QPair< unsigned int, QString > LogRecord;
 	static Timer tLogClean;
-	static QSqlDatabase *db;
+	/// The database connection of the current thread. The writer thread has a connection of its own.
+	static thread_local QSqlDatabase *db;
 	static QString qsUpgradeSuffix;
 	static void setSUPW(int iServNum, const QString &pw);
 	static void disableSU(int srvnum);
@@ -54,6 +60,11 @@ public:
 	static QMap< QString, QString > getAllConf(int server_id);
 	static QVariant getConf(int server_id, const QString &key, QVariant def = QVariant());
 	static void setConf(int server_id, const QString &key, const QVariant &value = QVariant());
+	/// Buffers a line of the given server's log. Buffered lines are written in batches by flushLog().
+	static void log(int server_id, const QString &str);
+	/// Writes the buffered lines of the servers' logs and removes lines that have expired
+	static void flushLog();
+	/// @returns The lines of the given server's log, both those in the database and those that are still buffered
 	static QList< LogRecord > getLog(int server_id, unsigned int offs_min, unsigned int offs_max);
 	static QString getLegacySHA1Hash(const QString &password);
 	static int getLogLen(int server_id);
@@ -62,10 +73,30 @@ public:
 	static bool query(QSqlQuery &, const QString &, bool fatal = true, bool warn = true);
 	static bool exec(QSqlQuery &, const QString &str = QString(), bool fatal = true, bool warn = true);
 	static bool execBatch(QSqlQuery &, const QString &str = QString(), bool fatal = true);
+
+	/// A write that is executed on the writer thread. It must have captured everything it needs by value.
+	using Write = std::function< void(QSqlQuery &) >;
+	/// Queues the given write, such that it is executed on the writer thread after all writes queued before. Writes
+	/// that are queued within a short time of each other are committed in a single transaction. Without a writer
+	/// thread (i.e. unless the database allows concurrent writes) or within an open transaction, the write is
+	/// executed right away on the current connection instead.
+	///
+	/// @returns The write's ticket, which committedWrites() reaches once it has been committed
+	static std::uint64_t enqueue(Write write);
+	/// @returns The ticket of the last write that has been committed
+	static std::uint64_t committedWrites();
+	/// Blocks until all queued writes have been committed. Every transaction started on the main thread does this
+	/// first, so that it sees the effects of all writes queued before.
+	static void flushWrites();
 	// No copy; private declaration without implementation
 	ServerDB(const ServerDB &);
 
 private:
+	/// The thread executing the writes queued by enqueue() or nullptr if they are executed synchronously
+	static DBWriter *writer;
+	/// The lines of the servers' logs that haven't been committed yet
+	static LogBuffer logBuffer;
+
 	static void loadOrSetupMetaPBKDF2IterationCount(QSqlQuery &query);
 	static void writeSUPW(int srvnum, const QString &pwHash, const QString &saltHash, const QVariant &kdfIterations);
 };
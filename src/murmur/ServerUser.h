@@ -14,11 +14,12 @@
 
 #include "ClientType.h"
 #include "Connection.h"
+#include "Group.h"
 #include "HostAddress.h"
-#include "Timer.h"
+#include "RateLimit.h"
+#include "UDPSendDescriptor.h"
 #include "User.h"
 
-#include <QtCore/QElapsedTimer>
 #include <QtCore/QStringList>
 
 #ifdef Q_OS_WIN
@@ -27,37 +28,17 @@
 #	include <sys/socket.h>
 #endif
 
+#include <cstdint>
 #include <vector>
 
-// Unfortunately, this needs to be "large enough" to hold
-// enough frames to account for both short-term and
-// long-term "maladjustments".
-
-#define N_BANDWIDTH_SLOTS 360
-
-struct BandwidthRecord {
-	int iRecNum;
-	int iSum;
-	Timer tFirst;
-	Timer tIdleControl;
-	unsigned short a_iBW[N_BANDWIDTH_SLOTS];
-	Timer a_qtWhen[N_BANDWIDTH_SLOTS];
-	mutable QMutex qmMutex;
-
-	BandwidthRecord();
-	bool addFrame(int size, int maxpersec);
-	int onlineSeconds() const;
-	int idleSeconds() const;
-	void resetIdleSeconds();
-	int bandwidth() const;
-};
-
 struct WhisperTarget {
 	struct Channel {
 		unsigned int id;
 		bool includeChildren;
 		bool includeLinks;
 		QString targetGroup;
+		/// The parsed form of targetGroup, so that it doesn't have to be parsed for every user it is checked against
+		Group::Specification targetGroupSpecification;
 	};
 
 	std::vector< unsigned int > sessions;
@@ -74,34 +55,6 @@ struct WhisperTargetCache {
 
 class Server;
 
-/// A simple implementation for rate-limiting.
-/// See https://en.wikipedia.org/wiki/Leaky_bucket
-class LeakyBucket {
-private:
-	/// The amount of tokens that are drained per second.
-	/// (The size of the whole in the bucket)
-	unsigned int m_tokensPerSec;
-	/// The maximum amount of tokens that may be encountered.
-	/// (The capacity of the bucket)
-	unsigned int m_maxTokens;
-	/// The amount of tokens currently stored
-	/// (The amount of whater currently in the bucket)
-	long m_currentTokens;
-	/// A timer that is used to measure time intervals. It is essential
-	/// that this timer uses a monotonic clock (which is why QElapsedTimer is
-	/// used instead of QTime or QDateTime).
-	QElapsedTimer m_timer;
-
-public:
-	/// @param tokens The amount of tokens that should be added.
-	/// @returns Whether adding this amount of tokens triggers rate
-	/// 	limiting (true means the corresponding packet has to be
-	/// 	discared and false means the packet may be processed)
-	bool ratelimit(int tokens);
-
-	LeakyBucket(unsigned int tokensPerSec, unsigned int maxTokens);
-};
-
 class ServerUser : public Connection, public User {
 private:
 	Q_OBJECT
@@ -144,6 +97,14 @@ public:
 
 	QList< int > qlCodecs;
 	bool bOpus;
+	/// The UDP cipher modes (MumbleProto::CryptSetup::CipherMode) the client announced support for
+	QList< int > qlCipherModes;
+	/// Whether the client announced that it can prefix its UDP pings with an association header
+	bool m_udpAssociationSupported = false;
+	/// The token identifying this user in UDP association headers or 0 if none has been assigned
+	std::uint32_t m_udpAssociationToken = 0;
+	/// Whether the user's password hash is being computed, during which it can't authenticate again
+	bool m_verifyingPassword = false;
 
 	QStringList qslAccessTokens;
 
@@ -164,7 +125,18 @@ public:
 	BandwidthRecord bwr;
 	struct sockaddr_storage saiUdpAddress;
 	struct sockaddr_storage saiTcpLocalAddress;
+	/// Derived from sUdpSocket, saiUdpAddress and saiTcpLocalAddress. Like these, it must only be changed while
+	/// holding qmCrypt.
+	UDPSendDescriptor m_udpSendDescriptor;
+	/// Tunnelled voice packets that have already been framed, but not yet written to the socket. Guarded by
+	/// Server::m_tcpTunnelMutex.
+	QByteArray m_tcpTunnelQueue;
 	ServerUser(Server *parent, QSslSocket *socket);
+
+protected:
+	/// Hands the message to the server directly, without copying it
+	void messageReceived(Mumble::Protocol::TCPMessageType type,
+						 gsl::span< const Mumble::Protocol::byte > data) Q_DECL_OVERRIDE;
 };
 
 #endif
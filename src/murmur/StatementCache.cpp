@@ -0,0 +1,83 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "StatementCache.h"
+
+constexpr int StatementCache::MAX_STATEMENTS;
+
+void StatementCache::begin() {
+	++m_depth;
+}
+
+void StatementCache::end() {
+	if (m_depth == 0 || --m_depth > 0) {
+		return;
+	}
+
+	for (QSqlQuery &query : m_statements) {
+		if (query.isActive()) {
+			query.finish();
+		}
+	}
+}
+
+bool StatementCache::find(const QString &key, QSqlQuery &query) {
+	if (m_depth == 0) {
+		return false;
+	}
+
+	// Preparing a query discards its previous result set, even if its statement is a cached one
+	if (query.isActive()) {
+		query.finish();
+	}
+
+	auto it = m_statements.find(key);
+	if (it == m_statements.end()) {
+		++m_misses;
+		return false;
+	}
+
+	// Every connection has a driver instance of its own. Executing the statement through a query of another
+	// connection would run it on the wrong database.
+	if (it->driver() != query.driver()) {
+		++m_misses;
+		return false;
+	}
+
+	// An executed SELECT stays active until it is finished, as its rows may still be read (e.g. by a loop that
+	// prepares the same statement again for every row). Executing it again would discard them.
+	if (it->isActive() && it->isSelect()) {
+		++m_misses;
+		return false;
+	}
+
+	++m_hits;
+	query = *it;
+	return true;
+}
+
+void StatementCache::insert(const QString &key, const QSqlQuery &query) {
+	if (m_depth == 0 || (m_statements.size() >= MAX_STATEMENTS && !m_statements.contains(key))) {
+		return;
+	}
+
+	m_statements.insert(key, query);
+}
+
+void StatementCache::clear() {
+	m_statements.clear();
+}
+
+int StatementCache::size() const {
+	return m_statements.size();
+}
+
+quint64 StatementCache::hits() const {
+	return m_hits;
+}
+
+quint64 StatementCache::misses() const {
+	return m_misses;
+}
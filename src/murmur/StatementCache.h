@@ -0,0 +1,57 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_STATEMENTCACHE_H_
+#define MUMBLE_MURMUR_STATEMENTCACHE_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtSql/QSqlQuery>
+
+/// Keeps the statements that have been prepared on a single database connection, such that statements that are
+/// executed over and over again are only parsed and planned by the database once.
+///
+/// A QSqlQuery that has been assigned a cached statement shares it with the cache: binding values to it and executing
+/// it reuses the prepared statement. Statements are only handed out to queries of the connection they have been
+/// prepared on, even if the cache is (mistakenly) used for several. Statements are only cached within transactions,
+/// as the result sets of executed statements (and with them the database's locks) are kept until they are released
+/// at the end of the transaction.
+class StatementCache {
+public:
+	/// The maximum amount of statements that are kept. Statements prepared beyond that aren't cached.
+	static constexpr int MAX_STATEMENTS = 256;
+
+	/// Has to be called whenever a transaction begins. Transactions may be nested.
+	void begin();
+	/// Has to be called before a transaction is committed. Releases the result sets of all cached statements once the
+	/// outermost transaction ends.
+	void end();
+
+	/// Makes query refer to the statement that has been cached for the given key.
+	///
+	/// @returns Whether such a statement has been found. A statement whose rows may still be read by someone else isn't
+	/// handed out a second time, and neither is one that has been prepared on another connection than query's.
+	bool find(const QString &key, QSqlQuery &query);
+	/// Caches the statement the given query has been prepared with. The query must not be used to prepare another
+	/// statement afterwards, which is why it should be a fresh QSqlQuery.
+	void insert(const QString &key, const QSqlQuery &query);
+	/// Forgets all statements. Has to be called before the connection is closed.
+	void clear();
+
+	int size() const;
+	/// @returns The amount of times a statement has been found
+	quint64 hits() const;
+	/// @returns The amount of times a statement had to be prepared within a transaction
+	quint64 misses() const;
+
+private:
+	QHash< QString, QSqlQuery > m_statements;
+	/// The amount of transactions that have begun but not ended yet
+	int m_depth      = 0;
+	quint64 m_hits   = 0;
+	quint64 m_misses = 0;
+};
+
+#endif
@@ -0,0 +1,174 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UDPBatch.h"
+
+#ifdef Q_OS_LINUX
+
+#	include <cerrno>
+#	include <cstring>
+
+#	include <tracy/Tracy.hpp>
+
+void UDPBatchStatistics::record(std::uint64_t batchSize) {
+	calls++;
+	datagrams += batchSize;
+	maxBatchSize = std::max(maxBatchSize, batchSize);
+}
+
+void UDPBatchStatistics::merge(const UDPBatchStatistics &other) {
+	calls += other.calls;
+	datagrams += other.datagrams;
+	maxBatchSize = std::max(maxBatchSize, other.maxBatchSize);
+}
+
+double UDPBatchStatistics::averageBatchSize() const {
+	if (calls == 0) {
+		return 0;
+	}
+
+	return static_cast< double >(datagrams) / static_cast< double >(calls);
+}
+
+
+UDPReceiveBatch::UDPReceiveBatch() : m_slots(UDPBatch::MAX_BATCH_SIZE), m_headers(UDPBatch::MAX_BATCH_SIZE) {
+	memset(m_headers.data(), 0, m_headers.size() * sizeof(struct mmsghdr));
+}
+
+int UDPReceiveBatch::receive(int socket) {
+	for (std::size_t i = 0; i < m_slots.size(); ++i) {
+		UDPBatch::Slot &slot = m_slots[i];
+		struct msghdr &msg   = m_headers[i].msg_hdr;
+
+		// The kernel overwrites the lengths and a previous ping reply might have redirected the iov, so everything
+		// has to be reset before every call.
+		slot.iov.iov_base  = slot.payload();
+		slot.iov.iov_len   = Mumble::Protocol::MAX_UDP_PACKET_SIZE;
+		msg.msg_name       = reinterpret_cast< struct sockaddr * >(&slot.address);
+		msg.msg_namelen    = sizeof(slot.address);
+		msg.msg_iov        = &slot.iov;
+		msg.msg_iovlen     = 1;
+		msg.msg_control    = slot.control;
+		msg.msg_controllen = sizeof(slot.control);
+		msg.msg_flags      = 0;
+		m_headers[i].msg_len = 0;
+	}
+
+	int received;
+	do {
+		received = ::recvmmsg(socket, m_headers.data(), static_cast< unsigned int >(m_headers.size()),
+							  MSG_DONTWAIT | MSG_TRUNC, nullptr);
+	} while (received < 0 && errno == EINTR);
+
+	if (received > 0) {
+		m_statistics.record(static_cast< std::uint64_t >(received));
+		TracyPlot("udp_receive_batch_size", static_cast< int64_t >(received));
+	} else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		// Another wakeup raced us to the pending datagrams
+		received = 0;
+	}
+
+	return received;
+}
+
+unsigned char *UDPReceiveBatch::data(unsigned int index) {
+	return m_slots[index].payload();
+}
+
+std::size_t UDPReceiveBatch::length(unsigned int index) const {
+	return m_headers[index].msg_len;
+}
+
+struct sockaddr_storage &UDPReceiveBatch::address(unsigned int index) {
+	return m_slots[index].address;
+}
+
+struct msghdr &UDPReceiveBatch::header(unsigned int index) {
+	return m_headers[index].msg_hdr;
+}
+
+const UDPBatchStatistics &UDPReceiveBatch::statistics() const {
+	return m_statistics;
+}
+
+
+UDPSendBatch::UDPSendBatch() : m_slots(UDPBatch::MAX_BATCH_SIZE), m_headers(UDPBatch::MAX_BATCH_SIZE) {
+	memset(m_headers.data(), 0, m_headers.size() * sizeof(struct mmsghdr));
+}
+
+unsigned char *UDPSendBatch::prepare(int socket) {
+	if (m_pending > 0 && (socket != m_socket || m_pending == m_slots.size())) {
+		flush();
+	}
+
+	m_socket = socket;
+
+	return m_slots[m_pending].payload();
+}
+
+bool UDPSendBatch::commit(std::size_t length, const UDPSendDescriptor &descriptor) {
+	if (!descriptor.valid) {
+		return false;
+	}
+
+	UDPBatch::Slot &slot = m_slots[m_pending];
+	struct msghdr &msg   = m_headers[m_pending].msg_hdr;
+
+	// Only the parts of the address and control buffers that are actually in use need to be copied
+	memcpy(&slot.address, &descriptor.address, descriptor.addressLength);
+	memcpy(slot.control, descriptor.control, descriptor.controlLength);
+	slot.iov.iov_base = slot.payload();
+	slot.iov.iov_len  = length;
+
+	msg.msg_name       = reinterpret_cast< struct sockaddr * >(&slot.address);
+	msg.msg_namelen    = descriptor.addressLength;
+	msg.msg_iov        = &slot.iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = slot.control;
+	msg.msg_controllen = descriptor.controlLength;
+	msg.msg_flags      = 0;
+
+	m_pending++;
+
+	return true;
+}
+
+void UDPSendBatch::flush() {
+	if (m_pending == 0) {
+		return;
+	}
+
+	ZoneScoped;
+
+	m_statistics.record(m_pending);
+	TracyPlot("udp_send_batch_size", static_cast< int64_t >(m_pending));
+
+	unsigned int sent = 0;
+	while (sent < m_pending) {
+		int ret = ::sendmmsg(m_socket, &m_headers[sent], m_pending - sent, 0);
+
+		if (ret > 0) {
+			sent += static_cast< unsigned int >(ret);
+		} else if (ret < 0 && errno == EINTR) {
+			continue;
+		} else {
+			// The datagram at index sent could not be delivered (e.g. because its destination is unreachable).
+			// Skip it so that it doesn't prevent the remaining datagrams from being sent.
+			sent++;
+		}
+	}
+
+	m_pending = 0;
+}
+
+bool UDPSendBatch::isEmpty() const {
+	return m_pending == 0;
+}
+
+const UDPBatchStatistics &UDPSendBatch::statistics() const {
+	return m_statistics;
+}
+
+#endif // Q_OS_LINUX
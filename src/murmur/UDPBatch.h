@@ -0,0 +1,117 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_UDPBATCH_H_
+#define MUMBLE_MURMUR_UDPBATCH_H_
+
+#include <QtCore/QtGlobal>
+
+#include "MumbleProtocol.h"
+#include "UDPSendDescriptor.h"
+
+#ifdef Q_OS_LINUX
+
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+
+#	include <algorithm>
+#	include <cstdint>
+#	include <vector>
+
+/// Counters describing how well datagrams could be batched into a single syscall.
+struct UDPBatchStatistics {
+	/// The amount of recvmmsg/sendmmsg calls that have been made
+	std::uint64_t calls = 0;
+	/// The amount of datagrams that have been transferred by these calls
+	std::uint64_t datagrams = 0;
+	/// The biggest amount of datagrams that has been transferred by a single call
+	std::uint64_t maxBatchSize = 0;
+
+	void record(std::uint64_t batchSize);
+	/// Adds the counters of the given statistics to these ones
+	void merge(const UDPBatchStatistics &other);
+	double averageBatchSize() const;
+};
+
+namespace UDPBatch {
+/// The maximum amount of datagrams that will be handled by a single syscall
+constexpr unsigned int MAX_BATCH_SIZE = 32;
+
+/// Storage for a single datagram. The payload buffer is laid out such that the 4-byte crypt header is followed
+/// by 8-byte aligned data (which is what CryptStateOCB2 operates on).
+struct Slot {
+	alignas(8) unsigned char storage[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+	struct sockaddr_storage address;
+	struct iovec iov;
+	std::uint8_t control[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+
+	unsigned char *payload() { return storage + 4; }
+};
+} // namespace UDPBatch
+
+/// Receives up to UDPBatch::MAX_BATCH_SIZE datagrams from a socket using a single recvmmsg call.
+class UDPReceiveBatch {
+public:
+	UDPReceiveBatch();
+
+	/// Reads all datagrams that are currently pending on the given socket (up to the batch size) without blocking.
+	///
+	/// @returns The amount of received datagrams or -1 on error
+	int receive(int socket);
+
+	/// @returns The buffer the datagram at the given index has been written to
+	unsigned char *data(unsigned int index);
+	/// @returns The length of the datagram at the given index. As the datagrams are received with MSG_TRUNC, this
+	/// 	may be bigger than the size of the buffer.
+	std::size_t length(unsigned int index) const;
+	/// @returns The address the datagram at the given index has been received from
+	struct sockaddr_storage &address(unsigned int index);
+	/// @returns The message header of the datagram at the given index. It contains the packet info of the
+	/// 	receiving interface and can thus be used to send a reply from the address the datagram was sent to.
+	struct msghdr &header(unsigned int index);
+
+	const UDPBatchStatistics &statistics() const;
+
+protected:
+	std::vector< UDPBatch::Slot > m_slots;
+	std::vector< struct mmsghdr > m_headers;
+	UDPBatchStatistics m_statistics;
+};
+
+/// Collects outgoing datagrams and sends them using a single sendmmsg call per socket once flushed.
+class UDPSendBatch {
+public:
+	UDPSendBatch();
+
+	/// Obtains the buffer for the next datagram that is to be sent via the given socket. If the batch is full or
+	/// contains datagrams for a different socket, it is flushed first.
+	///
+	/// @returns A buffer of at least MAX_UDP_PACKET_SIZE + 4 bytes into which the datagram has to be written
+	unsigned char *prepare(int socket);
+	/// Adds the datagram that has been written into the buffer obtained from the last call to prepare to the batch.
+	///
+	/// @param length The length of the datagram
+	/// @param descriptor The descriptor of the endpoint the datagram is to be sent to
+	/// @returns Whether the datagram has been added. Nothing is added if the descriptor isn't valid.
+	bool commit(std::size_t length, const UDPSendDescriptor &descriptor);
+
+	/// Sends all datagrams in the batch
+	void flush();
+
+	bool isEmpty() const;
+
+	const UDPBatchStatistics &statistics() const;
+
+protected:
+	std::vector< UDPBatch::Slot > m_slots;
+	std::vector< struct mmsghdr > m_headers;
+	unsigned int m_pending = 0;
+	int m_socket           = -1;
+	UDPBatchStatistics m_statistics;
+};
+
+#endif // Q_OS_LINUX
+
+#endif // MUMBLE_MURMUR_UDPBATCH_H_
@@ -0,0 +1,74 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UDPSendDescriptor.h"
+
+#include "HostAddress.h"
+
+#include <cstring>
+
+UDPSendDescriptor::UDPSendDescriptor() {
+	memset(&address, 0, sizeof(address));
+#ifdef Q_OS_LINUX
+	memset(control, 0, sizeof(control));
+#endif
+}
+
+#ifdef Q_OS_WIN
+void UDPSendDescriptor::update(SOCKET socket, const struct sockaddr_storage &address,
+							   const struct sockaddr_storage &localAddress) {
+#else
+void UDPSendDescriptor::update(int socket, const struct sockaddr_storage &address,
+							   const struct sockaddr_storage &localAddress) {
+#endif
+	this->socket = socket;
+
+	memset(&this->address, 0, sizeof(this->address));
+	if (address.ss_family == AF_INET6) {
+		addressLength = sizeof(struct sockaddr_in6);
+	} else {
+		addressLength = sizeof(struct sockaddr_in);
+	}
+	memcpy(&this->address, &address, addressLength);
+
+	valid = socket != INVALID_SOCKET;
+
+#ifdef Q_OS_LINUX
+	HostAddress tcpha(localAddress);
+
+	memset(control, 0, sizeof(control));
+
+	// CMSG_FIRSTHDR needs a message header that refers to the control buffer
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (address.ss_family == AF_INET6) {
+		controlLength               = CMSG_SPACE(sizeof(struct in6_pktinfo));
+		cmsg->cmsg_level            = IPPROTO_IPV6;
+		cmsg->cmsg_type             = IPV6_PKTINFO;
+		cmsg->cmsg_len              = CMSG_LEN(sizeof(struct in6_pktinfo));
+		struct in6_pktinfo *pktinfo = reinterpret_cast< struct in6_pktinfo * >(CMSG_DATA(cmsg));
+		memcpy(&pktinfo->ipi6_addr.s6_addr[0], tcpha.getByteRepresentation().data(),
+			   sizeof(pktinfo->ipi6_addr.s6_addr));
+	} else {
+		controlLength                = CMSG_SPACE(sizeof(struct in_pktinfo));
+		cmsg->cmsg_level             = IPPROTO_IP;
+		cmsg->cmsg_type              = IP_PKTINFO;
+		cmsg->cmsg_len               = CMSG_LEN(sizeof(struct in_pktinfo));
+		struct in_pktinfo *pktinfo   = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
+		pktinfo->ipi_spec_dst.s_addr = tcpha.toIPv4();
+
+		// Datagrams to IPv4 addresses can't be sent from an IPv6 address
+		if (tcpha.isV6()) {
+			valid = false;
+		}
+	}
+#else
+	Q_UNUSED(localAddress);
+#endif
+}
@@ -0,0 +1,65 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_UDPSENDDESCRIPTOR_H_
+#define MUMBLE_MURMUR_UDPSENDDESCRIPTOR_H_
+
+#include <QtCore/QtGlobal>
+
+#include "Utils.h"
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/// Everything that is needed to send a datagram to a user's UDP endpoint. It is derived from the user's UDP address
+/// and the local address of the user's TCP connection once either of them changes, so that sending a datagram merely
+/// requires copying the descriptor into the message header.
+struct UDPSendDescriptor {
+#ifdef Q_OS_WIN
+	SOCKET socket = INVALID_SOCKET;
+#else
+	int socket = INVALID_SOCKET;
+#endif
+	union {
+		struct sockaddr generic;
+		struct sockaddr_in ipv4;
+		struct sockaddr_in6 ipv6;
+	} address;
+	socklen_t addressLength = 0;
+#ifdef Q_OS_LINUX
+	/// The IP_PKTINFO or IPV6_PKTINFO control message that makes the datagram originate from the address the user
+	/// is connected to via TCP
+	alignas(struct cmsghdr) std::uint8_t
+		control[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+	std::size_t controlLength = 0;
+#endif
+	/// Whether datagrams can be sent using this descriptor
+	bool valid = false;
+
+	UDPSendDescriptor();
+
+	/// Recreates the descriptor for the given addresses
+	///
+	/// @param socket The socket datagrams are sent through
+	/// @param address The address datagrams are sent to
+	/// @param localAddress The local address of the user's TCP connection
+#ifdef Q_OS_WIN
+	void update(SOCKET socket, const struct sockaddr_storage &address, const struct sockaddr_storage &localAddress);
+#else
+	void update(int socket, const struct sockaddr_storage &address, const struct sockaddr_storage &localAddress);
+#endif
+};
+
+#endif // MUMBLE_MURMUR_UDPSENDDESCRIPTOR_H_
@@ -0,0 +1,217 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UserDirectory.h"
+
+#include <limits>
+
+UserDirectory::UserDirectory(CaseFolding folding) : m_folding(folding) {
+}
+
+bool UserDirectory::isLoaded() const {
+	return m_loaded;
+}
+
+void UserDirectory::setLoaded() {
+	m_loaded = true;
+}
+
+void UserDirectory::clear() {
+	m_loaded = false;
+	m_users.clear();
+	m_ids.clear();
+	m_orderedNames.clear();
+	m_certHashes.clear();
+	m_emails.clear();
+}
+
+void UserDirectory::insert(int id, const QString &name, const QString &passwordHash, const QString &salt,
+						   int kdfIterations) {
+	// Names are unique, so the database replaces any other user of the same name
+	const int other = findByName(name);
+	if (other >= 0 && other != id && m_users.value(other).name == name) {
+		remove(other);
+	}
+
+	setName(id, name);
+
+	RegisteredUser &user = m_users[id];
+	user.passwordHash    = passwordHash;
+	user.salt            = salt;
+	user.kdfIterations   = kdfIterations;
+}
+
+void UserDirectory::remove(int id) {
+	const RegisteredUser *user = find(id);
+	if (!user) {
+		return;
+	}
+
+	unindex(m_certHashes, user->certHash, id);
+	unindex(m_emails, user->email, id);
+	setName(id, QString());
+	m_users.remove(id);
+}
+
+void UserDirectory::setName(int id, const QString &name) {
+	RegisteredUser &user = m_users[id];
+
+	if (!user.name.isEmpty()) {
+		const QString folded = fold(user.name);
+		m_orderedNames.erase(std::make_pair(folded, id));
+
+		if (m_ids.value(folded, -1) == id) {
+			// Another user may have the same name, apart from the case
+			auto next = m_orderedNames.lower_bound(std::make_pair(folded, std::numeric_limits< int >::min()));
+			if (next != m_orderedNames.end() && next->first == folded) {
+				m_ids.insert(folded, next->second);
+			} else {
+				m_ids.remove(folded);
+			}
+		}
+	}
+
+	user.name = name;
+
+	if (!name.isEmpty()) {
+		const QString folded = fold(name);
+		m_orderedNames.insert(std::make_pair(folded, id));
+
+		// The user with the lowest ID is found if names only differ in case
+		auto existing = m_ids.find(folded);
+		if (existing == m_ids.end() || *existing > id) {
+			m_ids.insert(folded, id);
+		}
+	}
+}
+
+void UserDirectory::setPassword(int id, const QString &passwordHash, const QString &salt, int kdfIterations) {
+	auto it = m_users.find(id);
+	if (it == m_users.end()) {
+		return;
+	}
+
+	it->passwordHash  = passwordHash;
+	it->salt          = salt;
+	it->kdfIterations = kdfIterations;
+}
+
+void UserDirectory::setCertHash(int id, const QString &certHash) {
+	auto it = m_users.find(id);
+	if (it != m_users.end()) {
+		unindex(m_certHashes, it->certHash, id);
+		it->certHash = certHash;
+	}
+
+	addToIndex(m_certHashes, certHash, id);
+}
+
+void UserDirectory::setEmail(int id, const QString &email) {
+	auto it = m_users.find(id);
+	if (it != m_users.end()) {
+		unindex(m_emails, it->email, id);
+		it->email = email;
+	}
+
+	addToIndex(m_emails, email, id);
+}
+
+const RegisteredUser *UserDirectory::find(int id) const {
+	auto it = m_users.constFind(id);
+	return it != m_users.constEnd() ? &*it : nullptr;
+}
+
+int UserDirectory::findByName(const QString &name) const {
+	return m_ids.value(fold(name), -1);
+}
+
+int UserDirectory::findByCertHash(const QString &certHash) const {
+	return findLowest(m_certHashes, certHash);
+}
+
+int UserDirectory::findByEmail(const QString &email) const {
+	return findLowest(m_emails, email);
+}
+
+QMap< int, QString > UserDirectory::findAllByName(const QString &name, Qt::CaseSensitivity sensitivity) const {
+	QMap< int, QString > result;
+
+	// Folding may change the length of a name, so the folded names are compared rather than their lengths
+	const QString folded = fold(name);
+	for (auto it = m_orderedNames.lower_bound(std::make_pair(folded, std::numeric_limits< int >::min()));
+		 it != m_orderedNames.end() && it->first == folded; ++it) {
+		const QString &current = m_users.constFind(it->second)->name;
+		if (sensitivity == Qt::CaseInsensitive || current == name) {
+			result.insert(it->second, current);
+		}
+	}
+
+	return result;
+}
+
+QMap< int, QString > UserDirectory::findByPrefix(const QString &prefix, Qt::CaseSensitivity sensitivity) const {
+	QMap< int, QString > result;
+
+	const QString folded = fold(prefix);
+	for (auto it = m_orderedNames.lower_bound(std::make_pair(folded, std::numeric_limits< int >::min()));
+		 it != m_orderedNames.end() && it->first.startsWith(folded); ++it) {
+		const QString &name = m_users.constFind(it->second)->name;
+		if (sensitivity == Qt::CaseInsensitive || name.startsWith(prefix)) {
+			result.insert(it->second, name);
+		}
+	}
+
+	return result;
+}
+
+QMap< int, QString > UserDirectory::names() const {
+	QMap< int, QString > result;
+	for (auto it = m_users.constBegin(); it != m_users.constEnd(); ++it) {
+		result.insert(it.key(), it->name);
+	}
+
+	return result;
+}
+
+int UserDirectory::size() const {
+	return m_users.size();
+}
+
+QString UserDirectory::fold(const QString &name) const {
+	if (m_folding == CaseFolding::Unicode) {
+		return name.toLower();
+	}
+
+	QString folded = name;
+	for (QChar &c : folded) {
+		if (c >= QLatin1Char('A') && c <= QLatin1Char('Z')) {
+			c = QChar(c.unicode() + ('a' - 'A'));
+		}
+	}
+	return folded;
+}
+
+void UserDirectory::addToIndex(QMultiHash< QString, int > &index, const QString &key, int id) {
+	if (!key.isEmpty() && !index.contains(key, id)) {
+		index.insert(key, id);
+	}
+}
+
+void UserDirectory::unindex(QMultiHash< QString, int > &index, const QString &key, int id) {
+	if (!key.isEmpty()) {
+		index.remove(key, id);
+	}
+}
+
+int UserDirectory::findLowest(const QMultiHash< QString, int > &index, const QString &key) {
+	int id = -1;
+	for (auto it = index.constFind(key); it != index.constEnd() && it.key() == key; ++it) {
+		if (id < 0 || *it < id) {
+			id = *it;
+		}
+	}
+
+	return id;
+}
@@ -0,0 +1,104 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_USERDIRECTORY_H_
+#define MUMBLE_MURMUR_USERDIRECTORY_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMultiHash>
+#include <QtCore/QString>
+
+#include <set>
+#include <utility>
+
+/// What the database stores about a registered user that is needed for logging in
+struct RegisteredUser {
+	QString name;
+	/// Empty if the user doesn't have a password
+	QString passwordHash;
+	QString salt;
+	int kdfIterations = -1;
+	/// The hash of the certificate the user has last been authenticated with
+	QString certHash;
+	QString email;
+};
+
+/// Keeps the registered users of a server in memory, such that they can be looked up without asking the database.
+/// It has to be told about every change made to the users in the database.
+///
+/// Names are looked up case-insensitively, the same way the database compares them. The names are additionally kept in
+/// an ordered index, which allows for finding all names that start with a given prefix.
+class UserDirectory {
+public:
+	enum class CaseFolding {
+		/// Only ASCII letters are folded (as done by SQLite's LOWER())
+		Ascii,
+		Unicode
+	};
+
+	explicit UserDirectory(CaseFolding folding = CaseFolding::Unicode);
+
+	/// @returns Whether the users have been loaded from the database
+	bool isLoaded() const;
+	/// Marks the users as having been loaded
+	void setLoaded();
+	/// Forgets about all users, such that they have to be loaded again
+	void clear();
+
+	/// Adds the given user or replaces its name and password, keeping the information that is stored separately
+	/// (certificate hash and email)
+	void insert(int id, const QString &name, const QString &passwordHash = QString(), const QString &salt = QString(),
+				int kdfIterations = -1);
+	void remove(int id);
+	void setName(int id, const QString &name);
+	void setPassword(int id, const QString &passwordHash, const QString &salt, int kdfIterations);
+	/// Stores the certificate hash of the given user. Hashes may be stored for users that aren't known (yet), as the
+	/// database doesn't prevent that.
+	void setCertHash(int id, const QString &certHash);
+	void setEmail(int id, const QString &email);
+
+	/// @returns The user with the given ID or nullptr if there is none. The pointer is invalidated by any change.
+	const RegisteredUser *find(int id) const;
+	/// @returns The ID of the user with the given name or -1 if there is none
+	int findByName(const QString &name) const;
+	/// @returns The ID of the user the given certificate hash has been stored for or -1 if there is none. Several
+	/// users may share a hash, in which case the lowest ID is returned.
+	int findByCertHash(const QString &certHash) const;
+	/// @returns The ID of the user the given email has been stored for or -1 if there is none. Several users may
+	/// share an email, in which case the lowest ID is returned.
+	int findByEmail(const QString &email) const;
+	/// @returns The IDs and names of all users with the given name. Case-insensitively, that may be several users
+	/// whose names only differ in case.
+	QMap< int, QString > findAllByName(const QString &name, Qt::CaseSensitivity sensitivity) const;
+	/// @returns The IDs and names of all users whose name starts with the given prefix
+	QMap< int, QString > findByPrefix(const QString &prefix, Qt::CaseSensitivity sensitivity) const;
+	/// @returns The IDs and names of all users
+	QMap< int, QString > names() const;
+
+	int size() const;
+
+private:
+	CaseFolding m_folding;
+	bool m_loaded = false;
+	QHash< int, RegisteredUser > m_users;
+	/// Maps the folded names to IDs
+	QHash< QString, int > m_ids;
+	/// The folded names along with the IDs, in order
+	std::set< std::pair< QString, int > > m_orderedNames;
+	/// Neither certificate hashes nor emails are unique, so every user they have been stored for is kept
+	QMultiHash< QString, int > m_certHashes;
+	QMultiHash< QString, int > m_emails;
+
+	QString fold(const QString &name) const;
+	/// Adds the given user's entry to the given index
+	static void addToIndex(QMultiHash< QString, int > &index, const QString &key, int id);
+	/// Removes the given user's entry from the given index, keeping those of other users with the same key
+	static void unindex(QMultiHash< QString, int > &index, const QString &key, int id);
+	/// @returns The lowest ID stored for the given key or -1 if there is none
+	static int findLowest(const QMultiHash< QString, int > &index, const QString &key);
+};
+
+#endif
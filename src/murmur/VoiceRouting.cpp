@@ -0,0 +1,159 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "VoiceRouting.h"
+
+#include <algorithm>
+#include <limits>
+
+const VoiceRoutingSnapshot::User *VoiceRoutingSnapshot::findUser(unsigned int session) const {
+	auto it = users.find(session);
+
+	return it == users.end() ? nullptr : &it->second;
+}
+
+const VoiceRoutingSnapshot::Channel *VoiceRoutingSnapshot::findChannel(unsigned int id) const {
+	auto it = channels.find(id);
+
+	return it == channels.end() ? nullptr : &it->second;
+}
+
+void VoiceRoutingSnapshot::createFanOuts() {
+	std::unordered_map< std::string, unsigned int > contextIDs;
+	for (auto &current : users) {
+		User &user = current.second;
+
+		user.contextID = contextIDs.emplace(user.context, static_cast< unsigned int >(contextIDs.size())).first->second;
+		user.fanOut    = nullptr;
+	}
+
+	std::vector< unsigned int > key;
+	std::unordered_map< unsigned int, std::size_t > receiverIndices;
+
+	for (auto &current : users) {
+		User &speaker = current.second;
+
+		const Channel *channel = findChannel(speaker.channelID);
+		if (!speaker.canSpeak || !channel) {
+			continue;
+		}
+
+		key.clear();
+		key.push_back(channel->id);
+		for (const Channel *link : speaker.speakableLinks) {
+			key.push_back(link->id);
+		}
+		std::sort(key.begin() + 1, key.end());
+
+		auto it = fanOuts.find(key);
+		if (it != fanOuts.end()) {
+			// Another user in the same channel may speak in the same linked channels
+			speaker.fanOut = &it->second;
+			continue;
+		}
+
+		FanOut &fanOut = fanOuts[key];
+		receiverIndices.clear();
+
+		auto addReceiver = [&](const User &user, Mumble::Protocol::audio_context_t context,
+							   const VolumeAdjustment &volumeAdjustment) {
+			auto index = receiverIndices.find(user.session);
+			if (index == receiverIndices.end()) {
+				receiverIndices[user.session] = fanOut.receivers.size();
+				fanOut.receivers.push_back({ user.user, user.session, user.contextID, context, volumeAdjustment });
+			} else {
+				// Same rules as in AudioReceiverBuffer::forceAddReceiver
+				FanOut::Receiver &receiver = fanOut.receivers[index->second];
+
+				receiver.context = std::min(receiver.context, context);
+				if (receiver.volumeAdjustment.factor < volumeAdjustment.factor) {
+					receiver.volumeAdjustment = volumeAdjustment;
+				}
+			}
+		};
+
+		for (unsigned int channelID : key) {
+			const Channel &target = *findChannel(channelID);
+
+			for (const Listener &listener : target.listeners) {
+				addReceiver(*listener.user, Mumble::Protocol::AudioContext::LISTEN, listener.volumeAdjustment);
+			}
+			for (const User *member : target.members) {
+				addReceiver(*member, Mumble::Protocol::AudioContext::NORMAL, VolumeAdjustment::fromFactor(1.0f));
+			}
+		}
+
+		speaker.fanOut = &fanOut;
+	}
+}
+
+
+VoiceRouting::ReadGuard::ReadGuard(VoiceRouting &routing, unsigned int reader)
+	: m_slot(routing.m_readers[reader].epoch) {
+	// Announce the epoch before loading the snapshot. Both operations are sequentially consistent, so the main
+	// thread either sees us in this epoch or we see whatever it published before advancing the epoch.
+	m_slot.store(routing.m_epoch.load());
+	m_snapshot = routing.m_current.load();
+}
+
+VoiceRouting::ReadGuard::~ReadGuard() {
+	m_slot.store(0, std::memory_order_release);
+}
+
+
+VoiceRouting::VoiceRouting(unsigned int readerCount)
+	: m_current(new VoiceRoutingSnapshot()), m_readers(std::max(readerCount, 1U)) {
+}
+
+VoiceRouting::~VoiceRouting() {
+	for (Retired &retired : m_retired) {
+		retired.deleter();
+	}
+
+	delete m_current.load();
+}
+
+const VoiceRoutingSnapshot &VoiceRouting::current() const {
+	return *m_current.load(std::memory_order_relaxed);
+}
+
+void VoiceRouting::publish(std::unique_ptr< VoiceRoutingSnapshot > snapshot) {
+	const VoiceRoutingSnapshot *previous = m_current.exchange(snapshot.release());
+
+	retire([previous]() { delete previous; });
+}
+
+void VoiceRouting::retire(std::function< void() > deleter) {
+	// Readers that enter after the epoch has been advanced can no longer reach the retired object
+	m_retired.push_back({ m_epoch.fetch_add(1), std::move(deleter) });
+}
+
+bool VoiceRouting::reclaim() {
+	std::uint64_t oldestActiveEpoch = std::numeric_limits< std::uint64_t >::max();
+	for (const ReaderSlot &reader : m_readers) {
+		const std::uint64_t epoch = reader.epoch.load();
+		if (epoch != 0) {
+			oldestActiveEpoch = std::min(oldestActiveEpoch, epoch);
+		}
+	}
+
+	// Retired objects are ordered by their epoch
+	auto firstPending = std::find_if(m_retired.begin(), m_retired.end(),
+									 [oldestActiveEpoch](const Retired &retired) {
+										 return retired.epoch >= oldestActiveEpoch;
+									 });
+
+	std::vector< Retired > reclaimable;
+	reclaimable.reserve(static_cast< std::size_t >(std::distance(m_retired.begin(), firstPending)));
+	std::move(m_retired.begin(), firstPending, std::back_inserter(reclaimable));
+	m_retired.erase(m_retired.begin(), firstPending);
+
+	// The deleters may retire further objects, which is why they are only called once m_retired is consistent again
+	for (Retired &retired : reclaimable) {
+		retired.deleter();
+	}
+
+	return !m_retired.empty();
+}
@@ -0,0 +1,162 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICEROUTING_H_
+#define MUMBLE_MURMUR_VOICEROUTING_H_
+
+#include "HostAddress.h"
+#include "MumbleProtocol.h"
+#include "VolumeAdjustment.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ServerUser;
+
+/// An immutable copy of the state that is needed to route regular speech. Snapshots are built by the main thread
+/// and published to the voice threads through VoiceRouting, which allows the voice threads to route audio without
+/// taking Server::qrwlVoiceThread.
+struct VoiceRoutingSnapshot {
+	struct Channel;
+
+	/// Everyone receiving regular speech from users in a given channel who may speak in the same set of linked
+	/// channels. The receivers are deduplicated already, so that routing a packet boils down to a single scan over
+	/// this list. Grouping them into ranges receiving the same packet is left to AudioReceiverBuffer, as that depends
+	/// on the packet (e.g. on whether it contains positional data).
+	struct FanOut {
+		struct Receiver {
+			ServerUser *user;
+			unsigned int session;
+			/// See User::contextID
+			unsigned int contextID;
+			Mumble::Protocol::audio_context_t context;
+			VolumeAdjustment volumeAdjustment;
+		};
+
+		std::vector< Receiver > receivers;
+	};
+
+	struct User {
+		/// The user this entry belongs to. The object is kept alive for as long as any voice thread might still use
+		/// a snapshot referencing it.
+		ServerUser *user;
+		unsigned int session;
+		unsigned int channelID;
+		/// Whether the user is authenticated and neither muted nor suppressed
+		bool canSpeak;
+		/// Whether the user is deafened (and thus must not receive any audio)
+		bool deaf;
+		/// The user's positional audio context
+		std::string context;
+		/// Identifies the user's positional audio context within this snapshot. Users share positional data if and
+		/// only if their context IDs are equal.
+		unsigned int contextID = 0;
+		/// The linked channels (excluding the user's own channel) the user has permission to speak in
+		std::vector< const Channel * > speakableLinks;
+		/// The receivers of the user's regular speech or nullptr if the user can't speak. The user itself may be
+		/// part of this list.
+		const FanOut *fanOut = nullptr;
+	};
+
+	struct Listener {
+		const User *user;
+		VolumeAdjustment volumeAdjustment;
+	};
+
+	struct Channel {
+		unsigned int id;
+		/// All users in this channel that may receive audio
+		std::vector< const User * > members;
+		/// All users listening to this channel that may receive audio
+		std::vector< Listener > listeners;
+	};
+
+	std::unordered_map< unsigned int, User > users;
+	std::unordered_map< unsigned int, Channel > channels;
+	/// The fan-out lists keyed by the ID of the speaker's channel followed by the (sorted) IDs of the linked
+	/// channels the speaker may speak in
+	std::map< std::vector< unsigned int >, FanOut > fanOuts;
+	QHash< QPair< HostAddress, quint16 >, ServerUser * > peers;
+
+	/// @returns The entry for the user with the given session or nullptr if there is none
+	const User *findUser(unsigned int session) const;
+	/// @returns The entry for the channel with the given ID or nullptr if there is none
+	const Channel *findChannel(unsigned int id) const;
+
+	/// Assigns the context IDs of all users and creates the fan-out lists of all users that can speak. This must
+	/// be called once all users and channels (including the users' speakable links) have been added.
+	void createFanOuts();
+};
+
+/// Publishes VoiceRoutingSnapshots to the voice threads.
+///
+/// Outdated snapshots (as well as any other objects that voice threads may still be referencing through such a
+/// snapshot) are reclaimed using epoch-based reclamation: every voice thread announces the epoch it has entered
+/// while it is processing a packet and retired objects are only destroyed once no voice thread can be in an epoch
+/// in which the object was still reachable.
+///
+/// Except for ReadGuard, all functions must only be called from the main thread.
+class VoiceRouting {
+public:
+	/// Marks the critical section in which a voice thread accesses the current snapshot
+	class ReadGuard {
+	public:
+		ReadGuard(VoiceRouting &routing, unsigned int reader);
+		~ReadGuard();
+
+		const VoiceRoutingSnapshot &snapshot() const { return *m_snapshot; }
+
+	protected:
+		std::atomic< std::uint64_t > &m_slot;
+		const VoiceRoutingSnapshot *m_snapshot;
+	};
+
+	/// @param readerCount The amount of voice threads that will read snapshots
+	explicit VoiceRouting(unsigned int readerCount);
+	/// Destroys all objects that are still pending. All readers must have stopped at this point.
+	~VoiceRouting();
+
+	/// @returns The most recently published snapshot
+	const VoiceRoutingSnapshot &current() const;
+
+	/// Replaces the current snapshot. The previous snapshot is retired.
+	void publish(std::unique_ptr< VoiceRoutingSnapshot > snapshot);
+	/// Schedules the given deleter to be called by reclaim once no reader can access objects that have been
+	/// unreachable from the current snapshot.
+	void retire(std::function< void() > deleter);
+	/// Calls the deleters of all retired objects that are no longer accessible by any reader
+	///
+	/// @returns Whether there are retired objects left that could not be reclaimed yet
+	bool reclaim();
+
+protected:
+	struct ReaderSlot {
+		/// The epoch the reader is currently in or 0 if it is not accessing a snapshot
+		std::atomic< std::uint64_t > epoch = { 0 };
+		/// Keeps the slots of different readers in different cache lines
+		char padding[64 - sizeof(std::atomic< std::uint64_t >)];
+	};
+
+	struct Retired {
+		std::uint64_t epoch;
+		std::function< void() > deleter;
+	};
+
+	std::atomic< const VoiceRoutingSnapshot * > m_current;
+	std::atomic< std::uint64_t > m_epoch = { 1 };
+	std::vector< ReaderSlot > m_readers;
+	std::vector< Retired > m_retired;
+};
+
+#endif // MUMBLE_MURMUR_VOICEROUTING_H_
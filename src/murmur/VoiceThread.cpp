@@ -0,0 +1,52 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "VoiceThread.h"
+
+#include "Server.h"
+
+#ifdef Q_OS_UNIX
+#	include <sys/socket.h>
+#	include <unistd.h>
+#endif
+
+VoiceThreadContext::~VoiceThreadContext() {
+#ifdef Q_OS_UNIX
+	if (notify[0] >= 0)
+		close(notify[0]);
+	if (notify[1] >= 0)
+		close(notify[1]);
+#else
+	if (notify)
+		CloseHandle(notify);
+#endif
+}
+
+bool VoiceThreadContext::createNotify() {
+#ifdef Q_OS_UNIX
+	return socketpair(AF_UNIX, SOCK_STREAM, 0, notify) == 0;
+#else
+	notify = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	return notify != nullptr;
+#endif
+}
+
+bool VoiceThreadContext::wakeUp() {
+#ifdef Q_OS_UNIX
+	unsigned char val = 0;
+	return ::write(notify[1], &val, 1) == 1;
+#else
+	return SetEvent(notify);
+#endif
+}
+
+
+VoiceThread::VoiceThread(Server &server, VoiceThreadContext &context)
+	: QThread(&server), m_server(server), m_context(context) {
+}
+
+void VoiceThread::run() {
+	m_server.runVoiceThread(m_context);
+}
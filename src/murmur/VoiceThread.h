@@ -0,0 +1,87 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICETHREAD_H_
+#define MUMBLE_MURMUR_VOICETHREAD_H_
+
+#include <QtCore/QtGlobal>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#endif
+
+#include "AudioReceiverBuffer.h"
+#include "MumbleProtocol.h"
+#include "UDPBatch.h"
+
+#include <QtCore/QList>
+#include <QtCore/QThread>
+
+#ifdef Q_OS_WIN
+#	include <winsock2.h>
+#endif
+
+class Server;
+
+/// Everything a single voice thread needs in order to process voice packets without sharing mutable state with the
+/// other voice threads of the same server. The only state shared between the voice threads is the routing state
+/// of the Server, which is either read from the current VoiceRoutingSnapshot or guarded by Server::qrwlVoiceThread.
+struct VoiceThreadContext {
+	Q_DISABLE_COPY(VoiceThreadContext)
+
+	explicit VoiceThreadContext(unsigned int index) : index(index) {}
+	~VoiceThreadContext();
+
+	/// The index of this context within the Server's voice contexts. It also serves as the thread's reader slot in
+	/// the Server's VoiceRouting.
+	const unsigned int index;
+
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > decoder;
+	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > pingEncoder;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > audioEncoder;
+	AudioReceiverBuffer audioReceivers;
+#ifdef Q_OS_LINUX
+	UDPReceiveBatch receiveBatch;
+	UDPSendBatch sendBatch;
+#endif
+
+#ifdef Q_OS_UNIX
+	/// The UDP sockets (one per bind address) this thread is reading from. The sockets are owned by the Server.
+	QList< int > sockets;
+	/// Socket pair used to wake up the thread when it is supposed to terminate
+	int notify[2] = { -1, -1 };
+#else
+	QList< SOCKET > sockets;
+	HANDLE notify = nullptr;
+#endif
+
+	/// Creates the handles used by wakeUp
+	///
+	/// @returns Whether the creation was successful
+	bool createNotify();
+	/// Interrupts the thread that is currently waiting for datagrams on this context's sockets
+	///
+	/// @returns Whether the thread could be signalled
+	bool wakeUp();
+};
+
+/// A voice thread of a Server in addition to the Server's own thread. It runs the same loop as the Server thread
+/// (Server::runVoiceThread) but on its own set of sockets. On Linux these are bound with SO_REUSEPORT, such that
+/// the kernel distributes clients across the voice threads.
+class VoiceThread : public QThread {
+private:
+	Q_DISABLE_COPY(VoiceThread)
+
+public:
+	VoiceThread(Server &server, VoiceThreadContext &context);
+
+protected:
+	Server &m_server;
+	VoiceThreadContext &m_context;
+
+	void run() Q_DECL_OVERRIDE;
+};
+
+#endif // MUMBLE_MURMUR_VOICETHREAD_H_
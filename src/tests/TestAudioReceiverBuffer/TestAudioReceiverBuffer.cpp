@@ -305,6 +305,41 @@ private slots:
 		qDebug() << "Sample receiver list required" << requiredReencodings << "encoding steps";
 	}
 
+	void test_protocolOrderAcrossLists() {
+		AudioReceiverBuffer buffer;
+
+		ServerUser &sender = contextUser1;
+
+		buffer.addReceiver(sender, contextUser3, Mumble::Protocol::AudioContext::NORMAL, true);
+		buffer.addReceiver(sender, users[0], Mumble::Protocol::AudioContext::NORMAL, false);
+		buffer.addReceiver(sender, users[3], Mumble::Protocol::AudioContext::NORMAL, false);
+		buffer.addReceiver(sender, users[1], Mumble::Protocol::AudioContext::SHOUT, false);
+		buffer.addReceiver(sender, users[4], Mumble::Protocol::AudioContext::SHOUT, false);
+
+		buffer.preprocessBuffer();
+
+		std::vector< AudioReceiver > positionalReceivers = buffer.getReceivers(true);
+		std::vector< AudioReceiver > regularReceivers    = buffer.getReceivers(false);
+
+		QCOMPARE(positionalReceivers.size(), static_cast< std::size_t >(1));
+		QCOMPARE(regularReceivers.size(), static_cast< std::size_t >(4));
+
+		// The regular receivers have to continue with the protocol the positional ones ended with, so that switching
+		// between the lists doesn't require re-encoding the packet for a different protocol
+		QVERIFY(Mumble::Protocol::protocolVersionsAreCompatible(positionalReceivers.back().getReceiver().m_version,
+																regularReceivers.front().getReceiver().m_version));
+
+		// Receivers using the same protocol still have to be next to each other
+		std::size_t protocolChanges = 0;
+		for (std::size_t i = 1; i < regularReceivers.size(); ++i) {
+			if (!Mumble::Protocol::protocolVersionsAreCompatible(regularReceivers[i - 1].getReceiver().m_version,
+																 regularReceivers[i].getReceiver().m_version)) {
+				protocolChanges++;
+			}
+		}
+		QCOMPARE(protocolChanges, static_cast< std::size_t >(1));
+	}
+
 	void test_emptyRange() {
 		AudioReceiverBuffer buffer;
 
@@ -0,0 +1,202 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "BanList.h"
+
+#include <random>
+#include <vector>
+
+static Ban makeBan(const char *address, int mask, unsigned int duration = 0, qint64 startedSecsAgo = 0) {
+	Ban ban;
+	ban.haAddress = HostAddress(QHostAddress(QLatin1String(address)));
+	ban.iMask     = mask;
+	ban.qsReason  = QString::fromLatin1("%1/%2").arg(QLatin1String(address)).arg(mask);
+	ban.qdtStart  = QDateTime::currentDateTime().toUTC().addSecs(-startedSecsAgo);
+	ban.iDuration = duration;
+
+	return ban;
+}
+
+static HostAddress address(const char *address) {
+	return HostAddress(QHostAddress(QLatin1String(address)));
+}
+
+class TestBanList : public QObject {
+	Q_OBJECT
+private slots:
+	void matchIPv4();
+	void matchIPv6();
+	void matchUnalignedMask();
+	void matchHash();
+	void removeExpired();
+	void clear();
+	void matchesLinearScan();
+};
+
+void TestBanList::matchIPv4() {
+	BanList bans;
+	QVERIFY(!bans.match(address("10.1.2.3")));
+
+	bans.add(makeBan("10.0.0.0", 96 + 8));
+	bans.add(makeBan("10.1.0.0", 96 + 16));
+	bans.add(makeBan("192.168.1.7", 128));
+
+	QCOMPARE(bans.count(), 3);
+
+	// The most specific ban is reported
+	QVERIFY(bans.match(address("10.1.2.3")));
+	QCOMPARE(bans.match(address("10.1.2.3"))->iMask, 96 + 16);
+	QVERIFY(bans.match(address("10.2.0.1")));
+	QCOMPARE(bans.match(address("10.2.0.1"))->iMask, 96 + 8);
+	QVERIFY(!bans.match(address("11.0.0.1")));
+
+	QVERIFY(bans.match(address("192.168.1.7")));
+	QVERIFY(!bans.match(address("192.168.1.8")));
+	QVERIFY(!bans.match(address("::1")));
+}
+
+void TestBanList::matchIPv6() {
+	BanList bans;
+	bans.add(makeBan("2001:db8::", 32));
+	bans.add(makeBan("2001:db8:1:2::", 64));
+
+	QVERIFY(bans.match(address("2001:db8:ffff::1")));
+	QCOMPARE(bans.match(address("2001:db8:1:2::42"))->iMask, 64);
+	QVERIFY(!bans.match(address("2001:db9::1")));
+	QVERIFY(!bans.match(address("10.0.0.1")));
+}
+
+void TestBanList::matchUnalignedMask() {
+	BanList bans;
+	// 10.0.16.0/20
+	bans.add(makeBan("10.0.16.0", 96 + 20));
+
+	QVERIFY(bans.match(address("10.0.16.0")));
+	QVERIFY(bans.match(address("10.0.31.255")));
+	QVERIFY(!bans.match(address("10.0.15.255")));
+	QVERIFY(!bans.match(address("10.0.32.0")));
+
+	QVERIFY(address("10.0.16.0").match(address("10.0.31.255"), 96 + 20));
+	QVERIFY(!address("10.0.16.0").match(address("10.0.32.0"), 96 + 20));
+}
+
+void TestBanList::matchHash() {
+	BanList bans;
+
+	Ban first     = makeBan("10.0.0.1", 128);
+	first.qsHash  = QLatin1String("abc");
+	Ban second    = makeBan("10.0.0.2", 128);
+	second.qsHash = QLatin1String("def");
+	Ban third     = makeBan("10.0.0.3", 128);
+	third.qsHash  = QLatin1String("abc");
+
+	bans.add(first);
+	bans.add(second);
+	bans.add(third);
+
+	const QList< Ban > matches = bans.matchHash(QLatin1String("abc"));
+	QCOMPARE(matches.size(), 2);
+	QCOMPARE(matches[0], first);
+	QCOMPARE(matches[1], third);
+	QVERIFY(bans.matchHash(QLatin1String("xyz")).isEmpty());
+}
+
+void TestBanList::removeExpired() {
+	BanList bans;
+	bans.add(makeBan("10.0.0.1", 128, 10, 100));
+	bans.add(makeBan("10.0.0.0", 96 + 24));
+	bans.add(makeBan("10.0.0.2", 128, 1000, 100));
+	bans.add(makeBan("10.0.0.3", 128, 10, 100));
+
+	QVERIFY(bans.removeExpired());
+	QCOMPARE(bans.count(), 2);
+	QVERIFY(!bans.removeExpired());
+
+	// The expired /32 bans are gone, but the address is still covered by the /24 one
+	QCOMPARE(bans.match(address("10.0.0.1"))->iMask, 96 + 24);
+	QCOMPARE(bans.match(address("10.0.0.2"))->iMask, 128);
+	QCOMPARE(bans.match(address("10.0.0.3"))->iMask, 96 + 24);
+
+	const QList< Ban > remaining = bans.bans();
+	QCOMPARE(remaining.size(), 2);
+	QCOMPARE(remaining[0].iMask, 96 + 24);
+	QCOMPARE(remaining[1].haAddress, address("10.0.0.2"));
+}
+
+void TestBanList::clear() {
+	BanList bans;
+	bans.add(makeBan("10.0.0.1", 128, 10, 100));
+	bans.add(makeBan("2001:db8::", 32));
+
+	bans.clear();
+
+	QVERIFY(bans.isEmpty());
+	QVERIFY(!bans.match(address("10.0.0.1")));
+	QVERIFY(!bans.match(address("2001:db8::1")));
+	QVERIFY(!bans.removeExpired());
+}
+
+void TestBanList::matchesLinearScan() {
+	std::mt19937 rng(42);
+	std::uniform_int_distribution< int > byte(0, 255);
+
+	// Addresses from a small range, such that bans overlap a lot
+	auto randomAddress = [&]() {
+		HostAddress result;
+		result.reset();
+		result.setByte(0, 0x20);
+		result.setByte(1, static_cast< std::uint8_t >(byte(rng) % 4));
+		for (std::size_t i = 14; i < 16; ++i) {
+			result.setByte(i, static_cast< std::uint8_t >(byte(rng)));
+		}
+		return result;
+	};
+
+	BanList bans;
+	std::vector< Ban > reference;
+
+	for (int i = 0; i < 2000; ++i) {
+		Ban ban;
+		ban.haAddress = randomAddress();
+		ban.iMask     = 8 + static_cast< int >(rng() % 121);
+		ban.qdtStart  = QDateTime::currentDateTime().toUTC().addSecs(-100);
+		// Every third ban has expired already
+		ban.iDuration = i % 3 == 0 ? 10 : 0;
+
+		bans.add(ban);
+		if (ban.iDuration == 0) {
+			reference.push_back(ban);
+		}
+	}
+
+	QVERIFY(bans.removeExpired());
+	QCOMPARE(bans.count(), static_cast< int >(reference.size()));
+
+	for (int i = 0; i < 5000; ++i) {
+		const HostAddress candidate = randomAddress();
+
+		int longestMask = -1;
+		for (const Ban &ban : reference) {
+			if (ban.haAddress.match(candidate, static_cast< unsigned int >(ban.iMask))) {
+				longestMask = std::max(longestMask, ban.iMask);
+			}
+		}
+
+		const Ban *match = bans.match(candidate);
+		if (longestMask == -1) {
+			QVERIFY(!match);
+		} else {
+			QVERIFY(match);
+			QCOMPARE(match->iMask, longestMask);
+			QVERIFY(match->haAddress.match(candidate, static_cast< unsigned int >(match->iMask)));
+		}
+	}
+}
+
+QTEST_MAIN(TestBanList)
+#include "TestBanList.moc"
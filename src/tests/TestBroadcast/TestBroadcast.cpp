@@ -0,0 +1,93 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "Broadcast.h"
+#include "Connection.h"
+#include "Mumble.pb.h"
+
+static QByteArray toNetwork(const MumbleProto::UserState &msg) {
+	QByteArray data;
+	Connection::messageToNetwork(msg, Mumble::Protocol::TCPMessageType::UserState, data);
+	return data;
+}
+
+static MumbleProto::UserState userState(unsigned int session, const char *comment) {
+	MumbleProto::UserState mpus;
+	mpus.set_session(session);
+	mpus.set_comment(comment);
+	return mpus;
+}
+
+class TestBroadcast : public QObject {
+	Q_OBJECT
+private slots:
+	void empty();
+	void order();
+	void versions();
+	void shared();
+};
+
+void TestBroadcast::empty() {
+	Broadcast broadcast;
+
+	QVERIFY(broadcast.isEmpty());
+	QVERIFY(broadcast.dataFor(Version::fromComponents(1, 5, 0)).isEmpty());
+}
+
+void TestBroadcast::order() {
+	Broadcast broadcast;
+	broadcast.add(userState(1, "a"), Mumble::Protocol::TCPMessageType::UserState);
+	broadcast.add(userState(2, "b"), Mumble::Protocol::TCPMessageType::UserState);
+	broadcast.add(userState(3, "c"), Mumble::Protocol::TCPMessageType::UserState);
+
+	QVERIFY(!broadcast.isEmpty());
+	QCOMPARE(broadcast.dataFor(Version::fromComponents(1, 5, 0)),
+			 toNetwork(userState(1, "a")) + toNetwork(userState(2, "b")) + toNetwork(userState(3, "c")));
+}
+
+void TestBroadcast::versions() {
+	Broadcast broadcast;
+	broadcast.add(userState(1, "all"), Mumble::Protocol::TCPMessageType::UserState);
+	broadcast.add(userState(2, "old"), Mumble::Protocol::TCPMessageType::UserState, Version::fromComponents(1, 2, 2),
+				  Version::CompareMode::LessThan);
+	broadcast.add(userState(2, "new"), Mumble::Protocol::TCPMessageType::UserState, Version::fromComponents(1, 2, 2),
+				  Version::CompareMode::AtLeast);
+	broadcast.add(userState(3, "newest"), Mumble::Protocol::TCPMessageType::UserState,
+				  Version::fromComponents(1, 5, 0), Version::CompareMode::AtLeast);
+
+	const QByteArray all    = toNetwork(userState(1, "all"));
+	const QByteArray old    = toNetwork(userState(2, "old"));
+	const QByteArray recent = toNetwork(userState(2, "new"));
+	const QByteArray newest = toNetwork(userState(3, "newest"));
+
+	QCOMPARE(broadcast.dataFor(Version::fromComponents(1, 2, 0)), all + old);
+	QCOMPARE(broadcast.dataFor(Version::fromComponents(1, 2, 2)), all + recent);
+	QCOMPARE(broadcast.dataFor(Version::fromComponents(1, 4, 0)), all + recent);
+	QCOMPARE(broadcast.dataFor(Version::fromComponents(1, 5, 0)), all + recent + newest);
+	QCOMPARE(broadcast.dataFor(Version::fromComponents(1, 6, 0)), all + recent + newest);
+}
+
+void TestBroadcast::shared() {
+	Broadcast broadcast;
+	broadcast.add(userState(1, "a"), Mumble::Protocol::TCPMessageType::UserState);
+	broadcast.add(userState(2, "b"), Mumble::Protocol::TCPMessageType::UserState, Version::fromComponents(1, 2, 2),
+				  Version::CompareMode::AtLeast);
+
+	// Clients getting the same messages get the same buffer
+	const QByteArray first  = broadcast.dataFor(Version::fromComponents(1, 4, 0));
+	const QByteArray second = broadcast.dataFor(Version::fromComponents(1, 5, 0));
+	QCOMPARE(first.constData(), second.constData());
+
+	// A single message isn't copied at all
+	const QByteArray single = broadcast.dataFor(Version::fromComponents(1, 2, 0));
+	QCOMPARE(single, toNetwork(userState(1, "a")));
+	QCOMPARE(broadcast.dataFor(Version::fromComponents(1, 1, 0)).constData(), single.constData());
+}
+
+QTEST_MAIN(TestBroadcast)
+#include "TestBroadcast.moc"
@@ -0,0 +1,133 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "ConnectionThrottle.h"
+
+#include <random>
+#include <vector>
+
+constexpr std::uint64_t SECOND = 1000000;
+
+static HostAddress address(const char *address) {
+	return HostAddress(QHostAddress(QLatin1String(address)));
+}
+
+class TestConnectionThrottle : public QObject {
+	Q_OBJECT
+private slots:
+	void limit();
+	void banExpires();
+	void slidingTimeframe();
+	void reset();
+	void ipv6Prefix();
+	void flood();
+};
+
+void TestConnectionThrottle::limit() {
+	ConnectionThrottle throttle(10, 120 * SECOND, 300 * SECOND);
+
+	for (int i = 0; i < 10; ++i) {
+		QVERIFY(!throttle.check(address("10.0.0.1"), SECOND + i));
+	}
+	QVERIFY(throttle.check(address("10.0.0.1"), 2 * SECOND));
+	QVERIFY(throttle.check(address("10.0.0.1"), 3 * SECOND));
+	QVERIFY(!throttle.check(address("10.0.0.2"), 3 * SECOND));
+
+	QCOMPARE(throttle.statistics().attempts, static_cast< std::uint64_t >(13));
+	QCOMPARE(throttle.statistics().rejected, static_cast< std::uint64_t >(2));
+	QCOMPARE(throttle.statistics().bans, static_cast< std::uint64_t >(1));
+}
+
+void TestConnectionThrottle::banExpires() {
+	ConnectionThrottle throttle(3, 120 * SECOND, 300 * SECOND);
+
+	for (int i = 0; i < 3; ++i) {
+		QVERIFY(!throttle.check(address("10.0.0.1"), SECOND + i));
+	}
+	QVERIFY(throttle.check(address("10.0.0.1"), SECOND + 3));
+
+	QVERIFY(throttle.check(address("10.0.0.1"), 300 * SECOND));
+	QVERIFY(!throttle.check(address("10.0.0.1"), 302 * SECOND));
+}
+
+void TestConnectionThrottle::slidingTimeframe() {
+	ConnectionThrottle throttle(10, 120 * SECOND, 300 * SECOND);
+
+	for (int i = 0; i < 10; ++i) {
+		QVERIFY(!throttle.check(address("10.0.0.1"), SECOND + i));
+		QVERIFY(!throttle.check(address("10.0.0.2"), SECOND + i));
+	}
+
+	// The attempts of the previous timeframe count by how much of it still overlaps with the sliding window
+	QVERIFY(throttle.check(address("10.0.0.1"), 125 * SECOND));
+	QVERIFY(!throttle.check(address("10.0.0.2"), 200 * SECOND));
+}
+
+void TestConnectionThrottle::reset() {
+	ConnectionThrottle throttle(3, 120 * SECOND, 300 * SECOND);
+
+	for (int round = 0; round < 10; ++round) {
+		for (int i = 0; i < 3; ++i) {
+			QVERIFY(!throttle.check(address("10.0.0.1"), SECOND + round * 10 + i));
+		}
+		throttle.reset(address("10.0.0.1"), SECOND + round * 10 + 5);
+	}
+}
+
+void TestConnectionThrottle::ipv6Prefix() {
+	ConnectionThrottle throttle(3, 120 * SECOND, 300 * SECOND);
+
+	// Addresses within the same /64 are counted together
+	QVERIFY(!throttle.check(address("2001:db8:1:2::1"), SECOND));
+	QVERIFY(!throttle.check(address("2001:db8:1:2::2"), SECOND));
+	QVERIFY(!throttle.check(address("2001:db8:1:2:ffff::3"), SECOND));
+	QVERIFY(throttle.check(address("2001:db8:1:2::4"), SECOND));
+
+	QVERIFY(!throttle.check(address("2001:db8:1:3::1"), SECOND));
+	// IPv4 addresses are not counted per prefix
+	QVERIFY(!throttle.check(address("::ffff:10.0.0.1"), SECOND));
+	QVERIFY(!throttle.check(address("10.0.0.2"), SECOND));
+}
+
+void TestConnectionThrottle::flood() {
+	ConnectionThrottle throttle(10, 120 * SECOND, 300 * SECOND);
+	std::mt19937_64 rng(42);
+
+	auto randomAddress = [&]() {
+		HostAddress result;
+		for (std::size_t i = 0; i < 16; ++i) {
+			result.setByte(i, static_cast< std::uint8_t >(rng()));
+		}
+		return result;
+	};
+
+	std::vector< HostAddress > attackers;
+	for (int i = 0; i < 100; ++i) {
+		attackers.push_back(randomAddress());
+	}
+
+	// Many more sources than the throttle can track, each only making a single attempt
+	constexpr int FLOOD_SIZE = 200000;
+	std::uint64_t now        = SECOND;
+
+	for (int i = 0; i < FLOOD_SIZE; ++i) {
+		now += 200;
+
+		QVERIFY(!throttle.check(randomAddress(), now));
+		if (i % 100 == 0) {
+			throttle.check(attackers[static_cast< std::size_t >(i / 100) % attackers.size()], now);
+		}
+	}
+
+	// None of the single attempts got banned, but all of the attackers (20 attempts each) did
+	QCOMPARE(throttle.statistics().bans, static_cast< std::uint64_t >(attackers.size()));
+	QVERIFY(throttle.statistics().evictions > 0);
+}
+
+QTEST_MAIN(TestConnectionThrottle)
+#include "TestConnectionThrottle.moc"
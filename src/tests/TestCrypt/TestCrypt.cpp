@@ -9,7 +9,12 @@
 #include "SSL.h"
 #include "Timer.h"
 #include "Utils.h"
+#include "crypto/CryptStateChaCha20Poly1305.h"
 #include "crypto/CryptStateOCB2.h"
+
+#include <openssl/evp.h>
+
+#include <memory>
 #include <string>
 
 class TestCrypt : public QObject {
@@ -19,10 +24,13 @@ private slots:
 	void cleanupTestCase();
 	void testvectors();
 	void authcrypt();
+	void authcryptLarge();
 	void xexstarAttack();
 	void ivrecovery();
 	void reverserecovery();
 	void tamper();
+	void chacha20poly1305();
+	void crossImplementation();
 };
 
 void TestCrypt::initTestCase() {
@@ -214,6 +222,46 @@ void TestCrypt::authcrypt() {
 	}
 }
 
+// Packets spanning several of the batches ocb_encrypt and ocb_decrypt process at once
+void TestCrypt::authcryptLarge() {
+	const unsigned char rawkey[AES_BLOCK_SIZE] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+												   0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	const unsigned char nonce[AES_BLOCK_SIZE]  = { 0xff, 0xee, 0xdd, 0xcc, 0xbb, 0xaa, 0x99, 0x88,
+                                                  0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00 };
+	std::string rawkey_str                     = std::string(reinterpret_cast< const char * >(rawkey), AES_BLOCK_SIZE);
+	std::string nonce_str                      = std::string(reinterpret_cast< const char * >(nonce), AES_BLOCK_SIZE);
+	CryptStateOCB2 cs;
+	cs.setKey(rawkey_str, nonce_str, nonce_str);
+
+	for (unsigned int len = 1000; len < 4200; len += 61) {
+		std::vector< unsigned char > src;
+		src.resize(len);
+		for (unsigned int i = 0; i < len; i++)
+			src[i] = static_cast< unsigned char >(i * 13 + 1);
+
+		unsigned char enctag[AES_BLOCK_SIZE];
+		unsigned char dectag[AES_BLOCK_SIZE];
+		std::vector< unsigned char > encrypted;
+		encrypted.resize(len);
+		std::vector< unsigned char > decrypted;
+		decrypted.resize(len);
+
+		QVERIFY(cs.ocb_encrypt(src.data(), encrypted.data(), len, nonce, enctag));
+		QVERIFY(cs.ocb_decrypt(encrypted.data(), decrypted.data(), len, nonce, dectag));
+
+		for (int i = 0; i < AES_BLOCK_SIZE; i++)
+			QCOMPARE(enctag[i], dectag[i]);
+
+		for (unsigned int i = 0; i < len; i++)
+			QCOMPARE(src[i], decrypted[i]);
+
+		// Tampering with a block towards the end of the packet must still be detected
+		encrypted[len - 20] ^= 0x10;
+		QVERIFY(cs.ocb_decrypt(encrypted.data(), decrypted.data(), len, nonce, dectag));
+		QVERIFY(memcmp(enctag, dectag, AES_BLOCK_SIZE) != 0);
+	}
+}
+
 // Test prevention of the attack described in section 4.1 of https://eprint.iacr.org/2019/311
 void TestCrypt::xexstarAttack() {
 	const unsigned char rawkey[AES_BLOCK_SIZE] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
@@ -301,5 +349,93 @@ void TestCrypt::tamper() {
 	QVERIFY(cs.decrypt(encrypted.data(), decrypted.data(), len + 4));
 }
 
+void TestCrypt::chacha20poly1305() {
+	// Compare against OpenSSL's ChaCha20-Poly1305 used directly
+	std::string key(CryptStateChaCha20Poly1305::KEY_SIZE, '\0');
+	std::string iv(AES_BLOCK_SIZE, '\0');
+	for (std::size_t i = 0; i < key.size(); i++)
+		key[i] = static_cast< char >(0x80 + i);
+	for (std::size_t i = 0; i < iv.size(); i++)
+		iv[i] = static_cast< char >(0x40 + i);
+
+	CryptStateChaCha20Poly1305 cs;
+	QVERIFY(cs.setKey(key, iv, iv));
+
+	for (unsigned int len = 0; len < 300; len += 7) {
+		std::vector< unsigned char > src(len);
+		for (unsigned int i = 0; i < len; i++)
+			src[i] = static_cast< unsigned char >(i * 3);
+
+		std::vector< unsigned char > encrypted(len + 4);
+		QVERIFY(cs.encrypt(src.data(), encrypted.data(), len));
+
+		// The encrypt IV is incremented before every packet
+		std::string nonce = cs.getEncryptIV();
+
+		std::vector< unsigned char > expected(len + 16);
+		unsigned char tag[16];
+		int outlen          = 0;
+		EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+		QVERIFY(EVP_EncryptInit_ex(ctx, EVP_chacha20_poly1305(), nullptr,
+								   reinterpret_cast< const unsigned char * >(key.data()),
+								   reinterpret_cast< const unsigned char * >(nonce.data()))
+				== 1);
+		QVERIFY(EVP_EncryptUpdate(ctx, expected.data(), &outlen, src.data(), static_cast< int >(len)) == 1);
+		QVERIFY(EVP_EncryptFinal_ex(ctx, expected.data() + outlen, &outlen) == 1);
+		QVERIFY(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, 16, tag) == 1);
+		EVP_CIPHER_CTX_free(ctx);
+
+		QCOMPARE(encrypted[0], static_cast< unsigned char >(nonce[0]));
+		QCOMPARE(encrypted[1], tag[0]);
+		QCOMPARE(encrypted[2], tag[1]);
+		QCOMPARE(encrypted[3], tag[2]);
+		for (unsigned int i = 0; i < len; i++)
+			QCOMPARE(encrypted[i + 4], expected[i]);
+	}
+}
+
+void TestCrypt::crossImplementation() {
+	std::vector< std::unique_ptr< CryptState > > senders;
+	std::vector< std::unique_ptr< CryptState > > receivers;
+	senders.push_back(std::make_unique< CryptStateOCB2 >());
+	senders.push_back(std::make_unique< CryptStateChaCha20Poly1305 >());
+	receivers.push_back(std::make_unique< CryptStateOCB2 >());
+	receivers.push_back(std::make_unique< CryptStateChaCha20Poly1305 >());
+
+	for (std::size_t i = 0; i < senders.size(); i++) {
+		senders[i]->genKey();
+		QVERIFY(receivers[i]->setKey(senders[i]->getRawKey(), senders[i]->getDecryptIV(),
+									 senders[i]->getEncryptIV()));
+	}
+
+	const unsigned char secret[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+	const unsigned int len       = sizeof(secret);
+	unsigned char crypted[len + 4];
+	unsigned char decrypted[len];
+
+	for (std::size_t i = 0; i < senders.size(); i++) {
+		for (std::size_t j = 0; j < receivers.size(); j++) {
+			QVERIFY(senders[i]->encrypt(secret, crypted, len));
+
+			const unsigned int goodBefore = receivers[j]->uiGood;
+			const bool decrypted_ok       = receivers[j]->decrypt(crypted, decrypted, len + 4);
+
+			if (i == j) {
+				// Both implementations track IVs and statistics in the same way
+				QVERIFY(decrypted_ok);
+				QCOMPARE(receivers[j]->uiGood, goodBefore + 1);
+				QVERIFY(memcmp(secret, decrypted, len) == 0);
+
+				// Replays are rejected
+				QVERIFY(!receivers[j]->decrypt(crypted, decrypted, len + 4));
+			} else {
+				// A packet for one cipher mode is never accepted by the other one
+				QVERIFY(!decrypted_ok);
+				QCOMPARE(receivers[j]->uiGood, goodBefore);
+			}
+		}
+	}
+}
+
 QTEST_MAIN(TestCrypt)
 #include "TestCrypt.moc"
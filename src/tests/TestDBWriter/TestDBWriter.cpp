@@ -0,0 +1,168 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "DBWriter.h"
+
+#include <vector>
+
+/// Records the batches instead of writing to a database
+class RecordingWriter : public DBWriter {
+public:
+	~RecordingWriter() Q_DECL_OVERRIDE { stop(); }
+
+	/// Only accessed by the writer thread or after flush() or stop()
+	std::vector< int > executed;
+	std::vector< std::size_t > batchSizes;
+	QThread *setUpThread = nullptr;
+	bool tornDown        = false;
+
+	void add(int value) {
+		enqueue([this, value]() {
+			executed.push_back(value);
+			++m_currentBatchSize;
+		});
+	}
+
+protected:
+	std::size_t m_currentBatchSize = 0;
+
+	void setUp() Q_DECL_OVERRIDE { setUpThread = QThread::currentThread(); }
+	void tearDown() Q_DECL_OVERRIDE { tornDown = true; }
+	void beginBatch() Q_DECL_OVERRIDE { m_currentBatchSize = 0; }
+	void commitBatch() Q_DECL_OVERRIDE { batchSizes.push_back(m_currentBatchSize); }
+};
+
+class TestDBWriter : public QObject {
+	Q_OBJECT
+private slots:
+	void order();
+	void groupCommit();
+	void batchSize();
+	void flush();
+	void stop();
+	void tickets();
+};
+
+void TestDBWriter::order() {
+	RecordingWriter writer;
+	writer.start();
+
+	for (int i = 0; i < 1000; ++i) {
+		writer.add(i);
+	}
+	writer.flush();
+
+	QCOMPARE(writer.executed.size(), static_cast< std::size_t >(1000));
+	for (int i = 0; i < 1000; ++i) {
+		QCOMPARE(writer.executed[static_cast< std::size_t >(i)], i);
+	}
+	QVERIFY(writer.setUpThread == &writer);
+
+	const DBWriterStatistics statistics = writer.statistics();
+	QCOMPARE(statistics.commands, static_cast< std::uint64_t >(1000));
+	QCOMPARE(statistics.batches, static_cast< std::uint64_t >(writer.batchSizes.size()));
+}
+
+void TestDBWriter::groupCommit() {
+	RecordingWriter writer;
+	writer.start();
+
+	// Keep the writer busy with a first batch, while more commands are queued
+	QSemaphore started;
+	QSemaphore release;
+	writer.enqueue([&]() {
+		started.release();
+		release.acquire();
+	});
+	started.acquire();
+
+	for (int i = 0; i < 10; ++i) {
+		writer.add(i);
+	}
+	QCOMPARE(writer.queueDepth(), static_cast< std::size_t >(10));
+
+	release.release();
+	writer.flush();
+
+	QCOMPARE(writer.batchSizes.size(), static_cast< std::size_t >(2));
+	QCOMPARE(writer.batchSizes[1], static_cast< std::size_t >(10));
+	QCOMPARE(writer.statistics().maxQueueDepth, static_cast< std::uint64_t >(10));
+}
+
+void TestDBWriter::batchSize() {
+	RecordingWriter writer;
+
+	// Queue everything before the thread starts, such that it is all waiting at once
+	for (int i = 0; i < 1000; ++i) {
+		writer.add(i);
+	}
+	writer.start();
+	writer.flush();
+
+	QCOMPARE(writer.executed.size(), static_cast< std::size_t >(1000));
+	QCOMPARE(writer.batchSizes.size(), static_cast< std::size_t >(4));
+	for (std::size_t size : writer.batchSizes) {
+		QVERIFY(size <= DBWriter::MAX_BATCH_SIZE);
+	}
+}
+
+void TestDBWriter::flush() {
+	RecordingWriter writer;
+	writer.start();
+
+	bool done = false;
+	writer.enqueue([&]() {
+		QThread::msleep(50);
+		done = true;
+	});
+	writer.flush();
+
+	QVERIFY(done);
+
+	// Nothing to wait for
+	writer.flush();
+}
+
+void TestDBWriter::stop() {
+	RecordingWriter writer;
+	writer.start();
+
+	for (int i = 0; i < 100; ++i) {
+		writer.add(i);
+	}
+	writer.stop();
+
+	QCOMPARE(writer.executed.size(), static_cast< std::size_t >(100));
+	QVERIFY(writer.tornDown);
+	QVERIFY(writer.isFinished());
+
+	// Doesn't wait for a writer that has ended
+	writer.flush();
+}
+
+void TestDBWriter::tickets() {
+	RecordingWriter writer;
+
+	QCOMPARE(writer.committed(), static_cast< std::uint64_t >(0));
+
+	std::uint64_t ticket = 0;
+	for (int i = 0; i < 10; ++i) {
+		const std::uint64_t next = writer.enqueue([]() {});
+		QVERIFY(next > ticket);
+		ticket = next;
+	}
+	QCOMPARE(writer.committed(), static_cast< std::uint64_t >(0));
+
+	writer.start();
+	writer.flush();
+
+	QCOMPARE(writer.committed(), ticket);
+}
+
+QTEST_MAIN(TestDBWriter)
+#include "TestDBWriter.moc"
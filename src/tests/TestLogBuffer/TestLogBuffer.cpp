@@ -0,0 +1,135 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "LogBuffer.h"
+
+class TestLogBuffer : public QObject {
+	Q_OBJECT
+private slots:
+	void append();
+	void sent();
+	void committed();
+	void records();
+	void remove();
+	void roundTrip();
+};
+
+void TestLogBuffer::append() {
+	LogBuffer buffer;
+
+	QVERIFY(buffer.append(1, 100, QLatin1String("first")));
+	QVERIFY(!buffer.append(1, 101, QLatin1String("second")));
+	QCOMPARE(buffer.pendingCount(), static_cast< std::size_t >(2));
+
+	const std::vector< BufferedLogRecord > pending = buffer.pending();
+	QCOMPARE(pending.size(), static_cast< std::size_t >(2));
+	QCOMPARE(pending[0].message, QString::fromLatin1("first"));
+	QCOMPARE(pending[1].time, 101u);
+}
+
+void TestLogBuffer::sent() {
+	LogBuffer buffer;
+
+	buffer.append(1, 100, QLatin1String("first"));
+	buffer.append(1, 101, QLatin1String("second"));
+	buffer.sent(1, 5);
+
+	QCOMPARE(buffer.pendingCount(), static_cast< std::size_t >(1));
+	QCOMPARE(buffer.pending()[0].message, QString::fromLatin1("second"));
+	// Sent records are kept until they have been committed
+	QCOMPARE(buffer.count(1), 2);
+
+	// Being the first pending record again requires scheduling another write
+	buffer.sent(10, 6);
+	QCOMPARE(buffer.pendingCount(), static_cast< std::size_t >(0));
+	QVERIFY(buffer.append(1, 102, QLatin1String("third")));
+}
+
+void TestLogBuffer::committed() {
+	LogBuffer buffer;
+
+	buffer.append(1, 100, QLatin1String("first"));
+	buffer.sent(1, 5);
+	buffer.append(1, 101, QLatin1String("second"));
+	buffer.sent(1, 7);
+
+	QVERIFY(!buffer.hasCommitted(4));
+	QVERIFY(buffer.hasCommitted(5));
+
+	buffer.committed(6);
+	QCOMPARE(buffer.count(1), 1);
+	QVERIFY(!buffer.hasCommitted(6));
+	QVERIFY(buffer.hasCommitted(7));
+
+	buffer.committed(7);
+	QCOMPARE(buffer.count(1), 0);
+}
+
+void TestLogBuffer::records() {
+	LogBuffer buffer;
+
+	buffer.append(1, 100, QLatin1String("a"));
+	buffer.append(2, 101, QLatin1String("b"));
+	buffer.append(1, 102, QLatin1String("c"));
+	buffer.sent(2, 1);
+	buffer.append(1, 103, QLatin1String("d"));
+
+	// Newest first, whether they have been sent or not
+	const std::vector< BufferedLogRecord > records = buffer.records(1);
+	QCOMPARE(records.size(), static_cast< std::size_t >(3));
+	QCOMPARE(records[0].message, QString::fromLatin1("d"));
+	QCOMPARE(records[1].message, QString::fromLatin1("c"));
+	QCOMPARE(records[2].message, QString::fromLatin1("a"));
+
+	QCOMPARE(buffer.count(1), 3);
+	QCOMPARE(buffer.count(2), 1);
+	QCOMPARE(buffer.count(3), 0);
+}
+
+void TestLogBuffer::remove() {
+	LogBuffer buffer;
+
+	buffer.append(1, 100, QLatin1String("a"));
+	buffer.append(2, 101, QLatin1String("b"));
+	buffer.append(1, 102, QLatin1String("c"));
+
+	buffer.remove(1);
+	QCOMPARE(buffer.count(1), 0);
+	QCOMPARE(buffer.pendingCount(), static_cast< std::size_t >(1));
+
+	buffer.clear();
+	QCOMPARE(buffer.count(2), 0);
+}
+
+void TestLogBuffer::roundTrip() {
+	// What ServerDB::getLog() reads from the buffer after ServerDB::log() and ServerDB::flushLog()
+	LogBuffer buffer;
+
+	buffer.append(1, 100, QLatin1String("first"));
+	QCOMPARE(buffer.records(1).size(), static_cast< std::size_t >(1));
+
+	// Queued for the writer thread, which has committed earlier writes only
+	buffer.sent(buffer.pendingCount(), 3);
+	buffer.committed(2);
+	QCOMPARE(buffer.records(1)[0].message, QString::fromLatin1("first"));
+
+	// Committed while the database was read, which makes getLog() read again instead of returning the line twice
+	QVERIFY(buffer.hasCommitted(3));
+	buffer.committed(3);
+	QCOMPARE(buffer.count(1), 0);
+
+	// Written synchronously (within a transaction or without a writer thread), i.e. in the database already
+	buffer.append(1, 101, QLatin1String("second"));
+	buffer.sent(buffer.pendingCount(), 0);
+	buffer.committed(0);
+	QCOMPARE(buffer.count(1), 0);
+	QVERIFY(!buffer.hasCommitted(3));
+}
+
+QTEST_MAIN(TestLogBuffer)
+#include "TestLogBuffer.moc"
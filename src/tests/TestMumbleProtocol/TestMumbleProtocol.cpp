@@ -316,6 +316,34 @@ private slots:
 		// We only expect pre-encoded values for integer dB adjustments
 		QVERIFY(encoder.getPreEncodedVolumeAdjustment(VolumeAdjustment(std::pow(2.0f, (MAX + 0.5f) / 6.0f))).empty());
 	}
+
+	void test_udp_association_header() {
+		std::vector< Mumble::Protocol::byte > datagram(Mumble::Protocol::UDP_ASSOCIATION_HEADER_SIZE + 4, 0x42);
+
+		Mumble::Protocol::writeUDPAssociationHeader(datagram.data(), 0x01020304);
+
+		std::uint32_t token = 0;
+		QVERIFY(Mumble::Protocol::readUDPAssociationHeader(datagram, token));
+		QCOMPARE(token, static_cast< std::uint32_t >(0x01020304));
+
+		// The header is in network byte order
+		QCOMPARE(datagram[0], static_cast< Mumble::Protocol::byte >(Mumble::Protocol::UDP_ASSOCIATION_MAGIC >> 24));
+		QCOMPARE(datagram[7], static_cast< Mumble::Protocol::byte >(0x04));
+
+		// A header without any payload is invalid
+		token = 0;
+		QVERIFY(!Mumble::Protocol::readUDPAssociationHeader(
+			gsl::span< const Mumble::Protocol::byte >(datagram.data(), Mumble::Protocol::UDP_ASSOCIATION_HEADER_SIZE),
+			token));
+		QCOMPARE(token, static_cast< std::uint32_t >(0));
+
+		// Plain pings never start with the magic. Encrypted packets look random and thus do so with a probability
+		// of roughly 2^-32. Server::runVoiceThread() only treats a datagram as associated if the token belongs to a
+		// user at the sender's address whose key decrypts the rest, so such a collision falls through to the regular
+		// handling.
+		datagram[0] = static_cast< Mumble::Protocol::byte >(Mumble::Protocol::UDPMessageType::Ping);
+		QVERIFY(!Mumble::Protocol::readUDPAssociationHeader(datagram, token));
+	}
 };
 
 QTEST_MAIN(TestMumbleProtocol)
@@ -0,0 +1,136 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtNetwork/QHostAddress>
+#include <QtTest>
+
+#include "PasswordHasher.h"
+
+static QString concatenate(const QString &salt, const QString &password, int iterations) {
+	return salt + password + QString::number(iterations);
+}
+
+class TestPasswordHasher : public QObject {
+	Q_OBJECT
+private slots:
+	void hash();
+	void limitPerSource();
+	void limitPerPrefix();
+	void cancel();
+};
+
+void TestPasswordHasher::hash() {
+	PasswordHasher hasher(concatenate, 2);
+
+	QVector< PasswordHash > results;
+	QVERIFY(hasher.hash(this, HostAddress(QHostAddress(QLatin1String("127.0.0.1"))), QLatin1String("salt"),
+						QLatin1String("password"), 1000, [&](const PasswordHash &hash) {
+							// Callbacks are called on the thread the hasher lives in
+							QVERIFY(QThread::currentThread() == thread());
+							results << hash;
+						}));
+
+	QTRY_COMPARE(results.size(), 1);
+	QCOMPARE(results[0].salt, QString::fromLatin1("salt"));
+	QCOMPARE(results[0].iterations, 1000);
+	QCOMPARE(results[0].hash, QString::fromLatin1("saltpassword1000"));
+}
+
+void TestPasswordHasher::limitPerSource() {
+	QSemaphore release;
+	PasswordHasher hasher(
+		[&](const QString &salt, const QString &password, int iterations) {
+			release.acquire();
+			return concatenate(salt, password, iterations);
+		},
+		4, 2);
+
+	const HostAddress source(QHostAddress(QLatin1String("10.0.0.1")));
+	const HostAddress other(QHostAddress(QLatin1String("10.0.0.2")));
+
+	int delivered = 0;
+	auto callback = [&](const PasswordHash &) { ++delivered; };
+
+	QVERIFY(hasher.hash(this, source, QString(), QLatin1String("a"), 1, callback));
+	QVERIFY(hasher.hash(this, source, QString(), QLatin1String("b"), 1, callback));
+	QVERIFY(!hasher.hash(this, source, QString(), QLatin1String("c"), 1, callback));
+	QVERIFY(hasher.hash(this, other, QString(), QLatin1String("d"), 1, callback));
+	QCOMPARE(hasher.jobCount(source), 2);
+	QCOMPARE(hasher.jobCount(other), 1);
+
+	release.release(3);
+	QTRY_COMPARE(delivered, 3);
+
+	// Jobs stop counting once they have been delivered
+	QCOMPARE(hasher.jobCount(source), 0);
+	release.release();
+	QVERIFY(hasher.hash(this, source, QString(), QLatin1String("e"), 1, callback));
+	QTRY_COMPARE(delivered, 4);
+}
+
+void TestPasswordHasher::limitPerPrefix() {
+	QSemaphore release;
+	PasswordHasher hasher(
+		[&](const QString &salt, const QString &password, int iterations) {
+			release.acquire();
+			return concatenate(salt, password, iterations);
+		},
+		4, 1);
+
+	// A host can pick any address within its /64
+	const HostAddress source(QHostAddress(QLatin1String("2001:db8:0:1::1")));
+	const HostAddress samePrefix(QHostAddress(QLatin1String("2001:db8:0:1:ffff::2")));
+	const HostAddress otherPrefix(QHostAddress(QLatin1String("2001:db8:0:2::1")));
+
+	int delivered = 0;
+	auto callback = [&](const PasswordHash &) { ++delivered; };
+
+	QVERIFY(hasher.hash(this, source, QString(), QLatin1String("a"), 1, callback));
+	QVERIFY(!hasher.hash(this, samePrefix, QString(), QLatin1String("b"), 1, callback));
+	QVERIFY(hasher.hash(this, otherPrefix, QString(), QLatin1String("c"), 1, callback));
+	QCOMPARE(hasher.jobCount(samePrefix), 1);
+
+	// IPv4 addresses are counted individually
+	QVERIFY(hasher.hash(this, HostAddress(QHostAddress(QLatin1String("10.0.0.1"))), QString(), QLatin1String("d"), 1,
+						callback));
+	QVERIFY(hasher.hash(this, HostAddress(QHostAddress(QLatin1String("10.0.0.2"))), QString(), QLatin1String("e"), 1,
+						callback));
+
+	release.release(4);
+	QTRY_COMPARE(delivered, 4);
+	QCOMPARE(hasher.jobCount(source), 0);
+}
+
+void TestPasswordHasher::cancel() {
+	QSemaphore started;
+	QSemaphore release;
+	PasswordHasher hasher(
+		[&](const QString &salt, const QString &password, int iterations) {
+			started.release();
+			release.acquire();
+			return concatenate(salt, password, iterations);
+		},
+		1);
+
+	const HostAddress source(QHostAddress(QLatin1String("10.0.0.1")));
+	QObject owner;
+
+	bool called = false;
+	QVERIFY(hasher.hash(&owner, source, QString(), QLatin1String("a"), 1,
+						[&](const PasswordHash &) { called = true; }));
+	started.acquire();
+
+	hasher.cancel(&owner);
+	QCOMPARE(hasher.jobCount(source), 0);
+
+	// The hash is still computed, but nobody is told about it
+	release.release();
+	QTest::qWait(50);
+	QVERIFY(!called);
+}
+
+QTEST_MAIN(TestPasswordHasher)
+#include "TestPasswordHasher.moc"
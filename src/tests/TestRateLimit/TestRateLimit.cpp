@@ -0,0 +1,136 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "RateLimit.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+constexpr std::uint64_t SECOND = 1000000;
+
+class TestRateLimit : public QObject {
+	Q_OBJECT
+private slots:
+	void burst();
+	void drain();
+	void oversized();
+	void zeroRate();
+	void concurrent();
+	void bandwidthLimit();
+	void bandwidth();
+	void idleSeconds();
+};
+
+void TestRateLimit::burst() {
+	TokenBucket bucket;
+
+	for (int i = 0; i < 5; ++i) {
+		QVERIFY(bucket.add(1, 1, 5, SECOND));
+	}
+	QVERIFY(!bucket.add(1, 1, 5, SECOND));
+	QVERIFY(!bucket.add(1, 1, 5, SECOND + SECOND / 2));
+}
+
+void TestRateLimit::drain() {
+	TokenBucket bucket;
+
+	QVERIFY(bucket.add(10, 2, 10, SECOND));
+	QVERIFY(!bucket.add(1, 2, 10, SECOND));
+
+	// 2 tokens drain per second
+	QVERIFY(bucket.add(2, 2, 10, 2 * SECOND));
+	QVERIFY(!bucket.add(1, 2, 10, 2 * SECOND));
+
+	// Time spent with an empty bucket doesn't allow for more than its capacity
+	QVERIFY(bucket.add(10, 2, 10, 100 * SECOND));
+	QVERIFY(!bucket.add(1, 2, 10, 100 * SECOND));
+}
+
+void TestRateLimit::oversized() {
+	TokenBucket bucket;
+
+	QVERIFY(!bucket.add(6, 1, 5, SECOND));
+	QVERIFY(bucket.add(5, 1, 5, SECOND));
+}
+
+void TestRateLimit::zeroRate() {
+	TokenBucket bucket;
+
+	QVERIFY(!bucket.add(1, 0, 5, SECOND));
+	QVERIFY(bucket.add(0, 0, 5, SECOND));
+}
+
+void TestRateLimit::concurrent() {
+	TokenBucket bucket;
+	std::atomic< int > added(0);
+
+	std::vector< std::thread > threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.emplace_back([&]() {
+			for (int j = 0; j < 10000; ++j) {
+				if (bucket.add(1, 1, 1000, SECOND)) {
+					++added;
+				}
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	QCOMPARE(added.load(), 1000);
+}
+
+void TestRateLimit::bandwidthLimit() {
+	BandwidthRecord record;
+
+	// A second's worth of frames may be sent at once
+	for (int i = 0; i < 10; ++i) {
+		QVERIFY(record.addFrame(100, 1000, SECOND));
+	}
+	QVERIFY(!record.addFrame(100, 1000, SECOND));
+
+	// Sending at the limit is fine
+	for (std::uint64_t time = SECOND; time < 10 * SECOND; time += SECOND / 10) {
+		QVERIFY(record.addFrame(100, 1000, time + SECOND / 10));
+	}
+	QVERIFY(!record.addFrame(100, 1000, 10 * SECOND));
+}
+
+void TestRateLimit::bandwidth() {
+	BandwidthRecord record;
+
+	QCOMPARE(record.bandwidth(SECOND), 0);
+
+	for (std::uint64_t time = 0; time < 10 * SECOND; time += SECOND / 50) {
+		QVERIFY(record.addFrame(100, 100000, time));
+	}
+
+	// 50 frames of 100 bytes per second
+	QCOMPARE(record.bandwidth(10 * SECOND), 5000);
+	QVERIFY(qAbs(record.bandwidth(10 * SECOND + SECOND / 2) - 2500) <= 100);
+	QCOMPARE(record.bandwidth(11 * SECOND), 0);
+	QCOMPARE(record.bandwidth(100 * SECOND), 0);
+}
+
+void TestRateLimit::idleSeconds() {
+	BandwidthRecord record;
+
+	QCOMPARE(record.idleSeconds(5 * SECOND), 5);
+
+	QVERIFY(record.addFrame(100, 1000, 10 * SECOND));
+	QCOMPARE(record.idleSeconds(12 * SECOND), 2);
+
+	record.resetIdleSeconds(15 * SECOND);
+	QCOMPARE(record.idleSeconds(15 * SECOND), 0);
+	QCOMPARE(record.idleSeconds(20 * SECOND), 5);
+}
+
+QTEST_MAIN(TestRateLimit)
+#include "TestRateLimit.moc"
@@ -0,0 +1,268 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtSql>
+#include <QtTest>
+
+#include "StatementCache.h"
+
+const QString INSERT = QStringLiteral("INSERT INTO `items` (`value`) VALUES(?)");
+const QString SELECT = QStringLiteral("SELECT `value` FROM `items` ORDER BY `value`");
+
+class TestStatementCache : public QObject {
+	Q_OBJECT
+private:
+	QSqlDatabase m_database;
+
+	/// Does what ServerDB::prepare does
+	void prepare(StatementCache &statements, QSqlQuery &query, const QString &str) {
+		if (!statements.find(str, query)) {
+			query = QSqlQuery(m_database);
+			QVERIFY(query.prepare(str));
+			statements.insert(str, query);
+		}
+	}
+
+	int count() {
+		QSqlQuery query(m_database);
+		if (!query.exec(QStringLiteral("SELECT COUNT(*) FROM `items`")) || !query.next()) {
+			return -1;
+		}
+		return query.value(0).toInt();
+	}
+
+private slots:
+	void initTestCase();
+	void init();
+	void cleanupTestCase();
+	void reuse();
+	void outsideTransaction();
+	void activeSelect();
+	void finishedSelect();
+	void nested();
+	void maxStatements();
+	void clear();
+	void otherConnection();
+};
+
+void TestStatementCache::initTestCase() {
+	m_database = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"));
+	m_database.setDatabaseName(QStringLiteral(":memory:"));
+	QVERIFY(m_database.open());
+
+	QSqlQuery query(m_database);
+	QVERIFY(query.exec(QStringLiteral("CREATE TABLE `items` (`value` INTEGER)")));
+}
+
+void TestStatementCache::init() {
+	QSqlQuery query(m_database);
+	QVERIFY(query.exec(QStringLiteral("DELETE FROM `items`")));
+}
+
+void TestStatementCache::cleanupTestCase() {
+	m_database.close();
+}
+
+void TestStatementCache::reuse() {
+	StatementCache statements;
+	QSqlQuery query(m_database);
+
+	m_database.transaction();
+	statements.begin();
+	for (int i = 0; i < 10; ++i) {
+		prepare(statements, query, INSERT);
+		query.addBindValue(i);
+		QVERIFY(query.exec());
+	}
+	statements.end();
+	QVERIFY(m_database.commit());
+
+	QCOMPARE(count(), 10);
+	QCOMPARE(statements.size(), 1);
+	QCOMPARE(statements.misses(), static_cast< quint64 >(1));
+	QCOMPARE(statements.hits(), static_cast< quint64 >(9));
+}
+
+void TestStatementCache::outsideTransaction() {
+	StatementCache statements;
+	QSqlQuery query(m_database);
+
+	prepare(statements, query, INSERT);
+	query.addBindValue(1);
+	QVERIFY(query.exec());
+
+	QCOMPARE(statements.size(), 0);
+	QCOMPARE(count(), 1);
+}
+
+void TestStatementCache::activeSelect() {
+	StatementCache statements;
+	QSqlQuery query(m_database);
+
+	m_database.transaction();
+	statements.begin();
+	for (int i = 0; i < 3; ++i) {
+		prepare(statements, query, INSERT);
+		query.addBindValue(i);
+		QVERIFY(query.exec());
+	}
+
+	// Preparing the SELECT again while its rows are read must not discard them
+	QSqlQuery outer(m_database);
+	prepare(statements, outer, SELECT);
+	QVERIFY(outer.exec());
+
+	int rows = 0;
+	while (outer.next()) {
+		QCOMPARE(outer.value(0).toInt(), rows++);
+
+		QSqlQuery inner(m_database);
+		prepare(statements, inner, SELECT);
+		QVERIFY(inner.exec());
+		QVERIFY(inner.next());
+		QCOMPARE(inner.value(0).toInt(), 0);
+	}
+	QCOMPARE(rows, 3);
+
+	statements.end();
+	QVERIFY(m_database.commit());
+
+	// The cached SELECT has been finished
+	m_database.transaction();
+	statements.begin();
+	const quint64 hits = statements.hits();
+	prepare(statements, query, SELECT);
+	QCOMPARE(statements.hits(), hits + 1);
+	statements.end();
+	QVERIFY(m_database.commit());
+}
+
+void TestStatementCache::finishedSelect() {
+	StatementCache statements;
+	QSqlQuery query(m_database);
+
+	m_database.transaction();
+	statements.begin();
+
+	prepare(statements, query, SELECT);
+	QVERIFY(query.exec());
+
+	// Preparing the same query again discards its rows, which allows for reusing the statement
+	prepare(statements, query, SELECT);
+	QCOMPARE(statements.hits(), static_cast< quint64 >(1));
+	QVERIFY(query.exec());
+
+	statements.end();
+	QVERIFY(m_database.commit());
+}
+
+void TestStatementCache::nested() {
+	StatementCache statements;
+	QSqlQuery query(m_database);
+
+	statements.begin();
+	prepare(statements, query, SELECT);
+	QVERIFY(query.exec());
+
+	// The end of a nested transaction doesn't finish the statements of the outer one
+	statements.begin();
+	statements.end();
+	QVERIFY(query.isActive());
+
+	statements.end();
+	QVERIFY(!query.isActive());
+
+	// Unbalanced calls are ignored
+	statements.end();
+	prepare(statements, query, SELECT);
+	QCOMPARE(statements.size(), 1);
+}
+
+void TestStatementCache::maxStatements() {
+	StatementCache statements;
+	QSqlQuery query(m_database);
+
+	statements.begin();
+	for (int i = 0; i < StatementCache::MAX_STATEMENTS + 10; ++i) {
+		prepare(statements, query, QString::fromLatin1("SELECT %1").arg(i));
+	}
+	QCOMPARE(statements.size(), StatementCache::MAX_STATEMENTS);
+
+	// Cached statements are still found
+	const quint64 hits = statements.hits();
+	prepare(statements, query, QStringLiteral("SELECT 0"));
+	QCOMPARE(statements.hits(), hits + 1);
+	statements.end();
+}
+
+void TestStatementCache::clear() {
+	StatementCache statements;
+	QSqlQuery query(m_database);
+
+	statements.begin();
+	prepare(statements, query, INSERT);
+	statements.clear();
+	QCOMPARE(statements.size(), 0);
+
+	prepare(statements, query, INSERT);
+	QCOMPARE(statements.hits(), static_cast< quint64 >(0));
+	QCOMPARE(statements.misses(), static_cast< quint64 >(2));
+	statements.end();
+}
+
+void TestStatementCache::otherConnection() {
+	{
+		QSqlDatabase other = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("other"));
+		other.setDatabaseName(QStringLiteral(":memory:"));
+		QVERIFY(other.open());
+
+		QSqlQuery query(other);
+		QVERIFY(query.exec(QStringLiteral("CREATE TABLE `items` (`value` INTEGER)")));
+
+		StatementCache statements;
+		m_database.transaction();
+		other.transaction();
+		statements.begin();
+
+		query = QSqlQuery(m_database);
+		prepare(statements, query, INSERT);
+		query.addBindValue(1);
+		QVERIFY(query.exec());
+
+		// The statement that has been prepared on the first connection isn't handed out to the second one
+		QSqlQuery otherQuery(other);
+		QVERIFY(!statements.find(INSERT, otherQuery));
+		otherQuery = QSqlQuery(other);
+		QVERIFY(otherQuery.prepare(INSERT));
+		otherQuery.addBindValue(2);
+		QVERIFY(otherQuery.exec());
+
+		// But it still is to the first one
+		query = QSqlQuery(m_database);
+		QVERIFY(statements.find(INSERT, query));
+		query.addBindValue(3);
+		QVERIFY(query.exec());
+
+		statements.end();
+		QVERIFY(other.commit());
+		QVERIFY(m_database.commit());
+
+		QCOMPARE(count(), 2);
+		otherQuery = QSqlQuery(other);
+		QVERIFY(otherQuery.exec(QStringLiteral("SELECT COUNT(*) FROM `items`")));
+		QVERIFY(otherQuery.next());
+		QCOMPARE(otherQuery.value(0).toInt(), 1);
+
+		statements.clear();
+		otherQuery = QSqlQuery();
+		query      = QSqlQuery();
+		other.close();
+	}
+	QSqlDatabase::removeDatabase(QStringLiteral("other"));
+}
+
+QTEST_MAIN(TestStatementCache)
+#include "TestStatementCache.moc"
@@ -0,0 +1,179 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "TCPReadBuffer.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+using Bytes   = std::vector< Mumble::Protocol::byte >;
+using Message = std::pair< Mumble::Protocol::TCPMessageType, Bytes >;
+
+static Bytes frame(Mumble::Protocol::TCPMessageType type, const Bytes &payload) {
+	Bytes result(TCPReadBuffer::HEADER_SIZE);
+	qToBigEndian< quint16 >(static_cast< quint16 >(type), result.data());
+	qToBigEndian< quint32 >(static_cast< quint32 >(payload.size()), result.data() + 2);
+	result.insert(result.end(), payload.begin(), payload.end());
+	return result;
+}
+
+/// Writes the given data into the buffer in chunks of at most the given size, processing the buffer after each
+static bool feed(TCPReadBuffer &buffer, const Bytes &data, std::size_t chunkSize, std::vector< Message > &received) {
+	for (std::size_t offset = 0; offset < data.size();) {
+		gsl::span< Mumble::Protocol::byte > writable = buffer.writable();
+		if (writable.empty()) {
+			return false;
+		}
+
+		const std::size_t size = std::min(std::min(chunkSize, writable.size()), data.size() - offset);
+		std::copy(data.begin() + static_cast< std::ptrdiff_t >(offset),
+				  data.begin() + static_cast< std::ptrdiff_t >(offset + size), writable.begin());
+		buffer.commit(size);
+		offset += size;
+
+		const bool valid = buffer.process(
+			[&](Mumble::Protocol::TCPMessageType type, gsl::span< const Mumble::Protocol::byte > payload) {
+				received.emplace_back(type, Bytes(payload.begin(), payload.end()));
+				return true;
+			});
+		if (!valid) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+class TestTCPReadBuffer : public QObject {
+	Q_OBJECT
+private slots:
+	void messages();
+	void byteByByte();
+	void largeMessage();
+	void hugeMessage();
+	void stop();
+	void randomChunks();
+};
+
+void TestTCPReadBuffer::messages() {
+	TCPReadBuffer buffer;
+	std::vector< Message > received;
+
+	Bytes data = frame(Mumble::Protocol::TCPMessageType::Ping, { 1, 2, 3 });
+	Bytes next = frame(Mumble::Protocol::TCPMessageType::UDPTunnel, { 4, 5 });
+	data.insert(data.end(), next.begin(), next.end());
+	next = frame(Mumble::Protocol::TCPMessageType::Version, {});
+	data.insert(data.end(), next.begin(), next.end());
+
+	QVERIFY(feed(buffer, data, data.size(), received));
+
+	QCOMPARE(received.size(), static_cast< std::size_t >(3));
+	QVERIFY(received[0] == Message(Mumble::Protocol::TCPMessageType::Ping, { 1, 2, 3 }));
+	QVERIFY(received[1] == Message(Mumble::Protocol::TCPMessageType::UDPTunnel, { 4, 5 }));
+	QVERIFY(received[2] == Message(Mumble::Protocol::TCPMessageType::Version, {}));
+}
+
+void TestTCPReadBuffer::byteByByte() {
+	TCPReadBuffer buffer;
+	std::vector< Message > received;
+
+	const Bytes data = frame(Mumble::Protocol::TCPMessageType::UDPTunnel, Bytes(100, 42));
+
+	QVERIFY(feed(buffer, data, 1, received));
+
+	QCOMPARE(received.size(), static_cast< std::size_t >(1));
+	QVERIFY(received[0] == Message(Mumble::Protocol::TCPMessageType::UDPTunnel, Bytes(100, 42)));
+}
+
+void TestTCPReadBuffer::largeMessage() {
+	TCPReadBuffer buffer;
+	std::vector< Message > received;
+
+	Bytes payload(3 * TCPReadBuffer::DEFAULT_SIZE);
+	for (std::size_t i = 0; i < payload.size(); ++i) {
+		payload[i] = static_cast< Mumble::Protocol::byte >(i);
+	}
+	// Start with a small message, so that the large one doesn't start at the beginning of the buffer
+	Bytes data = frame(Mumble::Protocol::TCPMessageType::Ping, { 1 });
+	Bytes next = frame(Mumble::Protocol::TCPMessageType::UDPTunnel, payload);
+	data.insert(data.end(), next.begin(), next.end());
+
+	QVERIFY(feed(buffer, data, 1000, received));
+
+	QCOMPARE(received.size(), static_cast< std::size_t >(2));
+	QVERIFY(received[1] == Message(Mumble::Protocol::TCPMessageType::UDPTunnel, payload));
+
+	// Once the large message has been handled, the buffer shrinks back
+	QCOMPARE(buffer.writable().size(), TCPReadBuffer::DEFAULT_SIZE);
+}
+
+void TestTCPReadBuffer::hugeMessage() {
+	TCPReadBuffer buffer;
+	std::vector< Message > received;
+
+	Bytes data(TCPReadBuffer::HEADER_SIZE);
+	qToBigEndian< quint16 >(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel), data.data());
+	qToBigEndian< quint32 >(static_cast< quint32 >(TCPReadBuffer::MAX_MESSAGE_SIZE + 1), data.data() + 2);
+
+	QVERIFY(!feed(buffer, data, data.size(), received));
+	QVERIFY(received.empty());
+}
+
+void TestTCPReadBuffer::stop() {
+	TCPReadBuffer buffer;
+
+	Bytes data = frame(Mumble::Protocol::TCPMessageType::Ping, { 1 });
+	Bytes next = frame(Mumble::Protocol::TCPMessageType::Ping, { 2 });
+	data.insert(data.end(), next.begin(), next.end());
+
+	std::copy(data.begin(), data.end(), buffer.writable().begin());
+	buffer.commit(data.size());
+
+	std::vector< Bytes > received;
+	auto handler = [&](Mumble::Protocol::TCPMessageType, gsl::span< const Mumble::Protocol::byte > payload) {
+		received.emplace_back(payload.begin(), payload.end());
+		return false;
+	};
+
+	// Messages the handler didn't get to stay buffered
+	QVERIFY(buffer.process(handler));
+	QCOMPARE(received.size(), static_cast< std::size_t >(1));
+	QVERIFY(buffer.process(handler));
+	QCOMPARE(received.size(), static_cast< std::size_t >(2));
+	QVERIFY(received[1] == Bytes({ 2 }));
+}
+
+void TestTCPReadBuffer::randomChunks() {
+	std::mt19937 rng(42);
+
+	Bytes data;
+	std::vector< Message > expected;
+	for (int i = 0; i < 2000; ++i) {
+		Bytes payload(rng() % (i % 100 == 0 ? 200000 : 300));
+		for (Mumble::Protocol::byte &b : payload) {
+			b = static_cast< Mumble::Protocol::byte >(rng());
+		}
+
+		const Bytes next = frame(Mumble::Protocol::TCPMessageType::UDPTunnel, payload);
+		data.insert(data.end(), next.begin(), next.end());
+		expected.emplace_back(Mumble::Protocol::TCPMessageType::UDPTunnel, std::move(payload));
+	}
+
+	for (std::size_t chunkSize : { 1 + rng() % 10, 1 + rng() % 1000, 1 + rng() % 100000 }) {
+		TCPReadBuffer buffer;
+		std::vector< Message > received;
+
+		QVERIFY(feed(buffer, data, chunkSize, received));
+		QVERIFY(received == expected);
+	}
+}
+
+QTEST_MAIN(TestTCPReadBuffer)
+#include "TestTCPReadBuffer.moc"
@@ -0,0 +1,180 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "UserDirectory.h"
+
+class TestUserDirectory : public QObject {
+	Q_OBJECT
+private slots:
+	void insert();
+	void findByName();
+	void asciiFolding();
+	void rename();
+	void remove();
+	void certHashAndEmail();
+	void sharedCertHashAndEmail();
+	void findAllByName();
+	void findByPrefix();
+};
+
+void TestUserDirectory::insert() {
+	UserDirectory directory;
+
+	directory.insert(1, QLatin1String("Alice"), QLatin1String("hash"), QLatin1String("salt"), 1000);
+	QCOMPARE(directory.size(), 1);
+
+	const RegisteredUser *user = directory.find(1);
+	QVERIFY(user);
+	QCOMPARE(user->name, QString::fromLatin1("Alice"));
+	QCOMPARE(user->passwordHash, QString::fromLatin1("hash"));
+	QCOMPARE(user->salt, QString::fromLatin1("salt"));
+	QCOMPARE(user->kdfIterations, 1000);
+	QVERIFY(!directory.find(2));
+
+	// Another user of the same name replaces the existing one
+	directory.insert(2, QLatin1String("Alice"));
+	QCOMPARE(directory.size(), 1);
+	QVERIFY(!directory.find(1));
+	QCOMPARE(directory.findByName(QLatin1String("Alice")), 2);
+}
+
+void TestUserDirectory::findByName() {
+	UserDirectory directory;
+
+	directory.insert(3, QLatin1String("Bob"));
+	directory.insert(5, QString::fromUtf8("Émile"));
+
+	QCOMPARE(directory.findByName(QLatin1String("Bob")), 3);
+	QCOMPARE(directory.findByName(QLatin1String("bOB")), 3);
+	QCOMPARE(directory.findByName(QString::fromUtf8("émile")), 5);
+	QCOMPARE(directory.findByName(QLatin1String("Bobby")), -1);
+
+	// Names that only differ in case resolve to the lowest ID
+	directory.insert(2, QLatin1String("BOB"));
+	QCOMPARE(directory.findByName(QLatin1String("bob")), 2);
+	directory.remove(2);
+	QCOMPARE(directory.findByName(QLatin1String("bob")), 3);
+}
+
+void TestUserDirectory::asciiFolding() {
+	UserDirectory directory(UserDirectory::CaseFolding::Ascii);
+
+	directory.insert(1, QString::fromUtf8("Émile"));
+
+	QCOMPARE(directory.findByName(QString::fromUtf8("éMILE")), -1);
+	QCOMPARE(directory.findByName(QString::fromUtf8("ÉMILE")), 1);
+}
+
+void TestUserDirectory::rename() {
+	UserDirectory directory;
+
+	directory.insert(1, QLatin1String("Alice"));
+	directory.setName(1, QLatin1String("Carol"));
+
+	QCOMPARE(directory.findByName(QLatin1String("Alice")), -1);
+	QCOMPARE(directory.findByName(QLatin1String("carol")), 1);
+	QCOMPARE(directory.names().value(1), QString::fromLatin1("Carol"));
+}
+
+void TestUserDirectory::remove() {
+	UserDirectory directory;
+
+	directory.insert(1, QLatin1String("Alice"));
+	directory.setCertHash(1, QLatin1String("abc"));
+	directory.setEmail(1, QLatin1String("alice@example.com"));
+	directory.remove(1);
+
+	QCOMPARE(directory.size(), 0);
+	QCOMPARE(directory.findByName(QLatin1String("Alice")), -1);
+	QCOMPARE(directory.findByCertHash(QLatin1String("abc")), -1);
+	QCOMPARE(directory.findByEmail(QLatin1String("alice@example.com")), -1);
+	QVERIFY(directory.findByPrefix(QLatin1String("A"), Qt::CaseInsensitive).isEmpty());
+}
+
+void TestUserDirectory::certHashAndEmail() {
+	UserDirectory directory;
+
+	directory.insert(1, QLatin1String("Alice"));
+	directory.setCertHash(1, QLatin1String("abc"));
+	directory.setEmail(1, QLatin1String("alice@example.com"));
+
+	QCOMPARE(directory.findByCertHash(QLatin1String("abc")), 1);
+	QCOMPARE(directory.findByEmail(QLatin1String("alice@example.com")), 1);
+
+	directory.setCertHash(1, QLatin1String("def"));
+	QCOMPARE(directory.findByCertHash(QLatin1String("abc")), -1);
+	QCOMPARE(directory.findByCertHash(QLatin1String("def")), 1);
+
+	// Changing the password keeps what is stored separately
+	directory.insert(1, QLatin1String("Alice"), QLatin1String("hash"), QLatin1String("salt"), 1000);
+	QCOMPARE(directory.find(1)->certHash, QString::fromLatin1("def"));
+	QCOMPARE(directory.find(1)->email, QString::fromLatin1("alice@example.com"));
+}
+
+void TestUserDirectory::sharedCertHashAndEmail() {
+	UserDirectory directory;
+
+	directory.insert(2, QLatin1String("Alice"));
+	directory.insert(5, QLatin1String("Bob"));
+	directory.setCertHash(5, QLatin1String("abc"));
+	directory.setCertHash(2, QLatin1String("abc"));
+	directory.setEmail(5, QLatin1String("shared@example.com"));
+	directory.setEmail(2, QLatin1String("shared@example.com"));
+
+	// The lowest ID is found, no matter which user the value has been stored for first
+	QCOMPARE(directory.findByCertHash(QLatin1String("abc")), 2);
+	QCOMPARE(directory.findByEmail(QLatin1String("shared@example.com")), 2);
+
+	// The other user is still found once the first one's values change
+	directory.setCertHash(2, QLatin1String("def"));
+	QCOMPARE(directory.findByCertHash(QLatin1String("abc")), 5);
+	QCOMPARE(directory.findByCertHash(QLatin1String("def")), 2);
+
+	directory.remove(2);
+	QCOMPARE(directory.findByEmail(QLatin1String("shared@example.com")), 5);
+	QCOMPARE(directory.findByCertHash(QLatin1String("def")), -1);
+
+	directory.remove(5);
+	QCOMPARE(directory.findByCertHash(QLatin1String("abc")), -1);
+	QCOMPARE(directory.findByEmail(QLatin1String("shared@example.com")), -1);
+}
+
+void TestUserDirectory::findAllByName() {
+	UserDirectory directory;
+
+	directory.insert(2, QLatin1String("BOB"));
+	directory.insert(3, QLatin1String("Bob"));
+	directory.insert(4, QLatin1String("Bobby"));
+
+	QCOMPARE(directory.findAllByName(QLatin1String("bob"), Qt::CaseInsensitive).keys(), QList< int >({ 2, 3 }));
+	QCOMPARE(directory.findAllByName(QLatin1String("Bob"), Qt::CaseSensitive).keys(), QList< int >({ 3 }));
+	QVERIFY(directory.findAllByName(QLatin1String("bob"), Qt::CaseSensitive).isEmpty());
+	QVERIFY(directory.findAllByName(QLatin1String("Bo"), Qt::CaseInsensitive).isEmpty());
+}
+
+void TestUserDirectory::findByPrefix() {
+	UserDirectory directory;
+
+	directory.insert(1, QLatin1String("alpha"));
+	directory.insert(2, QLatin1String("Alfred"));
+	directory.insert(3, QLatin1String("beta"));
+	directory.insert(4, QLatin1String("Al"));
+
+	QMap< int, QString > found = directory.findByPrefix(QLatin1String("al"), Qt::CaseInsensitive);
+	QCOMPARE(found.size(), 3);
+	QCOMPARE(found.value(2), QString::fromLatin1("Alfred"));
+
+	found = directory.findByPrefix(QLatin1String("Al"), Qt::CaseSensitive);
+	QCOMPARE(found.keys(), QList< int >({ 2, 4 }));
+
+	QCOMPARE(directory.findByPrefix(QString(), Qt::CaseInsensitive).size(), 4);
+	QVERIFY(directory.findByPrefix(QLatin1String("gamma"), Qt::CaseInsensitive).isEmpty());
+}
+
+QTEST_MAIN(TestUserDirectory)
+#include "TestUserDirectory.moc"
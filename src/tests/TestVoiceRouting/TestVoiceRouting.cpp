@@ -0,0 +1,195 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "VoiceRouting.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class TestVoiceRouting : public QObject {
+	Q_OBJECT
+private slots:
+	void lookup();
+	void fanOuts();
+	void publish();
+	void retireWhileReading();
+	void concurrentReaders();
+};
+
+void TestVoiceRouting::lookup() {
+	VoiceRoutingSnapshot snapshot;
+
+	VoiceRoutingSnapshot::User &user = snapshot.users[5];
+	user.session                     = 5;
+	user.channelID                   = 3;
+
+	VoiceRoutingSnapshot::Channel &channel = snapshot.channels[3];
+	channel.id                             = 3;
+	channel.members.push_back(&user);
+
+	QCOMPARE(snapshot.findUser(5), &user);
+	QVERIFY(!snapshot.findUser(6));
+	QCOMPARE(snapshot.findChannel(3), &channel);
+	QVERIFY(!snapshot.findChannel(0));
+}
+
+void TestVoiceRouting::fanOuts() {
+	VoiceRoutingSnapshot snapshot;
+
+	for (unsigned int session = 1; session <= 5; ++session) {
+		VoiceRoutingSnapshot::User &user = snapshot.users[session];
+		user.user                        = nullptr;
+		user.session                     = session;
+		user.channelID                   = session <= 3 ? 1 : 2;
+		user.canSpeak                    = session != 3;
+		user.deaf                        = false;
+		user.context                     = session == 2 ? "game" : "";
+	}
+
+	for (unsigned int id : { 1U, 2U }) {
+		VoiceRoutingSnapshot::Channel &channel = snapshot.channels[id];
+		channel.id                             = id;
+
+		for (auto &current : snapshot.users) {
+			if (current.second.channelID == id) {
+				channel.members.push_back(&current.second);
+			}
+		}
+	}
+
+	// User 4 listens to channel 1 (in addition to being a member of the linked channel 2)
+	snapshot.channels[1].listeners.push_back({ snapshot.findUser(4), VolumeAdjustment::fromFactor(2.0f) });
+	// Only user 1 may speak into the linked channel
+	snapshot.users[1].speakableLinks.push_back(snapshot.findChannel(2));
+
+	snapshot.createFanOuts();
+
+	// Users in the same channel that may speak in the same linked channels share their fan-out
+	QVERIFY(snapshot.findUser(4)->fanOut);
+	QCOMPARE(snapshot.findUser(4)->fanOut, snapshot.findUser(5)->fanOut);
+	QVERIFY(snapshot.findUser(1)->fanOut != snapshot.findUser(2)->fanOut);
+	QVERIFY(!snapshot.findUser(3)->fanOut);
+
+	QVERIFY(snapshot.findUser(1)->contextID != snapshot.findUser(2)->contextID);
+	QCOMPARE(snapshot.findUser(1)->contextID, snapshot.findUser(3)->contextID);
+
+	// Every receiver is contained exactly once. User 4 is both a listener and a member, so it receives the audio
+	// as a regular member but with its (louder) listener volume.
+	const VoiceRoutingSnapshot::FanOut &linked = *snapshot.findUser(1)->fanOut;
+	QCOMPARE(linked.receivers.size(), static_cast< std::size_t >(5));
+	for (const VoiceRoutingSnapshot::FanOut::Receiver &receiver : linked.receivers) {
+		if (receiver.session == 4) {
+			QCOMPARE(receiver.context, Mumble::Protocol::AudioContext::NORMAL);
+			QCOMPARE(receiver.volumeAdjustment.factor, 2.0f);
+		}
+	}
+
+	const VoiceRoutingSnapshot::FanOut &local = *snapshot.findUser(2)->fanOut;
+	QCOMPARE(local.receivers.size(), static_cast< std::size_t >(4));
+	// Regular receivers come before listeners
+	QCOMPARE(local.receivers.back().session, 4U);
+	QCOMPARE(local.receivers.back().context, Mumble::Protocol::AudioContext::LISTEN);
+}
+
+void TestVoiceRouting::publish() {
+	VoiceRouting routing(1);
+
+	// There always is a (initially empty) snapshot
+	QVERIFY(routing.current().users.empty());
+
+	std::unique_ptr< VoiceRoutingSnapshot > snapshot = std::make_unique< VoiceRoutingSnapshot >();
+	snapshot->users[1].session                       = 1;
+	const VoiceRoutingSnapshot *published            = snapshot.get();
+
+	routing.publish(std::move(snapshot));
+	QCOMPARE(&routing.current(), published);
+
+	{
+		VoiceRouting::ReadGuard guard(routing, 0);
+		QCOMPARE(&guard.snapshot(), published);
+	}
+
+	// Nobody is reading, so the initial snapshot can be reclaimed immediately
+	QVERIFY(!routing.reclaim());
+}
+
+void TestVoiceRouting::retireWhileReading() {
+	VoiceRouting routing(2);
+
+	bool deleted = false;
+
+	{
+		VoiceRouting::ReadGuard guard(routing, 1);
+
+		routing.retire([&deleted]() { deleted = true; });
+
+		// The reader might still be using the object
+		QVERIFY(routing.reclaim());
+		QVERIFY(!deleted);
+	}
+
+	QVERIFY(!routing.reclaim());
+	QVERIFY(deleted);
+
+	// Readers that entered after the object has been retired can't reach it
+	deleted = false;
+	routing.retire([&deleted]() { deleted = true; });
+	{
+		VoiceRouting::ReadGuard guard(routing, 0);
+
+		QVERIFY(!routing.reclaim());
+		QVERIFY(deleted);
+	}
+}
+
+void TestVoiceRouting::concurrentReaders() {
+	constexpr unsigned int readerCount = 4;
+
+	VoiceRouting routing(readerCount);
+	std::atomic< bool > stop(false);
+	std::atomic< int > alive(0);
+	std::atomic< bool > failed(false);
+
+	std::vector< std::thread > readers;
+	for (unsigned int i = 0; i < readerCount; ++i) {
+		readers.emplace_back([&, i]() {
+			while (!stop) {
+				VoiceRouting::ReadGuard guard(routing, i);
+
+				const VoiceRoutingSnapshot::User *user = guard.snapshot().findUser(1);
+				if (user && user->session != 1) {
+					failed = true;
+				}
+			}
+		});
+	}
+
+	for (int i = 0; i < 10000; ++i) {
+		std::unique_ptr< VoiceRoutingSnapshot > snapshot = std::make_unique< VoiceRoutingSnapshot >();
+		snapshot->users[1].session                       = 1;
+
+		alive++;
+		routing.publish(std::move(snapshot));
+		routing.retire([&alive]() { alive--; });
+		routing.reclaim();
+	}
+
+	stop = true;
+	for (std::thread &reader : readers) {
+		reader.join();
+	}
+
+	QVERIFY(!routing.reclaim());
+	QVERIFY(!failed);
+	QCOMPARE(alive.load(), 0);
+}
+
+QTEST_MAIN(TestVoiceRouting)
+#include "TestVoiceRouting.moc"